@@ -0,0 +1,92 @@
+#include <benchmark/benchmark.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "compressedFileHandler.h"
+#include "fileHandler.h"
+#include "logger.h"
+#include "parser.h"
+#include "proxyRequestHandler.h"
+#include "requestHistory.h"
+#include "statusHandler.h"
+
+// Files of data/static_data the benchmarks use as fixtures
+static const char* fixtures[] = {"test.html", "taocp.txt", "samueli.jpg"};
+
+static std::string read_fixture(const std::string& name) {
+	std::ifstream file(std::string(KOKO_BENCH_DATA_DIR) + "/" + name, std::ios::binary);
+	std::stringstream contents;
+	contents << file.rdbuf();
+	return contents.str();
+}
+
+static NginxConfig parse_config(const std::string& text) {
+	NginxConfig config;
+	NginxConfigParser parser;
+	std::istringstream stream(text);
+	parser.Parse(&stream, &config);
+	return config;
+}
+
+static void BM_GetMime(benchmark::State& state) {
+	set_log_level(warning);
+	FileHandler handler("/static", parse_config("root \"" KOKO_BENCH_DATA_DIR "\";"));
+	std::vector<std::string> targets = {"/static/test.html", "/static/taocp.txt", "/static/samueli.jpg", "/static/testing-zip.zip", "/static/hello"};
+	for (auto _ : state) {
+		for (const std::string& target : targets) {
+			benchmark::DoNotOptimize(handler.get_mime(target));
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * targets.size());
+}
+BENCHMARK(BM_GetMime);
+
+static void BM_Compress(benchmark::State& state) {
+	std::string data = read_fixture(fixtures[state.range(0)]);
+	state.SetLabel(fixtures[state.range(0)]);
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(compress(data, CompressedFileHandler::compression_level));
+	}
+	state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_Compress)->ArgName("fixture")->DenseRange(0, 2)->Unit(benchmark::kMicrosecond);
+
+// test.html with as many absolute links as the argument, the rewrite target of a proxied page
+static void BM_ReplaceRelativeHtmlLinks(benchmark::State& state) {
+	set_log_level(warning);
+	ProxyRequestHandler handler("/proxy", parse_config("dest \"localhost\"; port \"80\";"));
+	std::string page = read_fixture("test.html");
+	for (int i = 0; i < state.range(0); i++) {
+		page += "<a href=\"/page" + std::to_string(i) + "\"><img src=\"/img" + std::to_string(i) + ".png\"></a>";
+		page += "<a href=\"//cdn.example.com/" + std::to_string(i) + "\">cdn</a>\n";
+	}
+	for (auto _ : state) {
+		std::string body = page;
+		handler.replace_relative_html_links(body);
+		benchmark::DoNotOptimize(body);
+	}
+	state.SetBytesProcessed(state.iterations() * page.size());
+}
+BENCHMARK(BM_ReplaceRelativeHtmlLinks)->ArgName("links")->Arg(0)->Arg(100)->Arg(1000)->Unit(benchmark::kMicrosecond);
+
+// Renders the status page over a full request history, as HTML or JSON
+static void BM_StatusPage(benchmark::State& state) {
+	set_log_level(warning);
+	StatusHandler handler("/status", NginxConfig());
+	RequestHistory& history = RequestHistory::instance();
+	history.clear();
+	for (int i = 0; i < 512; i++) {
+		history.record("/static/file" + std::to_string(i % 50) + ".html?v=" + std::to_string(i), i % 7 ? "File" : "Echo", i % 11 ? 200 : 404);
+	}
+
+	bool json = state.range(0);
+	http::request<http::string_body> req{http::verb::get, std::string("/status?limit=") + std::to_string(state.range(1)) + (json ? "&format=json" : ""), 11};
+	state.SetLabel(json ? "json" : "html");
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(handler.get_response(req));
+	}
+}
+BENCHMARK(BM_StatusPage)->ArgNames({"json", "limit"})->ArgsProduct({{0, 1}, {10, 100}})->Unit(benchmark::kMicrosecond);
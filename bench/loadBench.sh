@@ -0,0 +1,92 @@
+#!/bin/bash
+# Starts webserver with a bench config and loads it with koko_loadgen in a few scenarios.
+# Usage: loadBench.sh <path-to-webserver> <path-to-koko_loadgen> <path-to-koko_upstream> <port-num> <https-port-num> <upstream-port-num> [seconds]
+WEBSERVER="$1"
+LOADGEN="$2"
+UPSTREAM="$3"
+PORT="$4"
+PORT_HTTPS="$5"
+UPSTREAM_PORT="$6"
+DURATION="${7:-2}"
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+
+if [ ! -x "${WEBSERVER}" ] || [ ! -x "${LOADGEN}" ] || [ ! -x "${UPSTREAM}" ]; then
+	echo "Usage: ${0} <path-to-webserver> <path-to-koko_loadgen> <path-to-koko_upstream> <port-num> <https-port-num> <upstream-port-num> [seconds]"
+	exit 1
+fi
+
+if nc -z localhost "$PORT" || nc -z localhost "$PORT_HTTPS" || nc -z localhost "$UPSTREAM_PORT"; then
+	echo "port $PORT, $PORT_HTTPS or $UPSTREAM_PORT not free, stopping benchmark"
+	exit 1
+fi
+
+CONFIG_PATH=$(mktemp)
+cat >"$CONFIG_PATH" <<EOF
+port $PORT;
+httpsPort $PORT_HTTPS;
+certificate $ROOT/tests/certs/fullchain.pem;
+privateKey $ROOT/tests/certs/privkey.pem;
+asyncLog 1;
+
+location /static StaticHandler {
+	root $ROOT/data/static_data;
+	keep-alive 1;
+}
+
+location /echo EchoHandler {
+	keep-alive 1;
+}
+
+location /health HealthHandler {
+}
+
+location /metrics MetricsHandler {
+}
+
+location /proxy ProxyRequestHandler {
+	dest 127.0.0.1;
+	port $UPSTREAM_PORT;
+}
+EOF
+
+# The proxied upstream takes 1ms on average, with an exponential tail
+"${UPSTREAM}" --port "$UPSTREAM_PORT" --distribution exponential --latency 1000 --body-size 4096 >/dev/null &
+UPSTREAM_PID="$!"
+
+"${WEBSERVER}" "${CONFIG_PATH}" >/dev/null 2>&1 &
+PID="$!"
+for _ in $(seq 50); do
+	nc -z localhost "$PORT" && break
+	sleep 0.1
+done
+
+# Sum of the samples of a metric of the server
+metric() {
+	curl -s "localhost:$PORT/metrics" | awk -v name="$1" '$1 == name || index($1, name "{") == 1 { total += $2 } END { print total + 0 }'
+}
+
+FAILED=0
+run() {
+	echo "== $*"
+	local WRITES=$(metric koko_response_writes_total)
+	local RESPONSES=$(metric koko_responses_total)
+	"${LOADGEN}" --duration "$DURATION" "$@" || FAILED=1
+	echo "$(metric koko_response_writes_total) $WRITES $(metric koko_responses_total) $RESPONSES" |
+		awk '$3 > $4 { printf "server writes per response %.2f\n", ($1 - $2) / ($3 - $4) }'
+}
+
+PATHS=/static/test.html,/echo,/static/taocp.txt
+run --port "$PORT" --paths "$PATHS" --connections 16
+run --port "$PORT" --paths "$PATHS" --connections 16 --no-keep-alive
+run --port "$PORT_HTTPS" --tls --paths "$PATHS" --connections 16
+run --port "$PORT" --paths "$PATHS" --connections 16 --rate 2000
+run --port "$PORT" --paths /echo --connections 16
+run --port "$PORT" --paths /echo --connections 16 --pipeline 16
+# Handshakes, full on every connection and then resumed from the previous one
+run --port "$PORT_HTTPS" --tls --paths /health --connections 16 --no-keep-alive
+run --port "$PORT_HTTPS" --tls --tls-resume --paths /health --connections 16 --no-keep-alive
+run --port "$PORT" --paths /proxy/,/proxy/html/100,/proxy/chunked/16384 --connections 16
+
+kill "${PID}" "${UPSTREAM_PID}"
+rm "$CONFIG_PATH"
+exit $FAILED
@@ -0,0 +1,78 @@
+#include <benchmark/benchmark.h>
+
+#include <boost/log/attributes/constant.hpp>
+#include <boost/log/sinks/sync_frontend.hpp>
+#include <boost/log/sinks/text_file_backend.hpp>
+#include <boost/make_shared.hpp>
+#include <string>
+
+#include "asyncLogSink.h"
+#include "logger.h"
+
+static const char* bench_log_file = "/tmp/koko_logger_bench_%N.log";
+
+// The layout of the lines in the server log
+static logging::formatter line_format() {
+	logging::register_simple_formatter_factory<severity_level, char>("Severity");
+	return logging::parse_formatter("[%TimeStamp%] [%ThreadID%] [%ProcessID%] (%Severity%) : %Message%");
+}
+
+// A logger whose records only the sink of the benchmark takes
+static src::severity_logger_mt<severity_level> bench_logger() {
+	src::severity_logger_mt<severity_level> logger;
+	logger.add_attribute("LoggerBench", attrs::constant<bool>(true));
+	return logger;
+}
+
+// A record like the ones session::on_read writes for every request
+static void log_request(src::severity_logger_mt<severity_level>& logger, int i) {
+	BOOST_LOG_SEV(logger, info) << "metrics: request path: /static/index.html?v=" << i;
+}
+
+// The file sink init_logger installs, flushing every record on the logging thread
+static void BM_SyncFileLog(benchmark::State& state) {
+	auto sink = boost::make_shared<sinks::synchronous_sink<sinks::text_file_backend>>(
+	    keywords::file_name = bench_log_file, keywords::auto_flush = true);
+	sink->set_formatter(line_format());
+	sink->set_filter(expr::has_attr<bool>("LoggerBench"));
+	logging::core::get()->add_sink(sink);
+	logging::add_common_attributes();
+
+	auto logger = bench_logger();
+	int i = 0;
+	for (auto _ : state) {
+		log_request(logger, i++);
+	}
+
+	logging::core::get()->remove_sink(sink);
+}
+BENCHMARK(BM_SyncFileLog)->ThreadRange(1, 4)->UseRealTime();
+
+// The same file written by the writer thread of an AsyncLogSink
+static void BM_AsyncFileLog(benchmark::State& state) {
+	static boost::shared_ptr<AsyncLogSink> sink;
+	if (state.thread_index() == 0) {
+		AsyncLogSink::Options options;
+		options.ring_size = state.range(0);
+		sink = boost::make_shared<AsyncLogSink>(options);
+		auto backend = boost::make_shared<sinks::text_file_backend>(keywords::file_name = bench_log_file);
+		sink->add_output(backend, line_format());
+		sink->set_filter(expr::has_attr<bool>("LoggerBench"));
+		logging::core::get()->add_sink(sink);
+		logging::add_common_attributes();
+	}
+
+	auto logger = bench_logger();
+	int i = 0;
+	for (auto _ : state) {
+		log_request(logger, i++);
+	}
+
+	if (state.thread_index() == 0) {
+		state.counters["dropped"] = sink->dropped();
+		logging::core::get()->remove_sink(sink);
+		sink->stop();
+		sink.reset();
+	}
+}
+BENCHMARK(BM_AsyncFileLog)->Arg(4096)->ThreadRange(1, 4)->UseRealTime();
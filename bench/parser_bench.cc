@@ -0,0 +1,27 @@
+#include "parser.h"
+
+#include <benchmark/benchmark.h>
+
+#include <sstream>
+#include <string>
+
+#include "logger.h"
+
+// Parsing a config with as many location blocks as the argument, like conf/default.conf
+static void BM_ParseConfig(benchmark::State& state) {
+	set_log_level(warning);
+	std::string text = "port 8080;\nhttpsPort 8081;\ncontentCacheMB 64;\n";
+	for (int i = 0; i < state.range(0); i++) {
+		text += "location \"/static" + std::to_string(i) + "\" StaticHandler {\n\troot \"../data/static_data\";\n\tkeep-alive 1;\n}\n";
+		text += "location \"/proxy" + std::to_string(i) + "\" ProxyRequestHandler {\n\tdest \"www.example.com\";\n\tport \"80\";\n\tmaxIdle 8;\n}\n";
+	}
+
+	for (auto _ : state) {
+		std::istringstream stream(text);
+		NginxConfig config;
+		NginxConfigParser parser;
+		benchmark::DoNotOptimize(parser.Parse(&stream, &config));
+	}
+	state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_ParseConfig)->ArgName("locations")->Arg(10)->Arg(1000)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,121 @@
+#include "upstreamPool.h"
+
+#include <benchmark/benchmark.h>
+
+#include <boost/asio.hpp>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "logger.h"
+#include "parser.h"
+#include "proxyRequestHandler.h"
+#include "upstreamSimulator.h"
+
+namespace net = boost::asio;
+
+// Time of one proxied request, over a new connection for every request when the pool keeps
+// no idle connections, and over a reused connection otherwise
+static void BM_UpstreamRequest(benchmark::State& state) {
+	set_log_level(warning);
+	UpstreamSimulator upstream;
+	UpstreamPool::Options options;
+	options.max_idle = state.range(0);
+	UpstreamPool pool("127.0.0.1", upstream.port(), options);
+	net::io_context ioc;
+
+	for (auto _ : state) {
+		http::request<http::string_body> req{http::verb::get, "/", 11};
+		req.set(http::field::host, "127.0.0.1");
+		bool done = false;
+		pool.async_send(req, ioc.get_executor(), [&](beast::error_code err, http::response<http::string_body> res) {
+			if (err) {
+				state.SkipWithError(err.message().c_str());
+			}
+			benchmark::DoNotOptimize(res);
+			done = true;
+		});
+		while (!done) {
+			ioc.run_one();
+		}
+		ioc.restart();
+	}
+
+	state.counters["hit_rate"] = pool.stats().hit_rate();
+}
+BENCHMARK(BM_UpstreamRequest)->ArgName("max_idle")->Arg(0)->Arg(16)->UseRealTime()->Repetitions(5)->ReportAggregatesOnly(true);
+
+// Proxies requests through ProxyRequestHandler to a local upstream server, as the session does
+class ProxyFixture {
+   public:
+	explicit ProxyFixture(UpstreamSimulator::Options options)
+	    : upstream_(options) {
+		set_log_level(warning);
+		NginxConfig config;
+		NginxConfigParser parser;
+		std::istringstream config_stream("dest 127.0.0.1; port " + upstream_.port() + ";");
+		parser.Parse(&config_stream, &config);
+		handler_ = std::make_unique<ProxyRequestHandler>("/proxy", config);
+	}
+
+	// Sends requests for target on as many concurrent connections as in_flight, and waits for them
+	void send(const std::string& target, int in_flight, benchmark::State& state) {
+		http::request<http::string_body> req{http::verb::get, target, 11};
+		int pending = in_flight;
+		for (int i = 0; i < in_flight; i++) {
+			handler_->get_async_response(req, ioc_.get_executor(), [&](http::response<http::string_body> res) {
+				if (res.result() != http::status::ok) {
+					state.SkipWithError("upstream request failed");
+				}
+				benchmark::DoNotOptimize(res);
+				pending--;
+			});
+		}
+		while (pending > 0) {
+			ioc_.run_one();
+		}
+		ioc_.restart();
+	}
+
+   private:
+	UpstreamSimulator upstream_;
+	net::io_context ioc_;
+	std::unique_ptr<ProxyRequestHandler> handler_;
+};
+
+// Throughput of proxied pages with the argument links to rewrite, or as many bytes of text, with
+// requests in flight on several pooled connections
+static void BM_ProxyThroughput(benchmark::State& state) {
+	ProxyFixture proxy({});
+	bool html = state.range(0);
+	std::string target = (html ? "/proxy/html/" : "/proxy/bytes/") + std::to_string(state.range(1));
+	int in_flight = state.range(2);
+	state.SetLabel(html ? "html" : "text");
+	for (auto _ : state) {
+		proxy.send(target, in_flight, state);
+	}
+	state.SetItemsProcessed(state.iterations() * in_flight);
+}
+BENCHMARK(BM_ProxyThroughput)
+    ->ArgNames({"html", "size", "in_flight"})
+    ->Args({0, 1024, 8})
+    ->Args({0, 1 << 20, 8})
+    ->Args({1, 100, 8})
+    ->Args({1, 1000, 8})
+    ->UseRealTime()
+    ->Unit(benchmark::kMicrosecond);
+
+// Latency of a proxied request to an upstream taking 1ms on average with an exponential tail, so
+// that the cost of the proxy shows on top of a realistic upstream
+static void BM_ProxyLatency(benchmark::State& state) {
+	UpstreamSimulator::Options options;
+	options.distribution = UpstreamSimulator::Distribution::exponential;
+	options.latency_mean = std::chrono::milliseconds(1);
+	options.body_size = state.range(0);
+	ProxyFixture proxy(options);
+	for (auto _ : state) {
+		proxy.send("/proxy/", 1, state);
+	}
+}
+BENCHMARK(BM_ProxyLatency)->ArgName("body_size")->Arg(1024)->UseRealTime()->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,80 @@
+#include "router.h"
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "echoHandler.h"
+
+// The longest prefix scan that session::construct_response used before the Router,
+// kept here as the baseline to compare against.
+RequestHandler* linear_scan(const std::vector<std::pair<std::string, RequestHandler*>>& urlToHandler, const std::string& req_target) {
+	std::string target = req_target;
+
+	// ignore characters after the first "?" that is after the last "/" in URL
+	size_t last_slash_index = target.rfind("/");
+	if (last_slash_index != std::string::npos) {
+		size_t first_qmark_index = target.substr(last_slash_index).find("?");
+		if (first_qmark_index != std::string::npos) {
+			target.erase(first_qmark_index);
+		}
+	}
+
+	// add / to make sure the directory name is the same
+	target = target + "/";
+
+	size_t longest_prefix_match = 0;
+	RequestHandler* correct_handler = nullptr;
+
+	for (std::pair<std::string, RequestHandler*> handler_mapping : urlToHandler) {
+		std::string handler_url_prefix = handler_mapping.first;
+		size_t prefix_len = handler_url_prefix.size();
+
+		bool longest_prefix_string_match = target.substr(0, prefix_len) == handler_url_prefix && prefix_len > longest_prefix_match;
+		bool last_dirname_not_a_substr = (target[prefix_len] == '/') || handler_url_prefix == "/";
+
+		if (longest_prefix_string_match && last_dirname_not_a_substr) {
+			longest_prefix_match = prefix_len;
+			correct_handler = handler_mapping.second;
+		}
+	}
+	return correct_handler;
+}
+
+// Location blocks like the ones in conf/default.conf, with nested and sibling prefixes
+struct Locations {
+	Locations(int n) {
+		NginxConfig config;
+		handler = std::make_unique<EchoHandler>("/", config);
+		urlToHandler.push_back({"/", handler.get()});
+		for (int i = 0; i < n - 1; i++) {
+			std::string prefix = "/app" + std::to_string(i % 100) + "/v" + std::to_string(i / 100);
+			urlToHandler.push_back({prefix, handler.get()});
+		}
+		target = "/app" + std::to_string((n / 2) % 100) + "/v" + std::to_string((n / 2) / 100) + "/static/js/main.js?v=2";
+	}
+
+	std::unique_ptr<EchoHandler> handler;
+	std::vector<std::pair<std::string, RequestHandler*>> urlToHandler;
+	std::string target;
+};
+
+static void BM_LinearScan(benchmark::State& state) {
+	Locations locations(state.range(0));
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(linear_scan(locations.urlToHandler, locations.target));
+	}
+}
+BENCHMARK(BM_LinearScan)->Arg(10)->Arg(1000)->Arg(100000);
+
+static void BM_RouterMatch(benchmark::State& state) {
+	Locations locations(state.range(0));
+	Router router(locations.urlToHandler);
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(router.match(locations.target));
+	}
+}
+BENCHMARK(BM_RouterMatch)->Arg(10)->Arg(1000)->Arg(100000);
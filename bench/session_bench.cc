@@ -0,0 +1,53 @@
+#include <benchmark/benchmark.h>
+
+#include <boost/asio.hpp>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "logger.h"
+#include "sessionTCP.h"
+
+// Answers every request with the same small response, so that only routing is measured
+class FixedResponseHandler : public RequestHandler {
+   public:
+	FixedResponseHandler() {
+		name = "Fixed";
+		res_ = {http::status::ok, 11};
+		res_.body() = "OK";
+		res_.prepare_payload();
+	}
+
+   protected:
+	http::response<http::string_body> handle_request(__attribute__((unused)) const http::request<http::string_body>& request) override {
+		return res_;
+	}
+
+   private:
+	http::response<http::string_body> res_;
+};
+
+// Finding the handler of a request among as many locations as the argument, and getting its response
+static void BM_ConstructResponse(benchmark::State& state) {
+	set_log_level(warning);
+	FixedResponseHandler handler;
+	std::vector<std::pair<std::string, RequestHandler*>> url_to_handlers = {{"/", &handler}};
+	for (int i = 0; i < state.range(0) - 1; i++) {
+		url_to_handlers.push_back({"/app" + std::to_string(i % 100) + "/v" + std::to_string(i / 100), &handler});
+	}
+
+	boost::asio::io_context io_context;
+	NginxConfig config;
+	tcp::socket socket(io_context);
+	auto s = std::make_shared<sessionTCP>(&config, std::make_shared<const Router>(url_to_handlers), std::move(socket));
+
+	int middle = state.range(0) / 2;
+	http::request<http::string_body> req{http::verb::get, "/app" + std::to_string(middle % 100) + "/v" + std::to_string(middle / 100) + "/static/js/main.js?v=2", 11};
+	for (auto _ : state) {
+		http::response<http::string_body> res;
+		s->construct_response(req, res);
+		benchmark::DoNotOptimize(res);
+	}
+}
+BENCHMARK(BM_ConstructResponse)->ArgName("locations")->Arg(10)->Arg(1000);
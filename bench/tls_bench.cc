@@ -0,0 +1,67 @@
+#include "tlsResumption.h"
+
+#include <benchmark/benchmark.h>
+#include <openssl/ssl.h>
+
+#include <boost/asio/ssl.hpp>
+
+#include "logger.h"
+
+namespace ssl = boost::asio::ssl;
+
+// Handshakes per second of the server with new clients, and with clients resuming their session from
+// the session cache or with a ticket. Client and server run on this thread, over memory BIOs, so
+// both sides of every handshake are counted.
+static void BM_TlsHandshake(benchmark::State& state) {
+	set_log_level(warning);
+	ssl::context server_ctx{ssl::context::tlsv12};
+	server_ctx.use_certificate_chain_file(KOKO_BENCH_CERTS_DIR "/fullchain.pem");
+	server_ctx.use_private_key_file(KOKO_BENCH_CERTS_DIR "/privkey.pem", ssl::context::file_format::pem);
+	ssl::context client_ctx{ssl::context::tlsv12_client};
+
+	int resumption = state.range(0);
+	TlsResumption::Options options;
+	options.cache_size = resumption == 1 ? 1024 : 0;
+	options.tickets = resumption == 2;
+	TlsResumption::enable(server_ctx, options);
+
+	SSL_SESSION* session = nullptr;
+	for (auto _ : state) {
+		SSL* server = SSL_new(server_ctx.native_handle());
+		SSL* client = SSL_new(client_ctx.native_handle());
+		BIO* server_bio = nullptr;
+		BIO* client_bio = nullptr;
+		BIO_new_bio_pair(&server_bio, 0, &client_bio, 0);
+		SSL_set_bio(server, server_bio, server_bio);
+		SSL_set_bio(client, client_bio, client_bio);
+		SSL_set_accept_state(server);
+		SSL_set_connect_state(client);
+		if (session != nullptr) {
+			SSL_set_session(client, session);
+		}
+
+		bool done = false;
+		for (int i = 0; i < 20 && !done; i++) {
+			int client_done = SSL_do_handshake(client);
+			done = SSL_do_handshake(server) == 1 && client_done == 1;
+		}
+		if (!done || (resumption > 0 && session != nullptr && !SSL_session_reused(server))) {
+			state.SkipWithError("handshake failed or was not resumed");
+		}
+
+		if (resumption > 0 && session == nullptr) {
+			session = SSL_get1_session(client);
+		}
+
+		// Connections freed without a shutdown lose their session
+		SSL_set_shutdown(client, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+		SSL_set_shutdown(server, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+		SSL_free(client);
+		SSL_free(server);
+	}
+	if (session != nullptr) {
+		SSL_SESSION_free(session);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TlsHandshake)->ArgName("resumption")->Arg(0)->Arg(1)->Arg(2);
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <boost/log/core.hpp>
+#include <boost/log/expressions/filter.hpp>
+#include <boost/log/expressions/formatter.hpp>
+#include <boost/log/sinks/sink.hpp>
+#include <boost/smart_ptr/shared_ptr.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A Boost.Log sink that hands records to a writer thread instead of writing them on the logging thread.
+// Every logging thread pushes its records, whose message the caller has already formatted, into a
+// lock-free ring of its own. The writer thread drains the rings in batches, lays out the lines and
+// writes them to the outputs, flushing once per batch. Records of a thread are written in order.
+class AsyncLogSink : public boost::log::sinks::sink {
+   public:
+	// What logging threads do when their ring is full
+	enum class Overflow {
+		// Discard the record and count it
+		drop,
+		// Wait for the writer thread to make room
+		block,
+	};
+
+	struct Options {
+		// Records buffered per logging thread, rounded up to a power of two
+		std::size_t ring_size = 4096;
+		Overflow overflow = Overflow::drop;
+		// Longest time a record waits in a ring before it is written
+		std::chrono::milliseconds flush_interval{10};
+	};
+
+	// Writes a formatted line of a record
+	using Writer = std::function<void(const boost::log::record_view&, const std::string&)>;
+
+	explicit AsyncLogSink(Options options);
+
+	// Writes what is left in the rings and stops the writer thread
+	~AsyncLogSink();
+
+	// Adds a destination for the records, only called before the sink is registered with the core
+	void add_output(boost::log::formatter format, Writer write, std::function<void()> flush);
+
+	// Same as above for a Boost.Log formatted backend, like text_file_backend
+	template <class Backend>
+	void add_output(boost::shared_ptr<Backend> backend, boost::log::formatter format) {
+		add_output(
+		    std::move(format),
+		    [backend](const boost::log::record_view& rec, const std::string& line) { backend->consume(rec, line); },
+		    [backend]() { backend->flush(); });
+	}
+
+	// Only records passing the filter are consumed, all records by default.
+	// Meant to be called while setting up logging, every filter set is kept until the sink is destroyed.
+	void set_filter(boost::log::filter filter);
+
+	bool will_consume(const boost::log::attribute_value_set& attributes) override;
+
+	// Pushes the record into the ring of the calling thread. Fatal records are written right away.
+	void consume(const boost::log::record_view& rec) override;
+
+	// Writes every buffered record and flushes the outputs
+	void flush() override;
+
+	// Writes what is left in the rings and stops the writer thread, later records are dropped
+	void stop();
+
+	// Records discarded because a ring was full
+	std::uint64_t dropped() const;
+
+	struct Ring;
+
+   private:
+	// Finds or creates the ring of the calling thread
+	Ring& local_ring();
+
+	void writer_loop();
+
+	// Writes the records in all rings, returns the number written. Requires drain_mutex_ to be held.
+	std::size_t drain();
+
+	// Asks the writer thread to drain the rings before its interval passes
+	void wake_writer();
+
+	struct Output {
+		boost::log::formatter format;
+		Writer write;
+		std::function<void()> flush;
+	};
+
+	const Options options_;
+	const std::uint64_t id_;
+	std::vector<Output> outputs_;
+
+	// The current filter is read without a lock by every logging thread. Replaced filters are
+	// kept alive, since a thread may still be reading one.
+	std::mutex filter_mutex_;
+	std::vector<std::unique_ptr<const boost::log::filter>> filters_;
+	std::atomic<const boost::log::filter*> filter_;
+
+	// Rings of all threads that logged through this sink
+	std::mutex rings_mutex_;
+	std::vector<std::shared_ptr<Ring>> rings_;
+
+	// Held by whoever drains the rings, the writer thread or flush()
+	std::mutex drain_mutex_;
+	std::string line_;
+
+	std::mutex wake_mutex_;
+	std::condition_variable wake_;
+	std::atomic<bool> wake_requested_;
+	std::atomic<bool> stopped_;
+
+	std::atomic<std::uint64_t> dropped_;
+	std::uint64_t reported_dropped_;
+
+	std::thread writer_;
+};
+
+// Replaces the file and console sinks installed by init_logger with an AsyncLogSink writing to the
+// same destinations, and returns it. Buffered records are written when the process exits.
+boost::shared_ptr<AsyncLogSink> init_async_logger(AsyncLogSink::Options options);
+
+// The sink installed by init_async_logger, or null if logging is synchronous
+boost::shared_ptr<AsyncLogSink> async_logger();
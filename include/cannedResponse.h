@@ -0,0 +1,34 @@
+#pragma once
+
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/http.hpp>
+#include <string>
+
+namespace http = boost::beast::http;
+
+// A response that is the same every time, like a health check or an error, serialized once
+// into immutable bytes. Sessions write it as is with a single gather write instead of building
+// and serializing a response per request.
+// The bytes leave out the Date and Connection headers, which change per response, so sessions
+// write those between head() and tail().
+class CannedResponse {
+   public:
+	// Serializes the response, which should have neither a Date nor a Connection header
+	explicit CannedResponse(const http::response<http::string_body>& response);
+
+	int result_int() const;
+
+	// Status line and headers, each ending with CRLF
+	boost::asio::const_buffer head() const;
+
+	// Empty line ending the headers, then the body
+	boost::asio::const_buffer tail() const;
+
+	// Only the empty line ending the headers, for responses to HEAD requests
+	boost::asio::const_buffer end_of_head() const;
+
+   private:
+	std::string bytes_;
+	std::size_t head_size_;
+	int result_;
+};
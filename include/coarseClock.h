@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+// A process-wide clock read on the request path without system calls or time zone math.
+// Once started, a thread updates the cached time every interval, the Date header once a second,
+// and the offset of LA time from UTC. Until then, every read asks the system clock instead.
+class CoarseClock {
+   public:
+	static CoarseClock& instance();
+
+	// Starts the thread updating the clock, does nothing if it is running
+	void start(std::chrono::milliseconds interval = std::chrono::milliseconds(1));
+
+	// Stops the thread, reads ask the system clock again
+	void stop();
+
+	bool running() const;
+
+	// Microseconds since the epoch, at most an interval old while running
+	std::int64_t now_us() const;
+
+	// The time in LA
+	boost::posix_time::ptime local_time() const;
+
+	// A time in microseconds since the epoch in LA, with the current offset from UTC
+	boost::posix_time::ptime to_local(std::int64_t unix_us) const;
+
+	// Value of the Date header, like "Sun, 06 Nov 1994 08:49:37 GMT"
+	struct Date {
+		char text[32];
+		std::size_t size;
+
+		std::string_view view() const {
+			return std::string_view(text, size);
+		}
+	};
+	Date date() const;
+
+	// Formats a time in microseconds since the epoch as an RFC 7231 date
+	static Date format_date(std::int64_t unix_us);
+
+	~CoarseClock();
+
+   private:
+	CoarseClock() = default;
+
+	// Reads the system clock into the cached values
+	void update();
+
+	// Offset of LA time from UTC at a time, in microseconds
+	static std::int64_t local_offset_us(std::int64_t unix_us);
+
+	std::atomic<bool> running_{false};
+	std::atomic<std::int64_t> now_us_{0};
+	std::atomic<std::int64_t> local_offset_us_{0};
+
+	// The Date header, guarded by date_seq_ like a seqlock, odd while the updating thread writes it
+	std::atomic<std::uint64_t> date_seq_{0};
+	std::atomic<std::uint64_t> date_words_[sizeof(Date::text) / sizeof(std::uint64_t)] = {};
+	std::int64_t date_second_ = -1;
+
+	std::mutex mutex_;
+	std::condition_variable stop_;
+	bool stopping_ = false;
+	std::thread thread_;
+};
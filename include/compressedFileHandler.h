@@ -3,17 +3,57 @@
 #include <boost/iostreams/copy.hpp>
 #include <boost/iostreams/filter/gzip.hpp>
 #include <boost/iostreams/filtering_streambuf.hpp>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <sstream>
 
+#include "compressionCache.h"
 #include "fileHandler.h"
 
 namespace http = boost::beast::http;
 namespace fs = boost::filesystem;
 
+// Compresses data with gzip
+std::string compress(const std::string& data, int level = boost::iostreams::gzip::best_compression);
+
 class CompressedFileHandler : public FileHandler {
    public:
 	CompressedFileHandler(const std::string& url_prefix, const NginxConfig& config);
 
+	// Returns true if the request accepts gzip as a content encoding
+	static bool accepts_gzip(const http::request<http::string_body>& request);
+
+	// gzip level of the compressed bodies
+	static const int compression_level;
+
+	virtual bool is_asynchronous() const override;
+
    protected:
 	virtual http::response<http::string_body> handle_request(const http::request<http::string_body>& request) override;
-};
\ No newline at end of file
+
+	// When the request accepts gzip, serves a precompressed sibling or else the compressed body
+	// if it is in the compression cache, otherwise streams the file uncompressed.
+	// Declines files that still have to be compressed, handle_async_request answers those.
+	virtual bool handle_static_request(const http::request<http::string_body>& request, http::response<static_body>& response) override;
+
+	// Compresses the file on the threads of the compression cache, so that the session's executor
+	// keeps serving other connections meanwhile
+	virtual void handle_async_request(const http::request<http::string_body>& request, const boost::asio::any_io_executor& executor, ResponseHandler done) override;
+
+	// Fills in the key of the compressed version of the file at linux_path, false if it cannot be stat'ed
+	bool compression_key(const fs::path& linux_path, CompressionKey& key);
+
+	// Returns a function compressing the file at linux_path, reading it from the content cache if it is there
+	std::function<std::string()> compressor(const std::string& target, const fs::path& linux_path);
+
+	// Returns the compressed file found at linux_path for the target, compressing it only if it
+	// is not in the compression cache. Blocks until it is compressed.
+	// Returns nullptr if the file cannot be read.
+	std::shared_ptr<const std::string> compressed_body(const std::string& target, const fs::path& linux_path, std::uint64_t& size);
+
+	// The response with the compressed body of the file, without the body for HEAD requests
+	http::response<http::string_body> compressed_response(bool head, const fs::path& linux_path, std::uint64_t size, const std::string& body);
+
+	void log_metrics(std::uint64_t size, std::uint64_t compressed_size);
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Identifies one compressed variant of a file. A file changing on disk changes its
+// modification time or size, so stale variants are never looked up again.
+struct CompressionKey {
+	std::string path;
+	std::int64_t mtime_ns;
+	std::uint64_t size;
+	std::string encoding;
+	int level;
+
+	// The file and encoding this is a variant of, without its version
+	std::string variant() const;
+
+	// The full key
+	std::string str() const;
+};
+
+// A process-wide cache of compressed file bodies for CompressedFileHandler, kept in LRU order
+// within a byte budget. Misses are compressed on a small pool of threads of the cache, so that
+// io_context threads keep serving other connections meanwhile. Concurrent misses for the same key
+// wait for a single compression instead of all compressing the same file.
+class CompressionCache {
+   public:
+	// Called with the compressed body, or with the exception thrown while compressing it
+	using Handler = std::function<void(std::shared_ptr<const std::string> body, std::exception_ptr error)>;
+
+	// Threads compressing misses
+	static const std::size_t compression_threads;
+
+	// Capacity is the byte budget for compressed bodies, 0 disables the cache
+	CompressionCache(std::size_t capacity = 0);
+
+	// Waits for the compressions in progress
+	~CompressionCache();
+
+	// The cache shared by all handlers
+	static CompressionCache& instance();
+
+	// Changes the byte budget, evicting entries if needed
+	void set_capacity(std::size_t capacity);
+	bool enabled();
+
+	// Returns the cached compressed body for key without compressing it, nullptr on a miss
+	std::shared_ptr<const std::string> find(const CompressionKey& key);
+
+	// Calls done from executor with the compressed body for key. On a miss, compress runs on the
+	// threads of the cache, and every request waiting for the same key is completed on its own
+	// executor once it is done. Exceptions thrown by compress are passed on to every waiting request.
+	void async_get(const CompressionKey& key, std::function<std::string()> compress, const boost::asio::any_io_executor& executor, Handler done);
+
+	// Same as above, but blocks the calling thread until the body is compressed and returns it, or
+	// throws the exception thrown by compress. Not for use on io_context threads.
+	std::shared_ptr<const std::string> get(const CompressionKey& key, const std::function<std::string()>& compress);
+
+	struct Stats {
+		std::uint64_t hits;
+		std::uint64_t misses;
+		// Misses that waited for another thread compressing the same file
+		std::uint64_t coalesced;
+		std::size_t entries;
+		std::size_t bytes;
+		std::size_t capacity;
+		// CPU time compressing the bodies served from the cache would have taken
+		std::uint64_t cpu_saved_ns;
+
+		// Fraction of lookups served from the cache, 0 without lookups. Coalesced misses
+		// waited for a compression, so they are not hits.
+		double hit_ratio() const;
+	};
+	Stats stats();
+
+   private:
+	struct Compressed {
+		std::shared_ptr<const std::string> body;
+		// CPU time the compression took
+		std::uint64_t cpu_ns;
+	};
+
+	struct Entry {
+		std::string key;
+		std::string variant;
+		Compressed compressed;
+	};
+
+	// Returns the cached body and counts a hit, nullptr on a miss. Requires mutex_ to be held.
+	std::shared_ptr<const std::string> lookup(const std::string& k);
+
+	// Adds an entry, evicting least recently used ones. Requires mutex_ to be held.
+	void insert(const CompressionKey& key, const Compressed& compressed);
+
+	// Removes an entry. Requires mutex_ to be held.
+	void erase(std::list<Entry>::iterator it);
+
+	// A request waiting for a compression in progress
+	struct Waiter {
+		boost::asio::any_io_executor executor;
+		Handler done;
+	};
+
+	// Compresses the body of key on the calling thread, then caches it and completes its waiters
+	void compress_entry(const CompressionKey& key, const std::function<std::string()>& compress);
+
+	// Posts done to the executor of the waiter, or calls it right away if the waiter has none
+	static void complete(Waiter waiter, std::shared_ptr<const std::string> body, std::exception_ptr error);
+
+	// Runs work on the compression threads, starting them on first use
+	void run_on_pool(std::function<void()> work);
+
+	std::mutex mutex_;
+	std::size_t capacity_;
+	std::size_t bytes_;
+
+	// Most recently used entries first
+	std::list<Entry> lru_;
+	std::unordered_map<std::string, std::list<Entry>::iterator> entries_;
+
+	// The key cached for each variant, older versions are dropped when a new one is added
+	std::unordered_map<std::string, std::string> key_by_variant_;
+
+	// Compressions in progress and the requests waiting for them
+	std::unordered_map<std::string, std::vector<Waiter>> in_flight_;
+
+	std::atomic<std::uint64_t> hits_;
+	std::atomic<std::uint64_t> misses_;
+	std::atomic<std::uint64_t> coalesced_;
+	std::atomic<std::uint64_t> cpu_saved_ns_;
+
+	// Destroyed first, so that compressions still running finish before the entries are
+	std::unique_ptr<boost::asio::thread_pool> pool_;
+};
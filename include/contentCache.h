@@ -0,0 +1,154 @@
+#pragma once
+
+#include <boost/filesystem.hpp>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+// Estimates how often keys were seen recently, using a count-min sketch of small
+// counters which are halved periodically so that old popularity fades away.
+class FrequencySketch {
+   public:
+	// Width is rounded up to a power of two
+	FrequencySketch(std::size_t width);
+
+	void increment(std::size_t hash);
+	int estimate(std::size_t hash) const;
+
+   private:
+	// Index of the counter for the hash in a row of the table
+	std::size_t index(std::size_t hash, int row) const;
+
+	// Halves all counters
+	void age();
+
+	static const int rows = 4;
+	static const int max_count = 15;
+
+	std::vector<std::uint8_t> table_;
+	std::size_t mask_;
+	std::size_t additions_;
+	std::size_t sample_size_;
+};
+
+// A file held in memory by the content cache
+struct CachedFile {
+	// Canonical path of the file
+	std::string path;
+	std::string mime;
+
+	// Shared by every response serving the file, never modified
+	std::shared_ptr<const std::string> body;
+
+	// Extensions of the precompressed siblings looked for when the file was read, like ".gz"
+	// for file.txt.gz, and those of them that existed and were not older than the file
+	std::vector<std::string> sibling_extensions;
+	std::vector<std::string> siblings;
+};
+
+// A process-wide, in-memory cache of static files for FileHandler and CompressedFileHandler.
+// Entries are kept in LRU order within a byte budget, and a TinyLFU admission policy only
+// lets a file into a full cache if it was requested more often recently than the entry it
+// would evict, so a scan over many cold files cannot flush the hot ones. Cached files and
+// their precompressed siblings are watched with inotify, and cached files are dropped from
+// the cache as soon as either changes on disk.
+class ContentCache {
+   public:
+	// Capacity is the byte budget for file contents, 0 disables the cache
+	ContentCache(std::size_t capacity = 0);
+	~ContentCache();
+
+	// The cache shared by all handlers
+	static ContentCache& instance();
+
+	// Changes the byte budget, evicting entries if needed
+	void set_capacity(std::size_t capacity);
+	std::size_t capacity();
+	bool enabled();
+
+	// Files larger than this are never cached
+	std::size_t max_file_size();
+
+	// Returns the cached file for key, or nullptr on a miss
+	std::shared_ptr<const CachedFile> lookup(const std::string& key);
+
+	// Reads the file at path and offers it to the cache under key, along with which of the
+	// sibling extensions have an up to date precompressed sibling. Returns the file read, whether
+	// or not it was admitted, or nullptr if it could not be read or is too large to be cached.
+	std::shared_ptr<const CachedFile> load(const std::string& key, const fs::path& path, const std::string& mime,
+	                                       const std::vector<std::string>& sibling_extensions = {});
+
+	// Drops the entries for a file, or of which it is a precompressed sibling, by its canonical path
+	void invalidate(const std::string& path);
+
+	// Drops the entries for all files in a directory, by its canonical path
+	void invalidate_directory(const std::string& dir);
+
+	// Drops all entries
+	void clear();
+
+	struct Stats {
+		std::uint64_t hits;
+		std::uint64_t misses;
+		std::uint64_t rejected;
+		std::uint64_t invalidations;
+		std::size_t entries;
+		std::size_t bytes;
+		std::size_t capacity;
+	};
+	Stats stats();
+
+   private:
+	struct Entry {
+		std::string key;
+		std::shared_ptr<const CachedFile> file;
+	};
+
+	// Adds the entry unless the admission policy rejects it. Requires mutex_ to be held.
+	void admit(const std::string& key, std::shared_ptr<const CachedFile> file);
+
+	// Removes an entry. Requires mutex_ to be held.
+	void erase(std::list<Entry>::iterator it);
+
+	// Starts watching the directory for changes, returns false on failure
+	bool watch(const std::string& dir);
+
+	// Reads inotify events until the cache is destroyed
+	void watch_loop();
+
+	std::mutex mutex_;
+	std::size_t capacity_;
+	std::size_t bytes_;
+
+	// Most recently used entries first
+	std::list<Entry> lru_;
+	std::unordered_map<std::string, std::list<Entry>::iterator> entries_;
+
+	// Keys of the entries for each canonical file path, including those of precompressed siblings
+	std::unordered_map<std::string, std::vector<std::string>> keys_by_path_;
+
+	FrequencySketch sketch_;
+
+	// Incremented on every invalidation, to detect files changing while they are read
+	std::uint64_t generation_;
+
+	std::atomic<std::uint64_t> hits_;
+	std::atomic<std::uint64_t> misses_;
+	std::atomic<std::uint64_t> rejected_;
+	std::atomic<std::uint64_t> invalidations_;
+
+	// inotify state, the watcher thread is started with the first watch
+	int inotify_fd_;
+	int stop_fd_;
+	std::thread watcher_;
+	std::unordered_map<int, std::string> dir_by_watch_;
+	std::unordered_map<std::string, int> watch_by_dir_;
+};
@@ -15,6 +15,10 @@ class EchoHandler : public RequestHandler {
 
 	std::string get_url_prefix();
 
+	// Appends the request to body as it was sent, sizing body once for the whole request.
+	// Chunked requests are serialized with Beast instead, which chunks the body again.
+	static void append_request(const http::request<http::string_body>& request, std::string& body);
+
    protected:
 	virtual http::response<http::string_body> handle_request(const http::request<http::string_body>& request) override;
 
@@ -3,9 +3,11 @@
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/filesystem.hpp>
+#include <memory>
 #include <string>
 
 #include "config.h"
+#include "contentCache.h"
 #include "handler.h"
 
 namespace http = boost::beast::http;
@@ -18,8 +20,49 @@ class FileHandler : public RequestHandler {
 	std::string get_mime(std::string target);
 	fs::path get_linux_dir();
 
+	// Returns true if the Accept-Encoding header of the request allows the content coding
+	static bool accepts_encoding(const http::request<http::string_body>& request, const std::string& encoding);
+
    protected:
+	// Reads the file, or a precompressed sibling the request accepts, into the body, from the
+	// content cache when possible. HEAD requests only look up the size of the file.
 	virtual http::response<http::string_body> handle_request(const http::request<http::string_body>& request) override;
+
+	// Serves the file, or streams a precompressed sibling the request accepts, looking both up in
+	// the content cache first. Streams the file from disk instead of reading it into memory if it
+	// is not cacheable.
+	// Declines HEAD requests and requests for missing files, handle_request answers those.
+	virtual bool handle_static_request(const http::request<http::string_body>& request, http::response<static_body>& response) override;
+
+	// Answers every request with the canned internal server error if the root is not configured
+	virtual const CannedResponse* handle_canned_request(const http::request<http::string_body>& request) override;
+
+	// Finds the path of the file to serve for the target.
+	// Returns false if there is no such file.
+	virtual bool find_file(std::string target, fs::path& linux_path);
+
+	// Returns the file for the target from the content cache, loading it on a miss along with
+	// which precompressed siblings it has.
+	// Returns nullptr if the cache is disabled, the file is missing or it is too large to cache.
+	std::shared_ptr<const CachedFile> find_cached_file(std::string target);
+
+	// Finds a precompressed sibling of the file found at linux_path, like file.txt.gz for file.txt,
+	// in an encoding the request accepts. Siblings older than the file are ignored.
+	// Returns false if there is no such sibling.
+	bool find_precompressed_sibling(const http::request<http::string_body>& request, const fs::path& linux_path, fs::path& sibling, std::string& encoding);
+
+	// Same as above, for a file from the content cache, without looking at the disk
+	bool find_cached_sibling(const http::request<http::string_body>& request, const CachedFile& cached, fs::path& sibling, std::string& encoding);
+
+	// Streams a precompressed sibling of the file, returns false if there is none.
+	// The siblings of cached files are known to the cache, others are looked for next to
+	// linux_path, which the caller found.
+	bool serve_precompressed(const http::request<http::string_body>& request, const CachedFile* cached, const fs::path& linux_path,
+	                         http::response<static_body>& response);
+
+	// Reads the whole file into a string
+	static std::string read_file(const fs::path& linux_path);
+
 	std::string url_prefix;
 	fs::path linux_dir;
 	bool invalid_config;
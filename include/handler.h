@@ -1,37 +1,61 @@
 #pragma once
 
+#include <boost/asio/any_io_executor.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <chrono>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "cannedResponse.h"
 #include "logger.h"
 #include "config.h"
+#include "metrics.h"
+#include "requestHistory.h"
+#include "staticBody.h"
 
 namespace http = boost::beast::http;
 
-class URLInfo {
-   public:
-	URLInfo(std::string url, int res_code, boost::posix_time::ptime time);
-
-	std::string url;
-	int res_code;
-	boost::posix_time::ptime req_time;
-};
-
 class RequestHandler {
    public:
+	// Called with the response once an asynchronous request completes
+	using ResponseHandler = std::function<void(http::response<http::string_body>)>;
+
 	virtual ~RequestHandler() {}
 
 	// Gets name of handler
-	std::string get_name();
+	const std::string& get_name() const;
+
+	// Returns true if the handler overrides handle_async_request. Sessions call get_response
+	// directly for other handlers, without allocating a callback per request.
+	virtual bool is_asynchronous() const;
 
 	// Wraps handle_request and records url to response code pair
 	http::response<http::string_body> get_response(const http::request<http::string_body>& request);
 
+	// Wraps handle_static_request and records url to response code pair.
+	// Returns false without recording anything if the handler did not fill in a static response,
+	// in which case get_response has to be used for the request instead.
+	bool get_static_response(const http::request<http::string_body>& request, http::response<static_body>& response);
+
+	// Wraps handle_canned_request and records url to response code pair.
+	// Returns nullptr without recording anything if the handler has no canned response for the request.
+	const CannedResponse* get_canned_response(const http::request<http::string_body>& request);
+
+	// Wraps handle_async_request and records url to response code pair once the response is complete.
+	// done is called exactly once, right away for handlers that create their responses synchronously.
+	void get_async_response(const http::request<http::string_body>& request, const boost::asio::any_io_executor& executor, ResponseHandler done);
+
+	// Reads keep-alive, keepalive_timeout and keepalive_requests from the location block
 	void set_keep_alive_from_config(const NginxConfig& conf);
 
+	// Records the time from reading a request for this handler to writing its response
+	void record_latency(std::chrono::steady_clock::duration duration);
+
 	// Returns a 400 bad request
 	static http::response<http::string_body> bad_request();
 
@@ -41,17 +65,61 @@ class RequestHandler {
 	// Returns a 500 server error
 	static http::response<http::string_body> internal_server_error();
 
+	// The errors above, serialized once for sessions to write as they are.
+	// They leave out the Connection header, sessions close the connection after them.
+	static const CannedResponse& canned_bad_request();
+	static const CannedResponse& canned_not_found_error();
+	static const CannedResponse& canned_internal_server_error();
+
 	// Converts the response into a string
 	static std::string to_string(http::response<http::string_body> res);
 	static std::string to_string(http::request<http::string_body> req);
 
-	static std::vector<URLInfo> url_info;
+	// Whether responses of the handler may keep the connection open, set to false with keep-alive 0
+	bool keep_alive = true;
 
-	bool keep_alive = false;
+	// Seconds a connection stays open waiting for the next request, and how many requests it is
+	// used for, after responses of the handler. -1 to use the values of the server.
+	int keepalive_timeout = -1;
+	int keepalive_requests = -1;
 
    protected:
 	// Returns a response for the given request
 	virtual http::response<http::string_body> handle_request(const http::request<http::string_body>& request) = 0;
 
+	// Handlers whose response body can be streamed from a file instead of being built in
+	// a string override this to fill in the response and return true.
+	// By default, handlers only create responses with handle_request.
+	virtual bool handle_static_request(const http::request<http::string_body>& request, http::response<static_body>& response);
+
+	// Handlers that answer some requests with the same response every time override this
+	// to return it serialized once. By default, handlers have no canned responses.
+	virtual const CannedResponse* handle_canned_request(const http::request<http::string_body>& request);
+
+	// Handlers that wait on I/O or timers override this to start the work on the executor without
+	// blocking it. done is then called from the executor with the response.
+	// By default, this adapts synchronous handlers by calling done with the result of handle_request.
+	virtual void handle_async_request(const http::request<http::string_body>& request, const boost::asio::any_io_executor& executor, ResponseHandler done);
+
+	// Finds key=value in the query string of the target, returns false if the key is not there
+	static bool query_parameter(const std::string& target, const std::string& key, std::string& value);
+
+	// Records the url to response code pair for a handled request in RequestHistory
+	void record_url_info(const http::request<http::string_body>& request, int res_code);
+	void record_url_info(std::string_view target, int res_code);
+
 	std::string name;
+
+   private:
+	// Metrics of the handler, labeled with its name
+	struct Metrics {
+		Counter* requests[status_class_count];
+		Histogram* latency;
+	};
+
+	// Registers the metrics on first use, once subclasses have set the name
+	Metrics& metrics();
+
+	std::once_flag metrics_once_;
+	Metrics metrics_;
 };
\ No newline at end of file
@@ -16,4 +16,11 @@ class HealthHandler : public RequestHandler {
 
    protected:
 	virtual http::response<http::string_body> handle_request(const http::request<http::string_body>& request);
+
+	// The same response, serialized once
+	virtual const CannedResponse* handle_canned_request(const http::request<http::string_body>& request) override;
+
+   private:
+	// The response to every health check, without the Connection header
+	static http::response<http::string_body> ok();
 };
\ No newline at end of file
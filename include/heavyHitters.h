@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Finds the most frequent keys, like request paths or client IPs, over a sliding time window in
+// fixed memory however many distinct keys are seen.
+// The window is split into sub-windows. Each has a Count-Min sketch estimating how often every key
+// was seen, and a small table of candidate keys whose estimates were the largest. Adding a key
+// increments its sketch counters and may take a candidate slot from a smaller key, all with atomic
+// operations, so threads add keys without locking. Reading the top keys sums their estimates over
+// the sub-windows still in the window. Estimates never undercount, and overcount by a small
+// fraction of all keys added in the window.
+class HeavyHitters {
+   public:
+	struct Options {
+		// Keys reported by top()
+		std::size_t k = 10;
+		// Candidate keys kept per sub-window, more than k so that keys rising in the ranks are kept
+		std::size_t candidates = 64;
+		// Counters per row and rows of the sketches, wider sketches overcount less
+		std::size_t width = 1024;
+		std::size_t depth = 4;
+		std::chrono::seconds window{60};
+		std::size_t sub_windows = 6;
+	};
+
+	// Longest key kept, longer keys are truncated
+	static constexpr std::size_t max_key_length = 96;
+
+	explicit HeavyHitters(Options options);
+	~HeavyHitters();
+
+	using clock = std::chrono::steady_clock;
+
+	// Counts the key once
+	void add(std::string_view key);
+	void add(std::string_view key, clock::time_point now);
+
+	struct Entry {
+		std::string key;
+		std::uint64_t count;
+	};
+
+	// The k most frequent keys in the window, most frequent first
+	std::vector<Entry> top() const;
+	std::vector<Entry> top(clock::time_point now) const;
+
+	// Bytes of memory used, which only depends on the options
+	std::size_t memory() const;
+
+	const Options& options() const;
+
+	struct SubWindow;
+
+   private:
+	// The sub-window for the time, cleared first if it last held an older sub-window
+	SubWindow& current(clock::time_point now);
+
+	// Number of the sub-window a time falls in
+	std::int64_t epoch(clock::time_point now) const;
+
+	const Options options_;
+	std::vector<std::unique_ptr<SubWindow>> sub_windows_;
+};
+
+// The heavy hitters of every request, read by StatusHandler
+struct HotKeys {
+	// Sets the options of the trackers below, only before they are first used
+	static void configure(HeavyHitters::Options options);
+
+	// Request paths without their query, names of the handlers answering them, and client IPs
+	static HeavyHitters& paths();
+	static HeavyHitters& handlers();
+	static HeavyHitters& clients();
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+
+class session;
+
+// Kept-alive connections waiting for their next request, from the one idle the longest. When
+// connections run short, the server closes the oldest idle ones first to make room for new ones.
+// Sessions are linked into the list through their own members, so waiting does not allocate.
+class IdleConnections {
+   public:
+	static IdleConnections &instance();
+
+	// Adds the session as the newest idle connection
+	void add(session *s);
+
+	// Removes the session, does nothing if it is not idle
+	void remove(session *s);
+
+	// Has up to n of the oldest idle connections closed on their strands, returns how many
+	std::size_t close_oldest(std::size_t n);
+
+	std::size_t size();
+
+   private:
+	std::mutex mutex_;
+	session *oldest_ = nullptr;
+	session *newest_ = nullptr;
+	std::size_t size_ = 0;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Counts latencies in microseconds in log-linear buckets, like HdrHistogram: every power of two is
+// split into the same number of buckets, so percentiles are off by less than 1% of the value
+// whatever its size, in a fixed amount of memory.
+class LatencyHistogram {
+   public:
+	// Largest value counted, larger ones are counted as it
+	static constexpr std::uint64_t max_value = 3600ULL * 1000 * 1000;
+
+	LatencyHistogram();
+
+	void record(std::uint64_t value);
+
+	// Records the value, and if it is longer than the interval the values are expected at, also the
+	// values that would have been seen meanwhile had the load generator not waited for it.
+	// This corrects coordinated omission when requests are sent as soon as the previous one completes.
+	void record(std::uint64_t value, std::uint64_t expected_interval);
+
+	// Adds the counts of other
+	void merge(const LatencyHistogram& other);
+
+	std::uint64_t count() const;
+	std::uint64_t min() const;
+	std::uint64_t max() const;
+	double mean() const;
+
+	// Smallest value that percentile percent of the values are less than or equal to, 0 if empty
+	std::uint64_t percentile(double percent) const;
+
+   private:
+	// Index of the bucket of a value, and the largest value of a bucket
+	static std::size_t index(std::uint64_t value);
+	static std::uint64_t highest_value(std::size_t index);
+
+	std::vector<std::uint64_t> counts_;
+	std::uint64_t count_ = 0;
+	std::uint64_t min_ = 0;
+	std::uint64_t max_ = 0;
+	double sum_ = 0;
+};
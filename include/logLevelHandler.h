@@ -0,0 +1,36 @@
+#pragma once
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <string>
+
+#include "config.h"
+#include "handler.h"
+
+namespace http = boost::beast::http;
+
+// Shows the lowest severity logged on GET, and changes it on POST or PUT with ?level=<severity>
+// or the severity name as the body, so trace logs can be turned on briefly on a live server.
+// With `tokenFile <path>;` in the location block, changes are only made for requests with an
+// "Authorization: Bearer <token>" header holding the token in the file. If the file cannot be
+// read, no change is made at all.
+class LogLevelHandler : public RequestHandler {
+   public:
+	LogLevelHandler(const std::string& url_prefix, const NginxConfig& config);
+
+   protected:
+	virtual http::response<http::string_body> handle_request(const http::request<http::string_body>& request) override;
+
+   private:
+	// Returns the level named in the query string or body of the request, empty if there is none
+	static std::string requested_level(const http::request<http::string_body>& request);
+
+	// Returns true if the request may change the level
+	bool authorized(const http::request<http::string_body>& request) const;
+
+	// Returns a 401 unauthorized response asking for the token
+	static http::response<http::string_body> unauthorized();
+
+	bool requires_token_ = false;
+	std::string token_;
+};
@@ -15,6 +15,8 @@
 #include <boost/log/utility/setup/console.hpp>
 #include <boost/log/utility/setup/file.hpp>
 #include <boost/log/utility/setup/formatter_parser.hpp>
+#include <atomic>
+#include <string>
 
 namespace logging = boost::log;
 namespace expr = boost::log::expressions;
@@ -30,9 +32,30 @@ BOOST_LOG_INLINE_GLOBAL_LOGGER_DEFAULT(slg, src::severity_logger_mt<boost::log::
 
 void init_logger();
 
+// Lowest severity compiled in, records below it are removed from the binary.
+// Set with -DKOKO_MIN_LOG_LEVEL=<level> when running cmake, trace by default.
+#ifndef KOKO_MIN_LOG_LEVEL
+#define KOKO_MIN_LOG_LEVEL 0
+#endif
+
+// Lowest severity logged, records below it are skipped before their message is formatted
+extern std::atomic<int> runtime_log_level;
+void set_log_level(severity_level level);
+severity_level get_log_level();
+
+// Parses a severity name like "info", returns false if there is no such severity
+bool parse_log_level(const std::string& name, severity_level& level);
+
+// Logs a record of the given severity if it is above both minimums. A for statement rather than
+// an if, so that the macro can be used as the body of an if without an else binding to it.
+#define KOKO_LOG(level) \
+	for (bool koko_log_enabled = (level) >= KOKO_MIN_LOG_LEVEL && (level) >= runtime_log_level.load(std::memory_order_relaxed); \
+	     koko_log_enabled; koko_log_enabled = false) \
+		BOOST_LOG_SEV(slg::get(), level)
+
 // Macros for concise logging
-#define FATAL BOOST_LOG_SEV(slg::get(), fatal)
-#define ERROR BOOST_LOG_SEV(slg::get(), error)
-#define WARNING BOOST_LOG_SEV(slg::get(), warning)
-#define INFO BOOST_LOG_SEV(slg::get(), info)
-#define TRACE BOOST_LOG_SEV(slg::get(), trace)
\ No newline at end of file
+#define FATAL KOKO_LOG(fatal)
+#define ERROR KOKO_LOG(error)
+#define WARNING KOKO_LOG(warning)
+#define INFO KOKO_LOG(info)
+#define TRACE KOKO_LOG(trace)
\ No newline at end of file
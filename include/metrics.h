@@ -0,0 +1,150 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Metrics exported in the Prometheus text format by MetricsHandler.
+// Updates are wait-free: every thread adds to a shard of its own, and shards are summed when the
+// metrics are rendered. Looking up a metric in the registry takes a lock, so call sites keep the
+// returned reference, which stays valid for the life of the process.
+
+// Label names and values of a metric, like {{"handler", "Echo"}, {"code", "2xx"}}
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+// Shards per metric, threads share shards if there are more threads
+constexpr std::size_t metric_shards = 16;
+
+// Index of the shard the calling thread updates
+std::size_t metric_shard();
+
+// A value that only goes up
+class Counter {
+   public:
+	void inc(std::uint64_t n = 1) {
+		shards_[metric_shard()].value.fetch_add(n, std::memory_order_relaxed);
+	}
+	std::uint64_t value() const;
+
+   private:
+	struct alignas(64) Shard {
+		std::atomic<std::uint64_t> value{0};
+	};
+	Shard shards_[metric_shards];
+};
+
+// A value that goes up and down, like the number of open connections
+class Gauge {
+   public:
+	void add(std::int64_t n) {
+		shards_[metric_shard()].value.fetch_add(n, std::memory_order_relaxed);
+	}
+	void sub(std::int64_t n) {
+		add(-n);
+	}
+	std::int64_t value() const;
+
+   private:
+	struct alignas(64) Shard {
+		std::atomic<std::int64_t> value{0};
+	};
+	Shard shards_[metric_shards];
+};
+
+// Counts observations in fixed buckets, given by their inclusive upper bounds in increasing order
+class Histogram {
+   public:
+	explicit Histogram(std::vector<double> bounds);
+
+	void observe(double value);
+
+	struct Snapshot {
+		// Cumulative count of every bucket, then of all observations
+		std::vector<std::uint64_t> cumulative;
+		double sum;
+	};
+	Snapshot snapshot() const;
+	const std::vector<double>& bounds() const;
+
+   private:
+	struct alignas(64) Shard {
+		explicit Shard(std::size_t buckets)
+		    : counts(new std::atomic<std::uint64_t>[buckets]()) {
+		}
+		std::unique_ptr<std::atomic<std::uint64_t>[]> counts;
+		// Sum of the observations in millionths
+		std::atomic<std::uint64_t> sum_micros{0};
+	};
+
+	const std::vector<double> bounds_;
+	std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+// Bucket bounds in seconds for request latencies, from 100us to 10s
+const std::vector<double>& latency_buckets();
+
+// Every metric of the process, by name and labels
+class MetricsRegistry {
+   public:
+	static MetricsRegistry& instance();
+
+	// Returns the metric with the name and labels, creating it on first use.
+	// Metrics of one name share their help text and type.
+	Counter& counter(const std::string& name, const std::string& help, const MetricLabels& labels = {});
+	Gauge& gauge(const std::string& name, const std::string& help, const MetricLabels& labels = {});
+	Histogram& histogram(const std::string& name, const std::string& help, const MetricLabels& labels = {},
+	                     const std::vector<double>& bounds = latency_buckets());
+
+	// A gauge whose value is read from elsewhere, like cache statistics, when the metrics are rendered.
+	// Registering the same name and labels again replaces the function.
+	void gauge_function(const std::string& name, const std::string& help, const MetricLabels& labels, std::function<double()> value);
+
+	// Same as above, for a count read from elsewhere that only goes up, like cache hits
+	void counter_function(const std::string& name, const std::string& help, const MetricLabels& labels, std::function<double()> value);
+
+	// Renders every metric in the Prometheus text exposition format
+	std::string render();
+
+   private:
+	enum class Type { counter, gauge, histogram };
+
+	struct Metric {
+		MetricLabels labels;
+		std::unique_ptr<Counter> counter;
+		std::unique_ptr<Gauge> gauge;
+		std::unique_ptr<Histogram> histogram;
+		std::function<double()> function;
+	};
+
+	struct Family {
+		std::string help;
+		Type type;
+		// By the rendered labels
+		std::map<std::string, Metric> metrics;
+	};
+
+	// Finds or creates the metric, requires mutex_ to be held
+	Metric& metric(const std::string& name, const std::string& help, Type type, const MetricLabels& labels);
+
+	std::mutex mutex_;
+	std::map<std::string, Family> families_;
+};
+
+// Status classes of response codes, 1xx to 5xx and then other codes
+constexpr std::size_t status_class_count = 6;
+std::size_t status_class_index(int code);
+
+// Status class label of a response code, like "2xx"
+const char* status_class(int code);
+
+// Status class label by its index
+const char* status_class_name(std::size_t index);
+
+// Renders labels as {name="value",...}, empty if there are none
+std::string render_labels(const MetricLabels& labels);
@@ -15,4 +15,7 @@ class NotFoundHandler : public RequestHandler {
 
    protected:
 	virtual http::response<http::string_body> handle_request(const http::request<http::string_body>& request) override;
+
+	// The same response, serialized once
+	virtual const CannedResponse* handle_canned_request(const http::request<http::string_body>& request) override;
 };
\ No newline at end of file
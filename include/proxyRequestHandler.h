@@ -2,10 +2,14 @@
 #include <boost/asio.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
+#include <chrono>
+#include <functional>
+#include <memory>
 #include <string>
 
 #include "config.h"
 #include "handler.h"
+#include "upstreamPool.h"
 
 namespace http = boost::beast::http;
 
@@ -15,16 +19,45 @@ class ProxyRequestHandler : public RequestHandler {
 
 	std::string get_url_prefix();
 
+	using UpstreamHandler = UpstreamPool::Handler;
+
+	// Upstream servers that take longer than this to connect, accept the request or reply fail the request
+	static constexpr std::chrono::seconds upstream_timeout{30};
+
+	virtual bool is_asynchronous() const override;
+
+	// Rewrites absolute links in an upstream HTML page to go through the proxy
+	void replace_relative_html_links(std::string &body);
+
    protected:
+	// Blocks until the upstream server replies, used when the response is needed synchronously
 	virtual http::response<http::string_body> handle_request(const http::request<http::string_body> &request) override;
 
+	// Answers every request with the canned internal server error if the upstream is not configured
+	virtual const CannedResponse *handle_canned_request(const http::request<http::string_body> &request) override;
+
+	// Sends the request upstream on the session's executor without blocking it
+	virtual void handle_async_request(const http::request<http::string_body> &request, const boost::asio::any_io_executor &executor, ResponseHandler done) override;
+
    private:
 	virtual http::response<http::string_body> req_synchronous(const http::request<http::string_body> &request);
-	void replace_relative_html_links(std::string &body);
+
+	// Sends the request over a pooled upstream connection asynchronously on the executor
+	virtual void req_async(http::request<http::string_body> &&request, const boost::asio::any_io_executor &executor, UpstreamHandler done);
+
+	// The request to send upstream for a request to the proxy
+	http::request<http::string_body> make_proxy_request(const http::request<http::string_body> &request);
+
+	// Rewrites links and redirects in the upstream response to go through the proxy
+	http::response<http::string_body> finish_response(http::response<http::string_body> res);
+
 	// Serve for these url suffixes. eg. "/" to serve all valid targets
 	std::string url_prefix;
 	std::string proxy_dest;
 	std::string m_port;
 	std::size_t max_redirects;
 	bool invalid_config;
-};
\ No newline at end of file
+
+	// Keep-alive connections to proxy_dest
+	std::unique_ptr<UpstreamPool> pool_;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Position of a request in the history. Requests are ordered by time, and requests recorded in
+// the same microsecond by their ring and their index in it, so that every request has a position
+// of its own to read the requests after.
+struct HistoryCursor {
+	// -1 for no position
+	std::int64_t time_us = -1;
+	std::uint64_t ring = 0;
+	std::uint64_t index = 0;
+
+	bool operator<(const HistoryCursor& other) const;
+	bool operator<=(const HistoryCursor& other) const;
+
+	// The position after every request of a microsecond
+	static HistoryCursor after(std::int64_t time_us);
+
+	// Formats the cursor as <time_us>.<ring>.<index>, or only <time_us> for the position after a microsecond
+	std::string to_string() const;
+
+	// Parses what to_string formats, returns false if text is not a cursor
+	static bool parse(const std::string& text, HistoryCursor& cursor);
+};
+
+class URLInfo {
+   public:
+	URLInfo(std::string url, int res_code, boost::posix_time::ptime time);
+
+	std::string url;
+	int res_code;
+	boost::posix_time::ptime req_time;
+
+	// Name of the handler that answered, and the time in microseconds since the epoch
+	std::string handler;
+	std::int64_t time_us = 0;
+
+	// Position of the request in the history
+	HistoryCursor cursor;
+};
+
+// The most recent requests of the server, shown by StatusHandler.
+// Every thread appends to a fixed-size ring of its own without locking, overwriting its oldest
+// requests, so memory stays constant however many requests are served. Rings of threads that
+// exit are handed to the next new thread. Reading the history merges the rings by time.
+class RequestHistory {
+   public:
+	// Longest url and handler name kept, longer ones are truncated
+	static constexpr std::size_t max_url_length = 120;
+	static constexpr std::size_t max_handler_length = 24;
+
+	// Keeps the last capacity requests of every thread
+	explicit RequestHistory(std::size_t capacity);
+
+	// The history of the requests handled by every RequestHandler
+	static RequestHistory& instance();
+
+	// Appends a request to the ring of the calling thread
+	void record(std::string_view url, std::string_view handler, int res_code);
+
+	// Requests still in the rings, newest first, at most limit of them.
+	// With since, only requests after that position are returned, and if there are more than limit,
+	// the oldest of them so that pages can be read in order.
+	std::vector<URLInfo> snapshot(std::size_t limit = std::numeric_limits<std::size_t>::max(), const HistoryCursor& since = HistoryCursor()) const;
+
+	// Requests recorded since the history was created or cleared, including overwritten ones
+	std::uint64_t total() const;
+
+	// Forgets every request and resets the total
+	void clear();
+
+	// Rings created so far, one for every thread recording at the same time
+	std::size_t rings() const;
+
+	struct Ring;
+
+   private:
+	// Finds or takes a ring for the calling thread
+	Ring& local_ring();
+
+	const std::size_t capacity_;
+	const std::uint64_t id_;
+
+	mutable std::mutex rings_mutex_;
+	std::vector<std::shared_ptr<Ring>> rings_;
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "handler.h"
+
+// Maps request targets to the handler registered with the longest matching url prefix.
+// The url prefixes of the location blocks are compiled once at startup into an
+// immutable radix trie, so matching a target only walks the trie along the target,
+// costing O(target length) with no allocations, however many locations there are.
+class Router {
+   public:
+	// An empty router which matches nothing
+	Router();
+
+	// Compiles the url prefix to handler mappings. If a url prefix is
+	// registered more than once, the first mapping wins.
+	Router(const std::vector<std::pair<std::string, RequestHandler*>>& urlToHandler);
+
+	// Returns the handler with the longest url prefix matching the target, or nullptr
+	// if there is none. A url prefix only matches whole directory names, so "/foo"
+	// matches "/foo" and "/foo/bar" but not "/foo_continued", while "/" matches everything.
+	// If prefix is passed, it is set to the url prefix that matched.
+	RequestHandler* match(std::string_view target, std::string_view* prefix = nullptr) const;
+
+	// Returns the target without the characters after the first "?" that is after the last "/"
+	static std::string_view strip_query(std::string_view target);
+
+	// Number of url prefixes registered
+	std::size_t size() const;
+
+   private:
+	struct Node {
+		// Characters on the edge from the parent to this node
+		std::string label;
+
+		// Handler registered for the url prefix ending at this node, nullptr if none
+		RequestHandler* handler = nullptr;
+
+		// The url prefix ending at this node, if handler is set
+		std::string prefix;
+
+		// Indices of child nodes, sorted by the first character of their label
+		std::vector<std::pair<char, std::uint32_t>> children;
+	};
+
+	// Adds a url prefix to the trie, splitting edges as needed
+	void insert(const std::string& prefix, RequestHandler* handler);
+
+	// Returns the index of the child of node whose label starts with c, or 0 if there is none
+	std::uint32_t find_child(const Node& node, char c) const;
+
+	// Node 0 is the root, which is never a child
+	std::vector<Node> nodes_;
+	std::size_t size_;
+};
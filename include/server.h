@@ -5,6 +5,7 @@
 
 #include "config.h"
 #include "handler.h"
+#include "router.h"
 #include "session.h"
 
 // Adapted from the listener class from
@@ -20,6 +21,15 @@ class server : public std::enable_shared_from_this<server> {
 	// port number and request handlers can be extracted.
 	server(boost::asio::io_context& io_context, boost::asio::ssl::context& ctx, NginxConfig config);
 
+	// Same as above, but routes with an already compiled routing table instead of creating
+	// the handlers from the config. The routing table is shared, never copied, by every
+	// session the server creates.
+	// With reuse_port set, the acceptors are bound with SO_REUSEPORT so that several servers,
+	// each on its own io_context, can listen on the same ports and the kernel spreads
+	// incoming connections between them.
+	server(boost::asio::io_context& io_context, boost::asio::ssl::context& ctx, NginxConfig config,
+	       std::shared_ptr<const Router> router, bool reuse_port);
+
 	// Needs modification EVERYTIME a new handler is registered.
 	// Retuns a pointer to a newly constructed handler from the url prefix, handler name
 	// and the config sub-block attached to a location block.
@@ -29,9 +39,28 @@ class server : public std::enable_shared_from_this<server> {
 	// Creates all handlers from config, returns the mappings
 	static std::vector<std::pair<std::string, RequestHandler*>> create_all_handlers(NginxConfig config);
 
-	// starts a server and block until an exception occurs
+	// starts a server and block until an exception occurs or io_context is stopped.
+	// Runs "threads" worker threads from the config (hardware concurrency by default).
+	// With "reusePort 1", every worker thread gets its own io_context and its own
+	// SO_REUSEPORT acceptors instead of sharing io_context, and "pinThreads 1"
+	// additionally pins each worker thread to a CPU.
 	static void serve_forever(boost::asio::io_context* io_context, NginxConfig& config);
 
+	// Returns the number of worker threads to run as set in the config
+	static int get_thread_count(NginxConfig& config);
+
+	// Switches to asynchronous logging with "asyncLog 1". "logRingSize" records are buffered per
+	// thread, and with "logOverflow block" threads wait for room instead of dropping records.
+	// "logLevel" sets the lowest severity logged, trace by default.
+	static void configure_logging(NginxConfig& config);
+
+	// Sizes the heavy hitter trackers from "heavyHittersK", "heavyHittersWindow" in seconds,
+	// "heavyHittersWidth" and "heavyHittersCandidates"
+	static void configure_heavy_hitters(NginxConfig& config);
+
+	// Exports the statistics of the caches and the logger in the metrics registry
+	static void register_metrics();
+
 	// Registers the server closing function to be run as server received SIGINT to shutdown
 	static void register_server_sigint();
 
@@ -53,6 +82,13 @@ class server : public std::enable_shared_from_this<server> {
 	void handle_accept(boost::beast::error_code error, tcp::socket socket);
 	void handle_accept_https(boost::beast::error_code error, tcp::socket socket);
 
+	// Closes the oldest idle connections when maxConnections are open, before adding another one
+	void make_room();
+
+	// Closes idle connections when the process runs out of file descriptors, and accepts again
+	// once they are closed
+	void accept_later(bool https);
+
 	// Manage the event loop
 	boost::asio::io_context& io_context_;
 
@@ -62,6 +98,9 @@ class server : public std::enable_shared_from_this<server> {
 	// The config with tokens parsed from the file passed to the program
 	NginxConfig config_;
 
+	// Settings of every connection, read from the config once
+	ConnectionOptions connection_options_;
+
 	// HTTP Port the server is listening on
 	short unsigned port_;
 
@@ -73,8 +112,9 @@ class server : public std::enable_shared_from_this<server> {
 	tcp::acceptor acceptor_;
 	tcp::acceptor https_acceptor_;
 
-	// Maps url prefixes to handler pointers
-	std::vector<std::pair<std::string, RequestHandler*>> urlToHandler_;
+	// Immutable routing table from url prefixes to handler pointers,
+	// published once and pointed to by all sessions
+	std::shared_ptr<const Router> router_;
 };
 
 // Loads the certificates from the config into the SSL context
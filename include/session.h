@@ -4,18 +4,44 @@
 #include <boost/beast/http.hpp>
 #include <boost/beast/http/write.hpp>
 #include <boost/beast/ssl.hpp>
-#include <vector>
+#include <array>
 #include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
 
+#include "cannedResponse.h"
 #include "config.h"
 #include "handler.h"
+#include "router.h"
+#include "staticBody.h"
 
 using boost::asio::ip::tcp;
 namespace beast = boost::beast;
 namespace http = beast::http;
 
+// Settings of the connections of a server, read from its config once
+struct ConnectionOptions {
+	static ConnectionOptions from_config(NginxConfig &config);
+
+	// Responses to pipelined requests written together at most
+	std::size_t pipeline_depth = 16;
+
+	// Time to read a request, and to wait for the next one on a kept-alive connection
+	std::chrono::seconds request_timeout{30};
+	std::chrono::seconds keepalive_timeout{75};
+
+	// Requests answered on a connection before it is closed
+	std::size_t keepalive_requests = 1000;
+
+	// Open connections from which the oldest idle ones are closed for new ones, 0 for no limit
+	std::size_t max_connections = 0;
+};
+
 class session {
    public:
+	virtual ~session() = default;
+
 	// Assigns a strand to take care of this object's execution
 	// Should be called at thr start of the session for the session
 	// to take ownership of itself
@@ -24,19 +50,71 @@ class session {
 	// Given the request object, find the right handler and fills in the response
 	void construct_response(http::request<http::string_body> &req, http::response<http::string_body> &res);
 
-	// Runs first and before a read happens
+	// Same as above, but handlers that can stream their response body fill in static_res instead.
+	// Returns true if static_res was filled in, and false if res was.
+	bool construct_response(http::request<http::string_body> &req, http::response<http::string_body> &res, http::response<static_body> &static_res);
+
+	// Same as above, with the handler already found
+	bool construct_response(RequestHandler *handler, http::request<http::string_body> &req, http::response<http::string_body> &res, http::response<static_body> &static_res);
+
+	// Finds the handler registered for the request target, nullptr if there is none
+	RequestHandler *find_handler(http::request<http::string_body> &req);
+
+	// Lets the handler complete res_ for req_, and writes it once the handler is done.
+	// Synchronous handlers complete it before this returns.
+	void start_async_response(RequestHandler *handler);
+
+	// Runs first and before a read happens. Once a request was answered, waits for the next one with
+	// the idle timeout before reading it with the request timeout.
 	void do_read();
 
 	// Subclasses override http async_read based on their type of stream
 	virtual void async_read_stream() = 0;
 
+	// Same as above, but reads whatever arrives first into buffer_ and calls on_idle_read
+	virtual void async_read_some_stream() = 0;
+
+	// Runs once the next request begins to arrive on a kept-alive connection, or the wait ends
+	void on_idle_read(beast::error_code err, std::size_t bytes_transferred);
+
+	// Closes the connection if it is waiting for the next request, called on its strand
+	void close_idle();
+
+	// Whether the connection is kept open after the response of handler to req. Sets the idle
+	// timeout of the connection when it is.
+	bool keeps_alive(RequestHandler *handler, const http::request<http::string_body> &req);
+
+	// Number of connections open in the process
+	static std::size_t open_connections();
+
 	// Runs after the read has finished and before the write.
 	// Constructs the response from the request.
 	void on_read(beast::error_code err, std::size_t bytes_transferred);
 
+	// Finds the handler of req_ and has it answer, either writing the response or, if requests are
+	// pipelined behind req_, adding it to the responses written together
+	void handle_request();
+
+	// Writes res_, or static_res_ if is_static is set, and closes the connection afterwards
+	// if close is set or the response requires it
+	void write_response(bool is_static, bool close);
+
+	// Writes a canned response followed by the Date and Connection headers, and closes
+	// the connection afterwards if close is set
+	void write_canned_response(const CannedResponse &canned, bool close);
+
 	// Subclasses override http async_write based on their type of stream
 	virtual void async_write_stream(bool close) = 0;
 
+	// Same as above, but writes static_res_ instead of res_
+	virtual void async_write_static_stream(bool close) = 0;
+
+	// Same as above, but writes canned_buffers() with a single gather write
+	virtual void async_write_canned_stream(bool close) = 0;
+
+	// Same as above, but writes the responses of pipelined requests in pipeline_out_
+	virtual void async_write_pipeline_stream(bool close) = 0;
+
 	// Runs after the write is finished
 	// Clears the response and starts another read by calling do_read
 	void finished_write(bool close, beast::error_code err, std::size_t bytes_transferred);
@@ -48,23 +126,98 @@ class session {
 	virtual void set_expiration(std::chrono::seconds s) = 0;
 	virtual boost::beast::error_code shutdown_stream() = 0;
 
+	// Cancels the pending operations on the stream
+	virtual void cancel_stream() = 0;
+
+	// The executor of the stream, which asynchronous handlers run on
+	virtual boost::asio::any_io_executor get_executor() = 0;
+
+	// Keeps the session alive while an asynchronous handler works on its response
+	virtual std::shared_ptr<session> shared_session() = 0;
+
+	// Same as above, but empty once the session is being destroyed
+	virtual std::weak_ptr<session> weak_session() = 0;
+
+	// The canned response being written, with the Date and Connection headers in between
+	std::array<boost::asio::const_buffer, 3> canned_buffers() const;
+
+	// Reads the pipelined request following the one just answered out of buffer_ into req_, without
+	// reading from the stream. Returns false if the response closes the connection, pipeline_depth_
+	// responses are waiting to be written, or buffer_ does not hold a whole request.
+	bool read_pipelined(bool close);
+
+	// Adds the response serialized in pipeline_out_ to those written together, then answers the
+	// next request if it was read, or writes them all
+	void pipeline_response(bool next, bool close);
+
+	// Writes the responses in pipeline_out_ before a response that cannot be added to them, and
+	// returns false if there are none
+	enum class AfterPipeline { none, static_response, async_response };
+	bool flush_pipeline(AfterPipeline after);
+
+	// Count connections in the metrics registry, called by subclasses when they are created and destroyed
+	void count_connection_opened(bool https);
+	void count_connection_closed(bool https);
+
 	// Log metric name
 	std::string name;
 
+	// IP address of the client, set by log_ip_address
+	std::string client_ip_;
+
 	// Contains the entire server config
 	NginxConfig *config;
 
-	// Maps URLs to handler pointers
-	std::vector<std::pair<std::string, RequestHandler *>> urlToHandler;
+	// Maps URLs to handler pointers, shared with the server and all other sessions
+	std::shared_ptr<const Router> router;
 
 	// Request and response associated to this session
 	http::request<http::string_body> req_;
 	http::response<http::string_body> res_;
 
+	// Response streamed from a file, used instead of res_ when a handler fills it in
+	http::response<static_body> static_res_;
+
+	// Settings of the connection, from the server config
+	ConnectionOptions options_;
+
+	// Responses to pipelined requests serialized to be written together, how many there are, and
+	// what to write once they are written
+	std::string pipeline_out_;
+	std::size_t pipelined_ = 0;
+	AfterPipeline after_pipeline_ = AfterPipeline::none;
+
+	// Requests read on the connection, and how long to wait for the next one
+	std::size_t requests_ = 0;
+	std::chrono::seconds idle_timeout_{0};
+
+	// Whether the connection is waiting for the next request, and whether it was asked to close then
+	bool waiting_ = false;
+	bool evicted_ = false;
+
+	// Links into IdleConnections, guarded by its mutex
+	friend class IdleConnections;
+	bool idle_ = false;
+	session *idle_older_ = nullptr;
+	session *idle_newer_ = nullptr;
+
+	// Canned response being written, nullptr if there is none, and its Date and Connection headers.
+	// The headers are reused for every response so that their memory is only allocated once.
+	const CannedResponse *canned_res_ = nullptr;
+	std::string canned_fields_;
+
+	// Whether the canned response answers a HEAD request, and is written without its body
+	bool canned_head_only_ = false;
+
 	// Intermediate buffer used for async read and write into the
 	// request and response objects
 	beast::flat_buffer buffer_;
 
 	// Time point for when the session was created
 	std::chrono::steady_clock::time_point begin;
+
+	// Handler of the request being answered, nullptr if there is none,
+	// and the time point for when the request was read
+	RequestHandler *handler_ = nullptr;
+	std::chrono::steady_clock::time_point request_begin_;
 };
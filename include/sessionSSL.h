@@ -7,6 +7,7 @@
 
 #include "config.h"
 #include "handler.h"
+#include "router.h"
 #include "session.h"
 
 using boost::asio::ip::tcp;
@@ -20,7 +21,10 @@ namespace ssl = boost::asio::ssl;
 
 class sessionSSL : public session, public std::enable_shared_from_this<sessionSSL> {
    public:
-	sessionSSL(ssl::context &ctx, NginxConfig *c, std::vector<std::pair<std::string, RequestHandler *>> &utoh, tcp::socket &&socket);
+	sessionSSL(ssl::context &ctx, NginxConfig *c, const std::shared_ptr<const Router> &r, tcp::socket &&socket);
+
+	// Same as above, with the connection settings the server read from c once
+	sessionSSL(ssl::context &ctx, NginxConfig *c, const std::shared_ptr<const Router> &r, tcp::socket &&socket, const ConnectionOptions &options);
 
 	~sessionSSL();
 
@@ -39,12 +43,23 @@ class sessionSSL : public session, public std::enable_shared_from_this<sessionSS
 
 	// Provides async read and writes for SSL type streams
 	virtual void async_read_stream() override;
+	virtual void async_read_some_stream() override;
 	virtual void async_write_stream(bool close) override;
 
+	// Static bodies are read from the file in bounded chunks, then encrypted
+	virtual void async_write_static_stream(bool close) override;
+
+	virtual void async_write_canned_stream(bool close) override;
+	virtual void async_write_pipeline_stream(bool close) override;
+
    protected:
 	virtual void log_ip_address() override;
 	virtual void set_expiration(std::chrono::seconds s) override;
 	virtual boost::beast::error_code shutdown_stream() override;
+	virtual void cancel_stream() override;
+	virtual boost::asio::any_io_executor get_executor() override;
+	virtual std::shared_ptr<session> shared_session() override;
+	virtual std::weak_ptr<session> weak_session() override;
 
 	beast::ssl_stream<beast::tcp_stream> stream_;
 };
@@ -3,10 +3,12 @@
 #include <boost/asio.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/ssl.hpp>
+#include <boost/optional.hpp>
 #include <vector>
 
 #include "config.h"
 #include "handler.h"
+#include "router.h"
 #include "session.h"
 
 using boost::asio::ip::tcp;
@@ -21,7 +23,10 @@ class sessionTCP : public session, public std::enable_shared_from_this<sessionTC
    public:
 	// && means that socket was passed from a std::move, which means while no copies
 	// were created, the socket is no longer accessible from the server.
-	sessionTCP(NginxConfig *c, std::vector<std::pair<std::string, RequestHandler *>> &utoh, tcp::socket &&socket);
+	sessionTCP(NginxConfig *c, const std::shared_ptr<const Router> &r, tcp::socket &&socket);
+
+	// Same as above, with the connection settings the server read from c once
+	sessionTCP(NginxConfig *c, const std::shared_ptr<const Router> &r, tcp::socket &&socket, const ConnectionOptions &options);
 
 	// To log when sessions are being destroyed
 	~sessionTCP();
@@ -32,13 +37,41 @@ class sessionTCP : public session, public std::enable_shared_from_this<sessionTC
 	virtual void start() override;
 
 	virtual void async_read_stream() override;
+	virtual void async_read_some_stream() override;
 	virtual void async_write_stream(bool close) override;
 
+	// Writes the header of static_res_, then sends the body straight from the file with sendfile
+	virtual void async_write_static_stream(bool close) override;
+
+	virtual void async_write_canned_stream(bool close) override;
+	virtual void async_write_pipeline_stream(bool close) override;
+
    protected:
 	virtual void log_ip_address() override;
 	virtual void set_expiration(std::chrono::seconds s) override;
 	virtual boost::beast::error_code shutdown_stream() override;
+	virtual void cancel_stream() override;
+	virtual boost::asio::any_io_executor get_executor() override;
+	virtual std::shared_ptr<session> shared_session() override;
+	virtual std::weak_ptr<session> weak_session() override;
 
 	// Uses a simple TCP stream
 	beast::tcp_stream stream_;
+
+	// Runs after the header of a static response is written
+	void on_write_static_header(bool close, beast::error_code err, std::size_t bytes_transferred);
+
+	// Sends as much of the file as the socket takes, then waits for the socket
+	// to become writable again until the whole file is sent
+	void send_file(bool close, std::size_t bytes_transferred, beast::error_code err);
+
+	// Serializes the header of static_res_
+	boost::optional<http::response_serializer<static_body>> static_sr_;
+
+	// Offset of the next byte of the file to send
+	off_t file_offset_;
+
+	// Times out sends that wait too long for the socket to become writable,
+	// since these waits bypass the expiry of stream_
+	boost::asio::steady_timer send_timer_;
 };
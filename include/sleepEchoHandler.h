@@ -1,9 +1,9 @@
 #pragma once
 
+#include <boost/asio/any_io_executor.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
-#include <boost/chrono.hpp>
-#include <boost/thread/thread.hpp>
+#include <chrono>
 #include <string>
 
 #include "config.h"
@@ -11,10 +11,19 @@
 
 namespace http = boost::beast::http;
 
+// Echoes the request after a delay, without blocking the thread while waiting.
+// Synchronous callers of get_response are blocked for the delay instead.
 class SleepEchoHandler : public EchoHandler {
    public:
 	SleepEchoHandler(const std::string& url_prefix, const NginxConfig& config);
 
+	static constexpr std::chrono::milliseconds delay{3000};
+
+	virtual bool is_asynchronous() const override;
+
    protected:
+	// Sleeps for the delay, then echoes the request
 	virtual http::response<http::string_body> handle_request(const http::request<http::string_body>& request) override;
-};
\ No newline at end of file
+
+	virtual void handle_async_request(const http::request<http::string_body>& request, const boost::asio::any_io_executor& executor, ResponseHandler done) override;
+};
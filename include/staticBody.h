@@ -0,0 +1,89 @@
+#pragma once
+
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/optional.hpp>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+
+// A Beast body for static content that is streamed straight from a file instead of
+// being copied into a std::string first. Sessions on plain TCP streams send the file
+// with sendfile, other streams use the writer below which reads it in bounded chunks,
+// so memory used per response does not depend on the size of the file.
+// The body can also be an immutable buffer shared with the content cache, which is
+// written as is without being copied, or a generator producing the body piece by piece
+// while it is written, for responses sent with chunked encoding.
+struct static_body {
+	// Size of the chunks the file is read in, the largest TLS record
+	static constexpr std::size_t chunk_size = 16 * 1024;
+
+	// Replaces chunk with the next piece of the body, and returns false once it was the last piece
+	using generator_type = std::function<bool(std::string& chunk)>;
+
+	class value_type {
+	   public:
+		// Opens the file at path as the body, sets err on failure
+		void open(const char* path, beast::error_code& err);
+
+		// Returns true if a file is open
+		bool is_open() const;
+
+		// The open file, for sessions that send it directly
+		beast::file& file();
+
+		// Uses a shared buffer as the body instead of a file
+		void set_buffer(std::shared_ptr<const std::string> buffer);
+
+		// The shared buffer, or nullptr if the body is not a buffer
+		const std::shared_ptr<const std::string>& buffer() const;
+
+		// Generates the body while it is written instead. Its size is unknown, so the response
+		// has to be chunked instead of prepared with a Content-Length.
+		void set_generator(generator_type generator);
+
+		// The generator, or an empty function if the body is not generated
+		const generator_type& generator() const;
+
+		// Size of the body in bytes, 0 for generated bodies
+		std::uint64_t size() const;
+
+	   private:
+		beast::file file_;
+		std::shared_ptr<const std::string> buffer_;
+		generator_type generator_;
+		std::uint64_t size_ = 0;
+	};
+
+	// Used by prepare_payload to set the Content-Length
+	static std::uint64_t size(const value_type& body);
+
+	// Serializes the body in chunks, see the BodyWriter concept in the Beast docs
+	class writer {
+	   public:
+		using const_buffers_type = boost::asio::const_buffer;
+
+		template <bool isRequest, class Fields>
+		writer(__attribute__((unused)) const http::header<isRequest, Fields>& header, value_type& body)
+		    : body_(body) {
+		}
+
+		void init(beast::error_code& err);
+		boost::optional<std::pair<const_buffers_type, bool>> get(beast::error_code& err);
+
+	   private:
+		value_type& body_;
+		std::uint64_t remain_ = 0;
+		char buf_[chunk_size];
+
+		// The last piece of a generated body, and whether more follow
+		std::string chunk_;
+		bool more_ = false;
+	};
+};
@@ -2,18 +2,41 @@
 
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
+#include <cstdint>
 #include <string>
 #include <vector>
 
 #include "config.h"
 #include "handler.h"
+#include "requestHistory.h"
 
 namespace http = boost::beast::http;
 
+// Reports recent requests, per url and per handler summaries of them, registered handlers and
+// cache statistics. Takes ?format=json for a JSON page instead of HTML, ?limit=<n> for the number
+// of requests listed, and ?since=<microseconds since the epoch> to only list requests after that
+// time, or ?since=<next_since of a page> to list the requests after that page. The page is
+// streamed in chunks as it is written.
 class StatusHandler : public RequestHandler {
    public:
 	StatusHandler(const std::string& url_prefix, const NginxConfig& config);
 
+	// Requests listed when the request does not set a limit
+	static constexpr std::size_t default_limit = 100;
+
+	// Parameters of the page from the query string
+	struct Query {
+		bool json = false;
+		std::size_t limit = default_limit;
+		// No position to list the most recent requests
+		HistoryCursor since;
+	};
+
+	// Parses the query string of the target, returns false if it is invalid
+	static bool parse_query(const std::string& target, Query& query);
+
    protected:
 	virtual http::response<http::string_body> handle_request(const http::request<http::string_body>& request) override;
-};
\ No newline at end of file
+
+	virtual bool handle_static_request(const http::request<http::string_body>& request, http::response<static_body>& response) override;
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <openssl/ssl.h>
+
+#include <boost/asio/ssl/context.hpp>
+#include <chrono>
+#include <cstddef>
+
+#include "config.h"
+
+// Resumption of TLS sessions, so that clients connecting again skip the asymmetric crypto of a full
+// handshake. Sessions are kept in the session cache of the SSL context, which every thread serving
+// HTTPS shares, and in stateless session tickets. Tickets are encrypted with keys that are replaced
+// every rotation interval. Tickets of the previous key are still accepted, and replaced by new ones.
+class TlsResumption {
+   public:
+	struct Options {
+		// Sessions kept in the cache, 0 to keep none
+		std::size_t cache_size = 20480;
+
+		// Time a session can be resumed for, from the cache or from a ticket
+		std::chrono::seconds lifetime{300};
+
+		bool tickets = true;
+		std::chrono::seconds ticket_key_rotation{3600};
+
+		// Reads the options from the sslSessionCache, sslSessionTimeout, sslSessionTickets and
+		// sslTicketKeyRotation fields of the config
+		static Options from_config(NginxConfig &config);
+	};
+
+	// Enables the session cache and tickets on the server context, and exports its statistics
+	static void enable(boost::asio::ssl::context &ctx, const Options &options);
+
+	// Counts a finished handshake as full or resumed, or as failed if failed is set
+	static void count_handshake(SSL *ssl, bool failed);
+
+	// Replaces the ticket key right away, the current one becomes the previous one
+	static void rotate_ticket_keys();
+};
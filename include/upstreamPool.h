@@ -0,0 +1,77 @@
+#pragma once
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+
+// A pool of persistent HTTP/1.1 connections to one upstream server, used by ProxyRequestHandler.
+// Connections belong to the io_context they were opened on, so every io_context sending requests
+// through the pool has its own set of connections, and the limits below apply to each set.
+class UpstreamPool {
+   public:
+	struct Options {
+		// Idle connections kept open
+		std::size_t max_idle = 16;
+
+		// Open connections, active or idle. Further requests wait for a connection to be free.
+		std::size_t max_per_host = 64;
+
+		// Idle connections are closed after this long
+		std::chrono::seconds idle_timeout{60};
+
+		// Idle connections opened ahead of requests, once a request has been sent
+		std::size_t prewarm = 0;
+
+		// Connecting, writing a request and reading a response each fail after this long
+		std::chrono::seconds timeout{30};
+	};
+
+	// Called with the upstream response, or with an error if there is none
+	using Handler = std::function<void(beast::error_code, http::response<http::string_body>)>;
+
+	UpstreamPool(const std::string& host, const std::string& port, Options options);
+	~UpstreamPool();
+
+	// Sends the request over a pooled connection of the io_context running the executor, and calls
+	// done from the executor. Idempotent requests that fail on a reused connection, which the upstream
+	// server may have closed in the meantime, are retried once on another connection.
+	void async_send(http::request<http::string_body> request, const boost::asio::any_io_executor& executor, Handler done);
+
+	struct Stats {
+		// Requests sent over a reused connection
+		std::uint64_t hits;
+		// Requests that opened a new connection
+		std::uint64_t misses;
+		// Requests retried after failing on a reused connection
+		std::uint64_t retries;
+		// Idle connections found closed by the upstream server
+		std::uint64_t stale;
+		std::int64_t active;
+		std::int64_t idle;
+
+		// Fraction of requests sent over a reused connection, 0 without requests
+		double hit_rate() const;
+	};
+	Stats stats() const;
+
+	const std::string& host() const;
+	const std::string& port() const;
+
+	// Every pool that exists, for the status page
+	static std::vector<UpstreamPool*> all();
+
+	// Shared with the connections of the pool, which can outlive it until their io_context stops
+	struct State;
+
+   private:
+	std::shared_ptr<State> state_;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A stand-in for the upstream servers of ProxyRequestHandler, so that the proxy can be tested and
+// benchmarked on localhost. What it answers depends on the path of the request:
+//   /bytes/<n>       n bytes of text
+//   /html/<n>        an HTML page with n relative links, and as many protocol-relative ones
+//   /redirect/<n>    a 302 to /redirect/<n - 1> with a relative Location, /redirect/0 answers 200
+//   /absolute/<n>    a 301 to http://<Host>/redirect/<n - 1>, with an absolute Location
+//   /chunked/<n>     n bytes of text sent in chunks of 1KB
+//   /close/<n>       n bytes of text, then the connection is closed
+//   /status/<code>   an empty response with the status code
+//   /delay/<ms>      the default body after ms milliseconds, on top of the latency
+//   anything else    the default body, "upstream " followed by the target and padded to body_size
+// Every response is delayed by a latency drawn from the configured distribution.
+class UpstreamSimulator {
+   public:
+	enum class Distribution {
+		// Always the mean
+		constant,
+		// Between mean - spread and mean + spread
+		uniform,
+		// Exponential with the mean, plus up to spread of uniform jitter, has a long tail
+		exponential,
+	};
+
+	struct Options {
+		// Port to listen on, 0 for any free port
+		unsigned short port = 0;
+		std::size_t threads = 1;
+
+		Distribution distribution = Distribution::constant;
+		std::chrono::microseconds latency_mean{0};
+		std::chrono::microseconds latency_spread{0};
+
+		// Least size of the default body
+		std::size_t body_size = 0;
+
+		// Connections are closed after this many responses while announcing keep-alive, like servers
+		// dropping idle connections, 0 to keep them open
+		std::size_t close_after = 0;
+	};
+
+	explicit UpstreamSimulator(Options options);
+	UpstreamSimulator();
+	~UpstreamSimulator();
+
+	std::string port() const;
+
+	// Parses a distribution name, returns false if there is no such distribution
+	static bool parse_distribution(const std::string& name, Distribution& distribution);
+
+	std::atomic<std::uint64_t> connections{0};
+	std::atomic<std::uint64_t> requests{0};
+
+   private:
+	class Connection;
+
+	void accept();
+
+	// The latency of the next response
+	std::chrono::microseconds next_latency();
+
+	Options options_;
+	boost::asio::io_context ioc_;
+	boost::asio::ip::tcp::acceptor acceptor_;
+	std::vector<std::thread> threads_;
+
+	// Accessed from the threads serving connections
+	std::mutex random_mutex_;
+	std::mt19937 random_;
+};
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""Compares Google Benchmark JSON results of koko_bench with a stored baseline.
+
+Usage: bench_compare.py BASELINE.json CURRENT.json [--threshold 0.10] [--metric real_time]
+
+Benchmarks run with repetitions are compared by their median, others by their single run.
+Exits with 1 if any benchmark got slower than the baseline by more than the threshold.
+"""
+
+import argparse
+import json
+import sys
+
+# Nanoseconds per time unit of the results
+UNITS = {"ns": 1, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+# Aggregates used in place of single runs, most preferred first
+AGGREGATES = ["median", "mean"]
+
+
+def load(path, metric):
+    """Returns the context of the results and the time of every benchmark in nanoseconds."""
+    with open(path) as f:
+        results = json.load(f)
+
+    times = {}
+    ranks = {}
+    for run in results.get("benchmarks", []):
+        if run.get("error_occurred"):
+            continue
+        name = run.get("run_name", run["name"])
+        if run.get("run_type") == "aggregate":
+            aggregate = run.get("aggregate_name")
+            if aggregate not in AGGREGATES:
+                continue
+            rank = AGGREGATES.index(aggregate)
+        else:
+            rank = len(AGGREGATES)
+        # Keeps the most preferred aggregate, or the first single run
+        if name in ranks and ranks[name] <= rank:
+            continue
+        ranks[name] = rank
+        times[name] = run[metric] * UNITS[run.get("time_unit", "ns")]
+    return results.get("context", {}), times
+
+
+def format_time(ns):
+    for unit in ["s", "ms", "us"]:
+        if ns >= UNITS[unit]:
+            return "%.3g %s" % (ns / UNITS[unit], unit)
+    return "%.3g ns" % ns
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Flags koko_bench regressions against a baseline.")
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=0.10,
+                        help="relative slowdown flagged as a regression (default 0.10)")
+    parser.add_argument("--metric", choices=["real_time", "cpu_time"], default="real_time",
+                        help="time compared, real_time covers benchmarks waiting on I/O (default)")
+    args = parser.parse_args()
+
+    baseline_context, baseline = load(args.baseline, args.metric)
+    current_context, current = load(args.current, args.metric)
+
+    for key in ["library_build_type", "num_cpus", "host_name"]:
+        if baseline_context.get(key) != current_context.get(key):
+            print("warning: %s differs, baseline %s, current %s" % (key, baseline_context.get(key), current_context.get(key)))
+
+    regressions = []
+    width = max([len(name) for name in current] + [9])
+    print("%-*s %12s %12s %8s" % (width, "benchmark", "baseline", "current", "change"))
+    for name, time in current.items():
+        if name not in baseline:
+            print("%-*s %12s %12s %8s" % (width, name, "-", format_time(time), "new"))
+            continue
+        change = time / baseline[name] - 1 if baseline[name] > 0 else 0
+        flag = ""
+        if change > args.threshold:
+            flag = "  REGRESSION"
+            regressions.append(name)
+        print("%-*s %12s %12s %+7.1f%%%s" % (width, name, format_time(baseline[name]), format_time(time), change * 100, flag))
+    for name in baseline:
+        if name not in current:
+            print("%-*s %12s %12s %8s" % (width, name, format_time(baseline[name]), "-", "missing"))
+
+    if regressions:
+        print("\n%d benchmark(s) slower than the baseline by more than %.0f%%: %s" % (len(regressions), args.threshold * 100, ", ".join(regressions)))
+        return 1
+    print("\nno regressions over %.0f%%" % (args.threshold * 100))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
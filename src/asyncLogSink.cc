@@ -0,0 +1,220 @@
+#include "asyncLogSink.h"
+
+#include <boost/log/attributes/value_extraction.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/log/utility/formatting_ostream.hpp>
+
+#include "logger.h"
+
+// A single producer, single consumer queue of records. The logging thread owning the ring pushes,
+// and whoever holds the drain mutex of the sink pops.
+struct AsyncLogSink::Ring {
+	explicit Ring(std::size_t size) {
+		std::size_t capacity = 1;
+		while (capacity < size) {
+			capacity <<= 1;
+		}
+		slots.resize(capacity);
+		mask = capacity - 1;
+	}
+
+	// Returns false if the ring is full, leaving rec untouched
+	bool push(logging::record_view& rec) {
+		std::size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) > mask) {
+			return false;
+		}
+		slots[t & mask] = std::move(rec);
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Records waiting to be written
+	std::size_t size() const {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+
+	// Moves the records pushed so far to f, returns how many
+	template <class F>
+	std::size_t pop_all(F f) {
+		std::size_t h = head.load(std::memory_order_relaxed);
+		std::size_t t = tail.load(std::memory_order_acquire);
+		for (std::size_t i = h; i != t; i++) {
+			logging::record_view rec = std::move(slots[i & mask]);
+			f(rec);
+		}
+		head.store(t, std::memory_order_release);
+		return t - h;
+	}
+
+	std::vector<logging::record_view> slots;
+	std::size_t mask;
+	std::atomic<std::size_t> head{0};
+	std::atomic<std::size_t> tail{0};
+};
+
+// Tells sinks apart for the rings of a thread, even if one is created where another was freed
+static std::atomic<std::uint64_t> next_sink_id{1};
+
+AsyncLogSink::AsyncLogSink(Options options)
+    : sink(true),
+      options_(options),
+      id_(next_sink_id++),
+      filter_(nullptr),
+      wake_requested_(false),
+      stopped_(false),
+      dropped_(0),
+      reported_dropped_(0) {
+	set_filter(logging::filter());
+	writer_ = std::thread(&AsyncLogSink::writer_loop, this);
+}
+
+AsyncLogSink::~AsyncLogSink() {
+	stop();
+}
+
+void AsyncLogSink::add_output(logging::formatter format, Writer write, std::function<void()> flush) {
+	std::lock_guard<std::mutex> lock(drain_mutex_);
+	outputs_.push_back({std::move(format), std::move(write), std::move(flush)});
+}
+
+void AsyncLogSink::set_filter(logging::filter filter) {
+	std::lock_guard<std::mutex> lock(filter_mutex_);
+	filters_.push_back(std::make_unique<const logging::filter>(std::move(filter)));
+	filter_.store(filters_.back().get(), std::memory_order_release);
+}
+
+bool AsyncLogSink::will_consume(const logging::attribute_value_set& attributes) {
+	return (*filter_.load(std::memory_order_acquire))(attributes);
+}
+
+void AsyncLogSink::consume(const logging::record_view& rec) {
+	if (stopped_) {
+		dropped_++;
+		return;
+	}
+
+	bool is_fatal = logging::extract<severity_level>("Severity", rec) == fatal;
+	logging::record_view copy = rec;
+	Ring& ring = local_ring();
+	while (!ring.push(copy)) {
+		if (options_.overflow == Overflow::drop || stopped_) {
+			dropped_++;
+			return;
+		}
+		wake_writer();
+		std::this_thread::yield();
+	}
+
+	// Wake the writer early rather than letting the ring fill up
+	if (ring.size() > ring.slots.size() / 2) {
+		wake_writer();
+	}
+
+	// The process may be about to exit
+	if (is_fatal) {
+		flush();
+	}
+}
+
+void AsyncLogSink::flush() {
+	std::lock_guard<std::mutex> lock(drain_mutex_);
+	drain();
+}
+
+void AsyncLogSink::stop() {
+	if (stopped_.exchange(true)) {
+		return;
+	}
+	wake_writer();
+	writer_.join();
+}
+
+std::uint64_t AsyncLogSink::dropped() const {
+	return dropped_;
+}
+
+AsyncLogSink::Ring& AsyncLogSink::local_ring() {
+	// The rings of this thread, one for every sink it logged through
+	thread_local std::vector<std::pair<std::uint64_t, std::shared_ptr<Ring>>> local_rings;
+	for (auto& entry : local_rings) {
+		if (entry.first == id_) {
+			return *entry.second;
+		}
+	}
+
+	auto ring = std::make_shared<Ring>(options_.ring_size);
+	local_rings.emplace_back(id_, ring);
+	std::lock_guard<std::mutex> lock(rings_mutex_);
+	rings_.push_back(ring);
+	return *ring;
+}
+
+void AsyncLogSink::writer_loop() {
+	while (!stopped_) {
+		{
+			std::unique_lock<std::mutex> lock(wake_mutex_);
+			wake_.wait_for(lock, options_.flush_interval, [this]() { return wake_requested_ || stopped_; });
+			wake_requested_ = false;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(drain_mutex_);
+			drain();
+		}
+
+		// Logged without holding the drain mutex, the warning goes through the rings like any other record
+		std::uint64_t dropped = dropped_;
+		if (dropped != reported_dropped_) {
+			WARNING << "logger: dropped " << dropped - reported_dropped_ << " log records, " << dropped << " in total";
+			reported_dropped_ = dropped;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(drain_mutex_);
+	drain();
+}
+
+std::size_t AsyncLogSink::drain() {
+	std::vector<std::shared_ptr<Ring>> rings;
+	{
+		std::lock_guard<std::mutex> lock(rings_mutex_);
+		rings = rings_;
+	}
+
+	std::size_t written = 0;
+	logging::formatting_ostream stream(line_);
+	for (auto& ring : rings) {
+		written += ring->pop_all([&](const logging::record_view& rec) {
+			for (auto& output : outputs_) {
+				line_.clear();
+				output.format(rec, stream);
+				stream.flush();
+				output.write(rec, line_);
+			}
+		});
+	}
+
+	if (written > 0) {
+		for (auto& output : outputs_) {
+			output.flush();
+		}
+	}
+
+	// Forget the rings of threads that exited, once they are empty. Only this sink and
+	// the copy above hold those.
+	std::lock_guard<std::mutex> lock(rings_mutex_);
+	for (auto it = rings_.begin(); it != rings_.end();) {
+		if (it->use_count() <= 2 && (*it)->size() == 0) {
+			it = rings_.erase(it);
+		} else {
+			++it;
+		}
+	}
+	return written;
+}
+
+void AsyncLogSink::wake_writer() {
+	wake_requested_ = true;
+	wake_.notify_one();
+}
@@ -0,0 +1,29 @@
+#include "cannedResponse.h"
+
+#include <sstream>
+
+CannedResponse::CannedResponse(const http::response<http::string_body>& response)
+    : result_(response.result_int()) {
+	std::stringstream res_str;
+	res_str << response;
+	bytes_ = res_str.str();
+
+	// Split before the empty line ending the headers
+	head_size_ = bytes_.find("\r\n\r\n") + 2;
+}
+
+int CannedResponse::result_int() const {
+	return result_;
+}
+
+boost::asio::const_buffer CannedResponse::head() const {
+	return boost::asio::buffer(bytes_.data(), head_size_);
+}
+
+boost::asio::const_buffer CannedResponse::tail() const {
+	return boost::asio::buffer(bytes_.data() + head_size_, bytes_.size() - head_size_);
+}
+
+boost::asio::const_buffer CannedResponse::end_of_head() const {
+	return boost::asio::buffer(bytes_.data() + head_size_, 2);
+}
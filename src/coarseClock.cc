@@ -0,0 +1,145 @@
+#include "coarseClock.h"
+
+#include <boost/date_time/local_time_adjustor.hpp>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+typedef boost::date_time::local_adjustor<boost::posix_time::ptime, -8, boost::posix_time::us_dst> us_pacific;
+
+namespace {
+constexpr std::size_t date_words = sizeof(CoarseClock::Date::text) / sizeof(std::uint64_t);
+
+// Length of an RFC 7231 date
+constexpr std::size_t date_size = 29;
+
+const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+
+std::int64_t system_now_us() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+}  // namespace
+
+CoarseClock& CoarseClock::instance() {
+	// Leaked so that the clock can still be read while static objects are destroyed
+	static CoarseClock* clock = new CoarseClock();
+	return *clock;
+}
+
+CoarseClock::~CoarseClock() {
+	stop();
+}
+
+void CoarseClock::start(std::chrono::milliseconds interval) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (thread_.joinable()) {
+		return;
+	}
+
+	update();
+	stopping_ = false;
+	running_.store(true, std::memory_order_release);
+	thread_ = std::thread([this, interval]() {
+		std::unique_lock<std::mutex> lock(mutex_);
+		while (!stop_.wait_for(lock, interval, [this]() { return stopping_; })) {
+			update();
+		}
+	});
+}
+
+void CoarseClock::stop() {
+	std::thread thread;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		running_.store(false, std::memory_order_release);
+		stopping_ = true;
+		thread = std::move(thread_);
+	}
+	stop_.notify_all();
+	if (thread.joinable()) {
+		thread.join();
+	}
+}
+
+bool CoarseClock::running() const {
+	return running_.load(std::memory_order_acquire);
+}
+
+void CoarseClock::update() {
+	std::int64_t now = system_now_us();
+	now_us_.store(now, std::memory_order_release);
+
+	std::int64_t second = now / 1000000;
+	if (second == date_second_) {
+		return;
+	}
+	date_second_ = second;
+	local_offset_us_.store(local_offset_us(now), std::memory_order_relaxed);
+
+	Date date = format_date(now);
+	std::uint64_t seq = date_seq_.load(std::memory_order_relaxed);
+	date_seq_.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	for (std::size_t w = 0; w < date_words; w++) {
+		std::uint64_t word;
+		std::memcpy(&word, date.text + w * sizeof(word), sizeof(word));
+		date_words_[w].store(word, std::memory_order_relaxed);
+	}
+	date_seq_.store(seq + 2, std::memory_order_release);
+}
+
+std::int64_t CoarseClock::now_us() const {
+	if (!running()) {
+		return system_now_us();
+	}
+	return now_us_.load(std::memory_order_acquire);
+}
+
+boost::posix_time::ptime CoarseClock::local_time() const {
+	return to_local(now_us());
+}
+
+boost::posix_time::ptime CoarseClock::to_local(std::int64_t unix_us) const {
+	std::int64_t offset = running() ? local_offset_us_.load(std::memory_order_relaxed) : local_offset_us(unix_us);
+	return epoch + boost::posix_time::microseconds(unix_us + offset);
+}
+
+CoarseClock::Date CoarseClock::date() const {
+	if (!running()) {
+		return format_date(system_now_us());
+	}
+
+	Date date;
+	date.size = date_size;
+	while (true) {
+		std::uint64_t seq = date_seq_.load(std::memory_order_acquire);
+		for (std::size_t w = 0; w < date_words; w++) {
+			std::uint64_t word = date_words_[w].load(std::memory_order_relaxed);
+			std::memcpy(date.text + w * sizeof(word), &word, sizeof(word));
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		// Retry if the updating thread wrote the date meanwhile
+		if (seq % 2 == 0 && date_seq_.load(std::memory_order_relaxed) == seq) {
+			return date;
+		}
+	}
+}
+
+CoarseClock::Date CoarseClock::format_date(std::int64_t unix_us) {
+	std::time_t seconds = unix_us / 1000000;
+	std::tm utc;
+	gmtime_r(&seconds, &utc);
+
+	// Names are always English, whatever the locale
+	static const char* days[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+	static const char* months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+	Date date = {};
+	date.size = std::snprintf(date.text, sizeof(date.text), "%s, %02d %s %04d %02d:%02d:%02d GMT", days[utc.tm_wday], utc.tm_mday,
+	                          months[utc.tm_mon], utc.tm_year + 1900, utc.tm_hour, utc.tm_min, utc.tm_sec);
+	return date;
+}
+
+std::int64_t CoarseClock::local_offset_us(std::int64_t unix_us) {
+	boost::posix_time::ptime utc = epoch + boost::posix_time::seconds(unix_us / 1000000);
+	return (us_pacific::utc_to_local(utc) - utc).total_microseconds();
+}
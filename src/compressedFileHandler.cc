@@ -1,53 +1,214 @@
 #include "compressedFileHandler.h"
 
+#include <sys/stat.h>
+
+#include <exception>
+#include <functional>
+#include <string>
+
+#include "compressionCache.h"
+#include "metrics.h"
+
+const int CompressedFileHandler::compression_level = boost::iostreams::gzip::best_compression;
+
 CompressedFileHandler::CompressedFileHandler(const std::string& prefix, const NginxConfig& config)
     : FileHandler(prefix, config) {
 	name = "CompressedFileHandler";
 }
 
-std::string compress(const std::string& data) {
+std::string compress(const std::string& data, int level) {
 	namespace bio = boost::iostreams;
 
 	std::stringstream compressed;
 	std::stringstream origin(data);
 
 	bio::filtering_streambuf<bio::input> out;
-	out.push(bio::gzip_compressor(bio::gzip_params(bio::gzip::best_compression)));
+	out.push(bio::gzip_compressor(bio::gzip_params(level)));
 	out.push(origin);
 	bio::copy(out, compressed);
 
 	return compressed.str();
 }
 
-http::response<http::string_body> CompressedFileHandler::handle_request(const http::request<http::string_body>& request) {
-	http::response<http::string_body> res = FileHandler::handle_request(request);
+bool CompressedFileHandler::accepts_gzip(const http::request<http::string_body>& request) {
+	return accepts_encoding(request, "gzip");
+}
 
-	// Return uncompressed body if gzip is not accepted as a encoding
-	bool to_compress = false;
-	for (auto &h : request.base()) {
-		if (h.name_string() == "Accept-Encoding") {
-			if (h.value().find("gzip") != boost::beast::string_view::npos) {
-				to_compress = true;
-			}
-			break;
+bool CompressedFileHandler::compression_key(const fs::path& linux_path, CompressionKey& key) {
+	// A different modification time or size means the file changed since it was compressed
+	struct stat st;
+	if (stat(linux_path.c_str(), &st) != 0) {
+		ERROR << "compressedFileHandler: could not stat file: " << linux_path << ", errno: " << errno;
+		return false;
+	}
+
+	key.path = linux_path.string();
+	key.mtime_ns = (std::int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+	key.size = st.st_size;
+	key.encoding = "gzip";
+	key.level = compression_level;
+	return true;
+}
+
+std::function<std::string()> CompressedFileHandler::compressor(const std::string& target, const fs::path& linux_path) {
+	return [this, target, linux_path]() {
+		TRACE << "compressedFileHandler: compressing " << linux_path;
+		std::shared_ptr<const CachedFile> cached = find_cached_file(target);
+		if (cached) {
+			return compress(*cached->body, compression_level);
 		}
+		return compress(read_file(linux_path), compression_level);
+	};
+}
+
+std::shared_ptr<const std::string> CompressedFileHandler::compressed_body(const std::string& target, const fs::path& linux_path, std::uint64_t& size) {
+	CompressionKey key;
+	if (!compression_key(linux_path, key)) {
+		return nullptr;
 	}
-	if (!to_compress) {
-		TRACE << "compressedFileHandler: request does not accept gzip encoding, not compressing body";
+	size = key.size;
+	return CompressionCache::instance().get(key, compressor(target, linux_path));
+}
+
+http::response<http::string_body> CompressedFileHandler::compressed_response(bool head, const fs::path& linux_path, std::uint64_t size, const std::string& body) {
+	http::response<http::string_body> res;
+	res.version(11);  // HTTP/1.1
+	res.result(http::status::ok);
+	res.set(http::field::content_type, get_mime(linux_path.string()));
+	res.set(http::field::server, "koko.cs130.org");
+	res.set(http::field::content_encoding, "gzip");
+	res.set(http::field::vary, "Accept-Encoding");
+
+	// HEAD responses have the headers of GET responses, so the compressed length is needed too
+	if (head) {
+		res.content_length(body.size());
 		return res;
 	}
-	TRACE << "compressedFileHandler: request accepts gzip encoding, compressing body";
+	res.body() = body;
+	res.prepare_payload();
 
-	// Compress the body
-	std::string body = res.body();
-	int initial_len = body.size();
+	log_metrics(size, body.size());
+	return res;
+}
 
-	std::string compressedBody = compress(body);
-	res.body() = compressedBody;
-	res.set(http::field::content_encoding, "gzip");
-	res.set(http::field::content_length, compressedBody.size());
+bool CompressedFileHandler::handle_static_request(const http::request<http::string_body>& request, http::response<static_body>& response) {
+	if (!accepts_gzip(request)) {
+		return FileHandler::handle_static_request(request, response);
+	}
+	if (invalid_config || request.method() == http::verb::head) {
+		return false;
+	}
 
-	INFO << "metrics: compressedHandler reduced body size (bytes): " << (initial_len - compressedBody.size());
+	// Files compressed ahead of time need no compression at all
+	fs::path linux_path;
+	std::shared_ptr<const CachedFile> cached = find_cached_file(std::string(request.target()));
+	if (!cached && !find_file(std::string(request.target()), linux_path)) {
+		return false;
+	}
+	if (serve_precompressed(request, cached.get(), linux_path, response)) {
+		return true;
+	}
 
-	return res;
-}
\ No newline at end of file
+	// Files missing from the compression cache are compressed by handle_async_request
+	CompressionKey key;
+	if ((cached && !find_file(std::string(request.target()), linux_path)) || !compression_key(linux_path, key)) {
+		return false;
+	}
+	std::shared_ptr<const std::string> body = CompressionCache::instance().find(key);
+	if (!body) {
+		return false;
+	}
+
+	// The compressed body is shared with the cache instead of being copied
+	response.version(11);  // HTTP/1.1
+	response.result(http::status::ok);
+	response.set(http::field::content_type, get_mime(linux_path.string()));
+	response.set(http::field::server, "koko.cs130.org");
+	response.set(http::field::content_encoding, "gzip");
+	response.set(http::field::vary, "Accept-Encoding");
+	response.body().set_buffer(body);
+	response.prepare_payload();
+
+	log_metrics(key.size, body->size());
+	return true;
+}
+
+bool CompressedFileHandler::is_asynchronous() const {
+	return true;
+}
+
+void CompressedFileHandler::handle_async_request(const http::request<http::string_body>& request, const boost::asio::any_io_executor& executor, ResponseHandler done) {
+	fs::path linux_path;
+	fs::path sibling;
+	std::string encoding;
+	CompressionKey key;
+	std::string target(request.target());
+
+	// Only compressing waits on the compression threads, other responses are ready right away
+	if (invalid_config || !accepts_gzip(request) || !find_file(target, linux_path) ||
+	    find_precompressed_sibling(request, linux_path, sibling, encoding) || !compression_key(linux_path, key)) {
+		done(handle_request(request));
+		return;
+	}
+
+	// Completed from the executor of the session once the compression threads are done
+	bool head = request.method() == http::verb::head;
+	auto compressed = [this, head, linux_path, size = key.size, done = std::move(done)](std::shared_ptr<const std::string> body, std::exception_ptr failure) {
+		if (failure) {
+			try {
+				std::rethrow_exception(failure);
+			} catch (std::exception& e) {
+				ERROR << "compressedFileHandler: could not compress " << linux_path << ": " << e.what();
+			} catch (...) {
+				ERROR << "compressedFileHandler: could not compress " << linux_path;
+			}
+			done(RequestHandler::internal_server_error());
+			return;
+		}
+		done(compressed_response(head, linux_path, size, *body));
+	};
+	CompressionCache::instance().async_get(key, compressor(target, linux_path), executor, std::move(compressed));
+}
+
+http::response<http::string_body> CompressedFileHandler::handle_request(const http::request<http::string_body>& request) {
+	// Return uncompressed body if gzip is not accepted as a encoding
+	if (invalid_config || !accepts_gzip(request)) {
+		TRACE << "compressedFileHandler: request does not accept gzip encoding, not compressing body";
+		return FileHandler::handle_request(request);
+	}
+
+	fs::path linux_path;
+	std::string target(request.target());
+	if (!find_file(target, linux_path)) {
+		return not_found_error();
+	}
+
+	fs::path sibling;
+	std::string encoding;
+	if (find_precompressed_sibling(request, linux_path, sibling, encoding)) {
+		TRACE << "compressedFileHandler: serving precompressed file " << sibling;
+		return FileHandler::handle_request(request);
+	}
+	TRACE << "compressedFileHandler: request accepts gzip encoding, compressing body";
+
+	std::uint64_t size;
+	std::shared_ptr<const std::string> body = compressed_body(target, linux_path, size);
+	if (!body) {
+		return internal_server_error();
+	}
+	return compressed_response(request.method() == http::verb::head, linux_path, size, *body);
+}
+
+void CompressedFileHandler::log_metrics(std::uint64_t size, std::uint64_t compressed_size) {
+	INFO << "metrics: compressedHandler reduced body size (bytes): " << ((std::int64_t)size - (std::int64_t)compressed_size);
+	static Counter& saved_bytes = MetricsRegistry::instance().counter("koko_compression_saved_bytes_total", "Bytes saved by compressing response bodies");
+	static Counter& compressed_responses = MetricsRegistry::instance().counter("koko_compressed_responses_total", "Responses compressed by CompressedFileHandler");
+	compressed_responses.inc();
+	if (compressed_size < size) {
+		saved_bytes.inc(size - compressed_size);
+	}
+
+	CompressionCache::Stats stats = CompressionCache::instance().stats();
+	INFO << "metrics: compressedHandler cache hit ratio: " << stats.hit_ratio();
+	INFO << "metrics: compressedHandler cpu time saved (ms): " << stats.cpu_saved_ns / 1000000;
+}
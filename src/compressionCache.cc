@@ -0,0 +1,224 @@
+#include "compressionCache.h"
+
+#include <time.h>
+
+#include <boost/asio/post.hpp>
+#include <exception>
+#include <future>
+#include <string>
+#include <utility>
+
+#include "logger.h"
+
+// CPU time used by the calling thread
+static std::uint64_t thread_cpu_ns() {
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (std::uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+std::string CompressionKey::variant() const {
+	return path + "\n" + encoding + "\n" + std::to_string(level);
+}
+
+std::string CompressionKey::str() const {
+	return variant() + "\n" + std::to_string(mtime_ns) + "\n" + std::to_string(size);
+}
+
+const std::size_t CompressionCache::compression_threads = 2;
+
+double CompressionCache::Stats::hit_ratio() const {
+	std::uint64_t lookups = hits + misses + coalesced;
+	return lookups == 0 ? 0 : (double)hits / lookups;
+}
+
+CompressionCache::CompressionCache(std::size_t capacity)
+    : capacity_(capacity),
+      bytes_(0),
+      hits_(0),
+      misses_(0),
+      coalesced_(0),
+      cpu_saved_ns_(0) {
+}
+
+CompressionCache::~CompressionCache() {
+	if (pool_) {
+		pool_->join();
+	}
+}
+
+CompressionCache& CompressionCache::instance() {
+	// Never destroyed, worker threads may still be serving files while the process exits
+	static CompressionCache* cache = new CompressionCache();
+	return *cache;
+}
+
+void CompressionCache::set_capacity(std::size_t capacity) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	capacity_ = capacity;
+	while (bytes_ > capacity_ && !lru_.empty()) {
+		erase(std::prev(lru_.end()));
+	}
+	TRACE << "compression cache: capacity set to (bytes): " << capacity_;
+}
+
+bool CompressionCache::enabled() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return capacity_ > 0;
+}
+
+std::shared_ptr<const std::string> CompressionCache::find(const CompressionKey& key) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return lookup(key.str());
+}
+
+std::shared_ptr<const std::string> CompressionCache::lookup(const std::string& k) {
+	auto it = entries_.find(k);
+	if (it == entries_.end()) {
+		return nullptr;
+	}
+
+	// Move the entry to the front of the LRU list
+	lru_.splice(lru_.begin(), lru_, it->second);
+	hits_++;
+	cpu_saved_ns_ += it->second->compressed.cpu_ns;
+	return it->second->compressed.body;
+}
+
+void CompressionCache::async_get(const CompressionKey& key, std::function<std::string()> compress, const boost::asio::any_io_executor& executor, Handler done) {
+	std::string k = key.str();
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		std::shared_ptr<const std::string> body = lookup(k);
+		if (body) {
+			lock.unlock();
+			complete({executor, std::move(done)}, std::move(body), nullptr);
+			return;
+		}
+
+		auto flight = in_flight_.find(k);
+		if (flight != in_flight_.end()) {
+			// Another request is compressing the file already, wait for it
+			if (capacity_ > 0) {
+				coalesced_++;
+			}
+			flight->second.push_back({executor, std::move(done)});
+			return;
+		}
+
+		if (capacity_ > 0) {
+			misses_++;
+		}
+		in_flight_[k].push_back({executor, std::move(done)});
+	}
+
+	run_on_pool([this, key, compress = std::move(compress)]() { compress_entry(key, compress); });
+}
+
+void CompressionCache::compress_entry(const CompressionKey& key, const std::function<std::string()>& compress) {
+	Compressed compressed;
+	std::exception_ptr error;
+	try {
+		std::uint64_t start = thread_cpu_ns();
+		compressed.body = std::make_shared<const std::string>(compress());
+		compressed.cpu_ns = thread_cpu_ns() - start;
+	} catch (...) {
+		error = std::current_exception();
+	}
+
+	std::vector<Waiter> waiters;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto flight = in_flight_.find(key.str());
+		waiters = std::move(flight->second);
+		in_flight_.erase(flight);
+		if (!error && capacity_ > 0) {
+			insert(key, compressed);
+		}
+	}
+
+	// The first waiter is the request that missed, the others would have compressed the file too
+	if (!error && waiters.size() > 1) {
+		cpu_saved_ns_ += compressed.cpu_ns * (waiters.size() - 1);
+	}
+	for (Waiter& waiter : waiters) {
+		complete(std::move(waiter), compressed.body, error);
+	}
+}
+
+void CompressionCache::complete(Waiter waiter, std::shared_ptr<const std::string> body, std::exception_ptr error) {
+	if (!waiter.executor) {
+		waiter.done(std::move(body), error);
+		return;
+	}
+	boost::asio::post(waiter.executor, [body = std::move(body), error, done = std::move(waiter.done)]() { done(body, error); });
+}
+
+void CompressionCache::run_on_pool(std::function<void()> work) {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!pool_) {
+			pool_ = std::make_unique<boost::asio::thread_pool>(compression_threads);
+		}
+	}
+	boost::asio::post(*pool_, std::move(work));
+}
+
+std::shared_ptr<const std::string> CompressionCache::get(const CompressionKey& key, const std::function<std::string()>& compress) {
+	std::promise<std::shared_ptr<const std::string>> promise;
+	std::future<std::shared_ptr<const std::string>> future = promise.get_future();
+
+	// Without an executor, the promise is set on the thread that compressed the body
+	async_get(key, [&compress]() { return compress(); }, boost::asio::any_io_executor(), [&promise](std::shared_ptr<const std::string> body, std::exception_ptr error) {
+		if (error) {
+			promise.set_exception(error);
+			return;
+		}
+		promise.set_value(std::move(body));
+	});
+	return future.get();
+}
+
+void CompressionCache::insert(const CompressionKey& key, const Compressed& compressed) {
+	std::size_t size = compressed.body->size();
+	if (size > capacity_) {
+		return;
+	}
+
+	// Drop older versions of the file
+	std::string variant = key.variant();
+	auto old = key_by_variant_.find(variant);
+	if (old != key_by_variant_.end()) {
+		auto it = entries_.find(old->second);
+		if (it != entries_.end()) {
+			erase(it->second);
+		}
+	}
+
+	while (bytes_ + size > capacity_ && !lru_.empty()) {
+		erase(std::prev(lru_.end()));
+	}
+
+	std::string k = key.str();
+	lru_.push_front({k, variant, compressed});
+	entries_[k] = lru_.begin();
+	key_by_variant_[variant] = k;
+	bytes_ += size;
+	TRACE << "compression cache: cached " << key.encoding << " body of " << key.path;
+}
+
+void CompressionCache::erase(std::list<Entry>::iterator it) {
+	auto variant = key_by_variant_.find(it->variant);
+	if (variant != key_by_variant_.end() && variant->second == it->key) {
+		key_by_variant_.erase(variant);
+	}
+
+	bytes_ -= it->compressed.body->size();
+	entries_.erase(it->key);
+	lru_.erase(it);
+}
+
+CompressionCache::Stats CompressionCache::stats() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return Stats{hits_, misses_, coalesced_, entries_.size(), bytes_, capacity_, cpu_saved_ns_};
+}
@@ -14,7 +14,7 @@
 
 using boost::optional;
 
-std::unordered_map<std::string, short> NginxConfig::default_nums = {{"port", 80}, {"threads", 4}, {"httpsPort", 443}, {"keep-alive", 0}};
+std::unordered_map<std::string, short> NginxConfig::default_nums = {{"port", 80}, {"threads", 0}, {"httpsPort", 443}, {"keep-alive", 1}, {"reusePort", 0}, {"pinThreads", 0}, {"contentCacheMB", 0}, {"compressionCacheMB", 0}, {"asyncLog", 0}, {"logRingSize", 4096}, {"heavyHittersK", 10}, {"heavyHittersWindow", 60}, {"heavyHittersWidth", 1024}, {"heavyHittersCandidates", 64}, {"pipelineDepth", 16}, {"keepalive_timeout", 75}, {"keepalive_requests", 1000}, {"maxConnections", 0}, {"sslSessionCache", 20480}, {"sslSessionTimeout", 300}, {"sslSessionTickets", 1}, {"sslTicketKeyRotation", 3600}};
 
 NginxConfig::NginxConfig() {
 }
@@ -0,0 +1,388 @@
+#include "contentCache.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "logger.h"
+
+FrequencySketch::FrequencySketch(std::size_t width)
+    : additions_(0) {
+	std::size_t size = 1;
+	while (size < width) {
+		size <<= 1;
+	}
+	mask_ = size - 1;
+	table_.assign(rows * size, 0);
+
+	// Age the counters after this many increments
+	sample_size_ = 10 * size;
+}
+
+std::size_t FrequencySketch::index(std::size_t hash, int row) const {
+	// Double hashing gives every row an independent looking index
+	std::uint64_t h = hash * 0x9E3779B97F4A7C15ULL;
+	std::uint64_t step = (h >> 32) | 1;
+	return row * (mask_ + 1) + ((hash + row * step) & mask_);
+}
+
+void FrequencySketch::increment(std::size_t hash) {
+	for (int row = 0; row < rows; row++) {
+		std::uint8_t& counter = table_[index(hash, row)];
+		if (counter < max_count) {
+			counter++;
+		}
+	}
+
+	if (++additions_ >= sample_size_) {
+		age();
+	}
+}
+
+int FrequencySketch::estimate(std::size_t hash) const {
+	int count = max_count;
+	for (int row = 0; row < rows; row++) {
+		count = std::min<int>(count, table_[index(hash, row)]);
+	}
+	return count;
+}
+
+void FrequencySketch::age() {
+	for (auto& counter : table_) {
+		counter >>= 1;
+	}
+	additions_ /= 2;
+}
+
+// Paths whose changes make the cached file stale: its own and those of its possible siblings
+static std::vector<std::string> watched_paths(const CachedFile& file) {
+	std::vector<std::string> paths{file.path};
+	for (const auto& extension : file.sibling_extensions) {
+		paths.push_back(file.path + extension);
+	}
+	return paths;
+}
+
+ContentCache::ContentCache(std::size_t capacity)
+    : capacity_(capacity),
+      bytes_(0),
+      sketch_(16 * 1024),
+      generation_(0),
+      hits_(0),
+      misses_(0),
+      rejected_(0),
+      invalidations_(0),
+      inotify_fd_(-1),
+      stop_fd_(-1) {
+}
+
+ContentCache::~ContentCache() {
+	if (watcher_.joinable()) {
+		std::uint64_t one = 1;
+		if (write(stop_fd_, &one, sizeof(one)) == sizeof(one)) {
+			watcher_.join();
+		} else {
+			watcher_.detach();
+		}
+	}
+	if (inotify_fd_ >= 0) {
+		close(inotify_fd_);
+	}
+	if (stop_fd_ >= 0) {
+		close(stop_fd_);
+	}
+}
+
+ContentCache& ContentCache::instance() {
+	// Never destroyed, worker threads may still be serving files while the process exits
+	static ContentCache* cache = new ContentCache();
+	return *cache;
+}
+
+void ContentCache::set_capacity(std::size_t capacity) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	capacity_ = capacity;
+	while (bytes_ > capacity_ && !lru_.empty()) {
+		erase(std::prev(lru_.end()));
+	}
+	TRACE << "content cache: capacity set to (bytes): " << capacity_;
+}
+
+std::size_t ContentCache::capacity() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return capacity_;
+}
+
+bool ContentCache::enabled() {
+	return capacity() > 0;
+}
+
+std::size_t ContentCache::max_file_size() {
+	// A single file may not take more than an eighth of the cache
+	return capacity() / 8;
+}
+
+std::shared_ptr<const CachedFile> ContentCache::lookup(const std::string& key) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	sketch_.increment(std::hash<std::string>{}(key));
+
+	auto it = entries_.find(key);
+	if (it == entries_.end()) {
+		misses_++;
+		return nullptr;
+	}
+
+	// Move the entry to the front of the LRU list
+	lru_.splice(lru_.begin(), lru_, it->second);
+	hits_++;
+	return it->second->file;
+}
+
+std::shared_ptr<const CachedFile> ContentCache::load(const std::string& key, const fs::path& path, const std::string& mime,
+                                                     const std::vector<std::string>& sibling_extensions) {
+	boost::system::error_code err;
+	fs::path canonical = fs::canonical(path, err);
+	if (err) {
+		ERROR << "content cache: could not resolve path: " << path << ", error: " << err.message();
+		return nullptr;
+	}
+
+	std::uintmax_t size = fs::file_size(canonical, err);
+	if (err || size > max_file_size()) {
+		return nullptr;
+	}
+
+	// Watch before reading, so that changes made while reading are not missed
+	std::uint64_t generation;
+	bool watching;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		generation = generation_;
+		watching = watch(canonical.parent_path().string());
+	}
+
+	std::ifstream in(canonical.c_str(), std::ios::binary);
+	if (!in) {
+		return nullptr;
+	}
+	auto body = std::make_shared<std::string>();
+	body->reserve(size);
+	body->assign((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+	auto file = std::make_shared<CachedFile>();
+	file->path = canonical.string();
+	file->mime = mime;
+	file->body = std::move(body);
+
+	// Siblings older than the file are out of date. They are in the watched directory, so
+	// siblings changing or appearing from now on invalidate the entry.
+	file->sibling_extensions = sibling_extensions;
+	std::time_t modified = fs::last_write_time(canonical, err);
+	for (const auto& extension : sibling_extensions) {
+		fs::path sibling = file->path + extension;
+		if (!err && fs::is_regular_file(sibling, err) && fs::last_write_time(sibling, err) >= modified && !err) {
+			file->siblings.push_back(extension);
+		}
+		err.clear();
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (watching && generation == generation_ && file->body->size() <= capacity_ / 8) {
+		admit(key, file);
+	}
+	return file;
+}
+
+void ContentCache::admit(const std::string& key, std::shared_ptr<const CachedFile> file) {
+	auto existing = entries_.find(key);
+	if (existing != entries_.end()) {
+		erase(existing->second);
+	}
+
+	std::size_t size = file->body->size();
+	if (bytes_ + size > capacity_ && !lru_.empty()) {
+		// Only admit the file if it is more popular than the entry it would evict first
+		const std::string& victim = lru_.back().key;
+		std::hash<std::string> hash;
+		if (sketch_.estimate(hash(key)) <= sketch_.estimate(hash(victim))) {
+			TRACE << "content cache: not admitting " << file->path;
+			rejected_++;
+			return;
+		}
+	}
+
+	while (bytes_ + size > capacity_ && !lru_.empty()) {
+		erase(std::prev(lru_.end()));
+	}
+
+	lru_.push_front({key, file});
+	entries_[key] = lru_.begin();
+	for (const auto& path : watched_paths(*file)) {
+		keys_by_path_[path].push_back(key);
+	}
+	bytes_ += size;
+	TRACE << "content cache: cached " << file->path << " under key " << key;
+}
+
+void ContentCache::erase(std::list<Entry>::iterator it) {
+	for (const auto& path : watched_paths(*it->file)) {
+		auto keys = keys_by_path_.find(path);
+		if (keys != keys_by_path_.end()) {
+			auto& list = keys->second;
+			list.erase(std::remove(list.begin(), list.end(), it->key), list.end());
+			if (list.empty()) {
+				keys_by_path_.erase(keys);
+			}
+		}
+	}
+
+	bytes_ -= it->file->body->size();
+	entries_.erase(it->key);
+	lru_.erase(it);
+}
+
+void ContentCache::invalidate(const std::string& path) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	generation_++;
+
+	auto keys = keys_by_path_.find(path);
+	if (keys == keys_by_path_.end()) {
+		return;
+	}
+
+	// Copy the keys, erase() modifies the list
+	std::vector<std::string> to_erase = keys->second;
+	for (const auto& key : to_erase) {
+		auto it = entries_.find(key);
+		if (it != entries_.end()) {
+			erase(it->second);
+			invalidations_++;
+		}
+	}
+	TRACE << "content cache: invalidated " << path;
+}
+
+void ContentCache::invalidate_directory(const std::string& dir) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	generation_++;
+
+	std::string prefix = dir + "/";
+	for (auto it = lru_.begin(); it != lru_.end();) {
+		auto next = std::next(it);
+		if (it->file->path.compare(0, prefix.size(), prefix) == 0) {
+			erase(it);
+			invalidations_++;
+		}
+		it = next;
+	}
+	TRACE << "content cache: invalidated directory " << dir;
+}
+
+void ContentCache::clear() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	generation_++;
+	lru_.clear();
+	entries_.clear();
+	keys_by_path_.clear();
+	bytes_ = 0;
+}
+
+ContentCache::Stats ContentCache::stats() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return Stats{hits_, misses_, rejected_, invalidations_, entries_.size(), bytes_, capacity_};
+}
+
+bool ContentCache::watch(const std::string& dir) {
+	if (watch_by_dir_.count(dir) > 0) {
+		return true;
+	}
+
+	if (inotify_fd_ < 0) {
+		inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		stop_fd_ = eventfd(0, EFD_CLOEXEC);
+		if (inotify_fd_ < 0 || stop_fd_ < 0) {
+			ERROR << "content cache: could not initialize inotify, errno: " << errno;
+			return false;
+		}
+		watcher_ = std::thread(&ContentCache::watch_loop, this);
+	}
+
+	int wd = inotify_add_watch(inotify_fd_, dir.c_str(),
+	                           IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+	if (wd < 0) {
+		ERROR << "content cache: could not watch directory: " << dir << ", errno: " << errno;
+		return false;
+	}
+
+	dir_by_watch_[wd] = dir;
+	watch_by_dir_[dir] = wd;
+	TRACE << "content cache: watching directory " << dir;
+	return true;
+}
+
+void ContentCache::watch_loop() {
+	alignas(inotify_event) char buf[4096];
+	pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+
+	while (true) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			ERROR << "content cache: poll failed, errno: " << errno;
+			return;
+		}
+		if (fds[1].revents & POLLIN) {
+			return;
+		}
+
+		ssize_t len = read(inotify_fd_, buf, sizeof(buf));
+		if (len <= 0) {
+			continue;
+		}
+
+		for (char* p = buf; p < buf + len;) {
+			inotify_event* event = reinterpret_cast<inotify_event*>(p);
+			p += sizeof(inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				// Events were lost, nothing in the cache can be trusted
+				clear();
+				continue;
+			}
+
+			std::string dir;
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				auto it = dir_by_watch_.find(event->wd);
+				if (it == dir_by_watch_.end()) {
+					continue;
+				}
+				dir = it->second;
+
+				if (event->mask & IN_IGNORED) {
+					// The watch was removed along with the directory
+					watch_by_dir_.erase(dir);
+					dir_by_watch_.erase(it);
+				}
+			}
+
+			if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+				invalidate_directory(dir);
+			} else if (event->len > 0) {
+				invalidate(dir + "/" + event->name);
+			}
+		}
+	}
+}
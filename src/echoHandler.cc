@@ -8,10 +8,9 @@
 
 namespace http = boost::beast::http;
 
-EchoHandler::EchoHandler(const std::string& p, const NginxConfig& config)
+EchoHandler::EchoHandler(const std::string& p, __attribute__((unused)) const NginxConfig& config)
     : url_prefix(p) {
 	name = "Echo";
-	set_keep_alive_from_config(config);
 }
 
 http::response<http::string_body> EchoHandler::handle_request(const http::request<http::string_body>& request) {
@@ -20,11 +19,42 @@ http::response<http::string_body> EchoHandler::handle_request(const http::reques
 	res.result(http::status::ok);
 	res.set(http::field::content_type, "text/plain");
 	res.set(http::field::server, "koko.cs130.org");
-	res.body() = to_string(request);
+	append_request(request, res.body());
 	res.prepare_payload();
 	return res;
 }
 
+void EchoHandler::append_request(const http::request<http::string_body>& request, std::string& body) {
+	if (request.chunked()) {
+		body += to_string(request);
+		return;
+	}
+
+	// Request line, "\r\n" after every field and after the header, then the body
+	std::size_t size = request.method_string().size() + request.target().size() + sizeof(" HTTP/1.1\r\n") + 2 + request.body().size();
+	for (const auto& field : request) {
+		size += field.name_string().size() + 2 + field.value().size() + 2;
+	}
+	body.reserve(body.size() + size);
+
+	body.append(request.method_string().data(), request.method_string().size());
+	body += ' ';
+	body.append(request.target().data(), request.target().size());
+	body += " HTTP/";
+	body += char('0' + request.version() / 10);
+	body += '.';
+	body += char('0' + request.version() % 10);
+	body += "\r\n";
+	for (const auto& field : request) {
+		body.append(field.name_string().data(), field.name_string().size());
+		body += ": ";
+		body.append(field.value().data(), field.value().size());
+		body += "\r\n";
+	}
+	body += "\r\n";
+	body += request.body();
+}
+
 std::string EchoHandler::get_url_prefix() {
 	return url_prefix;
 }
\ No newline at end of file
@@ -1,10 +1,17 @@
 #include "fileHandler.h"
 
+#include <algorithm>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/filesystem.hpp>
+#include <cstdlib>
+#include <ctime>
+#include <iterator>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include "contentCache.h"
 #include "logger.h"
 
 namespace http = boost::beast::http;
@@ -26,18 +33,9 @@ FileHandler::FileHandler(const std::string& prefix, const NginxConfig& config)
 		FATAL << "exception occurred : " << e.what();
 		invalid_config = true;
 	}
-
-	set_keep_alive_from_config(config);
 }
 
-http::response<http::string_body> FileHandler::handle_request(const http::request<http::string_body>& request) {
-	std::string target(request.target());
-	fs::path linux_path;
-
-	if (invalid_config) {
-		return RequestHandler::internal_server_error();
-	}
-
+bool FileHandler::find_file(std::string target, fs::path& linux_path) {
 	// Ignore trailing slashes
 	if (target.size() > 0 && target[target.size() - 1] == '/') {
 		target.erase(target.size() - 1);
@@ -47,28 +45,264 @@ http::response<http::string_body> FileHandler::handle_request(const http::reques
 	// Check that linux_dir exists
 	if (!fs::exists(linux_dir)) {
 		TRACE << "file handler serving on non-existant linux path: " << linux_dir;
-		return not_found_error();
+		return false;
 	}
 
 	if (!fs::is_directory(linux_dir)) {
 		// If linux_dir is a file actually, ignore the rest of the url
 		TRACE << "file handler registered with a file directly: " << linux_dir;
 		linux_path = linux_dir;
+		return true;
+	}
+
+	// Construct the file path from the url
+	TRACE << "file handler registered with a directory: " << linux_dir;
+
+	fs::path filepath(target.substr(url_prefix.size()));
+	linux_path = linux_dir / filepath;
+
+	// Check if file exists
+	if (!fs::exists(linux_path) || fs::is_directory(linux_path)) {
+		ERROR << "file handler could not find path: " << linux_path;
+		return false;
+	}
+	return true;
+}
+
+// Content codings of precompressed sibling files and their extensions, most preferred first
+static const std::pair<const char*, const char*> precompressed_encodings[] = {{"br", ".br"}, {"zstd", ".zst"}, {"gzip", ".gz"}};
+
+// Extensions of the precompressed siblings the content cache looks for
+static const std::vector<std::string> precompressed_extensions = []() {
+	std::vector<std::string> extensions;
+	for (const auto& precompressed : precompressed_encodings) {
+		extensions.push_back(precompressed.second);
+	}
+	return extensions;
+}();
+
+std::shared_ptr<const CachedFile> FileHandler::find_cached_file(std::string target) {
+	ContentCache& cache = ContentCache::instance();
+	if (invalid_config || !cache.enabled()) {
+		return nullptr;
+	}
+
+	// Ignore trailing slashes
+	if (target.size() > 0 && target[target.size() - 1] == '/') {
+		target.erase(target.size() - 1);
+	}
+
+	// The same target can map to different files under different handlers
+	std::string key = linux_dir.string() + "\n" + target;
+	std::shared_ptr<const CachedFile> file = cache.lookup(key);
+	if (file) {
+		return file;
+	}
+
+	fs::path linux_path;
+	if (!find_file(target, linux_path)) {
+		return nullptr;
+	}
+	return cache.load(key, linux_path, get_mime(linux_path.string()), precompressed_extensions);
+}
+
+bool FileHandler::find_cached_sibling(const http::request<http::string_body>& request, const CachedFile& cached, fs::path& sibling, std::string& encoding) {
+	for (const auto& precompressed : precompressed_encodings) {
+		if (std::find(cached.siblings.begin(), cached.siblings.end(), precompressed.second) != cached.siblings.end() &&
+		    accepts_encoding(request, precompressed.first)) {
+			sibling = cached.path + precompressed.second;
+			encoding = precompressed.first;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool FileHandler::accepts_encoding(const http::request<http::string_body>& request, const std::string& encoding) {
+	std::string header(request[http::field::accept_encoding]);
+	double explicit_q = -1;
+	double any_q = -1;
+
+	// Codings are separated by commas, each with an optional ";q=" weight
+	size_t start = 0;
+	while (start < header.size()) {
+		size_t end = header.find(',', start);
+		if (end == std::string::npos) {
+			end = header.size();
+		}
+		std::string item = header.substr(start, end - start);
+		start = end + 1;
+
+		double q = 1;
+		size_t semicolon = item.find(';');
+		if (semicolon != std::string::npos) {
+			size_t q_pos = item.find("q=", semicolon);
+			if (q_pos != std::string::npos) {
+				q = std::strtod(item.c_str() + q_pos + 2, nullptr);
+			}
+			item.erase(semicolon);
+		}
+
+		// Trim whitespace around the coding
+		size_t first = item.find_first_not_of(" \t");
+		size_t last = item.find_last_not_of(" \t");
+		if (first == std::string::npos) {
+			continue;
+		}
+		item = item.substr(first, last - first + 1);
+
+		if (boost::beast::iequals(item, encoding)) {
+			explicit_q = q;
+		} else if (item == "*") {
+			any_q = q;
+		}
+	}
+
+	return explicit_q >= 0 ? explicit_q > 0 : any_q > 0;
+}
+
+bool FileHandler::find_precompressed_sibling(const http::request<http::string_body>& request, const fs::path& linux_path, fs::path& sibling, std::string& encoding) {
+	if (invalid_config) {
+		return false;
+	}
+
+	// Avoid looking at the disk when the client accepts none of the encodings
+	bool any_accepted = false;
+	for (const auto& precompressed : precompressed_encodings) {
+		any_accepted = any_accepted || accepts_encoding(request, precompressed.first);
+	}
+	if (!any_accepted) {
+		return false;
+	}
+
+	boost::system::error_code err;
+	std::time_t modified = fs::last_write_time(linux_path, err);
+	if (err) {
+		return false;
+	}
+
+	for (const auto& precompressed : precompressed_encodings) {
+		if (!accepts_encoding(request, precompressed.first)) {
+			continue;
+		}
+
+		// Siblings older than the file are out of date
+		fs::path candidate = linux_path.string() + precompressed.second;
+		if (fs::is_regular_file(candidate, err) && fs::last_write_time(candidate, err) >= modified && !err) {
+			TRACE << "file handler found precompressed file: " << candidate;
+			sibling = candidate;
+			encoding = precompressed.first;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool FileHandler::serve_precompressed(const http::request<http::string_body>& request, const CachedFile* cached, const fs::path& linux_path,
+                                      http::response<static_body>& res) {
+	fs::path sibling;
+	std::string encoding;
+	std::string mime;
+	if (request.method() == http::verb::head) {
+		return false;
+	}
+	if (cached) {
+		if (!find_cached_sibling(request, *cached, sibling, encoding)) {
+			return false;
+		}
+		mime = cached->mime;
 	} else {
-		// Construct the file path from the url
-		TRACE << "file handler registered with a directory: " << linux_dir;
+		if (!find_precompressed_sibling(request, linux_path, sibling, encoding)) {
+			return false;
+		}
+		mime = get_mime(linux_path.string());
+	}
+
+	beast::error_code err;
+	res.body().open(sibling.c_str(), err);
+	if (err) {
+		ERROR << "file handler could not open file: " << sibling << ", error: " << err.message();
+		return false;
+	}
+
+	res.version(11);  // HTTP/1.1
+	res.result(http::status::ok);
+	res.set(http::field::server, "koko.cs130.org");
+	res.set(http::field::content_type, mime);
+	res.set(http::field::content_encoding, encoding);
+	res.set(http::field::vary, "Accept-Encoding");
+	res.prepare_payload();
+	return true;
+}
+
+const CannedResponse* FileHandler::handle_canned_request(__attribute__((unused)) const http::request<http::string_body>& request) {
+	return invalid_config ? &RequestHandler::canned_internal_server_error() : nullptr;
+}
+
+http::response<http::string_body> FileHandler::handle_request(const http::request<http::string_body>& request) {
+	fs::path linux_path;
+	fs::path sibling;
+	std::string encoding;
+
+	if (invalid_config) {
+		return RequestHandler::internal_server_error();
+	}
+
+	http::response<http::string_body> res;
+	res.version(11);  // HTTP/1.1
+	res.result(http::status::ok);
+	res.set(http::field::server, "koko.cs130.org");
+	// Precompressed siblings make the response depend on Accept-Encoding, even when it is the file itself
+	res.set(http::field::vary, "Accept-Encoding");
 
-		fs::path filepath(target.substr(url_prefix.size()));
-		linux_path = linux_dir / filepath;
+	// The content cache knows the precompressed siblings of its files, so these need no disk lookup
+	std::shared_ptr<const CachedFile> cached;
+	if (request.method() != http::verb::head) {
+		cached = find_cached_file(std::string(request.target()));
+	}
+
+	if (cached && !find_cached_sibling(request, *cached, sibling, encoding)) {
+		// Copying from the content cache is still cheaper than reading the file
+		res.set(http::field::content_type, cached->mime);
+		res.body() = *cached->body;
+		res.prepare_payload();
+		return res;
+	}
 
-		// Check if file exists
-		if (!fs::exists(linux_path) || fs::is_directory(linux_path)) {
-			ERROR << "file handler could not find path: " << linux_path;
+	// Serve the precompressed sibling in place of the file, if there is one
+	if (cached) {
+		res.set(http::field::content_type, cached->mime);
+		res.set(http::field::content_encoding, encoding);
+		linux_path = sibling;
+	} else {
+		if (!find_file(std::string(request.target()), linux_path)) {
 			return not_found_error();
 		}
+		res.set(http::field::content_type, get_mime(linux_path.string()));
+		if (find_precompressed_sibling(request, linux_path, sibling, encoding)) {
+			res.set(http::field::content_encoding, encoding);
+			linux_path = sibling;
+		}
 	}
 
-	http::response<http::string_body> res;
+	if (request.method() == http::verb::head) {
+		// Only the size of the file is needed
+		boost::system::error_code err;
+		std::uintmax_t size = fs::file_size(linux_path, err);
+		if (err) {
+			ERROR << "file handler could not get size of file: " << linux_path << ", error: " << err.message();
+			return internal_server_error();
+		}
+		res.content_length(size);
+		return res;
+	}
+
+	res.body() = read_file(linux_path);
+	res.prepare_payload();
+	return res;
+}
+
+std::string FileHandler::read_file(const fs::path& linux_path) {
 	std::ifstream file(linux_path.c_str());
 	std::string filebody;
 
@@ -79,14 +313,48 @@ http::response<http::string_body> FileHandler::handle_request(const http::reques
 
 	// Load the file in a string
 	filebody.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	return filebody;
+}
+
+bool FileHandler::handle_static_request(const http::request<http::string_body>& request, http::response<static_body>& res) {
+	fs::path linux_path;
+
+	if (invalid_config || request.method() == http::verb::head) {
+		return false;
+	}
+
+	// The content cache knows the precompressed siblings of its files, so these need no disk lookup
+	std::shared_ptr<const CachedFile> cached = find_cached_file(std::string(request.target()));
+	if (!cached && !find_file(std::string(request.target()), linux_path)) {
+		return false;
+	}
+	if (serve_precompressed(request, cached.get(), linux_path, res)) {
+		return true;
+	}
 
 	res.version(11);  // HTTP/1.1
 	res.result(http::status::ok);
-	res.set(http::field::content_type, get_mime(linux_path.string()));
 	res.set(http::field::server, "koko.cs130.org");
-	res.body() = filebody;
+	res.set(http::field::vary, "Accept-Encoding");
+
+	// Serve small files from memory, shared with other responses
+	if (cached) {
+		res.set(http::field::content_type, cached->mime);
+		res.body().set_buffer(cached->body);
+		res.prepare_payload();
+		return true;
+	}
+
+	beast::error_code err;
+	res.body().open(linux_path.c_str(), err);
+	if (err) {
+		ERROR << "file handler could not open file: " << linux_path << ", error: " << err.message();
+		return false;
+	}
+
+	res.set(http::field::content_type, get_mime(linux_path.string()));
 	res.prepare_payload();
-	return res;
+	return true;
 }
 
 std::string getExtension(std::string filename) {
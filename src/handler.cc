@@ -2,18 +2,14 @@
 
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
-#include <boost/date_time/local_time_adjustor.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <algorithm>
 #include <string>
+#include <string_view>
 
-namespace http = boost::beast::http;
-typedef boost::date_time::local_adjustor<boost::posix_time::ptime, -8, boost::posix_time::us_dst> us_pacific;
+#include "heavyHitters.h"
 
-URLInfo::URLInfo(std::string u, int c, boost::posix_time::ptime t)
-    : url(u),
-      res_code(c),
-      req_time(t) {
-}
+namespace http = boost::beast::http;
 
 std::string RequestHandler::to_string(http::response<http::string_body> res) {
 	std::stringstream res_str;
@@ -27,59 +23,180 @@ std::string RequestHandler::to_string(http::request<http::string_body> req) {
 	return req_str.str();
 }
 
-http::response<http::string_body> RequestHandler::bad_request() {
+namespace {
+const char* bad_request_body = "Request was malformed.\n";
+const char* not_found_body = "The requested resource was not found.\n";
+const char* internal_server_error_body = "An internal error occurred on the server. Utsav will be fired promptly.\n";
+
+// A plain text error, without the Connection header
+http::response<http::string_body> error_response(http::status status, const char* body) {
 	http::response<http::string_body> res;
 	res.version(11);
-	res.result(http::status::bad_request);
+	res.result(status);
 	res.set(http::field::server, "koko.cs130.org");
 	res.set(http::field::content_type, "text/plain");
-	res.body() = "Request was malformed.\n";
-	res.set(http::field::connection, "close");
+	res.body() = body;
 	res.prepare_payload();
 	return res;
 }
 
-http::response<http::string_body> RequestHandler::not_found_error() {
-	http::response<http::string_body> res;
-	res.version(11);
-	res.result(http::status::not_found);
-	res.set(http::field::server, "koko.cs130.org");
-	res.set(http::field::content_type, "text/plain");
-	res.body() = "The requested resource was not found.\n";
+// Errors returned by handlers close the connection, unless the session sets it to keep-alive
+http::response<http::string_body> closing_error_response(http::status status, const char* body) {
+	http::response<http::string_body> res = error_response(status, body);
 	res.set(http::field::connection, "close");
-	res.prepare_payload();
 	return res;
 }
+}  // namespace
+
+// Errors are built once and copied, the copies are leaked so that handlers can still use them while static objects are destroyed
+http::response<http::string_body> RequestHandler::bad_request() {
+	static const http::response<http::string_body>* res = new http::response<http::string_body>(closing_error_response(http::status::bad_request, bad_request_body));
+	return *res;
+}
+
+http::response<http::string_body> RequestHandler::not_found_error() {
+	static const http::response<http::string_body>* res = new http::response<http::string_body>(closing_error_response(http::status::not_found, not_found_body));
+	return *res;
+}
 
 http::response<http::string_body> RequestHandler::internal_server_error() {
-	http::response<http::string_body> res;
-	res.version(11);
-	res.result(http::status::internal_server_error);
-	res.set(http::field::server, "koko.cs130.org");
-	res.set(http::field::content_type, "text/plain");
-	res.body() = "An internal error occurred on the server. Utsav will be fired promptly.\n";
-	res.set(http::field::connection, "close");
-	res.prepare_payload();
-	return res;
+	static const http::response<http::string_body>* res =
+	    new http::response<http::string_body>(closing_error_response(http::status::internal_server_error, internal_server_error_body));
+	return *res;
+}
+
+const CannedResponse& RequestHandler::canned_bad_request() {
+	static const CannedResponse* canned = new CannedResponse(error_response(http::status::bad_request, bad_request_body));
+	return *canned;
+}
+
+const CannedResponse& RequestHandler::canned_not_found_error() {
+	static const CannedResponse* canned = new CannedResponse(error_response(http::status::not_found, not_found_body));
+	return *canned;
+}
+
+const CannedResponse& RequestHandler::canned_internal_server_error() {
+	static const CannedResponse* canned = new CannedResponse(error_response(http::status::internal_server_error, internal_server_error_body));
+	return *canned;
 }
 
 http::response<http::string_body> RequestHandler::get_response(const http::request<http::string_body>& request) {
 	http::response<http::string_body> response = handle_request(request);
+	record_url_info(request, response.result_int());
+	return response;
+}
 
-	//record url to response code pair
-	boost::posix_time::ptime timeServerUTC = boost::posix_time::second_clock::universal_time();
-	boost::posix_time::ptime timeCal = us_pacific::utc_to_local(timeServerUTC);
-	RequestHandler::url_info.emplace_back(request.target().to_string(), response.result_int(), timeCal);
+bool RequestHandler::get_static_response(const http::request<http::string_body>& request, http::response<static_body>& response) {
+	if (!handle_static_request(request, response)) {
+		return false;
+	}
+	record_url_info(request, response.result_int());
+	return true;
+}
 
-	return response;
+const CannedResponse* RequestHandler::get_canned_response(const http::request<http::string_body>& request) {
+	const CannedResponse* canned = handle_canned_request(request);
+	if (canned != nullptr) {
+		record_url_info(request, canned->result_int());
+	}
+	return canned;
+}
+
+void RequestHandler::get_async_response(const http::request<http::string_body>& request, const boost::asio::any_io_executor& executor, ResponseHandler done) {
+	std::string target = request.target().to_string();
+	handle_async_request(request, executor, [this, target, done = std::move(done)](http::response<http::string_body> response) {
+		record_url_info(target, response.result_int());
+		done(std::move(response));
+	});
+}
+
+bool RequestHandler::handle_static_request(__attribute__((unused)) const http::request<http::string_body>& request,
+                                           __attribute__((unused)) http::response<static_body>& response) {
+	return false;
+}
+
+const CannedResponse* RequestHandler::handle_canned_request(__attribute__((unused)) const http::request<http::string_body>& request) {
+	return nullptr;
+}
+
+void RequestHandler::handle_async_request(const http::request<http::string_body>& request,
+                                          __attribute__((unused)) const boost::asio::any_io_executor& executor,
+                                          ResponseHandler done) {
+	done(handle_request(request));
 }
 
-std::vector<URLInfo> RequestHandler::url_info;
+bool RequestHandler::query_parameter(const std::string& target, const std::string& key, std::string& value) {
+	size_t query = target.find('?');
+	if (query == std::string::npos) {
+		return false;
+	}
 
-std::string RequestHandler::get_name() {
+	std::string prefix = key + "=";
+	for (size_t start = target.find(prefix, query); start != std::string::npos; start = target.find(prefix, start + 1)) {
+		if (target[start - 1] == '?' || target[start - 1] == '&') {
+			start += prefix.size();
+			value = target.substr(start, target.find('&', start) - start);
+			return true;
+		}
+	}
+	return false;
+}
+
+void RequestHandler::record_url_info(const http::request<http::string_body>& request, int res_code) {
+	record_url_info(std::string_view(request.target().data(), request.target().size()), res_code);
+}
+
+void RequestHandler::record_url_info(std::string_view target, int res_code) {
+	metrics().requests[status_class_index(res_code)]->inc();
+	RequestHistory::instance().record(target, name, res_code);
+	HotKeys::paths().add(target.substr(0, target.find('?')));
+	HotKeys::handlers().add(name);
+}
+
+void RequestHandler::record_latency(std::chrono::steady_clock::duration duration) {
+	metrics().latency->observe(std::chrono::duration<double>(duration).count());
+}
+
+RequestHandler::Metrics& RequestHandler::metrics() {
+	std::call_once(metrics_once_, [this]() {
+		MetricsRegistry& registry = MetricsRegistry::instance();
+		for (std::size_t i = 0; i < status_class_count; i++) {
+			metrics_.requests[i] = &registry.counter("koko_handler_requests_total", "Requests handled, by handler and response status class",
+			                                         {{"handler", name}, {"code", status_class_name(i)}});
+		}
+		metrics_.latency = &registry.histogram("koko_request_duration_seconds", "Time from reading a request to writing its response, by handler",
+		                                       {{"handler", name}});
+	});
+	return metrics_;
+}
+
+const std::string& RequestHandler::get_name() const {
 	return name;
 }
 
-void RequestHandler::set_keep_alive_from_config(const NginxConfig& conf){
-	keep_alive = const_cast<NginxConfig&>(conf).get_num("keep-alive");
+bool RequestHandler::is_asynchronous() const {
+	return false;
+}
+
+// Whether the block has a statement for field, without logging the fields it leaves out
+static bool has_field(const NginxConfig& conf, const char* field) {
+	for (const auto& statement : conf.statements_) {
+		if (!statement->tokens_.empty() && statement->tokens_[0] == field) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void RequestHandler::set_keep_alive_from_config(const NginxConfig& conf) {
+	NginxConfig& config = const_cast<NginxConfig&>(conf);
+	if (has_field(conf, "keep-alive")) {
+		keep_alive = config.get_num("keep-alive");
+	}
+	if (has_field(conf, "keepalive_timeout")) {
+		keepalive_timeout = std::max(config.get_num("keepalive_timeout"), 0);
+	}
+	if (has_field(conf, "keepalive_requests")) {
+		keepalive_requests = std::max(config.get_num("keepalive_requests"), 0);
+	}
 }
\ No newline at end of file
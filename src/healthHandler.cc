@@ -13,7 +13,7 @@ HealthHandler::HealthHandler(__attribute__((unused)) const std::string& url_pref
 	name = "Health";
 }
 
-http::response<http::string_body> HealthHandler::handle_request(__attribute__((unused)) const http::request<http::string_body>& request) {
+http::response<http::string_body> HealthHandler::ok() {
 	http::response<http::string_body> res;
 	res.version(11);
 	res.result(http::status::ok);
@@ -22,4 +22,14 @@ http::response<http::string_body> HealthHandler::handle_request(__attribute__((u
 	res.body() = "OK";
 	res.prepare_payload();
 	return res;
+}
+
+http::response<http::string_body> HealthHandler::handle_request(__attribute__((unused)) const http::request<http::string_body>& request) {
+	return ok();
+}
+
+const CannedResponse* HealthHandler::handle_canned_request(__attribute__((unused)) const http::request<http::string_body>& request) {
+	// Leaked so that health checks can still be answered while static objects are destroyed
+	static const CannedResponse* canned = new CannedResponse(ok());
+	return canned;
 }
\ No newline at end of file
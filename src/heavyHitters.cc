@@ -0,0 +1,272 @@
+#include "heavyHitters.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+
+#include "logger.h"
+
+namespace {
+constexpr std::size_t key_words = (HeavyHitters::max_key_length + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+// Slots looked at for a key in the candidate table
+constexpr std::size_t probes = 4;
+
+// A candidate key. Readers check that the key they copied hashes to the hash of the slot, since
+// a writer may be replacing the key meanwhile.
+struct Slot {
+	// 0 if the slot is empty
+	std::atomic<std::uint64_t> hash{0};
+	std::atomic<std::uint64_t> estimate{0};
+	std::atomic<std::uint32_t> length{0};
+	std::atomic<std::uint64_t> key[key_words];
+};
+
+std::uint64_t mix(std::uint64_t x) {
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+// FNV-1a, never 0 so that 0 marks empty slots
+std::uint64_t hash_key(std::string_view key) {
+	std::uint64_t h = 0xcbf29ce484222325ULL;
+	for (char c : key) {
+		h = (h ^ (unsigned char)c) * 0x100000001b3ULL;
+	}
+	h = mix(h);
+	return h ? h : 1;
+}
+}  // namespace
+
+struct HeavyHitters::SubWindow {
+	explicit SubWindow(const Options& options)
+	    : counters(new std::atomic<std::uint64_t>[options.width * options.depth]()),
+	      slots(new Slot[options.candidates]) {
+	}
+
+	void clear(const Options& options) {
+		for (std::size_t i = 0; i < options.width * options.depth; i++) {
+			counters[i].store(0, std::memory_order_relaxed);
+		}
+		for (std::size_t i = 0; i < options.candidates; i++) {
+			slots[i].hash.store(0, std::memory_order_relaxed);
+			slots[i].estimate.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	// Counter of the key in a row of the sketch
+	std::atomic<std::uint64_t>& counter(const Options& options, std::uint64_t hash, std::size_t row) const {
+		return counters[row * options.width + mix(hash + row * 0x9e3779b97f4a7c15ULL) % options.width];
+	}
+
+	// Smallest counter of the key
+	std::uint64_t estimate(const Options& options, std::uint64_t hash) const {
+		std::uint64_t estimate = std::numeric_limits<std::uint64_t>::max();
+		for (std::size_t row = 0; row < options.depth; row++) {
+			estimate = std::min(estimate, counter(options, hash, row).load(std::memory_order_relaxed));
+		}
+		return estimate;
+	}
+
+	// Number of the sub-window of the window this holds, -1 before it is first used
+	std::atomic<std::int64_t> epoch{-1};
+	std::unique_ptr<std::atomic<std::uint64_t>[]> counters;
+	std::unique_ptr<Slot[]> slots;
+};
+
+// Raises options that are too small to work
+static HeavyHitters::Options usable(HeavyHitters::Options options) {
+	options.k = std::max<std::size_t>(options.k, 1);
+	options.candidates = std::max(options.candidates, options.k);
+	options.width = std::max<std::size_t>(options.width, 1);
+	options.depth = std::max<std::size_t>(options.depth, 1);
+	options.sub_windows = std::max<std::size_t>(options.sub_windows, 1);
+	// Sub-windows are at least a second long
+	options.window = std::max(options.window, std::chrono::seconds(options.sub_windows));
+	return options;
+}
+
+HeavyHitters::HeavyHitters(Options options)
+    : options_(usable(options)) {
+	for (std::size_t i = 0; i < options_.sub_windows; i++) {
+		sub_windows_.push_back(std::make_unique<SubWindow>(options_));
+	}
+}
+
+HeavyHitters::~HeavyHitters() = default;
+
+std::int64_t HeavyHitters::epoch(clock::time_point now) const {
+	auto sub_window = options_.window / (std::int64_t)options_.sub_windows;
+	return now.time_since_epoch() / sub_window;
+}
+
+HeavyHitters::SubWindow& HeavyHitters::current(clock::time_point now) {
+	std::int64_t e = epoch(now);
+	SubWindow& sub_window = *sub_windows_[e % options_.sub_windows];
+	std::int64_t seen = sub_window.epoch.load(std::memory_order_acquire);
+	// The thread moving the sub-window on clears it. Keys other threads add while it does may be lost,
+	// which only makes the first moment of a sub-window undercount.
+	if (seen < e && sub_window.epoch.compare_exchange_strong(seen, e, std::memory_order_acq_rel)) {
+		sub_window.clear(options_);
+	}
+	return sub_window;
+}
+
+void HeavyHitters::add(std::string_view key) {
+	add(key, clock::now());
+}
+
+void HeavyHitters::add(std::string_view key, clock::time_point now) {
+	key = key.substr(0, max_key_length);
+	std::uint64_t hash = hash_key(key);
+	SubWindow& sub_window = current(now);
+
+	std::uint64_t estimate = std::numeric_limits<std::uint64_t>::max();
+	for (std::size_t row = 0; row < options_.depth; row++) {
+		estimate = std::min(estimate, sub_window.counter(options_, hash, row).fetch_add(1, std::memory_order_relaxed) + 1);
+	}
+
+	// Update the key if it is a candidate, or else take the slot of the smallest candidate it beats
+	Slot* smallest = nullptr;
+	std::uint64_t smallest_hash = 0;
+	std::uint64_t smallest_estimate = std::numeric_limits<std::uint64_t>::max();
+	for (std::size_t p = 0; p < std::min(probes, options_.candidates); p++) {
+		Slot& slot = sub_window.slots[(hash + p) % options_.candidates];
+		std::uint64_t slot_hash = slot.hash.load(std::memory_order_acquire);
+		if (slot_hash == hash) {
+			std::uint64_t current = slot.estimate.load(std::memory_order_relaxed);
+			while (current < estimate && !slot.estimate.compare_exchange_weak(current, estimate, std::memory_order_relaxed)) {
+			}
+			return;
+		}
+
+		std::uint64_t slot_estimate = slot_hash ? slot.estimate.load(std::memory_order_relaxed) : 0;
+		if (slot_estimate < smallest_estimate) {
+			smallest = &slot;
+			smallest_hash = slot_hash;
+			smallest_estimate = slot_estimate;
+		}
+	}
+
+	if (smallest == nullptr || (smallest_hash != 0 && estimate <= smallest_estimate)) {
+		return;
+	}
+	if (!smallest->hash.compare_exchange_strong(smallest_hash, hash, std::memory_order_acq_rel)) {
+		// Another thread took the slot first
+		return;
+	}
+	for (std::size_t w = 0; w * sizeof(std::uint64_t) < key.size(); w++) {
+		std::uint64_t word = 0;
+		std::memcpy(&word, key.data() + w * sizeof(word), std::min(sizeof(word), key.size() - w * sizeof(word)));
+		smallest->key[w].store(word, std::memory_order_relaxed);
+	}
+	smallest->length.store(key.size(), std::memory_order_relaxed);
+	smallest->estimate.store(estimate, std::memory_order_release);
+}
+
+std::vector<HeavyHitters::Entry> HeavyHitters::top() const {
+	return top(clock::now());
+}
+
+std::vector<HeavyHitters::Entry> HeavyHitters::top(clock::time_point now) const {
+	// Sub-windows still in the window
+	std::int64_t e = epoch(now);
+	std::vector<const SubWindow*> active;
+	for (const auto& sub_window : sub_windows_) {
+		std::int64_t seen = sub_window->epoch.load(std::memory_order_acquire);
+		if (seen >= 0 && seen > e - (std::int64_t)options_.sub_windows && seen <= e) {
+			active.push_back(sub_window.get());
+		}
+	}
+
+	// Candidates of every sub-window, by hash
+	std::unordered_map<std::uint64_t, std::string> keys;
+	char buf[key_words * sizeof(std::uint64_t)];
+	for (const SubWindow* sub_window : active) {
+		for (std::size_t i = 0; i < options_.candidates; i++) {
+			const Slot& slot = sub_window->slots[i];
+			std::uint64_t hash = slot.hash.load(std::memory_order_acquire);
+			if (hash == 0 || keys.count(hash)) {
+				continue;
+			}
+			std::size_t length = std::min<std::size_t>(slot.length.load(std::memory_order_acquire), max_key_length);
+			for (std::size_t w = 0; w * sizeof(std::uint64_t) < length; w++) {
+				std::uint64_t word = slot.key[w].load(std::memory_order_relaxed);
+				std::memcpy(buf + w * sizeof(word), &word, sizeof(word));
+			}
+			// Skips keys that were being replaced
+			std::string_view key(buf, length);
+			if (hash_key(key) == hash) {
+				keys.emplace(hash, std::string(key));
+			}
+		}
+	}
+
+	std::vector<Entry> entries;
+	entries.reserve(keys.size());
+	for (auto& entry : keys) {
+		std::uint64_t count = 0;
+		for (const SubWindow* sub_window : active) {
+			count += sub_window->estimate(options_, entry.first);
+		}
+		entries.push_back({std::move(entry.second), count});
+	}
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+		return a.count != b.count ? a.count > b.count : a.key < b.key;
+	});
+	if (entries.size() > options_.k) {
+		entries.resize(options_.k);
+	}
+	return entries;
+}
+
+std::size_t HeavyHitters::memory() const {
+	std::size_t sub_window = sizeof(SubWindow) + options_.width * options_.depth * sizeof(std::atomic<std::uint64_t>) +
+	                         options_.candidates * sizeof(Slot);
+	return sizeof(*this) + options_.sub_windows * sub_window;
+}
+
+const HeavyHitters::Options& HeavyHitters::options() const {
+	return options_;
+}
+
+namespace {
+std::mutex hot_keys_mutex;
+HeavyHitters::Options hot_keys_options;
+bool hot_keys_created = false;
+
+// Leaked so that requests can still be counted while static objects are destroyed
+HeavyHitters* create_hot_keys() {
+	std::lock_guard<std::mutex> lock(hot_keys_mutex);
+	hot_keys_created = true;
+	return new HeavyHitters(hot_keys_options);
+}
+}  // namespace
+
+void HotKeys::configure(HeavyHitters::Options options) {
+	std::lock_guard<std::mutex> lock(hot_keys_mutex);
+	if (hot_keys_created) {
+		WARNING << "heavy hitters: already counting, options only apply to new trackers";
+	}
+	hot_keys_options = options;
+}
+
+HeavyHitters& HotKeys::paths() {
+	static HeavyHitters* paths = create_hot_keys();
+	return *paths;
+}
+
+HeavyHitters& HotKeys::handlers() {
+	static HeavyHitters* handlers = create_hot_keys();
+	return *handlers;
+}
+
+HeavyHitters& HotKeys::clients() {
+	static HeavyHitters* clients = create_hot_keys();
+	return *clients;
+}
@@ -0,0 +1,88 @@
+#include "idleConnections.h"
+
+#include <boost/asio.hpp>
+#include <memory>
+
+#include "logger.h"
+#include "session.h"
+
+// Leaked, since sessions remove themselves from it while static objects are destroyed
+IdleConnections &IdleConnections::instance() {
+	static IdleConnections *connections = new IdleConnections();
+	return *connections;
+}
+
+void IdleConnections::add(session *s) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (s->idle_) {
+		return;
+	}
+	s->idle_ = true;
+	s->idle_older_ = newest_;
+	s->idle_newer_ = nullptr;
+	if (newest_ != nullptr) {
+		newest_->idle_newer_ = s;
+	} else {
+		oldest_ = s;
+	}
+	newest_ = s;
+	size_++;
+}
+
+void IdleConnections::remove(session *s) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (!s->idle_) {
+		return;
+	}
+	if (s->idle_older_ != nullptr) {
+		s->idle_older_->idle_newer_ = s->idle_newer_;
+	} else {
+		oldest_ = s->idle_newer_;
+	}
+	if (s->idle_newer_ != nullptr) {
+		s->idle_newer_->idle_older_ = s->idle_older_;
+	} else {
+		newest_ = s->idle_older_;
+	}
+	s->idle_ = false;
+	s->idle_older_ = nullptr;
+	s->idle_newer_ = nullptr;
+	size_--;
+}
+
+std::size_t IdleConnections::close_oldest(std::size_t n) {
+	std::size_t closed = 0;
+	while (closed < n) {
+		std::shared_ptr<session> s;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (oldest_ == nullptr) {
+				break;
+			}
+
+			// Sessions being destroyed can no longer be locked, they remove themselves once the lock is released
+			session *oldest = oldest_;
+			s = oldest->weak_session().lock();
+			oldest_ = oldest->idle_newer_;
+			if (oldest_ != nullptr) {
+				oldest_->idle_older_ = nullptr;
+			} else {
+				newest_ = nullptr;
+			}
+			oldest->idle_ = false;
+			oldest->idle_newer_ = nullptr;
+			size_--;
+		}
+		if (s != nullptr) {
+			boost::asio::post(s->get_executor(), [s]() { s->close_idle(); });
+			closed++;
+		}
+	}
+	TRACE << "idle connections: closing " << closed << " idle connections";
+	return closed;
+}
+
+std::size_t IdleConnections::size() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return size_;
+}
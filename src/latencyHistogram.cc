@@ -0,0 +1,107 @@
+#include "latencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// Values below sub_buckets each get their own bucket, then every power of two is split into
+// half_sub_buckets buckets
+constexpr std::uint64_t sub_bucket_bits = 8;
+constexpr std::uint64_t sub_buckets = 1 << sub_bucket_bits;
+constexpr std::uint64_t half_sub_buckets = sub_buckets / 2;
+
+// Position of the highest bit set, value has to be more than 0
+int highest_bit(std::uint64_t value) {
+	return 63 - __builtin_clzll(value);
+}
+}  // namespace
+
+constexpr std::uint64_t LatencyHistogram::max_value;
+
+LatencyHistogram::LatencyHistogram()
+    : counts_(index(max_value) + 1, 0) {
+}
+
+std::size_t LatencyHistogram::index(std::uint64_t value) {
+	if (value < sub_buckets) {
+		return value;
+	}
+	// Shift that brings the value between half_sub_buckets and sub_buckets
+	int shift = highest_bit(value) - (sub_bucket_bits - 1);
+	return sub_buckets + (shift - 1) * half_sub_buckets + ((value >> shift) - half_sub_buckets);
+}
+
+std::uint64_t LatencyHistogram::highest_value(std::size_t index) {
+	if (index < sub_buckets) {
+		return index;
+	}
+	int shift = (index - sub_buckets) / half_sub_buckets + 1;
+	std::uint64_t sub_bucket = (index - sub_buckets) % half_sub_buckets + half_sub_buckets;
+	return ((sub_bucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(std::uint64_t value) {
+	value = std::min(value, max_value);
+	counts_[index(value)]++;
+	min_ = count_ == 0 ? value : std::min(min_, value);
+	max_ = std::max(max_, value);
+	count_++;
+	sum_ += value;
+}
+
+void LatencyHistogram::record(std::uint64_t value, std::uint64_t expected_interval) {
+	record(value);
+	if (expected_interval == 0) {
+		return;
+	}
+	for (std::uint64_t missing = std::min(value, max_value); missing > expected_interval;) {
+		missing -= expected_interval;
+		record(missing);
+	}
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+	if (other.count_ == 0) {
+		return;
+	}
+	for (std::size_t i = 0; i < counts_.size(); i++) {
+		counts_[i] += other.counts_[i];
+	}
+	min_ = count_ == 0 ? other.min_ : std::min(min_, other.min_);
+	max_ = std::max(max_, other.max_);
+	count_ += other.count_;
+	sum_ += other.sum_;
+}
+
+std::uint64_t LatencyHistogram::count() const {
+	return count_;
+}
+
+std::uint64_t LatencyHistogram::min() const {
+	return min_;
+}
+
+std::uint64_t LatencyHistogram::max() const {
+	return max_;
+}
+
+double LatencyHistogram::mean() const {
+	return count_ == 0 ? 0 : sum_ / count_;
+}
+
+std::uint64_t LatencyHistogram::percentile(double percent) const {
+	if (count_ == 0) {
+		return 0;
+	}
+	// Rank of the value, at least the first one
+	std::uint64_t rank = std::max<std::uint64_t>(1, std::ceil(std::min(percent, 100.0) / 100 * count_));
+	std::uint64_t seen = 0;
+	for (std::size_t i = 0; i < counts_.size(); i++) {
+		seen += counts_[i];
+		if (seen >= rank) {
+			// The largest value of the bucket, but not more than what was recorded
+			return std::max(std::min(highest_value(i), max_), min_);
+		}
+	}
+	return max_;
+}
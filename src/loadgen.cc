@@ -0,0 +1,445 @@
+// koko_loadgen: measures the throughput and latency of a server with concurrent connections.
+//
+// Usage: koko_loadgen [options]
+//   --host <host>              server to load, 127.0.0.1 by default
+//   --port <port>              8080 by default
+//   --tls                      connects with TLS, without verifying the certificate
+//   --tls-resume               with --tls, resumes the TLS session of the previous connection when
+//                              reconnecting
+//   --paths <path,path,...>    paths requested in turn by every connection, / by default
+//   --connections <n>          concurrent connections, 16 by default
+//   --duration <seconds>       time requests are sent for, 10 by default
+//   --rate <requests/s>        total rate requests are sent at, 0 by default to send every request as
+//                              soon as the previous one on its connection completes
+//   --no-keep-alive            opens a new connection for every request
+//   --pipeline <n>             requests written at once on a connection before reading their
+//                              responses, 1 by default
+//   --threads <n>              threads running the connections, 1 by default
+//   --expected-interval <us>   without a rate, corrects latencies longer than this interval
+//
+// At a fixed rate, latencies are measured from the time every request was due to be sent rather
+// than from when it was sent, so that a server stalling the connections still counts the requests
+// that had to wait (coordinated omission). Without a rate, a request can only be sent once the
+// previous one completes, so the waits are instead estimated from the expected interval if given.
+// Exits with 1 if a request failed or none completed.
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/ssl.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "latencyHistogram.h"
+
+namespace net = boost::asio;
+namespace ssl = net::ssl;
+namespace beast = boost::beast;
+namespace http = beast::http;
+using tcp = net::ip::tcp;
+using clock_type = std::chrono::steady_clock;
+
+struct Options {
+	std::string host = "127.0.0.1";
+	std::string port = "8080";
+	bool tls = false;
+	bool tls_resume = false;
+	std::vector<std::string> paths = {"/"};
+	std::size_t connections = 16;
+	double duration = 10;
+	double rate = 0;
+	bool keep_alive = true;
+	std::size_t pipeline = 1;
+	std::size_t threads = 1;
+	std::uint64_t expected_interval = 0;
+};
+
+// Time after which requests without a response fail
+static constexpr std::chrono::seconds request_timeout{10};
+
+// Results of one connection, merged once every connection is done
+struct Results {
+	LatencyHistogram latency;
+	std::uint64_t errors = 0;
+	std::uint64_t connects = 0;
+	// TLS connections that resumed the session of the previous one
+	std::uint64_t resumed = 0;
+	// Pipelined requests left unanswered when the server closed the connection, which clients
+	// send again on a new connection, as the next batch of requests does here
+	std::uint64_t unanswered = 0;
+	// Responses by status class, 1xx to 5xx
+	std::uint64_t codes[5] = {};
+};
+
+// Sends requests one after another, or options.pipeline at a time, over a connection, reconnecting
+// when the server closes it
+class Connection : public std::enable_shared_from_this<Connection> {
+   public:
+	Connection(net::io_context& ioc, ssl::context& ctx, const Options& options, const tcp::resolver::results_type& endpoints,
+	           clock_type::time_point start, clock_type::time_point end, std::size_t id)
+	    : strand_(net::make_strand(ioc)),
+	      ctx_(ctx),
+	      options_(options),
+	      endpoints_(endpoints),
+	      timer_(strand_),
+	      end_(end),
+	      next_path_(id % options.paths.size()) {
+		if (options_.rate > 0) {
+			// Every connection sends its share of the rate, spread over the first interval
+			interval_ = std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(options_.connections * options_.pipeline / options_.rate));
+			due_ = start + interval_ * id / options_.connections;
+		} else {
+			due_ = start;
+		}
+	}
+
+	void start() {
+		net::dispatch(strand_, beast::bind_front_handler(&Connection::schedule, shared_from_this()));
+	}
+
+	const Results& results() const {
+		return results_;
+	}
+
+   private:
+	// Waits until the next request is due, then sends it
+	void schedule() {
+		if (due_ >= end_ || clock_type::now() >= end_) {
+			disconnect();
+			return;
+		}
+		if (options_.rate > 0 && clock_type::now() < due_) {
+			timer_.expires_at(due_);
+			timer_.async_wait([self = shared_from_this()](beast::error_code err) {
+				if (!err) {
+					self->send();
+				}
+			});
+			return;
+		}
+		send();
+	}
+
+	void send() {
+		// At a fixed rate, latency counts from when the request was due
+		sent_ = options_.rate > 0 ? due_ : clock_type::now();
+		requests_.clear();
+		for (pending_ = 0; pending_ < options_.pipeline; pending_++) {
+			requests_ += "GET " + options_.paths[next_path_] + " HTTP/1.1\r\nHost: " + options_.host + "\r\nUser-Agent: koko_loadgen\r\n";
+			requests_ += options_.keep_alive ? "\r\n" : "Connection: close\r\n\r\n";
+			next_path_ = (next_path_ + 1) % options_.paths.size();
+		}
+
+		if (!connected_) {
+			connect();
+			return;
+		}
+		write();
+	}
+
+	void connect() {
+		results_.connects++;
+		if (options_.tls) {
+			tls_ = std::make_unique<beast::ssl_stream<beast::tcp_stream>>(strand_, ctx_);
+			SSL_set_tlsext_host_name(tls_->native_handle(), options_.host.c_str());
+		} else {
+			tcp_ = std::make_unique<beast::tcp_stream>(strand_);
+		}
+		stream().expires_after(request_timeout);
+		stream().async_connect(endpoints_, [self = shared_from_this()](beast::error_code err, const tcp::endpoint&) {
+			if (err) {
+				self->fail(err, "connect");
+				return;
+			}
+			// Requests are written at once, without waiting on the acknowledgment of the previous one
+			self->stream().socket().set_option(tcp::no_delay(true), err);
+			if (!self->options_.tls) {
+				self->connected_ = true;
+				self->write();
+				return;
+			}
+			if (self->session_ != nullptr) {
+				SSL_set_session(self->tls_->native_handle(), self->session_.get());
+			}
+			self->tls_->async_handshake(ssl::stream_base::client, [self](beast::error_code err) {
+				if (err) {
+					self->fail(err, "handshake");
+					return;
+				}
+				if (self->options_.tls_resume) {
+					SSL* native = self->tls_->native_handle();
+					self->results_.resumed += SSL_session_reused(native);
+					self->session_.reset(SSL_get1_session(native));
+				}
+				self->connected_ = true;
+				self->write();
+			});
+		});
+	}
+
+	// The TCP connection, under TLS if enabled
+	beast::tcp_stream& stream() {
+		return tls_ ? beast::get_lowest_layer(*tls_) : *tcp_;
+	}
+
+	void write() {
+		stream().expires_after(request_timeout);
+		auto done = beast::bind_front_handler(&Connection::on_write, shared_from_this());
+		if (tls_) {
+			net::async_write(*tls_, net::buffer(requests_), std::move(done));
+		} else {
+			net::async_write(*tcp_, net::buffer(requests_), std::move(done));
+		}
+	}
+
+	void on_write(beast::error_code err, std::size_t) {
+		if (err) {
+			fail(err, "write");
+			return;
+		}
+		read();
+	}
+
+	void read() {
+		res_ = {};
+		auto done = beast::bind_front_handler(&Connection::on_read, shared_from_this());
+		if (tls_) {
+			http::async_read(*tls_, buffer_, res_, std::move(done));
+		} else {
+			http::async_read(*tcp_, buffer_, res_, std::move(done));
+		}
+	}
+
+	void on_read(beast::error_code err, std::size_t) {
+		if (err) {
+			fail(err, "read");
+			return;
+		}
+
+		std::uint64_t latency = std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - sent_).count();
+		results_.latency.record(latency, options_.rate > 0 ? 0 : options_.expected_interval);
+		unsigned code_class = res_.result_int() / 100;
+		if (code_class >= 1 && code_class <= 5) {
+			results_.codes[code_class - 1]++;
+		}
+
+		pending_--;
+		if (!options_.keep_alive || !res_.keep_alive()) {
+			// Pipelined requests after the response are not answered
+			results_.unanswered += pending_;
+			disconnect();
+		} else if (pending_ > 0) {
+			read();
+			return;
+		}
+		next();
+	}
+
+	void next() {
+		due_ = options_.rate > 0 ? due_ + interval_ : clock_type::now();
+		schedule();
+	}
+
+	void fail(beast::error_code err, const char* what) {
+		if (results_.errors++ == 0) {
+			std::cerr << "koko_loadgen: " << what << " failed: " << err.message() << std::endl;
+		}
+		disconnect();
+		next();
+	}
+
+	void disconnect() {
+		connected_ = false;
+		buffer_.clear();
+		if (tls_) {
+			// Keeps the session resumable, it is not if the connection ends without a TLS shutdown
+			SSL_set_shutdown(tls_->native_handle(), SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+		}
+		if (tcp_ || tls_) {
+			beast::error_code ignored;
+			stream().socket().shutdown(tcp::socket::shutdown_both, ignored);
+			stream().close();
+		}
+		tcp_.reset();
+		tls_.reset();
+	}
+
+	net::strand<net::io_context::executor_type> strand_;
+	ssl::context& ctx_;
+	const Options& options_;
+	const tcp::resolver::results_type& endpoints_;
+	net::steady_timer timer_;
+
+	// The connection, only one of which is open depending on whether TLS is enabled
+	std::unique_ptr<beast::tcp_stream> tcp_;
+	std::unique_ptr<beast::ssl_stream<beast::tcp_stream>> tls_;
+	bool connected_ = false;
+
+	beast::flat_buffer buffer_;
+	http::response<http::string_body> res_;
+
+	// The requests written at once, and how many of them are still waiting for a response
+	std::string requests_;
+	std::size_t pending_ = 0;
+
+	// When the next request is due, how long after the previous one, and when the last one was sent
+	clock_type::time_point due_;
+	clock_type::duration interval_{0};
+	clock_type::time_point sent_;
+	const clock_type::time_point end_;
+
+	// Session offered when reconnecting with --tls-resume
+	struct SessionFree {
+		void operator()(SSL_SESSION* session) const {
+			SSL_SESSION_free(session);
+		}
+	};
+	std::unique_ptr<SSL_SESSION, SessionFree> session_;
+
+	std::size_t next_path_;
+	Results results_;
+};
+
+static bool parse_options(int argc, char* argv[], Options& options) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--tls") {
+			options.tls = true;
+			continue;
+		}
+		if (arg == "--tls-resume") {
+			options.tls_resume = true;
+			continue;
+		}
+		if (arg == "--no-keep-alive") {
+			options.keep_alive = false;
+			continue;
+		}
+		if (i + 1 >= argc) {
+			return false;
+		}
+		std::string value = argv[++i];
+		try {
+			if (arg == "--host") {
+				options.host = value;
+			} else if (arg == "--port") {
+				options.port = value;
+			} else if (arg == "--paths") {
+				options.paths.clear();
+				for (std::size_t start = 0; start <= value.size();) {
+					std::size_t comma = std::min(value.find(',', start), value.size());
+					if (comma > start) {
+						options.paths.push_back(value.substr(start, comma - start));
+					}
+					start = comma + 1;
+				}
+			} else if (arg == "--connections") {
+				options.connections = std::stoul(value);
+			} else if (arg == "--duration") {
+				options.duration = std::stod(value);
+			} else if (arg == "--rate") {
+				options.rate = std::stod(value);
+			} else if (arg == "--pipeline") {
+				options.pipeline = std::stoul(value);
+			} else if (arg == "--threads") {
+				options.threads = std::stoul(value);
+			} else if (arg == "--expected-interval") {
+				options.expected_interval = std::stoull(value);
+			} else {
+				return false;
+			}
+		} catch (std::exception&) {
+			return false;
+		}
+	}
+	if (options.pipeline == 0 || (options.pipeline > 1 && !options.keep_alive) || (options.tls_resume && !options.tls)) {
+		return false;
+	}
+	return !options.paths.empty() && options.connections > 0 && options.threads > 0 && options.duration > 0 && options.rate >= 0;
+}
+
+int main(int argc, char* argv[]) {
+	Options options;
+	if (!parse_options(argc, argv, options)) {
+		std::cerr << "Usage: koko_loadgen [--host <host>] [--port <port>] [--tls] [--tls-resume] [--paths <path,...>] [--connections <n>] "
+		             "[--duration <seconds>] [--rate <requests/s>] [--no-keep-alive] [--pipeline <n>] [--threads <n>] [--expected-interval <us>]"
+		          << std::endl;
+		return 2;
+	}
+
+	net::io_context ioc;
+	ssl::context ctx{ssl::context::tls_client};
+	ctx.set_verify_mode(ssl::verify_none);
+
+	tcp::resolver::results_type endpoints;
+	try {
+		endpoints = tcp::resolver(ioc).resolve(options.host, options.port);
+	} catch (std::exception& e) {
+		std::cerr << "koko_loadgen: could not resolve " << options.host << ":" << options.port << ": " << e.what() << std::endl;
+		return 1;
+	}
+
+	clock_type::time_point start = clock_type::now();
+	clock_type::time_point end = start + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(options.duration));
+	std::vector<std::shared_ptr<Connection>> connections;
+	for (std::size_t i = 0; i < options.connections; i++) {
+		connections.push_back(std::make_shared<Connection>(ioc, ctx, options, endpoints, start, end, i));
+		connections.back()->start();
+	}
+
+	std::vector<std::thread> threads;
+	for (std::size_t i = 1; i < options.threads; i++) {
+		threads.emplace_back([&ioc]() { ioc.run(); });
+	}
+	ioc.run();
+	for (auto& t : threads) {
+		t.join();
+	}
+	double elapsed = std::chrono::duration<double>(clock_type::now() - start).count();
+
+	Results total;
+	for (const auto& connection : connections) {
+		const Results& results = connection->results();
+		total.latency.merge(results.latency);
+		total.errors += results.errors;
+		total.connects += results.connects;
+		total.resumed += results.resumed;
+		total.unanswered += results.unanswered;
+		for (int i = 0; i < 5; i++) {
+			total.codes[i] += results.codes[i];
+		}
+	}
+
+	// Requests with responses, not counting those added by the correction
+	std::uint64_t requests = 0;
+	for (std::uint64_t count : total.codes) {
+		requests += count;
+	}
+
+	std::string mode = options.rate > 0 ? std::to_string(static_cast<std::uint64_t>(options.rate)) + " requests/s" : "closed loop";
+	if (options.pipeline > 1) {
+		mode += ", pipelining " + std::to_string(options.pipeline) + ", " + std::to_string(total.unanswered) + " unanswered";
+	}
+	std::printf("%s://%s:%s, %zu connections%s, %s, %zu paths, %.1f s\n", options.tls ? "https" : "http", options.host.c_str(), options.port.c_str(),
+	            options.connections, options.keep_alive ? " kept alive" : "", mode.c_str(), options.paths.size(), elapsed);
+	std::printf("requests %lu, errors %lu, connects %lu, %.1f requests/s\n", (unsigned long)requests, (unsigned long)total.errors,
+	            (unsigned long)total.connects, requests / elapsed);
+	if (options.tls_resume) {
+		std::printf("resumed TLS sessions %lu of %lu connects\n", (unsigned long)total.resumed, (unsigned long)total.connects);
+	}
+	std::printf("responses 1xx %lu, 2xx %lu, 3xx %lu, 4xx %lu, 5xx %lu\n", (unsigned long)total.codes[0], (unsigned long)total.codes[1],
+	            (unsigned long)total.codes[2], (unsigned long)total.codes[3], (unsigned long)total.codes[4]);
+	const LatencyHistogram& latency = total.latency;
+	std::printf("latency (us) mean %.0f, p50 %lu, p90 %lu, p99 %lu, p99.9 %lu, max %lu\n", latency.mean(), (unsigned long)latency.percentile(50),
+	            (unsigned long)latency.percentile(90), (unsigned long)latency.percentile(99), (unsigned long)latency.percentile(99.9),
+	            (unsigned long)latency.max());
+
+	return total.errors > 0 || requests == 0 ? 1 : 0;
+}
@@ -0,0 +1,98 @@
+#include "logLevelHandler.h"
+
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <fstream>
+#include <string>
+
+#include "logger.h"
+
+namespace http = boost::beast::http;
+
+LogLevelHandler::LogLevelHandler(__attribute__((unused)) const std::string& url_prefix, const NginxConfig& config) {
+	name = "LogLevel";
+
+	for (const auto& statement : config.statements_) {
+		if (statement->tokens_.size() == 2 && statement->tokens_[0] == "tokenFile") {
+			requires_token_ = true;
+			std::ifstream file(statement->tokens_[1]);
+			std::getline(file, token_);
+			boost::algorithm::trim(token_);
+			if (token_.empty()) {
+				ERROR << "log level: could not read a token from " << statement->tokens_[1] << ", the level cannot be changed";
+			}
+		}
+	}
+}
+
+http::response<http::string_body> LogLevelHandler::handle_request(const http::request<http::string_body>& request) {
+	if (request.method() == http::verb::post || request.method() == http::verb::put) {
+		if (!authorized(request)) {
+			WARNING << "log level: refused a change without a valid token";
+			return unauthorized();
+		}
+		std::string level_name = requested_level(request);
+		severity_level level;
+		if (!parse_log_level(level_name, level)) {
+			return RequestHandler::bad_request();
+		}
+		set_log_level(level);
+		// Logged at warning so that the change shows up at any level but error and fatal
+		WARNING << "log level: set to " << level_name;
+	} else if (request.method() != http::verb::get) {
+		return RequestHandler::bad_request();
+	}
+
+	http::response<http::string_body> res;
+	res.version(11);
+	res.result(http::status::ok);
+	res.set(http::field::content_type, "text/plain");
+	res.set(http::field::server, "koko.cs130.org");
+	res.body() = std::string("level: ") + logging::trivial::to_string(get_log_level()) + "\n" +
+	             "compiled in: " + logging::trivial::to_string(static_cast<severity_level>(KOKO_MIN_LOG_LEVEL)) + "\n";
+	res.prepare_payload();
+	return res;
+}
+
+std::string LogLevelHandler::requested_level(const http::request<http::string_body>& request) {
+	std::string level;
+	if (query_parameter(request.target().to_string(), "level", level)) {
+		return level;
+	}
+	return boost::algorithm::trim_copy(request.body());
+}
+
+bool LogLevelHandler::authorized(const http::request<http::string_body>& request) const {
+	if (!requires_token_) {
+		return true;
+	}
+	if (token_.empty()) {
+		return false;
+	}
+
+	std::string prefix = "Bearer ";
+	boost::beast::string_view header = request[http::field::authorization];
+	if (header.size() != prefix.size() + token_.size() || !boost::beast::iequals(header.substr(0, prefix.size()), prefix)) {
+		return false;
+	}
+
+	// Compares every byte, so the time taken does not tell how much of the token matched
+	unsigned char difference = 0;
+	for (std::size_t i = 0; i < token_.size(); i++) {
+		difference |= header[prefix.size() + i] ^ token_[i];
+	}
+	return difference == 0;
+}
+
+http::response<http::string_body> LogLevelHandler::unauthorized() {
+	http::response<http::string_body> res;
+	res.version(11);
+	res.result(http::status::unauthorized);
+	res.set(http::field::content_type, "text/plain");
+	res.set(http::field::server, "koko.cs130.org");
+	res.set(http::field::www_authenticate, "Bearer");
+	res.body() = "401 Unauthorized\n";
+	res.prepare_payload();
+	return res;
+}
@@ -1,5 +1,6 @@
 #include "logger.h"
 
+#include <boost/core/null_deleter.hpp>
 #include <boost/log/attributes.hpp>
 #include <boost/log/common.hpp>
 #include <boost/log/core.hpp>
@@ -15,6 +16,10 @@
 #include <boost/log/utility/setup/console.hpp>
 #include <boost/log/utility/setup/file.hpp>
 #include <boost/log/utility/setup/formatter_parser.hpp>
+#include <cstdlib>
+#include <iostream>
+
+#include "asyncLogSink.h"
 
 namespace logging = boost::log;
 namespace attrs = boost::log::attributes;
@@ -22,18 +27,82 @@ namespace src = boost::log::sources;
 namespace keywords = boost::log::keywords;
 namespace sinks = boost::log::sinks;
 
+static const char* file_format = "[%TimeStamp%] [%ThreadID%] [%ProcessID%] (%Severity%) : %Message%";
+static const char* console_format = "=> %Message%";
+
+// Sinks installed by init_logger, replaced by init_async_logger
+static boost::shared_ptr<sinks::sink> file_sink;
+static boost::shared_ptr<sinks::sink> console_sink;
+static boost::shared_ptr<AsyncLogSink> async_sink;
+
 //initialise logger to be used in the program
 void init_logger() {
 	boost::log::register_simple_formatter_factory<boost::log::trivial::severity_level, char>("Severity");  //register Severity attribute to allow its use in formatter string
 
-	logging::add_file_log(
+	file_sink = logging::add_file_log(
 	    keywords::file_name = "./logs/SERVER_LOG_%Y-%m-%d_%N.log",                     //path where logs are stored
 	    keywords::rotation_size = 10 * 1024 * 1024,                                    //10MB
 	    keywords::time_based_rotation = sinks::file::rotation_at_time_point(0, 0, 0),  //rotate at midnight
-	    keywords::format = "[%TimeStamp%] [%ThreadID%] [%ProcessID%] (%Severity%) : %Message%",
+	    keywords::format = file_format,
 	    keywords::open_mode = std::ios_base::app,
 	    keywords::auto_flush = true);
-	logging::add_console_log(std::cout, keywords::format = "=> %Message%");  //allow console logging as well
+	console_sink = logging::add_console_log(std::cout, keywords::format = console_format);  //allow console logging as well
 
 	logging::add_common_attributes();
 }
+
+boost::shared_ptr<AsyncLogSink> init_async_logger(AsyncLogSink::Options options) {
+	if (async_sink) {
+		return async_sink;
+	}
+
+	// Same files as the synchronous sink, flushed by the writer thread once per batch instead of per record
+	auto file_backend = boost::make_shared<sinks::text_file_backend>(
+	    keywords::file_name = "./logs/SERVER_LOG_%Y-%m-%d_%N.log",
+	    keywords::rotation_size = 10 * 1024 * 1024,
+	    keywords::time_based_rotation = sinks::file::rotation_at_time_point(0, 0, 0),
+	    keywords::open_mode = std::ios_base::app);
+	auto console_backend = boost::make_shared<sinks::text_ostream_backend>();
+	console_backend->add_stream(boost::shared_ptr<std::ostream>(&std::cout, boost::null_deleter()));
+
+	async_sink = boost::make_shared<AsyncLogSink>(options);
+	async_sink->add_output(file_backend, logging::parse_formatter(file_format));
+	async_sink->add_output(console_backend, logging::parse_formatter(console_format));
+
+	auto core = logging::core::get();
+	core->add_sink(async_sink);
+	if (file_sink) {
+		core->remove_sink(file_sink);
+	}
+	if (console_sink) {
+		core->remove_sink(console_sink);
+	}
+
+	// Write out the buffered records when the server exits
+	std::atexit([]() { async_sink->stop(); });
+	return async_sink;
+}
+
+boost::shared_ptr<AsyncLogSink> async_logger() {
+	return async_sink;
+}
+
+std::atomic<int> runtime_log_level{trace};
+
+void set_log_level(severity_level level) {
+	runtime_log_level = level;
+}
+
+severity_level get_log_level() {
+	return static_cast<severity_level>(runtime_log_level.load());
+}
+
+bool parse_log_level(const std::string& name, severity_level& level) {
+	for (int l = trace; l <= fatal; l++) {
+		if (name == logging::trivial::to_string(static_cast<severity_level>(l))) {
+			level = static_cast<severity_level>(l);
+			return true;
+		}
+	}
+	return false;
+}
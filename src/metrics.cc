@@ -0,0 +1,240 @@
+#include "metrics.h"
+
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+std::size_t metric_shard() {
+	static std::atomic<std::size_t> next_thread{0};
+	thread_local std::size_t index = next_thread++ % metric_shards;
+	return index;
+}
+
+std::uint64_t Counter::value() const {
+	std::uint64_t total = 0;
+	for (const auto& shard : shards_) {
+		total += shard.value.load(std::memory_order_relaxed);
+	}
+	return total;
+}
+
+std::int64_t Gauge::value() const {
+	std::int64_t total = 0;
+	for (const auto& shard : shards_) {
+		total += shard.value.load(std::memory_order_relaxed);
+	}
+	return total;
+}
+
+Histogram::Histogram(std::vector<double> bounds)
+    : bounds_(std::move(bounds)) {
+	for (std::size_t i = 0; i < metric_shards; i++) {
+		// One more bucket for observations above the last bound
+		shards_.push_back(std::make_unique<Shard>(bounds_.size() + 1));
+	}
+}
+
+void Histogram::observe(double value) {
+	std::size_t bucket = 0;
+	while (bucket < bounds_.size() && value > bounds_[bucket]) {
+		bucket++;
+	}
+
+	Shard& shard = *shards_[metric_shard()];
+	shard.counts[bucket].fetch_add(1, std::memory_order_relaxed);
+	if (value > 0) {
+		shard.sum_micros.fetch_add((std::uint64_t)std::llround(value * 1e6), std::memory_order_relaxed);
+	}
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+	Snapshot snapshot{std::vector<std::uint64_t>(bounds_.size() + 1, 0), 0};
+	std::uint64_t sum_micros = 0;
+	for (const auto& shard : shards_) {
+		for (std::size_t i = 0; i <= bounds_.size(); i++) {
+			snapshot.cumulative[i] += shard->counts[i].load(std::memory_order_relaxed);
+		}
+		sum_micros += shard->sum_micros.load(std::memory_order_relaxed);
+	}
+	for (std::size_t i = 1; i <= bounds_.size(); i++) {
+		snapshot.cumulative[i] += snapshot.cumulative[i - 1];
+	}
+	snapshot.sum = sum_micros / 1e6;
+	return snapshot;
+}
+
+const std::vector<double>& Histogram::bounds() const {
+	return bounds_;
+}
+
+const std::vector<double>& latency_buckets() {
+	static const std::vector<double> buckets = {0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01,
+	                                            0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+	return buckets;
+}
+
+MetricsRegistry& MetricsRegistry::instance() {
+	// Leaked so that metrics can be updated while static objects are destroyed
+	static MetricsRegistry* registry = new MetricsRegistry();
+	return *registry;
+}
+
+MetricsRegistry::Metric& MetricsRegistry::metric(const std::string& name, const std::string& help, Type type, const MetricLabels& labels) {
+	auto inserted = families_.emplace(name, Family{help, type, {}});
+	Family& family = inserted.first->second;
+	if (family.type != type) {
+		throw std::invalid_argument("metric " + name + " registered with another type");
+	}
+
+	Metric& metric = family.metrics[render_labels(labels)];
+	metric.labels = labels;
+	return metric;
+}
+
+Counter& MetricsRegistry::counter(const std::string& name, const std::string& help, const MetricLabels& labels) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	Metric& m = metric(name, help, Type::counter, labels);
+	if (!m.counter && !m.function) {
+		m.counter = std::make_unique<Counter>();
+	}
+	if (!m.counter) {
+		throw std::invalid_argument("counter " + name + " is read from a function");
+	}
+	return *m.counter;
+}
+
+Gauge& MetricsRegistry::gauge(const std::string& name, const std::string& help, const MetricLabels& labels) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	Metric& m = metric(name, help, Type::gauge, labels);
+	if (!m.gauge && !m.function) {
+		m.gauge = std::make_unique<Gauge>();
+	}
+	if (!m.gauge) {
+		throw std::invalid_argument("gauge " + name + " is read from a function");
+	}
+	return *m.gauge;
+}
+
+Histogram& MetricsRegistry::histogram(const std::string& name, const std::string& help, const MetricLabels& labels, const std::vector<double>& bounds) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	Metric& m = metric(name, help, Type::histogram, labels);
+	if (!m.histogram) {
+		m.histogram = std::make_unique<Histogram>(bounds);
+	}
+	return *m.histogram;
+}
+
+void MetricsRegistry::gauge_function(const std::string& name, const std::string& help, const MetricLabels& labels, std::function<double()> value) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	Metric& m = metric(name, help, Type::gauge, labels);
+	if (m.gauge) {
+		throw std::invalid_argument("gauge " + name + " is updated directly");
+	}
+	m.function = std::move(value);
+}
+
+void MetricsRegistry::counter_function(const std::string& name, const std::string& help, const MetricLabels& labels, std::function<double()> value) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	Metric& m = metric(name, help, Type::counter, labels);
+	if (m.counter) {
+		throw std::invalid_argument("counter " + name + " is updated directly");
+	}
+	m.function = std::move(value);
+}
+
+// Formats a sample value the way Prometheus parses it
+static std::string format_value(double value) {
+	if (std::isinf(value)) {
+		return value > 0 ? "+Inf" : "-Inf";
+	}
+	if (std::isnan(value)) {
+		return "NaN";
+	}
+	std::ostringstream out;
+	out << std::setprecision(17) << value;
+	return out.str();
+}
+
+// Adds a label to rendered labels
+static std::string with_label(const MetricLabels& labels, const std::string& name, const std::string& value) {
+	MetricLabels all = labels;
+	all.emplace_back(name, value);
+	return render_labels(all);
+}
+
+std::string MetricsRegistry::render() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::ostringstream out;
+	for (const auto& entry : families_) {
+		const std::string& name = entry.first;
+		const Family& family = entry.second;
+		const char* type = family.type == Type::counter ? "counter" : family.type == Type::gauge ? "gauge" : "histogram";
+		out << "# HELP " << name << " " << family.help << "\n";
+		out << "# TYPE " << name << " " << type << "\n";
+
+		for (const auto& labeled : family.metrics) {
+			const std::string& labels = labeled.first;
+			const Metric& m = labeled.second;
+			if (m.counter) {
+				out << name << labels << " " << m.counter->value() << "\n";
+			} else if (m.gauge) {
+				out << name << labels << " " << m.gauge->value() << "\n";
+			} else if (m.function) {
+				out << name << labels << " " << format_value(m.function()) << "\n";
+			} else if (m.histogram) {
+				Histogram::Snapshot snapshot = m.histogram->snapshot();
+				const std::vector<double>& bounds = m.histogram->bounds();
+				for (std::size_t i = 0; i < bounds.size(); i++) {
+					out << name << "_bucket" << with_label(m.labels, "le", format_value(bounds[i])) << " " << snapshot.cumulative[i] << "\n";
+				}
+				out << name << "_bucket" << with_label(m.labels, "le", "+Inf") << " " << snapshot.cumulative.back() << "\n";
+				out << name << "_sum" << labels << " " << format_value(snapshot.sum) << "\n";
+				out << name << "_count" << labels << " " << snapshot.cumulative.back() << "\n";
+			}
+		}
+	}
+	return out.str();
+}
+
+std::size_t status_class_index(int code) {
+	if (code < 100 || code > 599) {
+		return status_class_count - 1;
+	}
+	return code / 100 - 1;
+}
+
+const char* status_class(int code) {
+	return status_class_name(status_class_index(code));
+}
+
+const char* status_class_name(std::size_t index) {
+	static const char* classes[status_class_count] = {"1xx", "2xx", "3xx", "4xx", "5xx", "other"};
+	return classes[index];
+}
+
+std::string render_labels(const MetricLabels& labels) {
+	if (labels.empty()) {
+		return "";
+	}
+
+	std::string out = "{";
+	for (std::size_t i = 0; i < labels.size(); i++) {
+		if (i > 0) {
+			out += ",";
+		}
+		out += labels[i].first + "=\"";
+		for (char c : labels[i].second) {
+			if (c == '\\' || c == '"') {
+				out += '\\';
+				out += c;
+			} else if (c == '\n') {
+				out += "\\n";
+			} else {
+				out += c;
+			}
+		}
+		out += "\"";
+	}
+	return out + "}";
+}
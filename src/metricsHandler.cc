@@ -0,0 +1,24 @@
+#include "metricsHandler.h"
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <string>
+
+#include "metrics.h"
+
+namespace http = boost::beast::http;
+
+MetricsHandler::MetricsHandler(__attribute__((unused)) const std::string& url_prefix, __attribute__((unused)) const NginxConfig& config) {
+	name = "Metrics";
+}
+
+http::response<http::string_body> MetricsHandler::handle_request(__attribute__((unused)) const http::request<http::string_body>& request) {
+	http::response<http::string_body> res;
+	res.version(11);
+	res.result(http::status::ok);
+	res.set(http::field::content_type, "text/plain; version=0.0.4; charset=utf-8");
+	res.set(http::field::server, "koko.cs130.org");
+	res.body() = MetricsRegistry::instance().render();
+	res.prepare_payload();
+	return res;
+}
@@ -15,4 +15,8 @@ NotFoundHandler::NotFoundHandler(__attribute__((unused)) const std::string& p,
 
 http::response<http::string_body> NotFoundHandler::handle_request(__attribute__((unused)) const http::request<http::string_body>& request) {
 	return not_found_error();
+}
+
+const CannedResponse* NotFoundHandler::handle_canned_request(__attribute__((unused)) const http::request<http::string_body>& request) {
+	return &canned_not_found_error();
 }
\ No newline at end of file
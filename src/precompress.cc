@@ -0,0 +1,137 @@
+// koko-precompress: writes compressed siblings of the static files under a directory, so that
+// FileHandler and CompressedFileHandler can serve them without compressing at runtime.
+//
+// Usage: koko-precompress <root> [min-size-bytes]
+//
+// For every file, file.gz is written with gzip, and file.br with brotli if koko-precompress was
+// built with it. Siblings that are up to date are skipped, and siblings that would not be smaller
+// than the file are not written. zstd siblings (.zst) are served too, but have to be made with
+// the zstd tool.
+
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_streambuf.hpp>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef KOKO_HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+namespace fs = boost::filesystem;
+
+// Extensions of precompressed files and of formats that are compressed already
+static const std::vector<std::string> skipped_extensions = {".gz", ".br", ".zst", ".zip", ".jpg", ".jpeg", ".jpe", ".png", ".gif", ".flv", ".svgz"};
+
+std::string gzip(const std::string& data) {
+	namespace bio = boost::iostreams;
+
+	std::stringstream compressed;
+	std::stringstream origin(data);
+
+	bio::filtering_streambuf<bio::input> out;
+	out.push(bio::gzip_compressor(bio::gzip_params(bio::gzip::best_compression)));
+	out.push(origin);
+	bio::copy(out, compressed);
+
+	return compressed.str();
+}
+
+#ifdef KOKO_HAVE_BROTLI
+std::string brotli(const std::string& data) {
+	std::string compressed(BrotliEncoderMaxCompressedSize(data.size()), '\0');
+	size_t size = compressed.size();
+	if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_GENERIC,
+	                           data.size(), reinterpret_cast<const uint8_t*>(data.data()),
+	                           &size, reinterpret_cast<uint8_t*>(&compressed[0]))) {
+		return "";
+	}
+	compressed.resize(size);
+	return compressed;
+}
+#endif
+
+// Writes the compressed sibling of a file, returns true if it was written
+bool write_sibling(const fs::path& path, const std::string& extension, const std::string& data, std::string (*compress)(const std::string&)) {
+	fs::path sibling = path.string() + extension;
+
+	// Skip siblings that are newer than the file
+	boost::system::error_code err;
+	if (fs::exists(sibling, err) && fs::last_write_time(sibling, err) >= fs::last_write_time(path, err) && !err) {
+		return false;
+	}
+
+	std::string compressed = compress(data);
+	if (compressed.empty() || compressed.size() >= data.size()) {
+		fs::remove(sibling, err);
+		return false;
+	}
+
+	// Write to a temporary file first so that the server never serves a partial sibling
+	fs::path tmp = sibling.string() + ".tmp";
+	{
+		std::ofstream out(tmp.c_str(), std::ios::binary);
+		out.write(compressed.data(), compressed.size());
+		if (!out) {
+			std::cerr << "could not write " << tmp << std::endl;
+			fs::remove(tmp, err);
+			return false;
+		}
+	}
+	fs::rename(tmp, sibling, err);
+	if (err) {
+		std::cerr << "could not rename " << tmp << ": " << err.message() << std::endl;
+		return false;
+	}
+
+	std::cout << sibling << ": " << data.size() << " -> " << compressed.size() << " bytes" << std::endl;
+	return true;
+}
+
+int main(int argc, const char* argv[]) {
+	if (argc < 2 || argc > 3) {
+		std::cerr << "usage: " << argv[0] << " <root> [min-size-bytes]" << std::endl;
+		return 2;
+	}
+
+	fs::path root(argv[1]);
+	std::uintmax_t min_size = argc == 3 ? std::strtoull(argv[2], nullptr, 10) : 256;
+	if (!fs::is_directory(root)) {
+		std::cerr << root << " is not a directory" << std::endl;
+		return 1;
+	}
+
+	int written = 0;
+	for (fs::recursive_directory_iterator it(root), end; it != end; ++it) {
+		const fs::path& path = it->path();
+		if (!fs::is_regular_file(path)) {
+			continue;
+		}
+
+		std::string extension = path.extension().string();
+		bool skipped = false;
+		for (const auto& e : skipped_extensions) {
+			skipped = skipped || extension == e;
+		}
+		if (skipped || extension == ".tmp" || fs::file_size(path) < min_size) {
+			continue;
+		}
+
+		std::ifstream in(path.c_str(), std::ios::binary);
+		std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+		written += write_sibling(path, ".gz", data, gzip);
+#ifdef KOKO_HAVE_BROTLI
+		written += write_sibling(path, ".br", data, brotli);
+#endif
+	}
+
+	std::cout << "wrote " << written << " compressed files" << std::endl;
+	return 0;
+}
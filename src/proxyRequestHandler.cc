@@ -4,7 +4,10 @@
 #include <boost/asio.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
+#include <algorithm>
+#include <memory>
 #include <string>
+#include <utility>
 
 #include "logger.h"
 
@@ -21,6 +24,7 @@ ProxyRequestHandler::ProxyRequestHandler(const std::string &p, const NginxConfig
 		url_prefix.erase(url_prefix.size() - 1);
 	}
 	try {
+		UpstreamPool::Options options;
 		for (size_t i = 0; i < config.statements_.size(); i++) {
 			std::shared_ptr<NginxConfigStatement> st = config.statements_.at(i);
 			if (!strcmp(st->tokens_.at(0).c_str(), "dest")) {
@@ -29,12 +33,28 @@ ProxyRequestHandler::ProxyRequestHandler(const std::string &p, const NginxConfig
 			if (!strcmp(st->tokens_.at(0).c_str(), "port")) {
 				m_port = st->tokens_.at(1);
 			}
+
+			// Upstream connection pool settings
+			if (!strcmp(st->tokens_.at(0).c_str(), "maxIdle")) {
+				options.max_idle = std::stoul(st->tokens_.at(1));
+			}
+			if (!strcmp(st->tokens_.at(0).c_str(), "maxPerHost")) {
+				options.max_per_host = std::max(std::stoul(st->tokens_.at(1)), 1UL);
+			}
+			if (!strcmp(st->tokens_.at(0).c_str(), "idleTimeout")) {
+				options.idle_timeout = std::chrono::seconds(std::stoul(st->tokens_.at(1)));
+			}
+			if (!strcmp(st->tokens_.at(0).c_str(), "prewarm")) {
+				options.prewarm = std::stoul(st->tokens_.at(1));
+			}
 		}
 		if (proxy_dest.empty() || m_port.empty()) {
 			throw std::runtime_error("Missing required config field");
 		}
 		TRACE << "ProxyRequestHandler for " << url_prefix << " -> Proxy destination: " << proxy_dest;
 		TRACE << "ProxyRequestHandler for " << url_prefix << " -> Port: " << m_port;
+		options.timeout = upstream_timeout;
+		pool_ = std::make_unique<UpstreamPool>(proxy_dest, m_port, options);
 		invalid_config = false;
 	} catch (std::exception &e) {
 		FATAL << "exception occurred : " << e.what();
@@ -93,44 +113,80 @@ void ProxyRequestHandler::replace_relative_html_links(std::string &body) {
 	boost::replace_all(body, "url(" + encoded_prefix + "\\2f\\2f", "url(\\2f\\2f");
 }
 
+http::request<http::string_body> ProxyRequestHandler::make_proxy_request(const http::request<http::string_body> &request) {
+	http::request<http::string_body> proxy_req(request);
+	proxy_req.set(http::field::host, proxy_dest);
+	std::string target = request.target().substr(url_prefix.length()).to_string();
+	if (target.length() == 0) {
+		target = "/";
+	}
+	if (target[0] != '/') {
+		target = "/" + target;
+	}
+	proxy_req.target(target);
+	// Only accept unencoded values so we can modify the body
+	proxy_req.set(http::field::accept_encoding, "identity");
+	proxy_req.prepare_payload();
+	return proxy_req;
+}
+
+http::response<http::string_body> ProxyRequestHandler::finish_response(http::response<http::string_body> res) {
+	if (http::to_status_class(res.result()) != http::status_class::redirection ||
+	    res.find(http::field::location) == res.end()) {
+		if (res.find(http::field::content_type) != res.end() && res.at(http::field::content_type).to_string().find("text/html") != std::string::npos) {
+			replace_relative_html_links(res.body());
+			// The rewritten links make the body longer than the upstream's Content-Length
+			res.prepare_payload();
+		}
+		return res;
+	}
+
+	// Handle redirect
+	std::string redirect_location = res.at(http::field::location).to_string();
+	if (redirect_location.length() > 0 && redirect_location[0] == '/') {
+		// Relative url redirects should be made relative to the proxy
+		redirect_location = url_prefix + redirect_location;
+	}
+	res.set(http::field::location, redirect_location);
+	return res;
+}
+
 http::response<http::string_body> ProxyRequestHandler::handle_request(const http::request<http::string_body> &request) {
 	if (invalid_config) {
 		return RequestHandler::internal_server_error();
 	}
 	try {
-		http::request<http::string_body> proxy_req(request);
-		proxy_req.set(http::field::host, proxy_dest);
-		std::string target = request.target().substr(url_prefix.length()).to_string();
-		if (target.length() == 0) {
-			target = "/";
-		}
-		if (target[0] != '/') {
-			target = "/" + target;
-		}
-		proxy_req.target(target);
-		// Only accept unencoded values so we can modify the body
-		proxy_req.set(http::field::accept_encoding, "identity");
-		proxy_req.prepare_payload();
-		http::response<http::string_body> res = req_synchronous(proxy_req);
-
-		if (http::to_status_class(res.result()) != http::status_class::redirection ||
-		    res.find(http::field::location) == res.end()) {
-			if (res.find(http::field::content_type) != res.end() && res.at(http::field::content_type).to_string().find("text/html") != std::string::npos) {
-				replace_relative_html_links(res.body());
-			}
-			return res;
-		}
-
-		// Handle redirect
-		std::string redirect_location = res.at(http::field::location).to_string();
-		if (redirect_location.length() > 0 && redirect_location[0] == '/') {
-			// Relative url redirects should be made relative to the proxy
-			redirect_location = url_prefix + redirect_location;
-		}
-		res.set(http::field::location, redirect_location);
-		return res;
+		return finish_response(req_synchronous(make_proxy_request(request)));
 	} catch (std::exception &e) {
 		ERROR << "Exception occurred in ProxyRequestHandler for " << url_prefix << ": " << e.what();
 		return RequestHandler::internal_server_error();
 	}
-}
\ No newline at end of file
+}
+
+bool ProxyRequestHandler::is_asynchronous() const {
+	return true;
+}
+
+const CannedResponse *ProxyRequestHandler::handle_canned_request(__attribute__((unused)) const http::request<http::string_body> &request) {
+	return invalid_config ? &RequestHandler::canned_internal_server_error() : nullptr;
+}
+
+void ProxyRequestHandler::handle_async_request(const http::request<http::string_body> &request, const net::any_io_executor &executor, ResponseHandler done) {
+	if (invalid_config) {
+		done(RequestHandler::internal_server_error());
+		return;
+	}
+
+	req_async(make_proxy_request(request), executor, [this, done = std::move(done)](beast::error_code err, http::response<http::string_body> res) {
+		if (err) {
+			ERROR << "Error occurred in ProxyRequestHandler for " << url_prefix << ": " << err.message();
+			done(RequestHandler::internal_server_error());
+			return;
+		}
+		done(finish_response(std::move(res)));
+	});
+}
+
+void ProxyRequestHandler::req_async(http::request<http::string_body> &&request, const net::any_io_executor &executor, UpstreamHandler done) {
+	pool_->async_send(std::move(request), executor, std::move(done));
+}
@@ -0,0 +1,307 @@
+#include "requestHistory.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "coarseClock.h"
+
+bool HistoryCursor::operator<(const HistoryCursor& other) const {
+	return std::tie(time_us, ring, index) < std::tie(other.time_us, other.ring, other.index);
+}
+
+bool HistoryCursor::operator<=(const HistoryCursor& other) const {
+	return !(other < *this);
+}
+
+HistoryCursor HistoryCursor::after(std::int64_t time_us) {
+	HistoryCursor cursor;
+	cursor.time_us = time_us;
+	cursor.ring = std::numeric_limits<std::uint64_t>::max();
+	cursor.index = std::numeric_limits<std::uint64_t>::max();
+	return cursor;
+}
+
+std::string HistoryCursor::to_string() const {
+	if (ring == std::numeric_limits<std::uint64_t>::max() && index == std::numeric_limits<std::uint64_t>::max()) {
+		return std::to_string(time_us);
+	}
+	return std::to_string(time_us) + "." + std::to_string(ring) + "." + std::to_string(index);
+}
+
+bool HistoryCursor::parse(const std::string& text, HistoryCursor& cursor) {
+	// A time alone, or a time, ring and index separated by dots
+	std::vector<std::uint64_t> numbers;
+	std::size_t start = 0;
+	while (start <= text.size()) {
+		std::size_t end = std::min(text.find('.', start), text.size());
+		std::string number = text.substr(start, end - start);
+		if (number.empty() || number.size() > 19 || number.find_first_not_of("0123456789") != std::string::npos) {
+			return false;
+		}
+		numbers.push_back(std::stoull(number));
+		start = end + 1;
+	}
+	if ((numbers.size() != 1 && numbers.size() != 3) || numbers[0] > (std::uint64_t)std::numeric_limits<std::int64_t>::max()) {
+		return false;
+	}
+
+	cursor = after(numbers[0]);
+	if (numbers.size() == 3) {
+		cursor.ring = numbers[1];
+		cursor.index = numbers[2];
+	}
+	return true;
+}
+
+URLInfo::URLInfo(std::string u, int c, boost::posix_time::ptime t)
+    : url(u),
+      res_code(c),
+      req_time(t) {
+}
+
+namespace {
+constexpr std::size_t words(std::size_t length) {
+	return (length + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+}
+
+// Copies text into atomic words
+template <std::size_t N>
+std::size_t store_text(std::string_view text, std::size_t max_length, std::atomic<std::uint64_t> (&out)[N]) {
+	std::size_t length = std::min(text.size(), max_length);
+	for (std::size_t w = 0; w * sizeof(std::uint64_t) < length; w++) {
+		std::uint64_t word = 0;
+		std::memcpy(&word, text.data() + w * sizeof(word), std::min(sizeof(word), length - w * sizeof(word)));
+		out[w].store(word, std::memory_order_relaxed);
+	}
+	return length;
+}
+
+// Copies text out of atomic words
+template <std::size_t N>
+void load_text(const std::atomic<std::uint64_t> (&in)[N], std::size_t length, std::string& text) {
+	char buf[N * sizeof(std::uint64_t)];
+	length = std::min(length, sizeof(buf));
+	for (std::size_t w = 0; w * sizeof(std::uint64_t) < length; w++) {
+		std::uint64_t word = in[w].load(std::memory_order_relaxed);
+		std::memcpy(buf + w * sizeof(word), &word, sizeof(word));
+	}
+	text.assign(buf, length);
+}
+
+// A recorded request. Its fields are atomics so that readers can copy it while the owning thread
+// overwrites it; seq tells readers whether the copy is whole.
+struct Slot {
+	// 2 * n + 1 while the n-th request of the ring is written into the slot, 2 * n + 2 once it is
+	std::atomic<std::uint64_t> seq{0};
+	std::atomic<std::int64_t> time_us{0};
+	std::atomic<int> res_code{0};
+	std::atomic<std::uint32_t> url_length{0};
+	std::atomic<std::uint32_t> handler_length{0};
+	std::atomic<std::uint64_t> url[words(RequestHistory::max_url_length)];
+	std::atomic<std::uint64_t> handler[words(RequestHistory::max_handler_length)];
+};
+
+// A request read from a slot
+struct Entry {
+	HistoryCursor cursor;
+	int res_code;
+	std::string url;
+	std::string handler;
+};
+
+// Gives every history an id for the rings threads keep
+std::atomic<std::uint64_t> next_history_id{0};
+}  // namespace
+
+struct RequestHistory::Ring {
+	explicit Ring(std::size_t capacity)
+	    : slots(new Slot[capacity]),
+	      capacity(capacity) {
+	}
+
+	// Only called by the thread using the ring
+	void push(std::string_view target, std::string_view name, int code, std::int64_t time) {
+		std::uint64_t n = head.load(std::memory_order_relaxed);
+		Slot& slot = slots[n % capacity];
+		slot.seq.store(2 * n + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		slot.url_length.store(store_text(target, max_url_length, slot.url), std::memory_order_relaxed);
+		slot.handler_length.store(store_text(name, max_handler_length, slot.handler), std::memory_order_relaxed);
+		slot.res_code.store(code, std::memory_order_relaxed);
+		slot.time_us.store(time, std::memory_order_relaxed);
+
+		slot.seq.store(2 * n + 2, std::memory_order_release);
+		head.store(n + 1, std::memory_order_release);
+	}
+
+	// Reads the n-th request of the ring, false if it was overwritten meanwhile
+	bool read(std::uint64_t n, Entry& entry) const {
+		const Slot& slot = slots[n % capacity];
+		std::uint64_t seq = slot.seq.load(std::memory_order_acquire);
+		if (seq != 2 * n + 2) {
+			return false;
+		}
+
+		entry.cursor.time_us = slot.time_us.load(std::memory_order_relaxed);
+		entry.cursor.index = n;
+		entry.res_code = slot.res_code.load(std::memory_order_relaxed);
+		load_text(slot.url, slot.url_length.load(std::memory_order_relaxed), entry.url);
+		load_text(slot.handler, slot.handler_length.load(std::memory_order_relaxed), entry.handler);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return slot.seq.load(std::memory_order_relaxed) == seq;
+	}
+
+	// Index of the oldest request still in the ring
+	std::uint64_t oldest(std::uint64_t end) const {
+		std::uint64_t first = end > capacity ? end - capacity : 0;
+		return std::max(first, start.load(std::memory_order_acquire));
+	}
+
+	std::unique_ptr<Slot[]> slots;
+	const std::size_t capacity;
+
+	// Requests pushed into the ring, and the number of them before the history was last cleared
+	std::atomic<std::uint64_t> head{0};
+	std::atomic<std::uint64_t> start{0};
+
+	// Whether a thread is using the ring
+	std::atomic<bool> in_use{true};
+};
+
+namespace {
+// A ring a thread uses, handed back when the thread exits
+struct Lease {
+	Lease(std::uint64_t id, std::shared_ptr<RequestHistory::Ring> ring)
+	    : id(id),
+	      ring(std::move(ring)) {
+	}
+	Lease(Lease&&) = default;
+	Lease& operator=(Lease&&) = default;
+	~Lease() {
+		if (ring) {
+			ring->in_use.store(false, std::memory_order_release);
+		}
+	}
+
+	std::uint64_t id;
+	std::shared_ptr<RequestHistory::Ring> ring;
+};
+}  // namespace
+
+RequestHistory::RequestHistory(std::size_t capacity)
+    : capacity_(std::max<std::size_t>(capacity, 1)),
+      id_(next_history_id++) {
+}
+
+RequestHistory& RequestHistory::instance() {
+	// Leaked so that threads can still record requests while static objects are destroyed
+	static RequestHistory* history = new RequestHistory(512);
+	return *history;
+}
+
+RequestHistory::Ring& RequestHistory::local_ring() {
+	// The rings of this thread, one for every history it recorded to
+	thread_local std::vector<Lease> leases;
+	for (auto& lease : leases) {
+		if (lease.id == id_) {
+			return *lease.ring;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(rings_mutex_);
+	std::shared_ptr<Ring> ring;
+	for (auto& r : rings_) {
+		bool in_use = false;
+		if (r->in_use.compare_exchange_strong(in_use, true, std::memory_order_acquire)) {
+			ring = r;
+			break;
+		}
+	}
+	if (!ring) {
+		ring = std::make_shared<Ring>(capacity_);
+		rings_.push_back(ring);
+	}
+	leases.emplace_back(id_, ring);
+	return *ring;
+}
+
+void RequestHistory::record(std::string_view url, std::string_view handler, int res_code) {
+	local_ring().push(url, handler, res_code, CoarseClock::instance().now_us());
+}
+
+std::vector<URLInfo> RequestHistory::snapshot(std::size_t limit, const HistoryCursor& since) const {
+	std::vector<std::shared_ptr<Ring>> rings;
+	{
+		std::lock_guard<std::mutex> lock(rings_mutex_);
+		rings = rings_;
+	}
+
+	// The newest requests of every ring, at most limit of each unless reading from since on.
+	// Rings are never removed, so their index identifies them.
+	bool paging = since.time_us >= 0;
+	std::vector<Entry> entries;
+	for (std::size_t r = 0; r < rings.size(); r++) {
+		const Ring& ring = *rings[r];
+		std::uint64_t end = ring.head.load(std::memory_order_acquire);
+		std::uint64_t oldest = ring.oldest(end);
+		std::size_t taken = 0;
+		Entry entry;
+		for (std::uint64_t n = end; n > oldest && (paging || taken < limit); n--) {
+			if (!ring.read(n - 1, entry)) {
+				continue;
+			}
+			entry.cursor.ring = r;
+			if (paging && entry.cursor <= since) {
+				break;
+			}
+			entries.push_back(entry);
+			taken++;
+		}
+	}
+
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return b.cursor < a.cursor; });
+	if (entries.size() > limit) {
+		// Keeps the newest requests, or the oldest ones after since
+		entries.erase(paging ? entries.begin() : entries.begin() + limit, paging ? entries.end() - limit : entries.end());
+	}
+
+	const CoarseClock& clock = CoarseClock::instance();
+	std::vector<URLInfo> infos;
+	infos.reserve(entries.size());
+	for (auto& entry : entries) {
+		infos.emplace_back(std::move(entry.url), entry.res_code, clock.to_local(entry.cursor.time_us));
+		infos.back().handler = std::move(entry.handler);
+		infos.back().time_us = entry.cursor.time_us;
+		infos.back().cursor = entry.cursor;
+	}
+	return infos;
+}
+
+std::uint64_t RequestHistory::total() const {
+	std::lock_guard<std::mutex> lock(rings_mutex_);
+	std::uint64_t total = 0;
+	for (const auto& ring : rings_) {
+		// start never passes the head read after it
+		std::uint64_t start = ring->start.load(std::memory_order_acquire);
+		total += ring->head.load(std::memory_order_relaxed) - start;
+	}
+	return total;
+}
+
+void RequestHistory::clear() {
+	std::lock_guard<std::mutex> lock(rings_mutex_);
+	for (auto& ring : rings_) {
+		ring->start.store(ring->head.load(std::memory_order_acquire), std::memory_order_release);
+	}
+}
+
+std::size_t RequestHistory::rings() const {
+	std::lock_guard<std::mutex> lock(rings_mutex_);
+	return rings_.size();
+}
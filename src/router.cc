@@ -0,0 +1,155 @@
+#include "router.h"
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+Router::Router()
+    : nodes_(1),
+      size_(0) {
+}
+
+Router::Router(const std::vector<std::pair<std::string, RequestHandler*>>& urlToHandler)
+    : Router() {
+	for (const auto& mapping : urlToHandler) {
+		insert(mapping.first, mapping.second);
+	}
+}
+
+std::size_t Router::size() const {
+	return size_;
+}
+
+std::uint32_t Router::find_child(const Node& node, char c) const {
+	auto it = std::lower_bound(node.children.begin(), node.children.end(), c,
+	                           [](const std::pair<char, std::uint32_t>& child, char ch) { return child.first < ch; });
+	if (it == node.children.end() || it->first != c) {
+		return 0;
+	}
+	return it->second;
+}
+
+void Router::insert(const std::string& prefix, RequestHandler* handler) {
+	std::uint32_t node = 0;
+	std::size_t pos = 0;
+
+	while (pos < prefix.size()) {
+		std::uint32_t child = find_child(nodes_[node], prefix[pos]);
+
+		if (child == 0) {
+			// No edge shares a character with the rest of the prefix, hang it off a new node
+			Node leaf;
+			leaf.label = prefix.substr(pos);
+			nodes_.push_back(leaf);
+			std::uint32_t leaf_index = nodes_.size() - 1;
+
+			auto& children = nodes_[node].children;
+			children.push_back({prefix[pos], leaf_index});
+			std::sort(children.begin(), children.end());
+
+			node = leaf_index;
+			pos = prefix.size();
+			break;
+		}
+
+		// Length of the common start of the edge label and rest of the prefix
+		const std::string& label = nodes_[child].label;
+		std::size_t common = 0;
+		while (common < label.size() && pos + common < prefix.size() && label[common] == prefix[pos + common]) {
+			common++;
+		}
+
+		if (common < label.size()) {
+			// Split the edge, the new middle node takes over the common part of the label
+			Node middle;
+			middle.label = label.substr(0, common);
+			middle.children.push_back({label[common], child});
+			nodes_[child].label.erase(0, common);
+			nodes_.push_back(middle);
+			std::uint32_t middle_index = nodes_.size() - 1;
+
+			for (auto& c : nodes_[node].children) {
+				if (c.second == child) {
+					c.second = middle_index;
+				}
+			}
+			child = middle_index;
+		}
+
+		node = child;
+		pos += common;
+	}
+
+	// Earlier mappings win, same as a first-to-last scan for the longest prefix
+	if (nodes_[node].handler == nullptr) {
+		nodes_[node].handler = handler;
+		nodes_[node].prefix = prefix;
+		size_++;
+	}
+}
+
+std::string_view Router::strip_query(std::string_view target) {
+	std::size_t last_slash_index = target.rfind('/');
+	if (last_slash_index == std::string_view::npos) {
+		return target;
+	}
+	std::size_t first_qmark_index = target.find('?', last_slash_index);
+	if (first_qmark_index == std::string_view::npos) {
+		return target;
+	}
+	return target.substr(0, first_qmark_index);
+}
+
+RequestHandler* Router::match(std::string_view target, std::string_view* prefix) const {
+	target = strip_query(target);
+
+	// Matching happens against the target with a "/" appended,
+	// so that a directory name is only matched as a whole.
+	std::size_t len = target.size() + 1;
+	auto at = [&target](std::size_t i) { return i < target.size() ? target[i] : '/'; };
+
+	const Node* best = nullptr;
+	const Node* node = &nodes_[0];
+	std::size_t pos = 0;
+
+	while (true) {
+		// The url prefix ending here matches if it is followed by a "/" in the target
+		if (node->handler != nullptr && ((pos < len && at(pos) == '/') || node->prefix == "/")) {
+			best = node;
+		}
+
+		if (pos >= len) {
+			break;
+		}
+
+		std::uint32_t child = find_child(*node, at(pos));
+		if (child == 0) {
+			break;
+		}
+
+		const std::string& label = nodes_[child].label;
+		if (pos + label.size() > len) {
+			break;
+		}
+
+		std::size_t i = 1;
+		while (i < label.size() && label[i] == at(pos + i)) {
+			i++;
+		}
+		if (i < label.size()) {
+			break;
+		}
+
+		node = &nodes_[child];
+		pos += label.size();
+	}
+
+	if (best == nullptr) {
+		return nullptr;
+	}
+	if (prefix != nullptr) {
+		*prefix = best->prefix;
+	}
+	return best->handler;
+}
@@ -8,26 +8,39 @@
 #include <boost/asio/strand.hpp>
 #include <boost/beast/ssl.hpp>
 #include <boost/bind.hpp>
+#include <algorithm>
 #include <cstddef>
 #include <iostream>
 #include <memory>
+#include <pthread.h>
+#include <sched.h>
 #include <thread>
 #include <unordered_map>
 #include <vector>
 
+#include "asyncLogSink.h"
+#include "coarseClock.h"
 #include "compressedFileHandler.h"
+#include "compressionCache.h"
 #include "config.h"
+#include "contentCache.h"
 #include "echoHandler.h"
 #include "fileHandler.h"
 #include "handler.h"
 #include "healthHandler.h"
+#include "heavyHitters.h"
+#include "idleConnections.h"
+#include "logLevelHandler.h"
 #include "logger.h"
+#include "metrics.h"
+#include "metricsHandler.h"
 #include "notFoundHandler.h"
 #include "proxyRequestHandler.h"
 #include "sessionSSL.h"
 #include "sessionTCP.h"
 #include "sleepEchoHandler.h"
 #include "statusHandler.h"
+#include "tlsResumption.h"
 
 using boost::asio::ip::tcp;
 using boost::beast::error_code;
@@ -35,6 +48,9 @@ namespace net = boost::asio;
 namespace ssl = boost::asio::ssl;
 namespace fs = boost::filesystem;
 
+// Socket option allowing multiple acceptors to bind to the same port
+typedef net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port_option;
+
 std::vector<std::pair<std::string, std::string>> server::urlToHandlerName{};
 
 // Retuns true if function is able to load the SSL context with the certificate and
@@ -93,7 +109,7 @@ inline bool load_server_certificate(boost::asio::ssl::context& ctx, NginxConfig&
 
 // Opens and binds an acceptor to the protocol and port specified in the endpoint
 // Returns false on any failure and returns true otherwise
-bool bind_acceptor(tcp::acceptor& acceptor, tcp::endpoint endpoint) {
+bool bind_acceptor(tcp::acceptor& acceptor, tcp::endpoint endpoint, bool reuse_port) {
 	error_code err;
 	acceptor.open(endpoint.protocol(), err);
 	if (err) {
@@ -108,6 +124,15 @@ bool bind_acceptor(tcp::acceptor& acceptor, tcp::endpoint endpoint) {
 		return false;
 	}
 
+	// Allow other acceptors to listen on the same port
+	if (reuse_port) {
+		acceptor.set_option(reuse_port_option(true), err);
+		if (err) {
+			ERROR << "server: could not reuse port: " << err.message();
+			return false;
+		}
+	}
+
 	// Bind to the server address
 	acceptor.bind(endpoint, err);
 	if (err) {
@@ -127,28 +152,33 @@ bool bind_acceptor(tcp::acceptor& acceptor, tcp::endpoint endpoint) {
 }
 
 server::server(boost::asio::io_context& io_context, ssl::context& ctx, NginxConfig c)
+    : server(io_context, ctx, c, std::make_shared<const Router>(create_all_handlers(c)), false) {
+}
+
+server::server(boost::asio::io_context& io_context, ssl::context& ctx, NginxConfig c,
+               std::shared_ptr<const Router> router, bool reuse_port)
     : io_context_(io_context),
       ctx_(ctx),
       config_(c),
+      connection_options_(ConnectionOptions::from_config(config_)),
       port_(config_.get_num("port")),
       https_port_(config_.get_num("httpsPort")),
       acceptor_(io_context_),
-      https_acceptor_(io_context_) {
+      https_acceptor_(io_context_),
+      router_(router) {
 	TRACE << "server: constructed";
 	serving_ = false;
 	serving_https_ = false;
 
 	TRACE << "server: attempting to bind to HTTP port: " << port_;
-	if (bind_acceptor(acceptor_, tcp::endpoint{tcp::v4(), port_})) {
+	if (bind_acceptor(acceptor_, tcp::endpoint{tcp::v4(), port_}, reuse_port)) {
 		serving_ = true;
 	}
 
 	TRACE << "server: attempting to bind to HTTPS port: " << https_port_;
-	if (bind_acceptor(https_acceptor_, tcp::endpoint{tcp::v4(), https_port_})) {
+	if (bind_acceptor(https_acceptor_, tcp::endpoint{tcp::v4(), https_port_}, reuse_port)) {
 		serving_https_ = true;
 	}
-
-	urlToHandler_ = create_all_handlers(config_);
 }
 
 RequestHandler* server::create_handler(std::string url_prefix, std::string handler_name, NginxConfig subconfig) {
@@ -187,6 +217,16 @@ RequestHandler* server::create_handler(std::string url_prefix, std::string handl
 		return new HealthHandler(url_prefix, subconfig);
 	}
 
+	else if (handler_name == "MetricsHandler") {
+		TRACE << "server: registering metrics handler for url prefix: " << url_prefix;
+		return new MetricsHandler(url_prefix, subconfig);
+	}
+
+	else if (handler_name == "LogLevelHandler") {
+		TRACE << "server: registering log level handler for url prefix: " << url_prefix;
+		return new LogLevelHandler(url_prefix, subconfig);
+	}
+
 	else if (handler_name == "CompressedFileHandler") {
 		TRACE << "server: registering compressed file handler for url prefix: " << url_prefix;
 		return new CompressedFileHandler(url_prefix, subconfig);
@@ -224,6 +264,7 @@ std::vector<std::pair<std::string, RequestHandler*>> server::create_all_handlers
 			NginxConfig* child_block = statement->child_block_.get();
 			RequestHandler* s = server::create_handler(url_prefix, handler_name, *child_block);
 			if (s != nullptr) {
+				s->set_keep_alive_from_config(*child_block);
 				temp_urlToHandler.push_back({url_prefix, s});
 				urlToHandlerName.push_back({url_prefix, handler_name});
 			}
@@ -282,8 +323,12 @@ void server::handle_accept(error_code err, tcp::socket socket) {
 
 	if (err) {
 		ERROR << "server: error ocurred while accepting HTTP connection: " << err.message();
+		if (err == net::error::no_descriptors) {
+			accept_later(false);
+		}
 		return;
 	}
+	make_room();
 
 	TRACE << "server: just accepted a HTTP connection, creating session for it";
 
@@ -294,7 +339,7 @@ void server::handle_accept(error_code err, tcp::socket socket) {
 	// When the session itself no longer needs its own this pointer
 	// (which will happen after closing the session and not assigning any more future async calls)
 	// the session will be automatically destroyed since it is inside a shared pointer.
-	std::shared_ptr<sessionTCP> s = std::make_shared<sessionTCP>(&config_, urlToHandler_, std::move(socket));
+	std::shared_ptr<sessionTCP> s = std::make_shared<sessionTCP>(&config_, router_, std::move(socket), connection_options_);
 
 	// Start the session, which will call do_read and read the data
 	// out of the socket we passed. socket will be destroyed when this function
@@ -310,18 +355,47 @@ void server::handle_accept(error_code err, tcp::socket socket) {
 void server::handle_accept_https(error_code err, tcp::socket socket) {
 	if (err) {
 		ERROR << "server: error ocurred while accepting HTTPS connection: " << err.message();
+		if (err == net::error::no_descriptors) {
+			accept_later(true);
+		}
 		return;
 	}
+	make_room();
 
 	TRACE << "server: just accepted a HTTPS connection, creating session for it";
 
-	std::shared_ptr<sessionSSL> s = std::make_shared<sessionSSL>(ctx_, &config_, urlToHandler_, std::move(socket));
+	std::shared_ptr<sessionSSL> s = std::make_shared<sessionSSL>(ctx_, &config_, router_, std::move(socket), connection_options_);
 	s->start();
 
 	// Accept new HTTPS connections now
 	start_accepting_https();
 }
 
+void server::make_room() {
+	std::size_t max = connection_options_.max_connections;
+	std::size_t open = session::open_connections();
+	if (max > 0 && open >= max) {
+		TRACE << "server: " << open << " connections open, closing idle ones";
+		IdleConnections::instance().close_oldest(open - max + 1);
+	}
+}
+
+void server::accept_later(bool https) {
+	// Like nginx, closes a batch of idle connections and stops accepting for a while,
+	// instead of failing every accept until connections close on their own
+	std::size_t closed = IdleConnections::instance().close_oldest(32);
+	WARNING << "server: out of file descriptors, closed " << closed << " idle connections";
+
+	auto timer = std::make_shared<net::steady_timer>(io_context_, std::chrono::milliseconds(100));
+	timer->async_wait([self = shared_from_this(), timer, https](error_code) {
+		if (https) {
+			self->start_accepting_https();
+		} else {
+			self->start_accepting();
+		}
+	});
+}
+
 void server::register_server_sigint() {
 	struct sigaction sigIntHandler;
 	sigIntHandler.sa_handler = server::server_sigint;
@@ -335,8 +409,86 @@ void server::server_sigint(__attribute__((unused)) int s) {
 	exit(130);
 }
 
+void server::configure_logging(NginxConfig& config) {
+	std::string level_name = config.get_str("logLevel");
+	severity_level level;
+	if (parse_log_level(level_name, level)) {
+		set_log_level(level);
+	} else if (!level_name.empty()) {
+		ERROR << "server: unknown log level in config: " << level_name;
+	}
+
+	if (!config.get_num("asyncLog")) {
+		return;
+	}
+
+	AsyncLogSink::Options options;
+	options.ring_size = std::max(config.get_num("logRingSize"), 1);
+	options.overflow = config.get_str("logOverflow") == "block" ? AsyncLogSink::Overflow::block : AsyncLogSink::Overflow::drop;
+	init_async_logger(options);
+	TRACE << "server: logging asynchronously, ring size: " << options.ring_size << ", blocking on overflow: " << (options.overflow == AsyncLogSink::Overflow::block);
+}
+
+void server::configure_heavy_hitters(NginxConfig& config) {
+	HeavyHitters::Options options;
+	options.k = std::max(config.get_num("heavyHittersK"), 1);
+	options.window = std::chrono::seconds(std::max(config.get_num("heavyHittersWindow"), 1));
+	options.width = std::max(config.get_num("heavyHittersWidth"), 1);
+	options.candidates = std::max(config.get_num("heavyHittersCandidates"), 1);
+	HotKeys::configure(options);
+	TRACE << "server: tracking the top " << options.k << " keys of the last " << options.window.count() << "s";
+}
+
+void server::register_metrics() {
+	MetricsRegistry& registry = MetricsRegistry::instance();
+	registry.counter_function("koko_content_cache_hits_total", "Static file requests served from the content cache", {},
+	                          []() { return (double)ContentCache::instance().stats().hits; });
+	registry.counter_function("koko_content_cache_misses_total", "Static file requests not served from the content cache", {},
+	                          []() { return (double)ContentCache::instance().stats().misses; });
+	registry.gauge_function("koko_content_cache_bytes", "Bytes of static files in the content cache", {},
+	                        []() { return (double)ContentCache::instance().stats().bytes; });
+	registry.gauge_function("koko_compression_cache_hit_ratio", "Fraction of compressions served from the compression cache", {},
+	                        []() { return CompressionCache::instance().stats().hit_ratio(); });
+	registry.counter_function("koko_compression_cache_cpu_saved_seconds_total", "CPU time saved by the compression cache", {},
+	                          []() { return CompressionCache::instance().stats().cpu_saved_ns / 1e9; });
+	registry.counter_function("koko_log_records_dropped_total", "Log records dropped because a logging ring was full", {}, []() {
+		auto sink = async_logger();
+		return sink ? (double)sink->dropped() : 0.0;
+	});
+}
+
+int server::get_thread_count(NginxConfig& config) {
+	int threads = config.get_num("threads");
+	if (threads > 0) {
+		return threads;
+	}
+
+	// Not set in the config, use one thread per core
+	int cores = std::thread::hardware_concurrency();
+	return std::max(cores, 1);
+}
+
+// Pins a thread to a single CPU, wrapping around if there are more threads than CPUs
+void pin_thread(pthread_t thread, int index) {
+	int cores = std::max((int)std::thread::hardware_concurrency(), 1);
+	cpu_set_t cpuset;
+	CPU_ZERO(&cpuset);
+	CPU_SET(index % cores, &cpuset);
+
+	int err = pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuset);
+	if (err != 0) {
+		ERROR << "server: could not pin thread " << index << " to cpu " << index % cores << ", error: " << err;
+		return;
+	}
+	TRACE << "server: pinned thread " << index << " to cpu " << index % cores;
+}
+
 void server::serve_forever(boost::asio::io_context* io_context, NginxConfig& config) {
 	TRACE << "server: setting up to serve forever";
+	configure_logging(config);
+	configure_heavy_hitters(config);
+	register_metrics();
+	CoarseClock::instance().start();
 	server::register_server_sigint();
 
 	// The SSL context holds certificates
@@ -345,35 +497,72 @@ void server::serve_forever(boost::asio::io_context* io_context, NginxConfig& con
 	// Load the test/production certificates from the config
 	bool loaded_certs = load_server_certificate(ssl_ctx, config);
 
+	// Clients connecting again resume their sessions, from the cache every server shares or from tickets
+	if (loaded_certs) {
+		TlsResumption::enable(ssl_ctx, TlsResumption::Options::from_config(config));
+	}
+
+	int threads = get_thread_count(config);
+	bool reuse_port = config.get_num("reusePort");
+	bool pin_threads = config.get_num("pinThreads");
+	TRACE << "server: running with " << threads << " threads, io_context per thread: " << reuse_port;
+
+	// Static files are cached in memory when a budget is set
+	ContentCache::instance().set_capacity((std::size_t)config.get_num("contentCacheMB") * 1024 * 1024);
+	CompressionCache::instance().set_capacity((std::size_t)config.get_num("compressionCacheMB") * 1024 * 1024);
+
 	try {
+		// The handlers and the routing table are created once and shared by all servers
+		auto router = std::make_shared<const Router>(create_all_handlers(config));
+
+		// Without reusePort, all threads work on the passed io_context.
+		// With reusePort, the passed io_context is run by this thread
+		// and every other thread gets an io_context of its own.
+		std::vector<boost::asio::io_context*> contexts{io_context};
+		std::vector<std::unique_ptr<boost::asio::io_context>> owned_contexts;
+		if (reuse_port) {
+			for (int i = 1; i < threads; ++i) {
+				// Each context is only ever run by one thread
+				owned_contexts.emplace_back(std::make_unique<boost::asio::io_context>(1));
+				contexts.push_back(owned_contexts.back().get());
+			}
+		}
+
 		// We need to have at least one shared pointer to server always
 		// otherwise enabled_shared_from_this will throw an exception.
 		// So, instead of creating a object directly, we will create a shared_ptr for
 		// the server.
-		std::shared_ptr<server> s = std::make_shared<server>(*io_context, ssl_ctx, config);
-		s->serving_https_ = loaded_certs;
-
-		// Start server with port from config
-		// This will schedule a function call in the event loop
-		s->start_accepting();
-		s->start_accepting_https();
+		// One server is created for every io_context, all of them listening on the same ports.
+		std::vector<std::shared_ptr<server>> servers;
+		for (auto context : contexts) {
+			std::shared_ptr<server> s = std::make_shared<server>(*context, ssl_ctx, config, router, reuse_port);
+			s->serving_https_ = s->serving_https_ && loaded_certs;
+
+			// Start server with port from config
+			// This will schedule a function call in the event loop
+			s->start_accepting();
+			s->start_accepting_https();
+			servers.push_back(s);
+		}
 
-		// Run server with 4 threads
-		int threads = 4;
 		std::vector<std::thread> threadpool;
 
 		// We will also make the current parent thread do server work
 		threadpool.reserve(threads - 1);
 
-		auto thread_work = [io_context]() {
-			// Makes the current thread a worker
-			// for the event loop's async function calls.
-			io_context->run();
-		};
+		for (int i = 1; i < threads; ++i) {
+			// Makes the thread a worker for the event loop's async function calls,
+			// either for its own io_context or the shared one.
+			boost::asio::io_context* context = reuse_port ? contexts[i] : io_context;
+			threadpool.emplace_back([context]() { context->run(); });
+
+			if (pin_threads) {
+				pin_thread(threadpool.back().native_handle(), i);
+			}
+		}
 
-		for (int i = 0; i < threads - 1; ++i) {
-			// Constructs threads with thread_work
-			threadpool.emplace_back(thread_work);
+		if (pin_threads) {
+			pin_thread(pthread_self(), 0);
 		}
 
 		// This thread will now forever keep finishing tasks in the event loop
@@ -381,7 +570,12 @@ void server::serve_forever(boost::asio::io_context* io_context, NginxConfig& con
 		// future events.
 		io_context->run();
 
-		// io_context was stopped, need to join all children
+		// io_context was stopped, stop the other event loops too
+		for (auto& context : owned_contexts) {
+			context->stop();
+		}
+
+		// need to join all children
 		for (auto& thread : threadpool) {
 			if (thread.joinable()) {
 				thread.join();
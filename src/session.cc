@@ -2,16 +2,135 @@
 
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
 #include <utility>
 
+#include "coarseClock.h"
 #include "config.h"
 #include "handler.h"
+#include "heavyHitters.h"
+#include "idleConnections.h"
 #include "logger.h"
+#include "metrics.h"
 
 using boost::asio::ip::tcp;
 using error_code = boost::system::error_code;
 namespace http = boost::beast::http;
 
+// Sets the Connection header of the response
+template <class Body>
+void set_connection(bool keep_alive, http::response<Body>& res) {
+	if (keep_alive) {
+		res.set(http::field::connection, "keep-alive");
+	} else {
+		res.set(http::field::connection, "close");
+	}
+}
+
+// Connection metrics of HTTP or HTTPS sessions
+struct ConnectionMetrics {
+	explicit ConnectionMetrics(const char* protocol)
+	    : opened(MetricsRegistry::instance().counter("koko_connections_total", "Connections accepted", {{"protocol", protocol}})),
+	      open(MetricsRegistry::instance().gauge("koko_connections_open", "Connections currently open", {{"protocol", protocol}})),
+	      duration(MetricsRegistry::instance().histogram("koko_connection_duration_seconds", "Time connections stay open", {{"protocol", protocol}},
+	                                                     {0.001, 0.01, 0.1, 1, 10, 30, 60, 300, 1800, 3600})) {
+	}
+
+	Counter& opened;
+	Gauge& open;
+	Histogram& duration;
+};
+
+// Connections of both protocols open in the process
+static std::atomic<std::size_t> open_connection_count{0};
+
+static ConnectionMetrics& connection_metrics(bool https) {
+	static ConnectionMetrics http_metrics("http");
+	static ConnectionMetrics https_metrics("https");
+	return https ? https_metrics : http_metrics;
+}
+
+// Responses written, by status class, including those without a handler
+static Counter& responses_counter(int code) {
+	static Counter* counters[status_class_count] = {};
+	static std::once_flag once;
+	std::call_once(once, []() {
+		for (std::size_t i = 0; i < status_class_count; i++) {
+			counters[i] = &MetricsRegistry::instance().counter("koko_responses_total", "Responses written, by status class", {{"code", status_class_name(i)}});
+		}
+	});
+	return *counters[status_class_index(code)];
+}
+
+// Requests answered in the same write as the responses of other pipelined requests
+static Counter& pipelined_counter() {
+	static Counter& counter = MetricsRegistry::instance().counter("koko_pipelined_requests_total", "Requests answered in one write with other pipelined requests");
+	return counter;
+}
+
+// Writes to clients, of one response or of the responses of several pipelined requests
+static Counter& writes_counter() {
+	static Counter& counter = MetricsRegistry::instance().counter("koko_response_writes_total", "Writes of responses to clients");
+	return counter;
+}
+
+// Kept-alive connections closed while waiting for the next request, because they waited for too
+// long or to make room for new connections
+static Counter& idle_closed_counter(bool timeout) {
+	static Counter& timeouts = MetricsRegistry::instance().counter("koko_idle_connections_closed_total", "Kept-alive connections closed while waiting for a request", {{"reason", "timeout"}});
+	static Counter& evictions = MetricsRegistry::instance().counter("koko_idle_connections_closed_total", "Kept-alive connections closed while waiting for a request", {{"reason", "pressure"}});
+	return timeout ? timeouts : evictions;
+}
+
+// Appends the serialized response to out
+static void append_serialized(http::response<http::string_body>& res, std::string& out) {
+	http::response_serializer<http::string_body> sr{res};
+	beast::error_code err;
+	while (!err && !sr.is_done()) {
+		sr.next(err, [&](beast::error_code&, const auto& buffers) {
+			std::size_t size = 0;
+			for (boost::asio::const_buffer buffer : beast::buffers_range_ref(buffers)) {
+				out.append(static_cast<const char*>(buffer.data()), buffer.size());
+				size += buffer.size();
+			}
+			sr.consume(size);
+		});
+	}
+}
+
+// Sets the Date header from the coarse clock, unless the response has one
+template <class Body>
+void set_date(http::response<Body>& res) {
+	if (res.find(http::field::date) == res.end()) {
+		CoarseClock::Date date = CoarseClock::instance().date();
+		res.set(http::field::date, boost::beast::string_view(date.text, date.size));
+	}
+}
+
+// Returns true if the connection needs to be closed after writing the response
+template <class Body>
+bool should_close(http::response<Body>& res) {
+	auto connection = res.find(http::field::connection);
+	if (connection != res.end() && connection->value() == "close") {
+		return true;
+	}
+	return res.need_eof();
+}
+
+// Leaves out the body of a response to a HEAD request, keeping the headers it has for GET.
+// Without a Content-Length, the end of a chunked body could not be written without the body,
+// so the connection is closed after the headers instead.
+template <class Body>
+void drop_body(http::response<Body>& res) {
+	if (res.chunked()) {
+		res.chunked(false);
+	}
+	res.body() = typename Body::value_type();
+}
+
 void session::do_read() {
 	TRACE << name << "starting work in a strand";
 
@@ -19,12 +138,75 @@ void session::do_read() {
 	// otherwise the operation behavior is undefined.
 	req_ = {};
 
-	// Set the timeout.
-	set_expiration(std::chrono::seconds(30));
+	// Kept-alive connections wait for the next request to begin arriving with the idle timeout
+	if (requests_ > 0 && buffer_.size() == 0) {
+		waiting_ = true;
+		IdleConnections::instance().add(this);
+		set_expiration(idle_timeout_);
+		async_read_some_stream();
+		return;
+	}
 
+	set_expiration(options_.request_timeout);
 	async_read_stream();
 }
 
+void session::on_idle_read(beast::error_code err, std::size_t bytes_transferred) {
+	waiting_ = false;
+	IdleConnections::instance().remove(this);
+
+	if (evicted_) {
+		TRACE << name << "closing idle connection to make room for new connections";
+		idle_closed_counter(false).inc();
+		shutdown_stream();
+		return;
+	}
+
+	// The stream is closed once it times out
+	if (err == beast::error::timeout) {
+		TRACE << name << "stream ended, idle timeout";
+		idle_closed_counter(true).inc();
+		return;
+	}
+
+	if (err) {
+		beast::error_code ec = shutdown_stream();
+		TRACE << name << "stream ended while waiting for a request: " << err.message() << ", err: " << ec.message();
+		return;
+	}
+
+	buffer_.commit(bytes_transferred);
+	set_expiration(options_.request_timeout);
+	async_read_stream();
+}
+
+void session::close_idle() {
+	if (!waiting_) {
+		return;
+	}
+	evicted_ = true;
+	cancel_stream();
+}
+
+bool session::keeps_alive(RequestHandler* handler, const http::request<http::string_body>& req) {
+	if (!handler->keep_alive || !req.keep_alive()) {
+		return false;
+	}
+
+	// Settings of the location take precedence over those of the server
+	std::size_t max_requests = handler->keepalive_requests >= 0 ? handler->keepalive_requests : options_.keepalive_requests;
+	if (requests_ >= max_requests) {
+		TRACE << name << "connection answered its last request: " << requests_;
+		return false;
+	}
+	idle_timeout_ = handler->keepalive_timeout >= 0 ? std::chrono::seconds(handler->keepalive_timeout) : options_.keepalive_timeout;
+	return idle_timeout_.count() > 0;
+}
+
+std::size_t session::open_connections() {
+	return open_connection_count;
+}
+
 void session::on_read(beast::error_code err, std::size_t bytes_transferred) {
 	// async_read also passed us the number of bytes read.
 	// It would have read all of the request and not some part of it.
@@ -39,32 +221,215 @@ void session::on_read(beast::error_code err, std::size_t bytes_transferred) {
 		return;
 	}
 
-	INFO << "metrics: request path: " << req_.target();
-
-	bool close = false;
 	if (err) {
-		close = true;
-		res_ = RequestHandler::bad_request();
 		ERROR << name << "error occurred while reading from the stream: " << err.message();
-	} else {
-		TRACE << name << "successfully read a request from the stream of size (bytes): " << bytes_transferred;
+		INFO << "metrics: request path: " << req_.target();
+		if (!client_ip_.empty()) {
+			HotKeys::clients().add(client_ip_);
+		}
+		request_begin_ = std::chrono::steady_clock::now();
+		handler_ = nullptr;
+		write_canned_response(RequestHandler::canned_bad_request(), true);
+		return;
+	}
+
+	TRACE << name << "successfully read a request from the stream of size (bytes): " << bytes_transferred;
+	handle_request();
+}
+
+void session::handle_request() {
+	INFO << "metrics: request path: " << req_.target();
+	if (!client_ip_.empty()) {
+		HotKeys::clients().add(client_ip_);
+	}
+	request_begin_ = std::chrono::steady_clock::now();
+	handler_ = nullptr;
+	requests_++;
+	TRACE << name << "received " << req_.method() << " request, user agent '" << req_[http::field::user_agent] << "'";
+
+	RequestHandler* correct_handler = find_handler(req_);
+	handler_ = correct_handler;
+	if (correct_handler == nullptr) {
+		write_canned_response(RequestHandler::canned_not_found_error(), true);
+		return;
+	}
+
+	// Responses that are the same every time are written as they were serialized
+	const CannedResponse* canned = correct_handler->get_canned_response(req_);
+	if (canned != nullptr) {
+		TRACE << name << "handler has a canned response";
+		write_canned_response(*canned, !keeps_alive(correct_handler, req_));
+		return;
+	}
+
+	// Prefer streaming the response body if the handler can
+	if (correct_handler->get_static_response(req_, static_res_)) {
+		TRACE << name << "handler streams the response body";
+		set_connection(keeps_alive(correct_handler, req_), static_res_);
+		if (flush_pipeline(AfterPipeline::static_response)) {
+			return;
+		}
+		write_response(true, false);
+		return;
+	}
+
+	// Handlers waiting on I/O or timers complete the response later, the session does nothing until then
+	if (correct_handler->is_asynchronous()) {
+		if (flush_pipeline(AfterPipeline::async_response)) {
+			return;
+		}
+		start_async_response(correct_handler);
+		return;
+	}
 
-		// generate the response from the request stored as a data member in this session object
-		// and store the response in another data member.
-		construct_response(req_, res_);
+	// Other handlers are called directly, without allocating a callback
+	res_ = correct_handler->get_response(req_);
+	set_connection(keeps_alive(correct_handler, req_), res_);
+	write_response(false, false);
+}
 
-		if(res_.find(http::field::connection) != res_.end() && res_.at(http::field::connection).to_string() == "close"){
-			TRACE << name << "force close in handler";
-			close = true;
+void session::start_async_response(RequestHandler* handler) {
+	std::shared_ptr<session> self = shared_session();
+	bool keep_alive = keeps_alive(handler, req_);
+	handler->get_async_response(req_, get_executor(), [self, keep_alive](http::response<http::string_body> res) {
+		self->res_ = std::move(res);
+		set_connection(keep_alive, self->res_);
+		self->write_response(false, false);
+	});
+}
+
+void session::write_response(bool is_static, bool close) {
+	if (req_.method() == http::verb::head) {
+		if (is_static) {
+			drop_body(static_res_);
+		} else {
+			drop_body(res_);
 		}
-		else {close = res_.need_eof();}
+	}
+	close = close || (is_static ? should_close(static_res_) : should_close(res_));
+	if (close) {
+		TRACE << name << "closing connection after the response";
 	}
 
-	INFO << "metrics: response code: " << res_.result_int();
+	int code = is_static ? static_res_.result_int() : res_.result_int();
+	INFO << "metrics: response code: " << code;
+	responses_counter(code).inc();
+
+	// Proxied responses keep the Date of the upstream server
+	if (is_static) {
+		set_date(static_res_);
+	} else {
+		set_date(res_);
+	}
 
 	// Asynchronously write the response back to the stream so that it it sent
 	// and then call finished_write().
-	async_write_stream(close);
+	if (is_static) {
+		async_write_static_stream(close);
+		return;
+	}
+
+	bool next = read_pipelined(close);
+	if (pipelined_ == 0 && !next) {
+		async_write_stream(close);
+		return;
+	}
+	append_serialized(res_, pipeline_out_);
+	res_ = {};
+	pipeline_response(next, close);
+}
+
+void session::write_canned_response(const CannedResponse& canned, bool close) {
+	if (close) {
+		TRACE << name << "closing connection after the response";
+	}
+
+	int code = canned.result_int();
+	INFO << "metrics: response code: " << code;
+	responses_counter(code).inc();
+
+	CoarseClock::Date date = CoarseClock::instance().date();
+	canned_fields_.assign("Date: ");
+	canned_fields_.append(date.text, date.size);
+	canned_fields_.append(close ? "\r\nConnection: close\r\n" : "\r\nConnection: keep-alive\r\n");
+	canned_res_ = &canned;
+	canned_head_only_ = req_.method() == http::verb::head;
+
+	bool next = read_pipelined(close);
+	if (pipelined_ == 0 && !next) {
+		async_write_canned_stream(close);
+		return;
+	}
+	for (boost::asio::const_buffer buffer : canned_buffers()) {
+		pipeline_out_.append(static_cast<const char*>(buffer.data()), buffer.size());
+	}
+	canned_res_ = nullptr;
+	pipeline_response(next, close);
+}
+
+bool session::read_pipelined(bool close) {
+	if (close || pipelined_ + 1 >= options_.pipeline_depth || buffer_.size() == 0) {
+		return false;
+	}
+
+	// Parse without consuming, so that a partial request is read again by the next read
+	http::request_parser<http::string_body> parser;
+	parser.eager(true);
+	const char* data = static_cast<const char*>(buffer_.data().data());
+	std::size_t used = 0;
+	beast::error_code err;
+	while (!parser.is_done()) {
+		std::size_t n = parser.put(boost::asio::buffer(data + used, buffer_.size() - used), err);
+		used += n;
+		if (err || n == 0) {
+			// Malformed requests are left for the next read to report
+			return false;
+		}
+	}
+
+	buffer_.consume(used);
+	req_ = parser.release();
+	TRACE << name << "read a pipelined request of size (bytes): " << used;
+	return true;
+}
+
+void session::pipeline_response(bool next, bool close) {
+	pipelined_++;
+	pipelined_counter().inc();
+	if (handler_ != nullptr) {
+		handler_->record_latency(std::chrono::steady_clock::now() - request_begin_);
+		handler_ = nullptr;
+	}
+
+	if (next) {
+		handle_request();
+		return;
+	}
+	TRACE << name << "writing the responses of " << pipelined_ << " pipelined requests";
+	async_write_pipeline_stream(close);
+}
+
+bool session::flush_pipeline(AfterPipeline after) {
+	if (pipelined_ == 0) {
+		return false;
+	}
+	TRACE << name << "writing the responses of " << pipelined_ << " pipelined requests first";
+	after_pipeline_ = after;
+	async_write_pipeline_stream(false);
+	return true;
+}
+
+ConnectionOptions ConnectionOptions::from_config(NginxConfig& config) {
+	ConnectionOptions options;
+	options.pipeline_depth = std::max(config.get_num("pipelineDepth"), 1);
+	options.keepalive_timeout = std::chrono::seconds(std::max(config.get_num("keepalive_timeout"), 0));
+	options.keepalive_requests = std::max(config.get_num("keepalive_requests"), 0);
+	options.max_connections = std::max(config.get_num("maxConnections"), 0);
+	return options;
+}
+
+std::array<boost::asio::const_buffer, 3> session::canned_buffers() const {
+	return {canned_res_->head(), boost::asio::buffer(canned_fields_), canned_head_only_ ? canned_res_->end_of_head() : canned_res_->tail()};
 }
 
 void session::finished_write(bool close, beast::error_code err, std::size_t bytes_transferred) {
@@ -72,6 +437,15 @@ void session::finished_write(bool close, beast::error_code err, std::size_t byte
 		ERROR << name << "error occurred before finishing write: " << err.message();
 		return;
 	}
+	writes_counter().inc();
+
+	// Pipelined responses had their latency recorded as they were serialized
+	if (pipelined_ > 0) {
+		pipeline_out_.clear();
+		pipelined_ = 0;
+	} else if (handler_ != nullptr) {
+		handler_->record_latency(std::chrono::steady_clock::now() - request_begin_);
+	}
 
 	if (close) {
 		beast::error_code ec = shutdown_stream();
@@ -82,8 +456,22 @@ void session::finished_write(bool close, beast::error_code err, std::size_t byte
 
 	TRACE << name << "finished writing a response, size (bytes): " << bytes_transferred;
 
-	// Remove the response for the past request
+	// The request after the pipelined ones was answered, but could not be written with them
+	AfterPipeline after = after_pipeline_;
+	after_pipeline_ = AfterPipeline::none;
+	if (after == AfterPipeline::static_response) {
+		write_response(true, false);
+		return;
+	}
+	if (after == AfterPipeline::async_response) {
+		start_async_response(handler_);
+		return;
+	}
+
+	// Remove the response for the past request, closing any file it was streaming
 	res_ = {};
+	static_res_ = {};
+	canned_res_ = nullptr;
 
 	// we have finished a write, let us read another request from the same connection
 	do_read();
@@ -92,58 +480,70 @@ void session::finished_write(bool close, beast::error_code err, std::size_t byte
 void session::construct_response(http::request<http::string_body>& req, http::response<http::string_body>& res) {
 	TRACE << name << "received " << req.method() << " request, user agent '" << req[http::field::user_agent] << "'";
 
-	std::string target = std::string(req.target());
+	RequestHandler* correct_handler = find_handler(req);
+	if (correct_handler == nullptr) {
+		res = RequestHandler::not_found_error();
+		return;
+	}
 
-	// ignore characters after the first "?" that is after the last "/" in URL
-	size_t last_slash_index = target.rfind("/");
-	if (last_slash_index != std::string::npos) {
-		size_t first_qmark_index = target.substr(last_slash_index).find("?");
-		if (first_qmark_index != std::string::npos) {
-			target.erase(first_qmark_index);
-		}
+	res = correct_handler->get_response(req);
+	set_connection(keeps_alive(correct_handler, req), res);
+}
+
+bool session::construct_response(http::request<http::string_body>& req, http::response<http::string_body>& res, http::response<static_body>& static_res) {
+	TRACE << name << "received " << req.method() << " request, user agent '" << req[http::field::user_agent] << "'";
+	return construct_response(find_handler(req), req, res, static_res);
+}
+
+bool session::construct_response(RequestHandler* correct_handler, http::request<http::string_body>& req, http::response<http::string_body>& res, http::response<static_body>& static_res) {
+	if (correct_handler == nullptr) {
+		res = RequestHandler::not_found_error();
+		return false;
 	}
 
-	// add / to make sure the directory name is the same
-	target = target + "/";
+	// Prefer streaming the response body if the handler can
+	if (correct_handler->get_static_response(req, static_res)) {
+		TRACE << name << "handler streams the response body";
+		set_connection(keeps_alive(correct_handler, req), static_res);
+		return true;
+	}
 
-	size_t longest_prefix_match = 0;
-	std::string handler_url = "";
-	RequestHandler* correct_handler = nullptr;
+	res = correct_handler->get_response(req);
+	set_connection(keeps_alive(correct_handler, req), res);
+	return false;
+}
 
-	//find correct handler (longest matching prefix)
-	for (std::pair<std::string, RequestHandler*> handler_mapping : urlToHandler) {
-		std::string handler_url_prefix = handler_mapping.first;
-		size_t prefix_len = handler_url_prefix.size();
+void session::count_connection_opened(bool https) {
+	ConnectionMetrics& metrics = connection_metrics(https);
+	metrics.opened.inc();
+	metrics.open.add(1);
+	open_connection_count++;
+}
 
-		bool longest_prefix_string_match = target.substr(0, prefix_len) == handler_url_prefix && prefix_len > longest_prefix_match;
-		bool last_dirname_not_a_substr = (target[prefix_len] == '/') || handler_url_prefix == "/";
+void session::count_connection_closed(bool https) {
+	ConnectionMetrics& metrics = connection_metrics(https);
+	metrics.open.sub(1);
+	open_connection_count--;
+	metrics.duration.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+}
 
-		if (longest_prefix_string_match && last_dirname_not_a_substr) {
-			longest_prefix_match = prefix_len;
-			correct_handler = handler_mapping.second;
-			handler_url = handler_url_prefix;
-		}
-	}
+RequestHandler* session::find_handler(http::request<http::string_body>& req) {
+	// find correct handler (longest matching prefix)
+	std::string_view handler_url;
+	RequestHandler* correct_handler = router->match(std::string_view(req.target().data(), req.target().size()), &handler_url);
 
 	if (correct_handler == nullptr) {
 		TRACE << name << "no request handler exists for " << req.method() << " request from user agent '" << req[http::field::user_agent] << "'";
-		res = RequestHandler::not_found_error();
-	} else {
-		TRACE << name << "handler creating the response is mapped to: " << handler_url;
-		INFO << "metrics: " << name << "serving URL: " << handler_url;
-		INFO << "metrics: handler handling request: " << correct_handler->get_name();
+		return nullptr;
+	}
 
-		// To identify timing metrics of compressed file handler
-		if (correct_handler->get_name() == "CompressedFileHandler") {
-			name += "CompressedFileHandler: ";
-		}
+	TRACE << name << "handler creating the response is mapped to: " << handler_url;
+	INFO << "metrics: " << name << "serving URL: " << handler_url;
+	INFO << "metrics: handler handling request: " << correct_handler->get_name();
 
-		res = correct_handler->get_response(req);
-		if(correct_handler->keep_alive){
-			res.set(http::field::connection, "keep-alive");
-		}
-		else {
-			res.set(http::field::connection, "close");
-		}
+	// To identify timing metrics of compressed file handler, once per session
+	if (correct_handler->get_name() == "CompressedFileHandler" && name.find("CompressedFileHandler: ") == std::string::npos) {
+		name += "CompressedFileHandler: ";
 	}
-}
\ No newline at end of file
+	return correct_handler;
+}
@@ -5,25 +5,42 @@
 
 #include "config.h"
 #include "handler.h"
+#include "idleConnections.h"
 #include "logger.h"
+#include "tlsResumption.h"
 
 using boost::asio::ip::tcp;
 namespace http = boost::beast::http;
 
-sessionSSL::sessionSSL(ssl::context& ctx, NginxConfig* c, std::vector<std::pair<std::string, RequestHandler*>>& utoh, tcp::socket&& socket)
+sessionSSL::sessionSSL(ssl::context& ctx, NginxConfig* c, const std::shared_ptr<const Router>& r, tcp::socket&& socket)
+    : sessionSSL(ctx, c, r, std::move(socket), ConnectionOptions::from_config(*c)) {
+}
+
+sessionSSL::sessionSSL(ssl::context& ctx, NginxConfig* c, const std::shared_ptr<const Router>& r, tcp::socket&& socket, const ConnectionOptions& options)
     : stream_(std::move(socket), ctx) {
 	config = c;
-	urlToHandler = utoh;
+	router = r;
 	name = "sessionSSL: ";
+	options_ = options;
+
+	// Responses written in several parts are not held back waiting for acknowledgments
+	beast::error_code err;
+	stream_.next_layer().socket().set_option(tcp::no_delay(true), err);
 	TRACE << name << "constructed a new session";
 	log_ip_address();
 	begin = std::chrono::steady_clock::now();
+	count_connection_opened(true);
 }
 
 sessionSSL::~sessionSSL() {
 	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
 	std::chrono::microseconds difference = std::chrono::duration_cast<std::chrono::microseconds>(end - begin);
 	INFO << "metrics: " << name << " alive time (ms): " << difference.count();
+	IdleConnections::instance().remove(this);
+	count_connection_closed(true);
+
+	// Connections end without a TLS shutdown, which would otherwise remove their session from the cache
+	SSL_set_shutdown(stream_.native_handle(), SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
 	TRACE << name << "closed";
 }
 
@@ -57,6 +74,7 @@ void sessionSSL::do_handshake() {
 
 void sessionSSL::after_handshake(boost::beast::error_code err) {
 	TRACE << name << "in after handshake handler";
+	TlsResumption::count_handshake(stream_.native_handle(), bool(err));
 	if (err) {
 		TRACE << name << "error while doing handshake: " << err.message();
 		return;
@@ -73,6 +91,11 @@ void sessionSSL::async_read_stream() {
 	                 beast::bind_front_handler(&sessionSSL::on_read, shared_from_this()));
 }
 
+void sessionSSL::async_read_some_stream() {
+	stream_.async_read_some(buffer_.prepare(beast::read_size(buffer_, 65536)),
+	                        beast::bind_front_handler(&sessionSSL::on_idle_read, shared_from_this()));
+}
+
 void sessionSSL::async_write_stream(bool close) {
 	// Asynchronously write the response back to the stream so that it it sent
 	// and then call finished_write().
@@ -80,10 +103,27 @@ void sessionSSL::async_write_stream(bool close) {
 	                  beast::bind_front_handler(&sessionSSL::finished_write, shared_from_this(), close));
 }
 
+void sessionSSL::async_write_static_stream(bool close) {
+	// The body needs to be encrypted, so it cannot be sent straight from the file
+	http::async_write(stream_, static_res_,
+	                  beast::bind_front_handler(&sessionSSL::finished_write, shared_from_this(), close));
+}
+
+void sessionSSL::async_write_canned_stream(bool close) {
+	boost::asio::async_write(stream_, canned_buffers(),
+	                         beast::bind_front_handler(&sessionSSL::finished_write, shared_from_this(), close));
+}
+
+void sessionSSL::async_write_pipeline_stream(bool close) {
+	boost::asio::async_write(stream_, boost::asio::buffer(pipeline_out_),
+	                         beast::bind_front_handler(&sessionSSL::finished_write, shared_from_this(), close));
+}
+
 void sessionSSL::log_ip_address() {
 	try {
 		std::string ip_addr = stream_.next_layer().socket().remote_endpoint().address().to_string();
 		INFO << "metrics: request IP: " << ip_addr;
+		client_ip_ = ip_addr;
 	} catch (std::exception& e) {
 		TRACE << name << "exception occurred while getting the IP address of socket: " << e.what();
 	}
@@ -97,4 +137,20 @@ boost::beast::error_code sessionSSL::shutdown_stream() {
 	boost::beast::error_code err;
 	stream_.next_layer().socket().shutdown(tcp::socket::shutdown_send, err);
 	return err;
-}
\ No newline at end of file
+}
+
+void sessionSSL::cancel_stream() {
+	stream_.next_layer().cancel();
+}
+
+boost::asio::any_io_executor sessionSSL::get_executor() {
+	return stream_.get_executor();
+}
+
+std::shared_ptr<session> sessionSSL::shared_session() {
+	return shared_from_this();
+}
+
+std::weak_ptr<session> sessionSSL::weak_session() {
+	return weak_from_this();
+}
@@ -2,28 +2,45 @@
 
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
+#include <cerrno>
+#include <sys/sendfile.h>
 
 #include "config.h"
 #include "handler.h"
+#include "idleConnections.h"
 #include "logger.h"
 
 using boost::asio::ip::tcp;
 namespace http = boost::beast::http;
 
-sessionTCP::sessionTCP(NginxConfig* c, std::vector<std::pair<std::string, RequestHandler*>>& utoh, tcp::socket&& socket)
-    : stream_(std::move(socket)) {
+sessionTCP::sessionTCP(NginxConfig* c, const std::shared_ptr<const Router>& r, tcp::socket&& socket)
+    : sessionTCP(c, r, std::move(socket), ConnectionOptions::from_config(*c)) {
+}
+
+sessionTCP::sessionTCP(NginxConfig* c, const std::shared_ptr<const Router>& r, tcp::socket&& socket, const ConnectionOptions& options)
+    : stream_(std::move(socket)),
+      file_offset_(0),
+      send_timer_(stream_.get_executor()) {
 	config = c;
-	urlToHandler = utoh;
+	router = r;
 	name = "sessionTCP: ";
+	options_ = options;
+
+	// Responses written in several parts are not held back waiting for acknowledgments
+	beast::error_code err;
+	stream_.socket().set_option(tcp::no_delay(true), err);
 	TRACE << name << "constructed a new session";
 	log_ip_address();
 	begin = std::chrono::steady_clock::now();
+	count_connection_opened(false);
 }
 
 sessionTCP::~sessionTCP() {
 	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
 	std::chrono::microseconds difference = std::chrono::duration_cast<std::chrono::microseconds>(end - begin);
 	INFO << "metrics: " << name << " alive time (ms): " << difference.count();
+	IdleConnections::instance().remove(this);
+	count_connection_closed(false);
 	TRACE << name << "closed";
 }
 
@@ -60,6 +77,11 @@ void sessionTCP::async_read_stream() {
 	                 beast::bind_front_handler(&sessionTCP::on_read, shared_from_this()));
 }
 
+void sessionTCP::async_read_some_stream() {
+	stream_.async_read_some(buffer_.prepare(beast::read_size(buffer_, 65536)),
+	                        beast::bind_front_handler(&sessionTCP::on_idle_read, shared_from_this()));
+}
+
 void sessionTCP::async_write_stream(bool close) {
 	// Asynchronously write the response back to the stream so that it it sent
 	// and then call finished_write().
@@ -67,10 +89,96 @@ void sessionTCP::async_write_stream(bool close) {
 	                  beast::bind_front_handler(&sessionTCP::finished_write, shared_from_this(), close));
 }
 
+void sessionTCP::async_write_static_stream(bool close) {
+	if (!static_res_.body().is_open()) {
+		// Bodies from the content cache are already in memory, and generated bodies are written as they are generated
+		http::async_write(stream_, static_res_,
+		                  beast::bind_front_handler(&sessionTCP::finished_write, shared_from_this(), close));
+		return;
+	}
+
+	static_sr_.emplace(static_res_);
+	http::async_write_header(stream_, *static_sr_,
+	                         beast::bind_front_handler(&sessionTCP::on_write_static_header, shared_from_this(), close));
+}
+
+void sessionTCP::on_write_static_header(bool close, beast::error_code err, std::size_t bytes_transferred) {
+	if (err) {
+		static_sr_.reset();
+		finished_write(close, err, bytes_transferred);
+		return;
+	}
+
+	file_offset_ = 0;
+	send_file(close, bytes_transferred, {});
+}
+
+void sessionTCP::send_file(bool close, std::size_t bytes_transferred, beast::error_code err) {
+	send_timer_.cancel();
+	if (err) {
+		ERROR << name << "error occurred while waiting to send file: " << err.message();
+		static_sr_.reset();
+		finished_write(true, err, bytes_transferred);
+		return;
+	}
+
+	tcp::socket& socket = stream_.socket();
+	int file = static_res_.body().file().native_handle();
+	off_t size = static_res_.body().size();
+
+	// sendfile should return instead of blocking when the socket buffer is full
+	socket.native_non_blocking(true, err);
+
+	while (!err && file_offset_ < size) {
+		ssize_t n = ::sendfile(socket.native_handle(), file, &file_offset_, size - file_offset_);
+		if (n > 0) {
+			bytes_transferred += n;
+		} else if (n < 0 && errno == EINTR) {
+			continue;
+		} else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			// Continue once the socket can take more data, or give up after a while
+			send_timer_.expires_after(std::chrono::seconds(30));
+			send_timer_.async_wait([self = shared_from_this()](beast::error_code ec) {
+				if (!ec) {
+					beast::error_code ignored;
+					self->stream_.socket().cancel(ignored);
+				}
+			});
+			socket.async_wait(tcp::socket::wait_write,
+			                  beast::bind_front_handler(&sessionTCP::send_file, shared_from_this(), close, bytes_transferred));
+			return;
+		} else if (n == 0) {
+			// The file became shorter than its size
+			err = http::error::short_read;
+		} else {
+			err = beast::error_code(errno, boost::system::system_category());
+		}
+	}
+
+	static_sr_.reset();
+	if (err) {
+		ERROR << name << "error occurred while sending file: " << err.message();
+		finished_write(true, err, bytes_transferred);
+		return;
+	}
+	finished_write(close, err, bytes_transferred);
+}
+
+void sessionTCP::async_write_canned_stream(bool close) {
+	boost::asio::async_write(stream_, canned_buffers(),
+	                         beast::bind_front_handler(&sessionTCP::finished_write, shared_from_this(), close));
+}
+
+void sessionTCP::async_write_pipeline_stream(bool close) {
+	boost::asio::async_write(stream_, boost::asio::buffer(pipeline_out_),
+	                         beast::bind_front_handler(&sessionTCP::finished_write, shared_from_this(), close));
+}
+
 void sessionTCP::log_ip_address() {
 	try {
 		std::string ip_addr = stream_.socket().remote_endpoint().address().to_string();
 		INFO << "metrics: request IP: " << ip_addr;
+		client_ip_ = ip_addr;
 	} catch (std::exception& e) {
 		TRACE << name << "exception occurred while getting the IP address of socket: " << e.what();
 	}
@@ -85,3 +193,19 @@ boost::beast::error_code sessionTCP::shutdown_stream() {
 	stream_.socket().shutdown(tcp::socket::shutdown_both, err);
 	return err;
 }
+
+void sessionTCP::cancel_stream() {
+	stream_.cancel();
+}
+
+boost::asio::any_io_executor sessionTCP::get_executor() {
+	return stream_.get_executor();
+}
+
+std::shared_ptr<session> sessionTCP::shared_session() {
+	return shared_from_this();
+}
+
+std::weak_ptr<session> sessionTCP::weak_session() {
+	return weak_from_this();
+}
@@ -1,24 +1,42 @@
 #include "sleepEchoHandler.h"
 
+#include <boost/asio/steady_timer.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
-#include <boost/chrono.hpp>
-#include <boost/thread/thread.hpp>
+#include <memory>
 #include <string>
+#include <thread>
 
 #include "logger.h"
 
 namespace http = boost::beast::http;
 
+constexpr std::chrono::milliseconds SleepEchoHandler::delay;
+
 SleepEchoHandler::SleepEchoHandler(const std::string& p, __attribute__((unused)) const NginxConfig& config)
     : EchoHandler(p, config) {
 	name = "SleepEcho";
 }
 
 http::response<http::string_body> SleepEchoHandler::handle_request(const http::request<http::string_body>& request) {
-	boost::this_thread::sleep_for(boost::chrono::milliseconds(3000));
+	// Synchronous callers have nothing else to do while waiting
+	std::this_thread::sleep_for(delay);
+	return EchoHandler::handle_request(request);
+}
 
-	http::response<http::string_body> res;
-	res = EchoHandler::handle_request(request);
-	return res;
-}
\ No newline at end of file
+bool SleepEchoHandler::is_asynchronous() const {
+	return true;
+}
+
+void SleepEchoHandler::handle_async_request(const http::request<http::string_body>& request, const boost::asio::any_io_executor& executor, ResponseHandler done) {
+	// Wait on a timer instead of the thread, so that other requests are served in the meantime
+	auto timer = std::make_shared<boost::asio::steady_timer>(executor, delay);
+	timer->async_wait([this, timer, request, done = std::move(done)](boost::beast::error_code err) {
+		if (err) {
+			ERROR << "SleepEchoHandler timer failed: " << err.message();
+			done(RequestHandler::internal_server_error());
+			return;
+		}
+		done(EchoHandler::handle_request(request));
+	});
+}
@@ -0,0 +1,99 @@
+#include "staticBody.h"
+
+#include <algorithm>
+
+void static_body::value_type::open(const char* path, beast::error_code& err) {
+	file_.open(path, beast::file_mode::scan, err);
+	if (err) {
+		return;
+	}
+	size_ = file_.size(err);
+	if (err) {
+		file_.close(err);
+		size_ = 0;
+	}
+}
+
+bool static_body::value_type::is_open() const {
+	return file_.is_open();
+}
+
+beast::file& static_body::value_type::file() {
+	return file_;
+}
+
+void static_body::value_type::set_buffer(std::shared_ptr<const std::string> buffer) {
+	size_ = buffer ? buffer->size() : 0;
+	buffer_ = std::move(buffer);
+}
+
+const std::shared_ptr<const std::string>& static_body::value_type::buffer() const {
+	return buffer_;
+}
+
+void static_body::value_type::set_generator(generator_type generator) {
+	size_ = 0;
+	generator_ = std::move(generator);
+}
+
+const static_body::generator_type& static_body::value_type::generator() const {
+	return generator_;
+}
+
+std::uint64_t static_body::value_type::size() const {
+	return size_;
+}
+
+std::uint64_t static_body::size(const value_type& body) {
+	return body.size();
+}
+
+void static_body::writer::init(beast::error_code& err) {
+	remain_ = body_.size();
+	more_ = static_cast<bool>(body_.generator());
+	if (body_.is_open()) {
+		body_.file().seek(0, err);
+	} else {
+		err = {};
+	}
+}
+
+boost::optional<std::pair<static_body::writer::const_buffers_type, bool>> static_body::writer::get(beast::error_code& err) {
+	err = {};
+	if (body_.generator()) {
+		// Skip empty pieces, an empty chunk would end a chunked body
+		chunk_.clear();
+		while (more_ && chunk_.empty()) {
+			more_ = body_.generator()(chunk_);
+		}
+		if (chunk_.empty()) {
+			return boost::none;
+		}
+		return {{const_buffers_type{chunk_.data(), chunk_.size()}, more_}};
+	}
+
+	if (remain_ == 0) {
+		return boost::none;
+	}
+
+	if (body_.buffer()) {
+		// The whole buffer is written at once
+		remain_ = 0;
+		return {{const_buffers_type{body_.buffer()->data(), body_.buffer()->size()}, false}};
+	}
+
+	// Read the next chunk of the file
+	std::size_t amount = std::min<std::uint64_t>(remain_, sizeof(buf_));
+	std::size_t n = body_.file().read(buf_, amount, err);
+	if (err) {
+		return boost::none;
+	}
+	if (n == 0) {
+		// The file became shorter than its size
+		err = http::error::short_read;
+		return boost::none;
+	}
+
+	remain_ -= n;
+	return {{const_buffers_type{buf_, n}, remain_ > 0}};
+}
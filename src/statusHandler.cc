@@ -1,86 +1,498 @@
 #include "statusHandler.h"
 
+#include <algorithm>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
-#include <boost/date_time/local_time_adjustor.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <map>
+#include <memory>
+#include <sstream>
 #include <string>
+#include <utility>
 
+#include "coarseClock.h"
+#include "compressionCache.h"
+#include "contentCache.h"
 #include "handler.h"
+#include "heavyHitters.h"
+#include "metrics.h"
+#include "requestHistory.h"
+#include "router.h"
 #include "server.h"
+#include "upstreamPool.h"
 
 namespace http = boost::beast::http;
-typedef boost::date_time::local_adjustor<boost::posix_time::ptime, -8, boost::posix_time::us_dst> us_pacific;
+
+namespace {
+// Rows written per chunk of the page
+constexpr std::size_t rows_per_chunk = 64;
+
+// Requests of a url or handler, by status class
+struct Summary {
+	std::string name;
+	std::uint64_t requests = 0;
+	std::uint64_t codes[status_class_count] = {};
+};
+
+// Summaries sorted by the number of requests, at most limit of them
+std::vector<Summary> top_summaries(std::map<std::string, Summary>& summaries, std::size_t limit) {
+	std::vector<Summary> top;
+	top.reserve(summaries.size());
+	for (auto& entry : summaries) {
+		entry.second.name = entry.first;
+		top.push_back(std::move(entry.second));
+	}
+	std::stable_sort(top.begin(), top.end(), [](const Summary& a, const Summary& b) { return a.requests > b.requests; });
+	if (top.size() > limit) {
+		top.resize(limit);
+	}
+	return top;
+}
+
+void append_html(std::string& out, const std::string& text) {
+	for (char c : text) {
+		switch (c) {
+			case '<': out += "&lt;"; break;
+			case '>': out += "&gt;"; break;
+			case '&': out += "&amp;"; break;
+			case '"': out += "&quot;"; break;
+			default: out += c;
+		}
+	}
+}
+
+void append_json(std::string& out, const std::string& text) {
+	static const char hex[] = "0123456789abcdef";
+	out += '"';
+	for (char c : text) {
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += c;
+		} else if ((unsigned char)c < 0x20) {
+			out += "\\u00";
+			out += hex[(c >> 4) & 0xf];
+			out += hex[c & 0xf];
+		} else {
+			out += c;
+		}
+	}
+	out += '"';
+}
+
+// A statistic of a cache or pool, written as a table row or a JSON member
+struct Statistic {
+	std::string name;
+	std::string key;
+	std::string value;
+};
+
+template <class T>
+Statistic statistic(const std::string& name, const std::string& key, T value) {
+	std::ostringstream out;
+	out << value;
+	return {name, key, out.str()};
+}
+
+// The status page. Everything shown is gathered when it is created, and then written out a
+// chunk at a time, so memory depends on the number of requests listed and not on the number served.
+class StatusPage {
+   public:
+	StatusPage(const StatusHandler::Query& query, const std::string& target)
+	    : query_(query),
+	      target_(target) {
+		RequestHistory& history = RequestHistory::instance();
+		// Counting the request for this page, which is recorded once the page is written
+		total_ = history.total() + 1;
+		requests_ = history.snapshot(query.limit, query.since);
+		// The position of the newest request listed, not its time, since requests share microseconds
+		next_since_ = query.since.time_us >= 0 ? query.since : HistoryCursor::after(0);
+		for (const URLInfo& info : requests_) {
+			next_since_ = std::max(next_since_, info.cursor);
+		}
+
+		// Summaries of every request still in the history
+		std::map<std::string, Summary> urls;
+		std::map<std::string, Summary> handlers;
+		for (const URLInfo& info : history.snapshot()) {
+			for (Summary* summary : {&urls[std::string(Router::strip_query(info.url))], &handlers[info.handler]}) {
+				summary->requests++;
+				summary->codes[status_class_index(info.res_code)]++;
+			}
+		}
+		urls_ = top_summaries(urls, query.limit);
+		handlers_ = top_summaries(handlers, query.limit);
+
+		// The most frequent keys of the heavy hitter window, which covers more requests than the history
+		hot_window_ = HotKeys::paths().options().window.count();
+		hot_ = {{"Paths", "paths", HotKeys::paths().top()},
+		        {"Handlers", "handlers", HotKeys::handlers().top()},
+		        {"Clients", "clients", HotKeys::clients().top()}};
+
+		ContentCache::Stats cache = ContentCache::instance().stats();
+		content_cache_ = {statistic("Hits", "hits", cache.hits),
+		                  statistic("Misses", "misses", cache.misses),
+		                  statistic("Rejected", "rejected", cache.rejected),
+		                  statistic("Invalidations", "invalidations", cache.invalidations),
+		                  statistic("Entries", "entries", cache.entries),
+		                  statistic("Size (bytes)", "bytes", cache.bytes),
+		                  statistic("Capacity (bytes)", "capacity", cache.capacity)};
+
+		CompressionCache::Stats compression = CompressionCache::instance().stats();
+		compression_cache_ = {statistic("Hits", "hits", compression.hits),
+		                      statistic("Misses", "misses", compression.misses),
+		                      statistic("Coalesced Misses", "coalesced", compression.coalesced),
+		                      statistic("Hit Ratio", "hit_ratio", compression.hit_ratio()),
+		                      statistic("CPU Time Saved (ms)", "cpu_saved_ms", compression.cpu_saved_ns / 1000000),
+		                      statistic("Entries", "entries", compression.entries),
+		                      statistic("Size (bytes)", "bytes", compression.bytes),
+		                      statistic("Capacity (bytes)", "capacity", compression.capacity)};
+
+		for (UpstreamPool* pool : UpstreamPool::all()) {
+			UpstreamPool::Stats stats = pool->stats();
+			pools_.push_back({statistic("Destination", "destination", pool->host() + ":" + pool->port()),
+			                  statistic("Hits", "hits", stats.hits),
+			                  statistic("Misses", "misses", stats.misses),
+			                  statistic("Hit Rate", "hit_rate", stats.hit_rate()),
+			                  statistic("Active", "active", stats.active),
+			                  statistic("Idle", "idle", stats.idle),
+			                  statistic("Retries", "retries", stats.retries),
+			                  statistic("Stale", "stale", stats.stale)});
+		}
+	}
+
+	// Replaces chunk with the next part of the page, returns false with the last part
+	bool next(std::string& chunk) {
+		chunk.clear();
+		switch (stage_) {
+			case Stage::head:
+				query_.json ? json_head(chunk) : html_head(chunk);
+				stage_ = Stage::requests;
+				return true;
+			case Stage::requests:
+				for (std::size_t end = std::min(row_ + rows_per_chunk, requests_.size()); row_ < end; row_++) {
+					query_.json ? json_request(chunk, requests_[row_]) : html_request(chunk, requests_[row_]);
+				}
+				if (row_ == requests_.size()) {
+					stage_ = Stage::summaries;
+				}
+				return true;
+			case Stage::summaries:
+				query_.json ? json_summaries(chunk) : html_summaries(chunk);
+				stage_ = Stage::tail;
+				return true;
+			case Stage::tail:
+				query_.json ? json_tail(chunk) : html_tail(chunk);
+				stage_ = Stage::done;
+				return false;
+			case Stage::done:
+				break;
+		}
+		return false;
+	}
+
+   private:
+	void html_head(std::string& out) {
+		out += "<html>"
+		       "<head>"
+		       "<style>table{width = \"500\";}td{width = \"400\";}</style>"
+		       "<title>Koko Status Report</title>"
+		       "</head>"
+		       "<body>"
+		       "<h1>Koko Server Status Report</h1>"
+		       "Members: Bryan Nguyen, Hyounjun Chang, Tanmaya Hada, Utsav Munendra<br>"
+		       "<h3>Total Requests Received: " +
+		       std::to_string(total_) +
+		       "</h3>"
+		       "</br>"
+		       "<h3>Received Requests</h3>"
+		       "<table>"
+		       "<tr><th>Location</th><th>Response Code</th><th>Time (LA)</th><th>Handler</th></tr>";
+
+		// The request for this page is not recorded yet
+		if (query_.since.time_us < 0) {
+			boost::posix_time::ptime now = CoarseClock::instance().local_time();
+			out += "<tr><td>";
+			append_html(out, target_);
+			out += "</td><td>200</td><td>" + boost::posix_time::to_simple_string(now) + "</td><td>Status</td></tr>";
+		}
+	}
+
+	void html_request(std::string& out, const URLInfo& info) {
+		out += "<tr><td>";
+		append_html(out, info.url);
+		out += "</td><td>" + std::to_string(info.res_code) + "</td>"
+		       "<td>" + boost::posix_time::to_simple_string(info.req_time) + "</td><td>";
+		append_html(out, info.handler);
+		out += "</td></tr>";
+	}
+
+	void html_summary_table(std::string& out, const std::string& title, const std::string& column, const std::vector<Summary>& summaries) {
+		out += "<h2>" + title + "</h2><table><tr><th>" + column + "</th><th>Requests</th>";
+		for (std::size_t i = 0; i < status_class_count; i++) {
+			out += std::string("<th>") + status_class_name(i) + "</th>";
+		}
+		out += "</tr>";
+		for (const Summary& summary : summaries) {
+			out += "<tr><td>";
+			append_html(out, summary.name);
+			out += "</td><td>" + std::to_string(summary.requests) + "</td>";
+			for (std::uint64_t count : summary.codes) {
+				out += "<td>" + std::to_string(count) + "</td>";
+			}
+			out += "</tr>";
+		}
+		out += "</table></br>";
+	}
+
+	void html_statistics_table(std::string& out, const std::string& title, const std::vector<Statistic>& statistics) {
+		out += "<h2>" + title + "</h2><table><tr><th>Statistic</th><th>Value</th></tr>";
+		for (const Statistic& stat : statistics) {
+			out += "<tr><td>" + stat.name + "</td><td>";
+			append_html(out, stat.value);
+			out += "</td></tr>";
+		}
+		out += "</table></br>";
+	}
+
+	void html_summaries(std::string& out) {
+		out += "</table></br>";
+		html_summary_table(out, "Recent Requests by URL", "Location", urls_);
+		html_summary_table(out, "Recent Requests by Handler", "Handler", handlers_);
+
+		out += "<h2>Registered Handlers</h2><table><tr><th>URL Prefix</th><th>Handler Type</th></tr>";
+		for (const auto& entry : server::urlToHandlerName) {
+			out += "<tr><td>";
+			append_html(out, entry.first);
+			out += "</td><td>" + entry.second + "</td></tr>";
+		}
+		out += "</table></br>";
+
+		for (const HotKeysOf& hot : hot_) {
+			out += "<h2>Hot " + hot.name + " (last " + std::to_string(hot_window_) + "s)</h2><table><tr><th>Key</th><th>Requests</th></tr>";
+			for (const HeavyHitters::Entry& entry : hot.entries) {
+				out += "<tr><td>";
+				append_html(out, entry.key);
+				out += "</td><td>" + std::to_string(entry.count) + "</td></tr>";
+			}
+			out += "</table></br>";
+		}
+
+		html_statistics_table(out, "Content Cache", content_cache_);
+		html_statistics_table(out, "Compression Cache", compression_cache_);
+	}
+
+	void html_tail(std::string& out) {
+		out += "<h2>Upstream Connection Pools</h2><table><tr>";
+		if (!pools_.empty()) {
+			for (const Statistic& stat : pools_[0]) {
+				out += "<th>" + stat.name + "</th>";
+			}
+		}
+		out += "</tr>";
+		for (const auto& pool : pools_) {
+			out += "<tr>";
+			for (const Statistic& stat : pool) {
+				out += "<td>";
+				append_html(out, stat.value);
+				out += "</td>";
+			}
+			out += "</tr>";
+		}
+		out += "</table>"
+		       "</body>"
+		       "</html>";
+	}
+
+	void json_head(std::string& out) {
+		out += "{\"total_requests\":" + std::to_string(total_) +
+		       ",\"next_since\":\"" + next_since_.to_string() + "\"" +
+		       ",\"requests\":[";
+	}
+
+	void json_request(std::string& out, const URLInfo& info) {
+		out += &info == &requests_.front() ? "{\"url\":" : ",{\"url\":";
+		append_json(out, info.url);
+		out += ",\"handler\":";
+		append_json(out, info.handler);
+		out += ",\"code\":" + std::to_string(info.res_code) +
+		       ",\"time\":\"" + boost::posix_time::to_iso_extended_string(info.req_time) + "\"" +
+		       ",\"time_us\":" + std::to_string(info.time_us) + "}";
+	}
+
+	void json_summaries(std::string& out, const std::string& key, const std::string& name, const std::vector<Summary>& summaries) {
+		out += ",\"" + key + "\":[";
+		for (const Summary& summary : summaries) {
+			out += &summary == &summaries.front() ? "{\"" : ",{\"";
+			out += name + "\":";
+			append_json(out, summary.name);
+			out += ",\"requests\":" + std::to_string(summary.requests) + ",\"codes\":{";
+			bool first = true;
+			for (std::size_t i = 0; i < status_class_count; i++) {
+				if (summary.codes[i] > 0) {
+					out += first ? "\"" : ",\"";
+					out += std::string(status_class_name(i)) + "\":" + std::to_string(summary.codes[i]);
+					first = false;
+				}
+			}
+			out += "}}";
+		}
+		out += "]";
+	}
+
+	void json_statistics(std::string& out, const std::vector<Statistic>& statistics) {
+		out += "{";
+		for (const Statistic& stat : statistics) {
+			out += &stat == &statistics.front() ? "\"" : ",\"";
+			out += stat.key + "\":";
+			// Only the destination of pools is not a number
+			if (stat.key == "destination") {
+				append_json(out, stat.value);
+			} else {
+				out += stat.value;
+			}
+		}
+		out += "}";
+	}
+
+	void json_summaries(std::string& out) {
+		out += "]";
+		json_summaries(out, "urls", "url", urls_);
+		json_summaries(out, "handlers", "handler", handlers_);
+
+		out += ",\"registered_handlers\":[";
+		for (const auto& entry : server::urlToHandlerName) {
+			out += &entry == &server::urlToHandlerName.front() ? "{\"prefix\":" : ",{\"prefix\":";
+			append_json(out, entry.first);
+			out += ",\"handler\":";
+			append_json(out, entry.second);
+			out += "}";
+		}
+		out += "],\"hot\":{\"window_seconds\":" + std::to_string(hot_window_);
+		for (const HotKeysOf& hot : hot_) {
+			out += ",\"" + hot.key + "\":[";
+			for (const HeavyHitters::Entry& entry : hot.entries) {
+				out += &entry == &hot.entries.front() ? "{\"key\":" : ",{\"key\":";
+				append_json(out, entry.key);
+				out += ",\"count\":" + std::to_string(entry.count) + "}";
+			}
+			out += "]";
+		}
+		out += "},\"content_cache\":";
+		json_statistics(out, content_cache_);
+		out += ",\"compression_cache\":";
+		json_statistics(out, compression_cache_);
+	}
+
+	void json_tail(std::string& out) {
+		out += ",\"upstream_pools\":[";
+		for (const auto& pool : pools_) {
+			if (&pool != &pools_.front()) {
+				out += ",";
+			}
+			json_statistics(out, pool);
+		}
+		out += "]}\n";
+	}
+
+	enum class Stage { head, requests, summaries, tail, done };
+
+	const StatusHandler::Query query_;
+	const std::string target_;
+	Stage stage_ = Stage::head;
+	std::size_t row_ = 0;
+
+	std::uint64_t total_;
+	HistoryCursor next_since_;
+	std::vector<URLInfo> requests_;
+	std::vector<Summary> urls_;
+	std::vector<Summary> handlers_;
+
+	// Heavy hitters of a kind of key
+	struct HotKeysOf {
+		std::string name;
+		std::string key;
+		std::vector<HeavyHitters::Entry> entries;
+	};
+	std::int64_t hot_window_;
+	std::vector<HotKeysOf> hot_;
+	std::vector<Statistic> content_cache_;
+	std::vector<Statistic> compression_cache_;
+	std::vector<std::vector<Statistic>> pools_;
+};
+
+// Sets the headers shared by both kinds of responses
+template <class Body>
+void set_headers(http::response<Body>& res, const StatusHandler::Query& query) {
+	res.version(11);
+	res.result(http::status::ok);
+	res.set(http::field::content_type, query.json ? "application/json" : "text/html");
+	res.set(http::field::server, "koko.cs130.org");
+}
+}  // namespace
 
 StatusHandler::StatusHandler(__attribute__((unused)) const std::string& url_prefix, __attribute__((unused)) const NginxConfig& config) {
 	name = "Status";
 }
 
+bool StatusHandler::parse_query(const std::string& target, Query& query) {
+	std::string value;
+	if (query_parameter(target, "format", value)) {
+		if (value != "json" && value != "html") {
+			return false;
+		}
+		query.json = value == "json";
+	}
+
+	try {
+		std::size_t parsed = 0;
+		if (query_parameter(target, "limit", value)) {
+			long long limit = std::stoll(value, &parsed);
+			if (parsed != value.size() || limit < 0) {
+				return false;
+			}
+			query.limit = limit;
+		}
+		if (query_parameter(target, "since", value) && !HistoryCursor::parse(value, query.since)) {
+			return false;
+		}
+	} catch (std::exception&) {
+		return false;
+	}
+	return true;
+}
+
 http::response<http::string_body> StatusHandler::handle_request(const http::request<http::string_body>& request) {
-	auto url_info = RequestHandler::url_info;
-	auto url_to_handler = server::urlToHandlerName;
-
-	//setup html table content for url to response code
-	std::stringstream url_info_table;
-	boost::posix_time::ptime timeServerUTC = boost::posix_time::second_clock::universal_time();
-	boost::posix_time::ptime timeLA = us_pacific::utc_to_local(timeServerUTC);
-	url_info_table << "<tr><td>" << std::string(request.target()) << "</td><td>200</td>"
-	               << "<td>" << timeLA << "</td>"
-	               << "</tr>";
-
-	for (int i = url_info.size() - 1; i >= 0; i--) {
-		url_info_table << "<tr>"
-		               << "<td>" << url_info[i].url << "</td>"
-		               << "<td>" << url_info[i].res_code << "</td>"
-		               << "<td>" << url_info[i].req_time << "</td>"
-		               << "</tr>";
-	}
-
-	std::string url_prefix_to_handler_table = "";
-
-	for (size_t i = 0; i < url_to_handler.size(); i++) {
-		url_prefix_to_handler_table +=
-		    "<tr><td>" + url_to_handler[i].first +
-		    "</td><td>" + url_to_handler[i].second + "</td></tr>";
-	}
-
-	std::string num_requests = std::to_string(RequestHandler::url_info.size() + 1);
-
-	std::string html_template =
-	    "<html>"
-	    "<head>"
-	    "<style>table{width = \"500\";}td{width = \"400\";}</style>"
-	    "<title>Koko Status Report</title>"
-	    "</head>"
-	    "<body>"
-	    "<h1>Koko Server Status Report</h1>"
-	    "Members: Bryan Nguyen, Hyounjun Chang, Tanmaya Hada, Utsav Munendra<br>"
-	    "<h3>Total Requests Received: " +
-	    num_requests +
-	    "</h3>"
-	    "</br>"
-	    "<h3>Received Requests</h3>"
-	    "<table>"
-	    "<tr><th>Location</th><th>Response Code</th><th>Time (LA)</th></tr>" +
-	    url_info_table.str() +
-	    "</table>"
-	    "</br>"
-	    "<h2>Registered Handlers</h2>"
-	    "<table>"
-	    "<tr><th>URL Prefix</th><th>Handler Type</th></tr>" +
-	    url_prefix_to_handler_table +
-	    "</table>"
-	    "</body>"
-	    "</html>";
-
-	//create response
+	std::string target = request.target().to_string();
+	Query query;
+	if (!parse_query(target, query)) {
+		return bad_request();
+	}
+
+	// Writes the whole page into the body
+	StatusPage page(query, target);
 	http::response<http::string_body> res;
-	res.version(11);
-	res.result(http::status::ok);
-	res.set(http::field::content_type, "text/html");
-	res.set(http::field::server, "koko.cs130.org");
-	res.body() = html_template;
+	set_headers(res, query);
+	std::string chunk;
+	bool more = true;
+	while (more) {
+		more = page.next(chunk);
+		res.body() += chunk;
+	}
 	res.prepare_payload();
-
 	return res;
-}
\ No newline at end of file
+}
+
+bool StatusHandler::handle_static_request(const http::request<http::string_body>& request, http::response<static_body>& response) {
+	std::string target = request.target().to_string();
+	Query query;
+	if (!parse_query(target, query)) {
+		// handle_request answers with a bad request
+		return false;
+	}
+
+	auto page = std::make_shared<StatusPage>(query, target);
+	set_headers(response, query);
+	response.chunked(true);
+	response.body().set_generator([page](std::string& chunk) { return page->next(chunk); });
+	return true;
+}
@@ -0,0 +1,253 @@
+#include "tlsResumption.h"
+
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+#include "logger.h"
+#include "metrics.h"
+
+namespace {
+// Names identify the key a ticket was encrypted with
+struct TicketKey {
+	unsigned char name[16];
+	unsigned char hmac[32];
+	unsigned char aes[32];
+};
+
+// The key new tickets are encrypted with and the one before it, shared by every thread
+class TicketKeys {
+   public:
+	void set_rotation(std::chrono::seconds rotation) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		rotation_ = rotation;
+	}
+
+	// Copies the current key, replacing it first if it is due
+	bool current(TicketKey &key) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!has_current_ || std::chrono::steady_clock::now() - created_ >= rotation_) {
+			if (!rotate_locked()) {
+				return false;
+			}
+		}
+		key = current_;
+		return true;
+	}
+
+	// Copies the key with the name, returns 1 if it is the current one, 2 if it is the previous one
+	// and 0 if it is neither
+	int find(const unsigned char *name, TicketKey &key) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (has_current_ && std::memcmp(name, current_.name, sizeof(current_.name)) == 0) {
+			key = current_;
+			return 1;
+		}
+		if (has_previous_ && std::memcmp(name, previous_.name, sizeof(previous_.name)) == 0) {
+			key = previous_;
+			return 2;
+		}
+		return 0;
+	}
+
+	bool rotate() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return rotate_locked();
+	}
+
+   private:
+	bool rotate_locked() {
+		TicketKey key;
+		if (RAND_bytes(key.name, sizeof(key.name)) != 1 || RAND_bytes(key.hmac, sizeof(key.hmac)) != 1 || RAND_bytes(key.aes, sizeof(key.aes)) != 1) {
+			ERROR << "tls: could not generate a session ticket key";
+			return false;
+		}
+		previous_ = current_;
+		has_previous_ = has_current_;
+		current_ = key;
+		has_current_ = true;
+		created_ = std::chrono::steady_clock::now();
+		TRACE << "tls: rotated the session ticket key";
+		return true;
+	}
+
+	std::mutex mutex_;
+	std::chrono::seconds rotation_{3600};
+	std::chrono::steady_clock::time_point created_;
+	TicketKey current_;
+	TicketKey previous_;
+	bool has_current_ = false;
+	bool has_previous_ = false;
+};
+
+// Leaked, since handshakes can still happen while static objects are destroyed
+TicketKeys &ticket_keys() {
+	static TicketKeys *keys = new TicketKeys();
+	return *keys;
+}
+
+Counter &handshakes_counter(const char *type) {
+	return MetricsRegistry::instance().counter("koko_tls_handshakes_total", "TLS handshakes, full, resumed or failed", {{"type", type}});
+}
+
+Counter &tickets_counter(const char *result) {
+	return MetricsRegistry::instance().counter("koko_tls_tickets_total", "TLS session tickets issued, and presented by clients", {{"result", result}});
+}
+
+struct HandshakeCounters {
+	Counter &full = handshakes_counter("full");
+	Counter &resumed = handshakes_counter("resumed");
+	Counter &failed = handshakes_counter("failed");
+};
+
+HandshakeCounters &handshake_counters() {
+	static HandshakeCounters *counters = new HandshakeCounters();
+	return *counters;
+}
+
+struct TicketCounters {
+	// New tickets, tickets accepted as they are, accepted and replaced since their key is the previous
+	// one, and rejected since their key is unknown
+	Counter &issued = tickets_counter("issued");
+	Counter &accepted = tickets_counter("accepted");
+	Counter &renewed = tickets_counter("renewed");
+	Counter &unknown = tickets_counter("unknown");
+};
+
+TicketCounters &ticket_counters() {
+	static TicketCounters *counters = new TicketCounters();
+	return *counters;
+}
+
+// Sets up the cipher and MAC of a ticket with the key
+bool init_ticket_crypto(const TicketKey &key, unsigned char *iv, EVP_CIPHER_CTX *cipher, EVP_MAC_CTX *mac, int enc) {
+	OSSL_PARAM params[] = {
+	    OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, const_cast<unsigned char *>(key.hmac), sizeof(key.hmac)),
+	    OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char *>("SHA256"), 0),
+	    OSSL_PARAM_construct_end(),
+	};
+	if (EVP_MAC_CTX_set_params(mac, params) != 1) {
+		return false;
+	}
+	return EVP_CipherInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aes, iv, enc) == 1;
+}
+
+// Encrypts new tickets with the current key, and finds the key of tickets presented by clients.
+// Returns 1 to use the key, 2 to also issue a new ticket, 0 to do a full handshake and -1 on errors.
+int ticket_key_callback(__attribute__((unused)) SSL *ssl, unsigned char key_name[16], unsigned char *iv, EVP_CIPHER_CTX *cipher, EVP_MAC_CTX *mac, int enc) {
+	TicketKey key;
+	if (enc) {
+		if (!ticket_keys().current(key) || RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1) {
+			return -1;
+		}
+		std::memcpy(key_name, key.name, sizeof(key.name));
+		if (!init_ticket_crypto(key, iv, cipher, mac, 1)) {
+			return -1;
+		}
+		ticket_counters().issued.inc();
+		return 1;
+	}
+
+	int found = ticket_keys().find(key_name, key);
+	if (found == 0) {
+		ticket_counters().unknown.inc();
+		return 0;
+	}
+	if (!init_ticket_crypto(key, iv, cipher, mac, 0)) {
+		return -1;
+	}
+	if (found == 2) {
+		ticket_counters().renewed.inc();
+	} else {
+		ticket_counters().accepted.inc();
+	}
+	return found;
+}
+
+// The context whose cache statistics are exported, referenced so that it outlives the metrics
+std::mutex stats_mutex;
+SSL_CTX *stats_ctx = nullptr;
+
+double cache_stat(long (*stat)(SSL_CTX *)) {
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	return stats_ctx ? stat(stats_ctx) : 0;
+}
+}  // namespace
+
+TlsResumption::Options TlsResumption::Options::from_config(NginxConfig &config) {
+	Options options;
+	options.cache_size = std::max(config.get_num("sslSessionCache"), 0);
+	options.lifetime = std::chrono::seconds(std::max(config.get_num("sslSessionTimeout"), 1));
+	options.tickets = config.get_num("sslSessionTickets");
+	options.ticket_key_rotation = std::chrono::seconds(std::max(config.get_num("sslTicketKeyRotation"), 1));
+	return options;
+}
+
+void TlsResumption::enable(boost::asio::ssl::context &ctx, const Options &options) {
+	SSL_CTX *native = ctx.native_handle();
+
+	// Sessions are only resumed by the server that created them
+	static const unsigned char session_id_context[] = "koko";
+	SSL_CTX_set_session_id_context(native, session_id_context, sizeof(session_id_context) - 1);
+	SSL_CTX_set_timeout(native, options.lifetime.count());
+
+	if (options.cache_size > 0) {
+		SSL_CTX_set_session_cache_mode(native, SSL_SESS_CACHE_SERVER);
+		SSL_CTX_sess_set_cache_size(native, options.cache_size);
+	} else {
+		SSL_CTX_set_session_cache_mode(native, SSL_SESS_CACHE_OFF);
+	}
+
+	if (options.tickets) {
+		SSL_CTX_clear_options(native, SSL_OP_NO_TICKET);
+		ticket_keys().set_rotation(options.ticket_key_rotation);
+		SSL_CTX_set_tlsext_ticket_key_evp_cb(native, ticket_key_callback);
+	} else {
+		SSL_CTX_set_options(native, SSL_OP_NO_TICKET);
+	}
+	TRACE << "tls: session cache size: " << options.cache_size << ", tickets: " << options.tickets << ", lifetime (s): " << options.lifetime.count();
+
+	{
+		std::lock_guard<std::mutex> lock(stats_mutex);
+		SSL_CTX_up_ref(native);
+		if (stats_ctx != nullptr) {
+			SSL_CTX_free(stats_ctx);
+		}
+		stats_ctx = native;
+	}
+	// Metrics are registered before rendering them needs them, since rendering holds the registry lock
+	HandshakeCounters &counters = handshake_counters();
+	ticket_counters();
+
+	MetricsRegistry &registry = MetricsRegistry::instance();
+	registry.gauge_function("koko_tls_session_cache_entries", "TLS sessions in the session cache", {},
+	                        []() { return cache_stat([](SSL_CTX *c) { return SSL_CTX_sess_number(c); }); });
+	registry.counter_function("koko_tls_session_cache_hits_total", "TLS sessions resumed from the session cache", {},
+	                          []() { return cache_stat([](SSL_CTX *c) { return SSL_CTX_sess_hits(c); }); });
+	registry.counter_function("koko_tls_session_cache_misses_total", "TLS sessions asked for and not in the session cache", {},
+	                          []() { return cache_stat([](SSL_CTX *c) { return SSL_CTX_sess_misses(c); }); });
+	registry.gauge_function("koko_tls_resumption_ratio", "Fraction of TLS handshakes that resumed a session", {}, [&counters]() {
+		double resumed = counters.resumed.value();
+		double total = resumed + counters.full.value();
+		return total > 0 ? resumed / total : 0.0;
+	});
+}
+
+void TlsResumption::count_handshake(SSL *ssl, bool failed) {
+	HandshakeCounters &counters = handshake_counters();
+	if (failed) {
+		counters.failed.inc();
+	} else if (SSL_session_reused(ssl)) {
+		counters.resumed.inc();
+	} else {
+		counters.full.inc();
+	}
+}
+
+void TlsResumption::rotate_ticket_keys() {
+	ticket_keys().rotate();
+}
@@ -0,0 +1,84 @@
+// koko_upstream: serves the responses of UpstreamSimulator on localhost, as the upstream server of
+// ProxyRequestHandler for tests and benchmarks that cannot reach real servers.
+//
+// Usage: koko_upstream [options]
+//   --port <port>              port on 127.0.0.1, 8084 by default
+//   --threads <n>              1 by default
+//   --latency <us>             mean latency added to every response, 0 by default
+//   --spread <us>              spread of the latency around the mean, 0 by default
+//   --distribution <name>      constant, uniform or exponential, constant by default
+//   --body-size <bytes>        least size of the default body, 0 by default
+//   --close-after <n>          closes connections after n responses, 0 by default to keep them open
+//
+// See include/upstreamSimulator.h for the paths it answers. Runs until killed.
+
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "upstreamSimulator.h"
+
+static bool parse_options(int argc, char* argv[], UpstreamSimulator::Options& options) {
+	for (int i = 1; i + 1 < argc; i += 2) {
+		std::string arg = argv[i];
+		std::string value = argv[i + 1];
+		try {
+			if (arg == "--port") {
+				options.port = std::stoul(value);
+			} else if (arg == "--threads") {
+				options.threads = std::stoul(value);
+			} else if (arg == "--latency") {
+				options.latency_mean = std::chrono::microseconds(std::stoull(value));
+			} else if (arg == "--spread") {
+				options.latency_spread = std::chrono::microseconds(std::stoull(value));
+			} else if (arg == "--distribution") {
+				if (!UpstreamSimulator::parse_distribution(value, options.distribution)) {
+					return false;
+				}
+			} else if (arg == "--body-size") {
+				options.body_size = std::stoul(value);
+			} else if (arg == "--close-after") {
+				options.close_after = std::stoul(value);
+			} else {
+				return false;
+			}
+		} catch (std::exception&) {
+			return false;
+		}
+	}
+	return argc % 2 == 1;
+}
+
+int main(int argc, char* argv[]) {
+	UpstreamSimulator::Options options;
+	options.port = 8084;
+	if (!parse_options(argc, argv, options)) {
+		std::cerr << "Usage: koko_upstream [--port <port>] [--threads <n>] [--latency <us>] [--spread <us>] "
+		             "[--distribution constant|uniform|exponential] [--body-size <bytes>] [--close-after <n>]"
+		          << std::endl;
+		return 2;
+	}
+
+	// Stops on SIGINT and SIGTERM, as tests stop it with kill
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+	std::unique_ptr<UpstreamSimulator> simulator;
+	try {
+		simulator = std::make_unique<UpstreamSimulator>(options);
+	} catch (std::exception& e) {
+		std::cerr << "koko_upstream: could not listen on port " << options.port << ": " << e.what() << std::endl;
+		return 1;
+	}
+	std::cout << "koko_upstream listening on 127.0.0.1:" << simulator->port() << std::endl;
+
+	int signal = 0;
+	sigwait(&signals, &signal);
+	std::cout << "koko_upstream served " << simulator->requests << " requests over " << simulator->connections << " connections" << std::endl;
+	return 0;
+}
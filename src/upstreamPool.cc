@@ -0,0 +1,467 @@
+#include "upstreamPool.h"
+
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <atomic>
+#include <boost/asio.hpp>
+#include <cerrno>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+#include "logger.h"
+
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+
+struct UpstreamPool::State {
+	std::string host;
+	std::string port;
+	Options options;
+
+	std::atomic<std::uint64_t> hits{0};
+	std::atomic<std::uint64_t> misses{0};
+	std::atomic<std::uint64_t> retries{0};
+	std::atomic<std::uint64_t> stale{0};
+	std::atomic<std::int64_t> active{0};
+	std::atomic<std::int64_t> idle{0};
+};
+
+namespace {
+
+// An open connection to the upstream server
+struct PooledConnection {
+	explicit PooledConnection(const net::any_io_executor& executor)
+	    : stream(executor) {
+	}
+
+	beast::tcp_stream stream;
+	beast::flat_buffer buffer;
+	std::chrono::steady_clock::time_point idle_since;
+};
+
+// The connections of one pool on one io_context
+class HostConnections : public std::enable_shared_from_this<HostConnections> {
+   public:
+	// Called with a connection, and whether it was used before
+	using Callback = std::function<void(beast::error_code, std::shared_ptr<PooledConnection>, bool)>;
+
+	HostConnections(std::shared_ptr<UpstreamPool::State> state, const net::any_io_executor& executor)
+	    : state_(std::move(state)),
+	      executor_(executor),
+	      idle_timer_(executor) {
+	}
+
+	// Hands out an idle connection, or opens a new one if the limit allows,
+	// or else waits for a connection to be released
+	void acquire(Callback cb) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		while (!idle_.empty()) {
+			std::shared_ptr<PooledConnection> conn = std::move(idle_.back());
+			idle_.pop_back();
+			state_->idle--;
+
+			if (!alive(*conn)) {
+				TRACE << "upstream pool: dropping stale connection to " << state_->host;
+				state_->stale++;
+				close(*conn);
+				open_--;
+				continue;
+			}
+
+			state_->active++;
+			state_->hits++;
+			lock.unlock();
+			prewarm();
+			cb({}, conn, true);
+			return;
+		}
+
+		if (open_ >= state_->options.max_per_host) {
+			TRACE << "upstream pool: waiting for a free connection to " << state_->host;
+			waiters_.push_back(std::move(cb));
+			return;
+		}
+
+		open_++;
+		state_->active++;
+		state_->misses++;
+		lock.unlock();
+		connect(std::move(cb));
+		prewarm();
+	}
+
+	// Returns a connection after an exchange, closing it if it cannot be reused
+	void release(std::shared_ptr<PooledConnection> conn, bool reusable) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		state_->active--;
+
+		if (reusable && !shut_down_ && !waiters_.empty()) {
+			// Hand the connection straight to a waiting request
+			Callback waiter = std::move(waiters_.front());
+			waiters_.pop_front();
+			state_->active++;
+			state_->hits++;
+			lock.unlock();
+			waiter({}, conn, true);
+			return;
+		}
+
+		if (!reusable || shut_down_ || idle_.size() >= state_->options.max_idle) {
+			close(*conn);
+			connect_waiter(lock);
+			return;
+		}
+
+		conn->idle_since = std::chrono::steady_clock::now();
+		idle_.push_back(std::move(conn));
+		state_->idle++;
+		arm_timer();
+	}
+
+	// Closes every connection, called when the io_context is destroyed
+	void shutdown() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		shut_down_ = true;
+		for (auto& conn : idle_) {
+			close(*conn);
+		}
+		state_->idle -= idle_.size();
+		idle_.clear();
+		waiters_.clear();
+		beast::error_code ignored;
+		idle_timer_.cancel(ignored);
+	}
+
+   private:
+	// Resolves the host and opens a new connection. open_ already counts it.
+	void connect(Callback cb) {
+		auto self = shared_from_this();
+		auto resolver = std::make_shared<tcp::resolver>(executor_);
+		// Exchanges on different connections complete in parallel, each connection only needs its
+		// own operations serialized
+		auto conn = std::make_shared<PooledConnection>(net::make_strand(executor_));
+		resolver->async_resolve(state_->host, state_->port, [self, resolver, conn, cb](beast::error_code err, tcp::resolver::results_type results) {
+			if (err) {
+				return self->connect_failed(err, cb);
+			}
+			conn->stream.expires_after(self->state_->options.timeout);
+			conn->stream.async_connect(results, [self, conn, cb](beast::error_code err, tcp::endpoint endpoint) {
+				if (err) {
+					return self->connect_failed(err, cb);
+				}
+				TRACE << "upstream pool: connected to host " << self->state_->host << " on "
+				      << endpoint.address().to_string() << ":" << endpoint.port();
+				cb({}, conn, false);
+			});
+		});
+	}
+
+	void connect_failed(beast::error_code err, const Callback& cb) {
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			state_->active--;
+			connect_waiter(lock);
+		}
+		cb(err, nullptr, false);
+	}
+
+	// Stops counting a closed connection and lets a waiting request open a new one in its place.
+	// Unlocks the lock.
+	void connect_waiter(std::unique_lock<std::mutex>& lock) {
+		open_--;
+		if (shut_down_ || waiters_.empty() || open_ >= state_->options.max_per_host) {
+			lock.unlock();
+			return;
+		}
+
+		Callback waiter = std::move(waiters_.front());
+		waiters_.pop_front();
+		open_++;
+		state_->active++;
+		state_->misses++;
+		lock.unlock();
+		connect(std::move(waiter));
+	}
+
+	// Opens connections until there are as many idle or opening ones as the prewarm option asks for
+	void prewarm() {
+		std::unique_lock<std::mutex> lock(mutex_);
+		std::size_t wanted = state_->options.prewarm;
+		int count = 0;
+		while (!shut_down_ && idle_.size() + prewarming_ < wanted && open_ < state_->options.max_per_host) {
+			open_++;
+			prewarming_++;
+			state_->active++;
+			count++;
+		}
+		lock.unlock();
+
+		auto self = shared_from_this();
+		for (int i = 0; i < count; i++) {
+			connect([self](beast::error_code err, std::shared_ptr<PooledConnection> conn, __attribute__((unused)) bool reused) {
+				{
+					std::lock_guard<std::mutex> lock(self->mutex_);
+					self->prewarming_--;
+				}
+				if (!err) {
+					self->release(std::move(conn), true);
+				}
+			});
+		}
+	}
+
+	// Closes idle connections after the idle timeout. Requires mutex_ to be held.
+	void arm_timer() {
+		if (timer_armed_ || idle_.empty()) {
+			return;
+		}
+		timer_armed_ = true;
+
+		// The front of idle_ has been idle the longest
+		idle_timer_.expires_at(idle_.front()->idle_since + state_->options.idle_timeout);
+		std::weak_ptr<HostConnections> weak = shared_from_this();
+		idle_timer_.async_wait([weak](beast::error_code err) {
+			auto self = weak.lock();
+			if (!self || err == net::error::operation_aborted) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(self->mutex_);
+			self->timer_armed_ = false;
+			if (self->shut_down_) {
+				return;
+			}
+			auto now = std::chrono::steady_clock::now();
+			while (!self->idle_.empty() && self->idle_.front()->idle_since + self->state_->options.idle_timeout <= now) {
+				TRACE << "upstream pool: closing idle connection to " << self->state_->host;
+				self->close(*self->idle_.front());
+				self->idle_.pop_front();
+				self->state_->idle--;
+				self->open_--;
+			}
+			self->arm_timer();
+		});
+	}
+
+	// Returns false if the upstream server closed the idle connection, or sent something unexpected
+	static bool alive(PooledConnection& conn) {
+		char c;
+		ssize_t n = ::recv(conn.stream.socket().native_handle(), &c, 1, MSG_PEEK | MSG_DONTWAIT);
+		return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+	}
+
+	// Closes a connection, callers update open_
+	void close(PooledConnection& conn) {
+		beast::error_code ignored;
+		conn.stream.socket().shutdown(tcp::socket::shutdown_both, ignored);
+		conn.stream.close();
+	}
+
+	std::mutex mutex_;
+	std::shared_ptr<UpstreamPool::State> state_;
+	// Executor of the io_context, not of any requester
+	net::any_io_executor executor_;
+
+	// Most recently used connections last
+	std::deque<std::shared_ptr<PooledConnection>> idle_;
+	std::deque<Callback> waiters_;
+
+	// Connections that are active, idle or opening
+	std::size_t open_ = 0;
+	std::size_t prewarming_ = 0;
+
+	net::steady_timer idle_timer_;
+	bool timer_armed_ = false;
+	bool shut_down_ = false;
+};
+
+// Holds the connections of every pool used on an io_context, and closes them when it is destroyed
+class UpstreamPoolService : public net::execution_context::service {
+   public:
+	static net::execution_context::id id;
+
+	explicit UpstreamPoolService(net::execution_context& context)
+	    : net::execution_context::service(context),
+	      executor_(static_cast<net::io_context&>(context).get_executor()) {
+	}
+
+	std::shared_ptr<HostConnections> connections(const std::shared_ptr<UpstreamPool::State>& state) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto& conns = connections_[state.get()];
+		if (!conns) {
+			conns = std::make_shared<HostConnections>(state, executor_);
+		}
+		return conns;
+	}
+
+   private:
+	void shutdown() override {
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (auto& entry : connections_) {
+			entry.second->shutdown();
+		}
+		connections_.clear();
+	}
+
+	// The connections are shared by every session on the io_context, so they are not bound to
+	// the strand of the session that happened to use them first
+	net::any_io_executor executor_;
+
+	std::mutex mutex_;
+
+	// Keeping the connections keeps their state, so the keys stay unique
+	std::unordered_map<UpstreamPool::State*, std::shared_ptr<HostConnections>> connections_;
+};
+
+net::execution_context::id UpstreamPoolService::id;
+
+bool idempotent(http::verb method) {
+	return method == http::verb::get || method == http::verb::head || method == http::verb::put ||
+	       method == http::verb::delete_ || method == http::verb::options || method == http::verb::trace;
+}
+
+// A single request to the upstream server, alive until its handler is called
+class UpstreamExchange : public std::enable_shared_from_this<UpstreamExchange> {
+   public:
+	UpstreamExchange(std::shared_ptr<HostConnections> connections, std::shared_ptr<UpstreamPool::State> state,
+	                 http::request<http::string_body>&& request, const net::any_io_executor& executor, UpstreamPool::Handler&& done)
+	    : connections_(std::move(connections)),
+	      state_(std::move(state)),
+	      req_(std::move(request)),
+	      executor_(executor),
+	      done_(std::move(done)) {
+	}
+
+	~UpstreamExchange() {
+		// The io_context stopped in the middle of the exchange
+		if (conn_) {
+			connections_->release(std::move(conn_), false);
+		}
+	}
+
+	void start() {
+		connections_->acquire(beast::bind_front_handler(&UpstreamExchange::on_acquire, shared_from_this()));
+	}
+
+   private:
+	void on_acquire(beast::error_code err, std::shared_ptr<PooledConnection> conn, bool reused) {
+		if (err) {
+			return finish(err);
+		}
+		conn_ = std::move(conn);
+		reused_ = reused;
+		conn_->stream.expires_after(state_->options.timeout);
+		http::async_write(conn_->stream, req_, beast::bind_front_handler(&UpstreamExchange::on_write, shared_from_this()));
+	}
+
+	void on_write(beast::error_code err, __attribute__((unused)) std::size_t bytes_transferred) {
+		if (err) {
+			return fail(err);
+		}
+		res_ = {};
+		conn_->stream.expires_after(state_->options.timeout);
+		http::async_read(conn_->stream, conn_->buffer, res_, beast::bind_front_handler(&UpstreamExchange::on_read, shared_from_this()));
+	}
+
+	void on_read(beast::error_code err, __attribute__((unused)) std::size_t bytes_transferred) {
+		if (err) {
+			return fail(err);
+		}
+
+		// Anything left in the buffer would be mistaken for the next response
+		bool reusable = res_.keep_alive() && !res_.need_eof() && conn_->buffer.size() == 0;
+		connections_->release(std::move(conn_), reusable);
+		res_.prepare_payload();
+		finish({});
+	}
+
+	void fail(beast::error_code err) {
+		connections_->release(std::move(conn_), false);
+
+		// The upstream server may have closed the reused connection just before the request
+		if (reused_ && !retried_ && err != beast::error::timeout && idempotent(req_.method())) {
+			TRACE << "upstream pool: retrying request to " << state_->host << " after error: " << err.message();
+			retried_ = true;
+			state_->retries++;
+			connections_->acquire(beast::bind_front_handler(&UpstreamExchange::on_acquire, shared_from_this()));
+			return;
+		}
+		finish(err);
+	}
+
+	// Calls the handler from the executor of the requester
+	void finish(beast::error_code err) {
+		net::dispatch(executor_, [self = shared_from_this(), err]() {
+			self->done_(err, std::move(self->res_));
+		});
+	}
+
+	std::shared_ptr<HostConnections> connections_;
+	std::shared_ptr<UpstreamPool::State> state_;
+	http::request<http::string_body> req_;
+	http::response<http::string_body> res_;
+	net::any_io_executor executor_;
+	UpstreamPool::Handler done_;
+	std::shared_ptr<PooledConnection> conn_;
+	bool reused_ = false;
+	bool retried_ = false;
+};
+
+std::mutex registry_mutex;
+std::vector<UpstreamPool*>& registry() {
+	static std::vector<UpstreamPool*> pools;
+	return pools;
+}
+
+}  // namespace
+
+UpstreamPool::UpstreamPool(const std::string& host, const std::string& port, Options options)
+    : state_(std::make_shared<State>()) {
+	state_->host = host;
+	state_->port = port;
+	state_->options = options;
+
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	registry().push_back(this);
+}
+
+UpstreamPool::~UpstreamPool() {
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	auto& pools = registry();
+	pools.erase(std::remove(pools.begin(), pools.end(), this), pools.end());
+}
+
+void UpstreamPool::async_send(http::request<http::string_body> request, const net::any_io_executor& executor, Handler done) {
+	// Ask the upstream server to keep the connection open
+	request.version(11);
+	request.keep_alive(true);
+
+	net::execution_context& context = net::query(executor, net::execution::context);
+	auto connections = net::use_service<UpstreamPoolService>(context).connections(state_);
+	std::make_shared<UpstreamExchange>(std::move(connections), state_, std::move(request), executor, std::move(done))->start();
+}
+
+double UpstreamPool::Stats::hit_rate() const {
+	std::uint64_t requests = hits + misses;
+	return requests == 0 ? 0 : (double)hits / requests;
+}
+
+UpstreamPool::Stats UpstreamPool::stats() const {
+	return Stats{state_->hits, state_->misses, state_->retries, state_->stale, state_->active, state_->idle};
+}
+
+const std::string& UpstreamPool::host() const {
+	return state_->host;
+}
+
+const std::string& UpstreamPool::port() const {
+	return state_->port;
+}
+
+std::vector<UpstreamPool*> UpstreamPool::all() {
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	return registry();
+}
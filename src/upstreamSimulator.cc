@@ -0,0 +1,250 @@
+#include "upstreamSimulator.h"
+
+#include <algorithm>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <memory>
+#include <sstream>
+#include <utility>
+
+namespace net = boost::asio;
+namespace beast = boost::beast;
+namespace http = beast::http;
+using tcp = net::ip::tcp;
+
+namespace {
+// Largest body served, larger sizes are served as it
+constexpr std::size_t max_body_size = 64 << 20;
+
+// Size of the chunks of /chunked responses
+constexpr std::size_t chunk_size = 1024;
+
+// n bytes of printable text
+std::string text(std::size_t n) {
+	static const std::string line = "The quick brown fox jumps over the lazy upstream server.\n";
+	std::string body;
+	body.reserve(n);
+	while (body.size() < n) {
+		body.append(line, 0, std::min(line.size(), n - body.size()));
+	}
+	return body;
+}
+
+std::string html(std::size_t links) {
+	std::string body = "<html><head><link rel=\"stylesheet\" href=\"/style.css\"></head><body>\n";
+	for (std::size_t i = 0; i < links; i++) {
+		std::string n = std::to_string(i);
+		body += "<a href=\"/page" + n + "\"><img src=\"//cdn.example.com/img" + n + ".png\"></a>\n";
+	}
+	body += "</body></html>\n";
+	return body;
+}
+
+// Reads the number at the end of target after prefix, returns false if there is none
+bool parse_number(beast::string_view target, beast::string_view prefix, std::size_t& number) {
+	if (!target.starts_with(prefix)) {
+		return false;
+	}
+	target.remove_prefix(prefix.size());
+	target = target.substr(0, target.find('?'));
+	if (target.empty() || target.size() > 9 || !std::all_of(target.begin(), target.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+		return false;
+	}
+	number = std::stoul(target.to_string());
+	return true;
+}
+}  // namespace
+
+// Serves the requests of one connection, one after another
+class UpstreamSimulator::Connection : public std::enable_shared_from_this<Connection> {
+   public:
+	Connection(UpstreamSimulator& simulator, tcp::socket socket)
+	    : simulator_(simulator), socket_(std::move(socket)), timer_(socket_.get_executor()) {
+	}
+
+	void read() {
+		req_ = {};
+		http::async_read(socket_, buffer_, req_, [self = shared_from_this()](beast::error_code err, std::size_t) {
+			if (!err) {
+				self->respond();
+			}
+		});
+	}
+
+   private:
+	void respond() {
+		simulator_.requests++;
+		served_++;
+		chunked_.clear();
+		res_ = {http::status::ok, req_.version()};
+		res_.set(http::field::server, "koko_upstream");
+		res_.set(http::field::content_type, "text/plain");
+		res_.keep_alive(req_.keep_alive());
+
+		beast::string_view target = req_.target();
+		std::size_t n = 0;
+		std::chrono::microseconds delay = simulator_.next_latency();
+		if (parse_number(target, "/bytes/", n)) {
+			res_.body() = text(std::min(n, max_body_size));
+		} else if (parse_number(target, "/html/", n)) {
+			res_.set(http::field::content_type, "text/html");
+			res_.body() = html(std::min(n, max_body_size / 64));
+		} else if (parse_number(target, "/redirect/", n)) {
+			if (n > 0) {
+				res_.result(http::status::found);
+				res_.set(http::field::location, "/redirect/" + std::to_string(n - 1));
+			} else {
+				res_.body() = "redirected";
+			}
+		} else if (parse_number(target, "/absolute/", n)) {
+			res_.result(http::status::moved_permanently);
+			res_.set(http::field::location, "http://" + req_[http::field::host].to_string() + "/redirect/" + std::to_string(n > 0 ? n - 1 : 0));
+		} else if (parse_number(target, "/chunked/", n)) {
+			chunk(text(std::min(n, max_body_size)));
+			write_later(delay);
+			return;
+		} else if (parse_number(target, "/close/", n)) {
+			res_.keep_alive(false);
+			res_.body() = text(std::min(n, max_body_size));
+		} else if (parse_number(target, "/status/", n) && n >= 100 && n <= 999) {
+			res_.result(static_cast<unsigned>(n));
+		} else {
+			if (parse_number(target, "/delay/", n)) {
+				delay += std::chrono::milliseconds(n);
+			}
+			res_.body() = "upstream " + target.to_string();
+			if (res_.body().size() < simulator_.options_.body_size) {
+				res_.body() += text(simulator_.options_.body_size - res_.body().size());
+			}
+		}
+		res_.prepare_payload();
+		write_later(delay);
+	}
+
+	// Writes the head and chunks of a chunked response into chunked_
+	void chunk(const std::string& body) {
+		res_.chunked(true);
+		std::ostringstream head;
+		head << res_.base();
+		chunked_ = head.str();
+		for (std::size_t start = 0; start < body.size(); start += chunk_size) {
+			std::size_t size = std::min(chunk_size, body.size() - start);
+			std::ostringstream length;
+			length << std::hex << size;
+			chunked_ += length.str() + "\r\n";
+			chunked_.append(body, start, size);
+			chunked_ += "\r\n";
+		}
+		chunked_ += "0\r\n\r\n";
+	}
+
+	void write_later(std::chrono::microseconds delay) {
+		if (delay.count() <= 0) {
+			write();
+			return;
+		}
+		timer_.expires_after(delay);
+		timer_.async_wait([self = shared_from_this()](beast::error_code err) {
+			if (!err) {
+				self->write();
+			}
+		});
+	}
+
+	void write() {
+		auto done = [self = shared_from_this()](beast::error_code err, std::size_t) {
+			if (!err) {
+				self->finish();
+			}
+		};
+		if (!chunked_.empty()) {
+			net::async_write(socket_, net::buffer(chunked_), std::move(done));
+		} else {
+			http::async_write(socket_, res_, std::move(done));
+		}
+	}
+
+	void finish() {
+		std::size_t close_after = simulator_.options_.close_after;
+		if (!res_.keep_alive() || (close_after > 0 && served_ >= close_after)) {
+			beast::error_code ignored;
+			socket_.shutdown(tcp::socket::shutdown_both, ignored);
+			return;
+		}
+		read();
+	}
+
+	UpstreamSimulator& simulator_;
+	tcp::socket socket_;
+	net::steady_timer timer_;
+	beast::flat_buffer buffer_;
+	http::request<http::string_body> req_;
+	http::response<http::string_body> res_;
+
+	// The whole response when it is chunked
+	std::string chunked_;
+	std::size_t served_ = 0;
+};
+
+UpstreamSimulator::UpstreamSimulator(Options options)
+    : options_(options), acceptor_(ioc_, tcp::endpoint(net::ip::make_address("127.0.0.1"), options.port)) {
+	accept();
+	for (std::size_t i = 0; i < std::max<std::size_t>(options_.threads, 1); i++) {
+		threads_.emplace_back([this]() { ioc_.run(); });
+	}
+}
+
+UpstreamSimulator::UpstreamSimulator()
+    : UpstreamSimulator(Options()) {
+}
+
+UpstreamSimulator::~UpstreamSimulator() {
+	ioc_.stop();
+	for (auto& t : threads_) {
+		t.join();
+	}
+}
+
+std::string UpstreamSimulator::port() const {
+	return std::to_string(acceptor_.local_endpoint().port());
+}
+
+bool UpstreamSimulator::parse_distribution(const std::string& name, Distribution& distribution) {
+	if (name == "constant") {
+		distribution = Distribution::constant;
+	} else if (name == "uniform") {
+		distribution = Distribution::uniform;
+	} else if (name == "exponential") {
+		distribution = Distribution::exponential;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+void UpstreamSimulator::accept() {
+	acceptor_.async_accept(net::make_strand(ioc_), [this](beast::error_code err, tcp::socket socket) {
+		if (!err) {
+			connections++;
+			socket.set_option(tcp::no_delay(true), err);
+			std::make_shared<Connection>(*this, std::move(socket))->read();
+		}
+		accept();
+	});
+}
+
+std::chrono::microseconds UpstreamSimulator::next_latency() {
+	std::int64_t mean = options_.latency_mean.count();
+	std::int64_t spread = options_.latency_spread.count();
+	if (options_.distribution == Distribution::constant || (mean == 0 && spread == 0)) {
+		return options_.latency_mean;
+	}
+
+	std::lock_guard<std::mutex> lock(random_mutex_);
+	if (options_.distribution == Distribution::uniform) {
+		return std::chrono::microseconds(std::uniform_int_distribution<std::int64_t>(std::max<std::int64_t>(mean - spread, 0), mean + spread)(random_));
+	}
+	double exponential = mean > 0 ? std::exponential_distribution<double>(1.0 / mean)(random_) : 0;
+	std::int64_t jitter = spread > 0 ? std::uniform_int_distribution<std::int64_t>(0, spread)(random_) : 0;
+	return std::chrono::microseconds(static_cast<std::int64_t>(exponential) + jitter);
+}
@@ -0,0 +1,62 @@
+#include "allocation_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+thread_local bool counting = false;
+thread_local std::size_t allocations = 0;
+thread_local std::size_t allocated_bytes = 0;
+}  // namespace
+
+// Replaces the global allocation functions for the whole test binary,
+// counting allocations only on threads with a live AllocationCounter.
+void* operator new(std::size_t size) {
+	if (counting) {
+		allocations++;
+		allocated_bytes += size;
+	}
+	void* p = std::malloc(size == 0 ? 1 : size);
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void* operator new[](std::size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, __attribute__((unused)) std::size_t size) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p, __attribute__((unused)) std::size_t size) noexcept {
+	std::free(p);
+}
+
+AllocationCounter::AllocationCounter() {
+	allocations = 0;
+	allocated_bytes = 0;
+	counting = true;
+}
+
+AllocationCounter::~AllocationCounter() {
+	counting = false;
+}
+
+std::size_t AllocationCounter::count() const {
+	return allocations;
+}
+
+std::size_t AllocationCounter::bytes() const {
+	return allocated_bytes;
+}
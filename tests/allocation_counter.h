@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+
+// Counts the heap allocations made through operator new by the current thread
+// while the counter is alive. Counters cannot be nested.
+class AllocationCounter {
+   public:
+	AllocationCounter();
+	~AllocationCounter();
+
+	// Number of allocations and total bytes allocated so far
+	std::size_t count() const;
+	std::size_t bytes() const;
+};
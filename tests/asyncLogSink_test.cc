@@ -0,0 +1,163 @@
+#include "asyncLogSink.h"
+
+#include <boost/log/attributes/constant.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/make_shared.hpp>
+#include <chrono>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "logger.h"
+
+class AsyncLogSinkTest : public ::testing::Test {
+   protected:
+	// Registers a sink that only takes records of the test logger, and writes their messages to lines
+	boost::shared_ptr<AsyncLogSink> make_sink(AsyncLogSink::Options options) {
+		auto sink = boost::make_shared<AsyncLogSink>(options);
+		sink->set_filter(expr::has_attr<bool>("AsyncLogSinkTest"));
+		sink->add_output(
+		    expr::stream << expr::smessage,
+		    [this](const logging::record_view&, const std::string& line) {
+			    // Lets the test hold the writer thread in its first write
+			    gate_future.wait();
+			    std::lock_guard<std::mutex> lock(mutex);
+			    lines.push_back(line);
+		    },
+		    [this]() { flushes++; });
+		logging::core::get()->add_sink(sink);
+		sinks.push_back(sink);
+		return sink;
+	}
+
+	void TearDown() override {
+		open_gate();
+		for (auto& sink : sinks) {
+			logging::core::get()->remove_sink(sink);
+			sink->stop();
+		}
+	}
+
+	void open_gate() {
+		if (!gate_opened) {
+			gate.set_value();
+			gate_opened = true;
+		}
+	}
+
+	// Logs through a logger whose records the test sinks take
+	static void log(const std::string& message) {
+		src::severity_logger_mt<severity_level> logger;
+		logger.add_attribute("AsyncLogSinkTest", attrs::constant<bool>(true));
+		BOOST_LOG_SEV(logger, info) << message;
+	}
+
+	std::promise<void> gate;
+	std::shared_future<void> gate_future = gate.get_future().share();
+	bool gate_opened = false;
+
+	std::mutex mutex;
+	std::vector<std::string> lines;
+	std::atomic<int> flushes{0};
+	std::vector<boost::shared_ptr<AsyncLogSink>> sinks;
+};
+
+TEST_F(AsyncLogSinkTest, WritesRecordsOfEveryThreadInOrder) {
+	AsyncLogSink::Options options;
+	options.overflow = AsyncLogSink::Overflow::block;
+	options.ring_size = 64;
+	auto sink = make_sink(options);
+	open_gate();
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.emplace_back([t]() {
+			for (int i = 0; i < 1000; i++) {
+				log(std::to_string(t) + " " + std::to_string(i));
+			}
+		});
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+	sink->flush();
+
+	ASSERT_EQ(lines.size(), 4000);
+	std::map<int, int> next;
+	for (const auto& line : lines) {
+		int t = std::stoi(line.substr(0, line.find(' ')));
+		int i = std::stoi(line.substr(line.find(' ') + 1));
+		EXPECT_EQ(i, next[t]);
+		next[t] = i + 1;
+	}
+	EXPECT_EQ(sink->dropped(), 0);
+	EXPECT_GT(flushes, 0);
+}
+
+TEST_F(AsyncLogSinkTest, WritesWithoutFlushing) {
+	AsyncLogSink::Options options;
+	options.flush_interval = std::chrono::milliseconds(1);
+	make_sink(options);
+	open_gate();
+
+	log("message");
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (std::chrono::steady_clock::now() < deadline) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!lines.empty()) {
+				break;
+			}
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	ASSERT_EQ(lines.size(), 1);
+	EXPECT_EQ(lines[0], "message");
+}
+
+TEST_F(AsyncLogSinkTest, DropsRecordsWhenFull) {
+	AsyncLogSink::Options options;
+	options.ring_size = 8;
+	auto sink = make_sink(options);
+
+	// The writer thread is stuck writing the first record, so the ring fills up
+	for (int i = 0; i < 100; i++) {
+		log(std::to_string(i));
+	}
+	EXPECT_GE(sink->dropped(), 100 - 8 - 1);
+
+	open_gate();
+	sink->flush();
+	EXPECT_EQ(lines.size() + sink->dropped(), 100);
+}
+
+TEST_F(AsyncLogSinkTest, BlocksWhenFull) {
+	AsyncLogSink::Options options;
+	options.ring_size = 8;
+	options.overflow = AsyncLogSink::Overflow::block;
+	auto sink = make_sink(options);
+
+	std::atomic<bool> done{false};
+	std::thread logging_thread([&]() {
+		for (int i = 0; i < 100; i++) {
+			log(std::to_string(i));
+		}
+		done = true;
+	});
+
+	// The logging thread waits for the writer thread, which is stuck writing the first record
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	EXPECT_FALSE(done);
+
+	open_gate();
+	logging_thread.join();
+	sink->flush();
+	EXPECT_EQ(lines.size(), 100);
+	EXPECT_EQ(sink->dropped(), 0);
+}
@@ -0,0 +1,64 @@
+#include "cannedResponse.h"
+
+#include <boost/beast/http.hpp>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "handler.h"
+
+namespace http = boost::beast::http;
+
+// The bytes a session writes for the canned response
+std::string written(const CannedResponse& canned, const std::string& fields) {
+	auto head = canned.head();
+	auto tail = canned.tail();
+	return std::string((const char*)head.data(), head.size()) + fields + std::string((const char*)tail.data(), tail.size());
+}
+
+http::response<http::string_body> parse(const std::string& bytes) {
+	http::response_parser<http::string_body> parser;
+	boost::beast::error_code err;
+	// The parser stops after the header, then parses the body
+	std::size_t parsed = 0;
+	while (!err && !parser.is_done() && parsed < bytes.size()) {
+		parsed += parser.put(boost::asio::buffer(bytes.data() + parsed, bytes.size() - parsed), err);
+	}
+	EXPECT_FALSE(err) << err.message();
+	EXPECT_TRUE(parser.is_done());
+	return parser.release();
+}
+
+TEST(CannedResponseTest, SplitsAroundTheDateAndConnection) {
+	http::response<http::string_body> res{http::status::ok, 11};
+	res.set(http::field::content_type, "text/plain");
+	res.body() = "OK";
+	res.prepare_payload();
+	CannedResponse canned(res);
+
+	EXPECT_EQ(canned.result_int(), 200);
+	std::string bytes = written(canned, "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\nConnection: keep-alive\r\n");
+	EXPECT_EQ(bytes,
+	          "HTTP/1.1 200 OK\r\n"
+	          "Content-Type: text/plain\r\n"
+	          "Content-Length: 2\r\n"
+	          "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+	          "Connection: keep-alive\r\n"
+	          "\r\n"
+	          "OK");
+}
+
+TEST(CannedResponseTest, MatchesTheErrorResponses) {
+	std::pair<const CannedResponse*, http::response<http::string_body>> errors[] = {
+	    {&RequestHandler::canned_bad_request(), RequestHandler::bad_request()},
+	    {&RequestHandler::canned_not_found_error(), RequestHandler::not_found_error()},
+	    {&RequestHandler::canned_internal_server_error(), RequestHandler::internal_server_error()},
+	};
+	for (auto& error : errors) {
+		http::response<http::string_body> res = parse(written(*error.first, "Connection: close\r\n"));
+		EXPECT_EQ(res.result_int(), error.first->result_int());
+		EXPECT_EQ(res.result(), error.second.result());
+		EXPECT_EQ(res.body(), error.second.body());
+		EXPECT_EQ(res[http::field::content_type], error.second[http::field::content_type]);
+		EXPECT_EQ(res[http::field::connection], "close");
+	}
+}
@@ -0,0 +1,47 @@
+#include "coarseClock.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+static std::int64_t system_now_us() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+TEST(CoarseClockTest, FormatsDates) {
+	EXPECT_EQ(CoarseClock::format_date(784111777000000).view(), "Sun, 06 Nov 1994 08:49:37 GMT");
+	EXPECT_EQ(CoarseClock::format_date(1792307177141692).view(), "Sun, 18 Oct 2026 07:06:17 GMT");
+}
+
+TEST(CoarseClockTest, ConvertsToLATime) {
+	CoarseClock& clock = CoarseClock::instance();
+	// Daylight saving time, then standard time
+	EXPECT_EQ(boost::posix_time::to_simple_string(clock.to_local(1792307177000000)), "2026-Oct-18 00:06:17");
+	EXPECT_EQ(boost::posix_time::to_simple_string(clock.to_local(1767225600000000)), "2025-Dec-31 16:00:00");
+}
+
+TEST(CoarseClockTest, FollowsTheSystemClock) {
+	CoarseClock& clock = CoarseClock::instance();
+	EXPECT_FALSE(clock.running());
+	EXPECT_LE(std::abs(clock.now_us() - system_now_us()), 1000000);
+
+	clock.start(std::chrono::milliseconds(1));
+	EXPECT_TRUE(clock.running());
+	for (int i = 0; i < 10; i++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		std::int64_t now = clock.now_us();
+		EXPECT_LE(std::abs(now - system_now_us()), 1000000);
+
+		// The cached date is of the current second, or the one before right as it changes
+		std::string date(clock.date().view());
+		std::int64_t second = system_now_us() / 1000000;
+		EXPECT_TRUE(date == CoarseClock::format_date(second * 1000000).view() ||
+		            date == CoarseClock::format_date((second - 1) * 1000000).view())
+		    << date;
+	}
+
+	clock.stop();
+	EXPECT_FALSE(clock.running());
+}
@@ -0,0 +1,171 @@
+#include "compressionCache.h"
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+// A version of a file compressed with gzip
+CompressionKey make_key(const std::string& path, std::int64_t mtime_ns = 1, std::uint64_t size = 100) {
+	return CompressionKey{path, mtime_ns, size, "gzip", 9};
+}
+
+TEST(CompressionCacheTest, CompressesOncePerVersion) {
+	CompressionCache cache(1024);
+	int compressions = 0;
+	auto compress = [&]() {
+		compressions++;
+		return std::string(10, 'x');
+	};
+
+	auto first = cache.get(make_key("a.txt"), compress);
+	auto second = cache.get(make_key("a.txt"), compress);
+	EXPECT_EQ(compressions, 1);
+	EXPECT_EQ(first.get(), second.get());
+	EXPECT_EQ(*first, std::string(10, 'x'));
+
+	// A new modification time or size is a new version of the file
+	cache.get(make_key("a.txt", 2), compress);
+	cache.get(make_key("a.txt", 2, 200), compress);
+	EXPECT_EQ(compressions, 3);
+
+	// Only the latest version is kept
+	CompressionCache::Stats stats = cache.stats();
+	EXPECT_EQ(stats.entries, 1);
+	EXPECT_EQ(stats.bytes, 10);
+	EXPECT_EQ(stats.hits, 1);
+	EXPECT_EQ(stats.misses, 3);
+	EXPECT_DOUBLE_EQ(stats.hit_ratio(), 0.25);
+}
+
+TEST(CompressionCacheTest, StaysWithinBudget) {
+	CompressionCache cache(100);
+	for (int i = 0; i < 20; i++) {
+		cache.get(make_key(std::to_string(i)), []() { return std::string(30, 'x'); });
+		EXPECT_LE(cache.stats().bytes, 100);
+	}
+	EXPECT_EQ(cache.stats().entries, 3);
+
+	// Least recently used entries are evicted first
+	int compressions = 0;
+	auto compress = [&]() {
+		compressions++;
+		return std::string(30, 'x');
+	};
+	cache.get(make_key("19"), compress);
+	cache.get(make_key("0"), compress);
+	EXPECT_EQ(compressions, 1);
+
+	// Bodies larger than the budget are returned but not cached
+	auto large = cache.get(make_key("large"), []() { return std::string(101, 'x'); });
+	EXPECT_EQ(large->size(), 101);
+	EXPECT_LE(cache.stats().bytes, 100);
+}
+
+TEST(CompressionCacheTest, DisabledCacheAlwaysCompresses) {
+	CompressionCache cache;
+	int compressions = 0;
+	auto compress = [&]() {
+		compressions++;
+		return std::string("x");
+	};
+	EXPECT_FALSE(cache.enabled());
+	cache.get(make_key("a.txt"), compress);
+	cache.get(make_key("a.txt"), compress);
+	EXPECT_EQ(compressions, 2);
+}
+
+TEST(CompressionCacheTest, ConcurrentMissesCompressOnce) {
+	CompressionCache cache(1024);
+	std::atomic<int> compressions(0);
+	auto compress = [&]() {
+		compressions++;
+		// Long enough for the other threads to miss while compressing
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		return std::string(10, 'x');
+	};
+
+	std::vector<std::thread> threads;
+	std::vector<std::shared_ptr<const std::string>> bodies(8);
+	for (int i = 0; i < 8; i++) {
+		threads.emplace_back([&, i]() { bodies[i] = cache.get(make_key("a.txt"), compress); });
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	EXPECT_EQ(compressions, 1);
+	for (auto& body : bodies) {
+		EXPECT_EQ(body.get(), bodies[0].get());
+	}
+	CompressionCache::Stats stats = cache.stats();
+	EXPECT_EQ(stats.misses, 1);
+	EXPECT_EQ(stats.coalesced, 7);
+	EXPECT_EQ(stats.hits, 0);
+	EXPECT_DOUBLE_EQ(stats.hit_ratio(), 0);
+}
+
+TEST(CompressionCacheTest, FailedCompressionsAreNotCached) {
+	CompressionCache cache(1024);
+	EXPECT_THROW(cache.get(make_key("a.txt"), []() -> std::string { throw std::runtime_error("failed"); }), std::runtime_error);
+
+	auto body = cache.get(make_key("a.txt"), []() { return std::string("x"); });
+	EXPECT_EQ(*body, "x");
+}
+
+TEST(CompressionCacheTest, MissesDoNotBlockTheExecutor) {
+	CompressionCache cache(1024);
+	boost::asio::io_context io_context;
+	auto work = boost::asio::make_work_guard(io_context);
+
+	std::atomic<bool> release(false);
+	auto compress = [&]() {
+		while (!release) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return std::string(10, 'x');
+	};
+
+	std::vector<std::shared_ptr<const std::string>> bodies;
+	std::vector<std::thread::id> threads;
+	for (int i = 0; i < 3; i++) {
+		cache.async_get(make_key("a.txt"), compress, io_context.get_executor(), [&](std::shared_ptr<const std::string> body, std::exception_ptr error) {
+			EXPECT_FALSE(error);
+			bodies.push_back(body);
+			threads.push_back(std::this_thread::get_id());
+		});
+	}
+
+	// The executor keeps running other work while the file is compressed
+	bool ran = false;
+	boost::asio::post(io_context, [&]() { ran = true; });
+	io_context.poll();
+	EXPECT_TRUE(ran);
+	EXPECT_TRUE(bodies.empty());
+
+	// Every waiting request is completed on the executor
+	release = true;
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while (bodies.size() < 3 && std::chrono::steady_clock::now() < deadline) {
+		io_context.run_one_for(std::chrono::milliseconds(10));
+	}
+	ASSERT_EQ(bodies.size(), 3);
+	for (std::size_t i = 0; i < bodies.size(); i++) {
+		EXPECT_EQ(bodies[i].get(), bodies[0].get());
+		EXPECT_EQ(threads[i], std::this_thread::get_id());
+	}
+
+	CompressionCache::Stats stats = cache.stats();
+	EXPECT_EQ(stats.misses, 1);
+	EXPECT_EQ(stats.coalesced, 2);
+	EXPECT_EQ(stats.hits, 0);
+	EXPECT_DOUBLE_EQ(stats.hit_ratio(), 0);
+	EXPECT_EQ(stats.entries, 1);
+}
@@ -0,0 +1,203 @@
+#include "contentCache.h"
+
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+class ContentCacheTest : public ::testing::Test {
+   protected:
+	void SetUp() override {
+		dir = fs::absolute("content_cache_test_dir");
+		fs::remove_all(dir);
+		fs::create_directories(dir);
+	}
+
+	void TearDown() override {
+		fs::remove_all(dir);
+	}
+
+	// Creates a file of size bytes in the test directory
+	fs::path write_file(const std::string& name, std::size_t size, char fill = 'a') {
+		fs::path path = dir / name;
+		std::ofstream file(path.c_str(), std::ios::binary);
+		file << std::string(size, fill);
+		return path;
+	}
+
+	// Requests a file the way FileHandler does, loading it on a miss
+	std::shared_ptr<const CachedFile> request(ContentCache& cache, const std::string& name) {
+		auto file = cache.lookup(name);
+		if (!file) {
+			file = cache.load(name, dir / name, "text/plain");
+		}
+		return file;
+	}
+
+	fs::path dir;
+};
+
+TEST_F(ContentCacheTest, HitsShareTheBody) {
+	ContentCache cache(800);
+	write_file("a.txt", 100);
+
+	EXPECT_EQ(cache.lookup("a.txt"), nullptr);
+	auto loaded = cache.load("a.txt", dir / "a.txt", "text/plain");
+	ASSERT_NE(loaded, nullptr);
+	EXPECT_EQ(*loaded->body, std::string(100, 'a'));
+	EXPECT_EQ(loaded->mime, "text/plain");
+
+	auto first = cache.lookup("a.txt");
+	auto second = cache.lookup("a.txt");
+	ASSERT_NE(first, nullptr);
+	EXPECT_EQ(first->body.get(), loaded->body.get());
+	EXPECT_EQ(second->body.get(), loaded->body.get());
+
+	ContentCache::Stats stats = cache.stats();
+	EXPECT_EQ(stats.hits, 2);
+	EXPECT_EQ(stats.misses, 1);
+	EXPECT_EQ(stats.entries, 1);
+	EXPECT_EQ(stats.bytes, 100);
+}
+
+TEST_F(ContentCacheTest, StaysWithinBudget) {
+	for (int i = 0; i < 20; i++) {
+		write_file(std::to_string(i) + ".txt", 100);
+	}
+
+	ContentCache cache(800);
+	for (int i = 0; i < 20; i++) {
+		std::string name = std::to_string(i) + ".txt";
+		// Every file is as popular as the others, so newer files replace older ones
+		for (int j = 0; j <= i; j++) {
+			cache.lookup(name);
+		}
+		cache.load(name, dir / name, "text/plain");
+		EXPECT_LE(cache.stats().bytes, 800);
+	}
+	EXPECT_EQ(cache.stats().entries, 8);
+	EXPECT_NE(cache.lookup("19.txt"), nullptr);
+	EXPECT_EQ(cache.lookup("0.txt"), nullptr);
+}
+
+TEST_F(ContentCacheTest, LargeFilesAreNotCached) {
+	ContentCache cache(800);
+	write_file("large.txt", 101);
+	EXPECT_EQ(cache.max_file_size(), 100);
+	EXPECT_EQ(request(cache, "large.txt"), nullptr);
+	EXPECT_EQ(cache.stats().entries, 0);
+}
+
+TEST_F(ContentCacheTest, DisabledByDefault) {
+	ContentCache cache;
+	write_file("a.txt", 1);
+	EXPECT_FALSE(cache.enabled());
+	EXPECT_EQ(request(cache, "a.txt"), nullptr);
+}
+
+TEST_F(ContentCacheTest, ColdFilesDoNotEvictHotOnes) {
+	// Write every file before the cache watches the directory, so that no late change
+	// notification invalidates a cached file
+	for (int i = 0; i < 8; i++) {
+		write_file("hot" + std::to_string(i) + ".txt", 100);
+	}
+	for (int i = 0; i < 50; i++) {
+		write_file("cold" + std::to_string(i) + ".txt", 100);
+	}
+
+	ContentCache cache(800);
+	for (int i = 0; i < 8; i++) {
+		for (int j = 0; j < 5; j++) {
+			request(cache, "hot" + std::to_string(i) + ".txt");
+		}
+	}
+	EXPECT_EQ(cache.stats().entries, 8);
+
+	// A scan over files requested only once leaves the hot files in the cache
+	for (int i = 0; i < 50; i++) {
+		std::string name = "cold" + std::to_string(i) + ".txt";
+		auto file = request(cache, name);
+		ASSERT_NE(file, nullptr);
+		EXPECT_EQ(file->body->size(), 100);
+	}
+	EXPECT_EQ(cache.stats().rejected, 50);
+	for (int i = 0; i < 8; i++) {
+		EXPECT_NE(cache.lookup("hot" + std::to_string(i) + ".txt"), nullptr);
+	}
+
+	// A file that becomes popular is admitted
+	for (int j = 0; j < 10; j++) {
+		request(cache, "cold0.txt");
+	}
+	EXPECT_NE(cache.lookup("cold0.txt"), nullptr);
+}
+
+TEST_F(ContentCacheTest, ChangedFilesAreInvalidated) {
+	ContentCache cache(800);
+	write_file("a.txt", 10, 'a');
+	write_file("b.txt", 10, 'b');
+	auto original = request(cache, "a.txt");
+	ASSERT_NE(original, nullptr);
+	ASSERT_NE(request(cache, "b.txt"), nullptr);
+	ASSERT_NE(cache.lookup("a.txt"), nullptr);
+
+	write_file("a.txt", 20, 'c');
+
+	// inotify events arrive asynchronously
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (cache.lookup("a.txt") != nullptr && std::chrono::steady_clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	EXPECT_EQ(cache.lookup("a.txt"), nullptr);
+	EXPECT_GE(cache.stats().invalidations, 1);
+
+	// Responses still holding the old body are not affected
+	EXPECT_EQ(*original->body, std::string(10, 'a'));
+
+	// The new contents are served after a reload
+	auto reloaded = request(cache, "a.txt");
+	ASSERT_NE(reloaded, nullptr);
+	EXPECT_EQ(*reloaded->body, std::string(20, 'c'));
+
+	// Other files in the directory stay cached
+	EXPECT_NE(cache.lookup("b.txt"), nullptr);
+}
+
+TEST_F(ContentCacheTest, DeletedDirectoriesAreInvalidated) {
+	ContentCache cache(800);
+	write_file("a.txt", 10);
+	ASSERT_NE(request(cache, "a.txt"), nullptr);
+
+	fs::remove_all(dir);
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (cache.stats().entries > 0 && std::chrono::steady_clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	EXPECT_EQ(cache.stats().entries, 0);
+}
+
+TEST_F(ContentCacheTest, SiblingChangesInvalidate) {
+	ContentCache cache(800);
+	write_file("a.txt", 10);
+	write_file("a.txt.gz", 5);
+	fs::last_write_time(dir / "a.txt.gz", fs::last_write_time(dir / "a.txt") + 10);
+
+	// Only up to date siblings are recorded
+	auto file = cache.load("a.txt", dir / "a.txt", "text/plain", {".br", ".gz"});
+	ASSERT_NE(file, nullptr);
+	EXPECT_EQ(file->siblings, std::vector<std::string>{".gz"});
+	ASSERT_NE(cache.lookup("a.txt"), nullptr);
+
+	// A sibling appearing later drops the file from the cache
+	write_file("a.txt.br", 5);
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (cache.lookup("a.txt") != nullptr && std::chrono::steady_clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	EXPECT_EQ(cache.lookup("a.txt"), nullptr);
+	EXPECT_EQ(cache.stats().entries, 0);
+}
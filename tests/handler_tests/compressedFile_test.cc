@@ -6,6 +6,7 @@
 #include <unordered_map>
 
 #include "compressedFileHandler.h"
+#include "compressionCache.h"
 #include "gtest/gtest.h"
 #include "logger.h"
 #include "parser.h"
@@ -46,4 +47,110 @@ TEST(CompressedFileHandlerTest, UnitTests) {
 
 	// uncompressed vs uncompressed
 	EXPECT_EQ(resa.body().size(), hello_str.size());
-}
\ No newline at end of file
+
+	// Both variants tell shared caches that they depend on Accept-Encoding
+	EXPECT_EQ(res[http::field::vary], "Accept-Encoding");
+	EXPECT_EQ(resa[http::field::vary], "Accept-Encoding");
+}
+TEST(CompressedFileHandlerTest, CompressesOnce) {
+	NginxConfig config;
+	NginxConfigParser p;
+	std::istringstream configStream;
+
+	std::ofstream("compressed_test.txt") << std::string(1000, 'a');
+	configStream.str("root compressed_test.txt;");
+	p.Parse(&configStream, &config);
+
+	CompressedFileHandler cf_handler("/compressed", config);
+	CompressionCache& cache = CompressionCache::instance();
+	cache.set_capacity(1024 * 1024);
+
+	// The cache is shared with the other tests of the process
+	CompressionCache::Stats before = cache.stats();
+
+	http::request<http::string_body> req;
+	req.method(http::verb::get);
+	req.target("/compressed");
+	req.set(http::field::accept_encoding, "gzip");
+	req.version(11);
+
+	http::response<http::string_body> first = cf_handler.get_response(req);
+	http::response<http::string_body> second = cf_handler.get_response(req);
+	EXPECT_EQ(first[http::field::content_encoding], "gzip");
+	EXPECT_EQ(first[http::field::vary], "Accept-Encoding");
+	EXPECT_EQ(first.body(), second.body());
+	EXPECT_EQ(first.body(), compress(std::string(1000, 'a')));
+	EXPECT_EQ(cache.stats().misses - before.misses, 1);
+	EXPECT_EQ(cache.stats().hits - before.hits, 1);
+
+	// A changed file is compressed again
+	std::ofstream("compressed_test.txt") << std::string(2000, 'b');
+	http::response<http::string_body> changed = cf_handler.get_response(req);
+	EXPECT_EQ(changed.body(), compress(std::string(2000, 'b')));
+	EXPECT_EQ(cache.stats().misses - before.misses, 2);
+	EXPECT_EQ(cache.stats().entries - before.entries, 1);
+
+	cache.set_capacity(0);
+	fs::remove("compressed_test.txt");
+}
+
+TEST(CompressedFileHandlerTest, HeadHasTheHeadersOfGet) {
+	NginxConfig config;
+	NginxConfigParser p;
+	std::istringstream configStream;
+
+	configStream.str("root \"../tests/handler_tests\";");
+	p.Parse(&configStream, &config);
+
+	CompressedFileHandler cf_handler("/compressed", config);
+
+	http::request<http::string_body> req;
+	req.method(http::verb::get);
+	req.target("/compressed/hello.txt");
+	req.set(http::field::accept_encoding, "gzip");
+	req.version(11);
+	http::response<http::string_body> get = cf_handler.get_response(req);
+
+	req.method(http::verb::head);
+	http::response<http::string_body> head = cf_handler.get_response(req);
+	EXPECT_EQ(head.result(), http::status::ok);
+	EXPECT_EQ(head[http::field::content_encoding], "gzip");
+	EXPECT_EQ(head[http::field::content_length], std::to_string(get.body().size()));
+	EXPECT_EQ(head[http::field::content_type], get[http::field::content_type]);
+	EXPECT_TRUE(head.body().empty());
+
+	req.target("/compressed/missing.txt");
+	EXPECT_EQ(cf_handler.get_response(req).result(), http::status::not_found);
+}
+
+TEST(CompressedFileHandlerTest, ServesPrecompressedFiles) {
+	NginxConfig config;
+	NginxConfigParser p;
+	std::istringstream configStream;
+
+	std::ofstream("precompressed_test.txt") << std::string(1000, 'a');
+	std::ofstream("precompressed_test.txt.gz") << "precompressed";
+	configStream.str("root precompressed_test.txt;");
+	p.Parse(&configStream, &config);
+
+	CompressedFileHandler cf_handler("/compressed", config);
+	CompressionCache& cache = CompressionCache::instance();
+	cache.set_capacity(1024 * 1024);
+	CompressionCache::Stats before = cache.stats();
+
+	http::request<http::string_body> req;
+	req.method(http::verb::get);
+	req.target("/compressed");
+	req.set(http::field::accept_encoding, "gzip");
+	req.version(11);
+
+	// The sibling is served without compressing the file
+	http::response<http::string_body> res = cf_handler.get_response(req);
+	EXPECT_EQ(res[http::field::content_encoding], "gzip");
+	EXPECT_EQ(res.body(), "precompressed");
+	EXPECT_EQ(cache.stats().misses, before.misses);
+
+	cache.set_capacity(0);
+	fs::remove("precompressed_test.txt");
+	fs::remove("precompressed_test.txt.gz");
+}
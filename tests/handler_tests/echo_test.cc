@@ -20,7 +20,7 @@ TEST(EchoHandlerTest, UnitTests) {
 		p.Parse(&configStream, &config);
 		EchoHandler esv("/echo", config);
 		EXPECT_EQ("/echo", esv.get_url_prefix());
-		EXPECT_EQ(esv.keep_alive, 0);
+		EXPECT_EQ(esv.keep_alive, 1);
 	}
 
 	{
@@ -48,12 +48,28 @@ TEST(EchoHandlerTest, UnitTests) {
 		NginxConfigParser p;
 		std::istringstream configStream;
 
-		configStream.str("keep-alive 1;");
+		configStream.str("keep-alive 0; keepalive_timeout 5; keepalive_requests 10;");
 		p.Parse(&configStream, &config);
 		EchoHandler esv("/echo", config);
+		esv.set_keep_alive_from_config(config);
 
-		EXPECT_EQ(esv.keep_alive, 1);
+		EXPECT_EQ(esv.keep_alive, 0);
+		EXPECT_EQ(esv.keepalive_timeout, 5);
+		EXPECT_EQ(esv.keepalive_requests, 10);
 	}
 
 
+}
+
+TEST(EchoHandlerTest, AppendsTheRequestAsSent) {
+	http::request<http::string_body> req{http::verb::post, "/echo?x=1", 11};
+	req.set(http::field::host, "localhost");
+	req.set(http::field::user_agent, "curl/7.68.0");
+	req.set("X-Custom", "value");
+	req.body() = "hello";
+	req.prepare_payload();
+
+	std::string body;
+	EchoHandler::append_request(req, body);
+	EXPECT_EQ(body, RequestHandler::to_string(req));
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include <boost/beast/http.hpp>
 #include <boost/filesystem.hpp>
+#include <chrono>
+#include <thread>
 #include <unordered_map>
 
 #include "gtest/gtest.h"
@@ -163,4 +165,285 @@ TEST_F(FileHandlerTest, FileTests) {
 		// Check that invalid settings do not return a 200 OK
 		test_not_ok("/static", "nonexistant-repo", "/static/");
 	}
-}
\ No newline at end of file
+}
+
+TEST_F(FileHandlerTest, StaticResponses) {
+	NginxConfig config;
+	NginxConfigParser p;
+	std::istringstream configStream;
+
+	configStream.str("root ../data/static_data;");
+	p.Parse(&configStream, &config);
+	FileHandler fsv("/static", config);
+	uintmax_t size = fs::file_size("../data/static_data/samueli.jpg");
+
+	http::request<http::string_body> req;
+	req.method(http::verb::get);
+	req.version(11);
+	req.target("/static/samueli.jpg");
+
+	{
+		// The file is opened, not read
+		http::response<static_body> res;
+		ASSERT_TRUE(fsv.get_static_response(req, res));
+		EXPECT_EQ(res.result(), http::status::ok);
+		EXPECT_TRUE(res.body().is_open());
+		EXPECT_EQ(res.body().size(), size);
+		EXPECT_EQ(res[http::field::content_length], std::to_string(size));
+		EXPECT_EQ(res[http::field::content_type], "image/jpeg");
+
+		// Writing the body reads the whole file in bounded chunks
+		beast::error_code err;
+		static_body::writer writer(res.base(), res.body());
+		writer.init(err);
+		ASSERT_FALSE(err);
+		uintmax_t written = 0;
+		while (auto chunk = writer.get(err)) {
+			EXPECT_LE(chunk->first.size(), static_body::chunk_size);
+			written += chunk->first.size();
+		}
+		EXPECT_FALSE(err);
+		EXPECT_EQ(written, size);
+	}
+
+	{
+		// HEAD requests only get the size of the file
+		req.method(http::verb::head);
+		http::response<static_body> static_res;
+		EXPECT_FALSE(fsv.get_static_response(req, static_res));
+
+		http::response<http::string_body> res = fsv.get_response(req);
+		EXPECT_EQ(res.result(), http::status::ok);
+		EXPECT_EQ(res[http::field::content_length], std::to_string(size));
+		EXPECT_TRUE(res.body().empty());
+		req.method(http::verb::get);
+	}
+
+	{
+		// Missing files are left for get_response to answer
+		req.target("/static/missing.txt");
+		http::response<static_body> res;
+		EXPECT_FALSE(fsv.get_static_response(req, res));
+		EXPECT_EQ(fsv.get_response(req).result(), http::status::not_found);
+	}
+}
+
+TEST_F(FileHandlerTest, CachedResponses) {
+	NginxConfig config;
+	NginxConfigParser p;
+	std::istringstream configStream;
+
+	configStream.str("root ../data/static_data;");
+	p.Parse(&configStream, &config);
+	FileHandler fsv("/static", config);
+
+	// Empty the process-wide cache in case another test left the file in it
+	ContentCache::instance().set_capacity(0);
+	ContentCache::instance().set_capacity(64 * 1024 * 1024);
+	ContentCache::Stats before = ContentCache::instance().stats();
+
+	http::request<http::string_body> req;
+	req.method(http::verb::get);
+	req.version(11);
+	req.target("/static/samueli.jpg");
+
+	// Small files are served from memory, every response shares the same buffer
+	http::response<static_body> first;
+	http::response<static_body> second;
+	ASSERT_TRUE(fsv.get_static_response(req, first));
+	ASSERT_TRUE(fsv.get_static_response(req, second));
+	ASSERT_NE(first.body().buffer(), nullptr);
+	EXPECT_FALSE(first.body().is_open());
+	EXPECT_EQ(first.body().buffer().get(), second.body().buffer().get());
+	EXPECT_EQ(first[http::field::content_type], "image/jpeg");
+	EXPECT_EQ(first[http::field::content_length], std::to_string(fs::file_size("../data/static_data/samueli.jpg")));
+
+	// The string responses are copied from the same cache entry
+	http::response<http::string_body> res = fsv.get_response(req);
+	EXPECT_EQ(res.body(), *first.body().buffer());
+
+	ContentCache::Stats stats = ContentCache::instance().stats();
+	EXPECT_EQ(stats.misses - before.misses, 1);
+	EXPECT_EQ(stats.hits - before.hits, 2);
+
+	ContentCache::instance().set_capacity(0);
+}
+
+TEST_F(FileHandlerTest, AcceptsEncoding) {
+	http::request<http::string_body> req;
+	EXPECT_FALSE(FileHandler::accepts_encoding(req, "gzip"));
+
+	req.set(http::field::accept_encoding, "gzip, deflate, br");
+	EXPECT_TRUE(FileHandler::accepts_encoding(req, "gzip"));
+	EXPECT_TRUE(FileHandler::accepts_encoding(req, "br"));
+	EXPECT_FALSE(FileHandler::accepts_encoding(req, "zstd"));
+
+	req.set(http::field::accept_encoding, "br;q=0, GZIP;q=0.5");
+	EXPECT_FALSE(FileHandler::accepts_encoding(req, "br"));
+	EXPECT_TRUE(FileHandler::accepts_encoding(req, "gzip"));
+
+	req.set(http::field::accept_encoding, "*, gzip;q=0");
+	EXPECT_TRUE(FileHandler::accepts_encoding(req, "zstd"));
+	EXPECT_FALSE(FileHandler::accepts_encoding(req, "gzip"));
+}
+
+TEST_F(FileHandlerTest, PrecompressedSiblings) {
+	fs::path dir = "precompressed_test_dir";
+	fs::remove_all(dir);
+	fs::create_directories(dir);
+	std::ofstream(dir / "page.html") << "<html></html>";
+	std::ofstream(dir / "page.html.gz") << "gzip body";
+	std::ofstream(dir / "page.html.br") << "brotli body";
+
+	NginxConfig config;
+	NginxConfigParser p;
+	std::istringstream configStream;
+	configStream.str("root precompressed_test_dir;");
+	p.Parse(&configStream, &config);
+	FileHandler fsv("/static", config);
+
+	http::request<http::string_body> req;
+	req.method(http::verb::get);
+	req.version(11);
+	req.target("/static/page.html");
+
+	// Returns the body and encoding of the static response for an Accept-Encoding header
+	auto serve = [&](const std::string& accept_encoding) {
+		req.set(http::field::accept_encoding, accept_encoding);
+		http::response<static_body> res;
+		EXPECT_TRUE(fsv.get_static_response(req, res));
+		http::response<http::string_body> string_res = fsv.get_response(req);
+		EXPECT_EQ(res[http::field::content_encoding], string_res[http::field::content_encoding]);
+		EXPECT_EQ(res[http::field::content_type], "text/html");
+		// Shared caches keep identity and encoded responses apart
+		EXPECT_EQ(res[http::field::vary], "Accept-Encoding");
+		EXPECT_EQ(string_res[http::field::vary], "Accept-Encoding");
+		return std::make_pair(string_res.body(), std::string(res[http::field::content_encoding]));
+	};
+
+	EXPECT_EQ(serve(""), std::make_pair(std::string("<html></html>"), std::string("")));
+	EXPECT_EQ(serve("gzip"), std::make_pair(std::string("gzip body"), std::string("gzip")));
+	EXPECT_EQ(serve("gzip, br"), std::make_pair(std::string("brotli body"), std::string("br")));
+	EXPECT_EQ(serve("gzip, br;q=0"), std::make_pair(std::string("gzip body"), std::string("gzip")));
+
+	// Siblings are streamed from disk with the right headers
+	req.set(http::field::accept_encoding, "gzip");
+	http::response<static_body> res;
+	ASSERT_TRUE(fsv.get_static_response(req, res));
+	EXPECT_TRUE(res.body().is_open());
+	EXPECT_EQ(res[http::field::vary], "Accept-Encoding");
+	EXPECT_EQ(res[http::field::content_length], "9");
+
+	// Siblings older than the file are ignored
+	fs::last_write_time(dir / "page.html.gz", fs::last_write_time(dir / "page.html") - 100);
+	EXPECT_EQ(serve("gzip"), std::make_pair(std::string("<html></html>"), std::string("")));
+
+	// HEAD responses vary too
+	req.method(http::verb::head);
+	req.set(http::field::accept_encoding, "");
+	EXPECT_EQ(fsv.get_response(req)[http::field::vary], "Accept-Encoding");
+
+	fs::remove_all(dir);
+}
+
+// Counts the times FileHandler looks for a file on disk
+class CountingFileHandler : public FileHandler {
+   public:
+	using FileHandler::FileHandler;
+	int disk_lookups = 0;
+
+   protected:
+	virtual bool find_file(std::string target, fs::path& linux_path) override {
+		disk_lookups++;
+		return FileHandler::find_file(target, linux_path);
+	}
+};
+
+TEST_F(FileHandlerTest, FindsUncachedFilesOnce) {
+	fs::path dir = "uncached_lookup_test_dir";
+	fs::remove_all(dir);
+	fs::create_directories(dir);
+	std::ofstream(dir / "plain.html") << "<html></html>";
+	std::ofstream(dir / "page.html") << "<html></html>";
+	std::ofstream(dir / "page.html.gz") << "gzip body";
+
+	NginxConfig config;
+	NginxConfigParser p;
+	std::istringstream configStream;
+	configStream.str("root uncached_lookup_test_dir;");
+	p.Parse(&configStream, &config);
+	CountingFileHandler fsv("/static", config);
+	ContentCache::instance().set_capacity(0);
+
+	http::request<http::string_body> req;
+	req.method(http::verb::get);
+	req.version(11);
+	req.set(http::field::accept_encoding, "gzip, br");
+
+	// Looking for a sibling reuses the path of the file, whether or not there is one
+	for (const char* target : {"/static/plain.html", "/static/page.html"}) {
+		req.target(target);
+		fsv.disk_lookups = 0;
+		EXPECT_EQ(fsv.get_response(req).result(), http::status::ok);
+		EXPECT_EQ(fsv.disk_lookups, 1);
+
+		http::response<static_body> res;
+		fsv.disk_lookups = 0;
+		ASSERT_TRUE(fsv.get_static_response(req, res));
+		EXPECT_EQ(fsv.disk_lookups, 1);
+	}
+
+	fs::remove_all(dir);
+}
+
+TEST_F(FileHandlerTest, CachedPrecompressedSiblings) {
+	// Every file is written before the cache watches the directory
+	fs::path dir = "cached_precompressed_test_dir";
+	fs::remove_all(dir);
+	fs::create_directories(dir);
+	std::ofstream(dir / "page.html") << "<html></html>";
+	std::ofstream(dir / "page.html.gz") << "gzip body";
+
+	NginxConfig config;
+	NginxConfigParser p;
+	std::istringstream configStream;
+	configStream.str("root cached_precompressed_test_dir;");
+	p.Parse(&configStream, &config);
+	CountingFileHandler fsv("/static", config);
+	ContentCache::instance().set_capacity(0);
+	ContentCache::instance().set_capacity(64 * 1024 * 1024);
+
+	http::request<http::string_body> req;
+	req.method(http::verb::get);
+	req.version(11);
+	req.target("/static/page.html");
+	req.set(http::field::accept_encoding, "gzip, br");
+
+	// The first request finds the file and its sibling on disk
+	http::response<static_body> first;
+	ASSERT_TRUE(fsv.get_static_response(req, first));
+	EXPECT_EQ(first[http::field::content_encoding], "gzip");
+	EXPECT_EQ(fsv.disk_lookups, 1);
+
+	// Later requests find both in the content cache
+	http::response<static_body> second;
+	ASSERT_TRUE(fsv.get_static_response(req, second));
+	EXPECT_TRUE(second.body().is_open());
+	EXPECT_EQ(second[http::field::content_encoding], "gzip");
+	EXPECT_EQ(second[http::field::content_length], "9");
+	http::response<http::string_body> string_res = fsv.get_response(req);
+	EXPECT_EQ(string_res.body(), "gzip body");
+	EXPECT_EQ(string_res[http::field::content_encoding], "gzip");
+	EXPECT_EQ(fsv.disk_lookups, 1);
+
+	// A new sibling invalidates the cached file, inotify events arrive asynchronously
+	std::ofstream(dir / "page.html.br") << "brotli body";
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (fsv.get_response(req)[http::field::content_encoding] != "br" && std::chrono::steady_clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	EXPECT_EQ(fsv.get_response(req).body(), "brotli body");
+
+	ContentCache::instance().set_capacity(0);
+	fs::remove_all(dir);
+}
@@ -26,4 +26,19 @@ TEST(HealthHandlerTest, UnitTests) {
 	std::string res = test_handler.to_string(test_handler.get_response(req));
 
 	EXPECT_NE(res.find("200 OK"), std::string::npos);
+}
+
+TEST(HealthHandlerTest, CannedResponse) {
+	NginxConfig config;
+	HealthHandler test_handler("/", config);
+
+	http::request<http::string_body> req{http::verb::get, "/health", 11};
+	const CannedResponse* canned = test_handler.get_canned_response(req);
+	ASSERT_NE(canned, nullptr);
+	EXPECT_EQ(canned->result_int(), 200);
+
+	// Serialized once and reused for every request
+	EXPECT_EQ(test_handler.get_canned_response(req), canned);
+	auto tail = canned->tail();
+	EXPECT_EQ(std::string((const char*)tail.data(), tail.size()), "\r\nOK");
 }
\ No newline at end of file
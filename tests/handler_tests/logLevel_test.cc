@@ -0,0 +1,99 @@
+#include "logLevelHandler.h"
+
+#include <boost/beast/http.hpp>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <memory>
+#include <sstream>
+
+#include "gtest/gtest.h"
+#include "logger.h"
+#include "parser.h"
+
+class LogLevelHandlerTest : public ::testing::Test {
+   protected:
+	void TearDown() override {
+		set_log_level(trace);
+	}
+
+	http::response<http::string_body> send(http::verb method, const std::string& target, const std::string& body = "", const std::string& authorization = "") {
+		return send(handler, method, target, body, authorization);
+	}
+
+	static http::response<http::string_body> send(LogLevelHandler& handler, http::verb method, const std::string& target, const std::string& body = "",
+	                                              const std::string& authorization = "") {
+		http::request<http::string_body> req;
+		req.method(method);
+		req.target(target);
+		req.version(11);
+		if (!authorization.empty()) {
+			req.set(http::field::authorization, authorization);
+		}
+		req.body() = body;
+		req.prepare_payload();
+		return handler.get_response(req);
+	}
+
+	// A handler reading its token from the file at path
+	static std::unique_ptr<LogLevelHandler> handler_with_token_file(const std::string& path) {
+		NginxConfig config;
+		NginxConfigParser parser;
+		std::istringstream config_stream("tokenFile \"" + path + "\";");
+		parser.Parse(&config_stream, &config);
+		return std::make_unique<LogLevelHandler>("/admin/loglevel", config);
+	}
+
+	NginxConfig config;
+	LogLevelHandler handler{"/admin/loglevel", config};
+};
+
+TEST_F(LogLevelHandlerTest, ShowsTheLevel) {
+	http::response<http::string_body> res = send(http::verb::get, "/admin/loglevel");
+	EXPECT_EQ(res.result(), http::status::ok);
+	EXPECT_NE(res.body().find("level: trace"), std::string::npos);
+}
+
+TEST_F(LogLevelHandlerTest, ChangesTheLevel) {
+	http::response<http::string_body> res = send(http::verb::post, "/admin/loglevel?level=warning");
+	EXPECT_EQ(res.result(), http::status::ok);
+	EXPECT_NE(res.body().find("level: warning"), std::string::npos);
+	EXPECT_EQ(get_log_level(), warning);
+
+	res = send(http::verb::put, "/admin/loglevel", "error\n");
+	EXPECT_EQ(res.result(), http::status::ok);
+	EXPECT_EQ(get_log_level(), error);
+}
+
+TEST_F(LogLevelHandlerTest, RejectsUnknownLevels) {
+	EXPECT_EQ(send(http::verb::post, "/admin/loglevel?level=verbose").result(), http::status::bad_request);
+	EXPECT_EQ(send(http::verb::post, "/admin/loglevel?notlevel=info").result(), http::status::bad_request);
+	EXPECT_EQ(send(http::verb::delete_, "/admin/loglevel").result(), http::status::bad_request);
+	EXPECT_EQ(get_log_level(), trace);
+}
+
+TEST_F(LogLevelHandlerTest, RequiresTheConfiguredToken) {
+	std::ofstream("loglevel_token_test") << "s3cret\n";
+	std::unique_ptr<LogLevelHandler> guarded = handler_with_token_file("loglevel_token_test");
+	boost::filesystem::remove("loglevel_token_test");
+
+	// Anyone may see the level
+	EXPECT_EQ(send(*guarded, http::verb::get, "/admin/loglevel").result(), http::status::ok);
+
+	// Clients without the token cannot change it
+	http::response<http::string_body> res = send(*guarded, http::verb::post, "/admin/loglevel?level=warning");
+	EXPECT_EQ(res.result(), http::status::unauthorized);
+	EXPECT_EQ(res[http::field::www_authenticate], "Bearer");
+	EXPECT_EQ(send(*guarded, http::verb::post, "/admin/loglevel?level=warning", "", "Bearer wrong!").result(), http::status::unauthorized);
+	EXPECT_EQ(send(*guarded, http::verb::put, "/admin/loglevel", "warning", "Bearer s3cre").result(), http::status::unauthorized);
+	EXPECT_EQ(send(*guarded, http::verb::post, "/admin/loglevel?level=warning", "", "s3cret").result(), http::status::unauthorized);
+	EXPECT_EQ(get_log_level(), trace);
+
+	EXPECT_EQ(send(*guarded, http::verb::post, "/admin/loglevel?level=warning", "", "Bearer s3cret").result(), http::status::ok);
+	EXPECT_EQ(get_log_level(), warning);
+}
+
+TEST_F(LogLevelHandlerTest, MissingTokenFileRefusesChanges) {
+	std::unique_ptr<LogLevelHandler> guarded = handler_with_token_file("no_such_token_file");
+	EXPECT_EQ(send(*guarded, http::verb::post, "/admin/loglevel?level=warning", "", "Bearer ").result(), http::status::unauthorized);
+	EXPECT_EQ(get_log_level(), trace);
+}
@@ -0,0 +1,22 @@
+#include "metricsHandler.h"
+
+#include <boost/beast/http.hpp>
+
+#include "gtest/gtest.h"
+#include "metrics.h"
+
+TEST(MetricsHandlerTest, ServesTheRegistry) {
+	MetricsRegistry::instance().counter("koko_test_handler_total", "Counted by MetricsHandlerTest").inc(3);
+
+	NginxConfig config;
+	MetricsHandler handler("/metrics", config);
+	http::request<http::string_body> req;
+	req.method(http::verb::get);
+	req.target("/metrics");
+	req.version(11);
+
+	http::response<http::string_body> res = handler.get_response(req);
+	EXPECT_EQ(res.result(), http::status::ok);
+	EXPECT_EQ(res[http::field::content_type], "text/plain; version=0.0.4; charset=utf-8");
+	EXPECT_NE(res.body().find("# TYPE koko_test_handler_total counter\nkoko_test_handler_total 3\n"), std::string::npos);
+}
@@ -28,4 +28,12 @@ TEST(NotFoundHandlerTest, UnitTests) {
 	// Check OK response
 	s = esv.to_string(esv.get_response(req));
 	EXPECT_NE(s.find("404 Not Found"), std::string::npos);
+}
+
+TEST(NotFoundHandlerTest, CannedResponse) {
+	NginxConfig config;
+	NotFoundHandler esv("/", config);
+
+	http::request<http::string_body> req{http::verb::get, "/", 11};
+	EXPECT_EQ(esv.get_canned_response(req), &RequestHandler::canned_not_found_error());
 }
\ No newline at end of file
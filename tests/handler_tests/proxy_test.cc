@@ -1,5 +1,6 @@
 #include "handler.h"
 
+#include <boost/asio.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/filesystem.hpp>
 #include <unordered_map>
@@ -9,6 +10,7 @@
 #include "parser.h"
 #include "server.h"
 #include "proxyRequestHandler.h"
+#include "upstreamSimulator.h"
 
 class TestProxyRequestHandler : public ProxyRequestHandler {
    private:
@@ -16,6 +18,9 @@ class TestProxyRequestHandler : public ProxyRequestHandler {
 	boost::beast::http::response<boost::beast::http::string_body> req_synchronous(const boost::beast::http::request<boost::beast::http::string_body> &) {
 		return m_res;
 	}
+	void req_async(boost::beast::http::request<boost::beast::http::string_body> &&, const boost::asio::any_io_executor &executor, UpstreamHandler done) {
+		boost::asio::post(executor, [this, done]() { done({}, m_res); });
+	}
 
    public:
 	TestProxyRequestHandler(const std::string &url_prefix, const NginxConfig &config) : ProxyRequestHandler{url_prefix, config} {}
@@ -118,4 +123,122 @@ TEST_F(ProxyHandlerTest, RedirectUnitTests) {
 	// proxy handler is mapped to root
 	EXPECT_TRUE(root_proxy_handler_contains(fake_res_relative, relative_path));
 	EXPECT_TRUE(root_proxy_handler_contains(fake_res_relative, "302 Found"));
-}
\ No newline at end of file
+}
+
+TEST_F(ProxyHandlerTest, AsyncResponses) {
+	http::response<http::string_body> fake_res;
+	fake_res.result(200);
+	fake_res.set(http::field::content_type, "text/html");
+	fake_res.body() = "href=\"/asdf\"";
+	fake_res.prepare_payload();
+	handler->set_fake_response(fake_res);
+
+	// The response is completed from the executor, with links rewritten like synchronous responses
+	boost::asio::io_context ioc;
+	bool completed = false;
+	http::response<http::string_body> res;
+	handler->get_async_response(handler_request, ioc.get_executor(), [&](http::response<http::string_body> r) {
+		completed = true;
+		res = std::move(r);
+	});
+	EXPECT_FALSE(completed);
+	ioc.run();
+	EXPECT_TRUE(completed);
+	EXPECT_EQ(res.result(), http::status::ok);
+	EXPECT_EQ(res.body(), "href=\"" + proxy_path + "/asdf\"");
+}
+
+TEST_F(ProxyHandlerTest, AsyncUpstreamErrors) {
+	// Nothing listens on port 1 of localhost, so connecting fails
+	NginxConfig local_config;
+	std::istringstream config_stream("dest 127.0.0.1; port 1;");
+	p.Parse(&config_stream, &local_config);
+	ProxyRequestHandler local_handler(proxy_path, local_config);
+
+	boost::asio::io_context ioc;
+	http::response<http::string_body> res;
+	local_handler.get_async_response(handler_request, ioc.get_executor(), [&](http::response<http::string_body> r) {
+		res = std::move(r);
+	});
+	ioc.run();
+	EXPECT_EQ(res.result(), http::status::internal_server_error);
+}
+
+// Proxies requests to a local UpstreamSimulator, as the session would
+class LocalUpstreamProxyTest : public ::testing::Test {
+   protected:
+	std::unique_ptr<ProxyRequestHandler> make_handler(UpstreamSimulator &upstream) {
+		NginxConfig config;
+		NginxConfigParser parser;
+		std::istringstream config_stream("dest 127.0.0.1; port " + upstream.port() + ";");
+		parser.Parse(&config_stream, &config);
+		return std::make_unique<ProxyRequestHandler>("/proxy", config);
+	}
+
+	// Runs the io_context until the response completes, leaving pooled connections open
+	http::response<http::string_body> get(ProxyRequestHandler &handler, const std::string &target) {
+		http::request<http::string_body> req{http::verb::get, target, 11};
+		http::response<http::string_body> res;
+		bool done = false;
+		handler.get_async_response(req, ioc.get_executor(), [&](http::response<http::string_body> r) {
+			res = std::move(r);
+			done = true;
+		});
+		while (!done) {
+			ioc.run_one();
+		}
+		ioc.restart();
+		return res;
+	}
+
+	boost::asio::io_context ioc;
+};
+
+TEST_F(LocalUpstreamProxyTest, RewritesPagesAndRedirects) {
+	UpstreamSimulator upstream;
+	auto handler = make_handler(upstream);
+
+	http::response<http::string_body> res = get(*handler, "/proxy/html/3");
+	EXPECT_EQ(res.result(), http::status::ok);
+	EXPECT_NE(res.body().find("href=\"/proxy/page2\""), std::string::npos);
+	EXPECT_NE(res.body().find("src=\"//cdn.example.com/img2.png\""), std::string::npos);
+	EXPECT_EQ(res[http::field::content_length], std::to_string(res.body().size()));
+
+	res = get(*handler, "/proxy/redirect/2");
+	EXPECT_EQ(res.result(), http::status::found);
+	EXPECT_EQ(res[http::field::location], "/proxy/redirect/1");
+
+	res = get(*handler, "/proxy/absolute/2");
+	EXPECT_EQ(res.result(), http::status::moved_permanently);
+	EXPECT_EQ(res[http::field::location], "http://127.0.0.1/redirect/1");
+
+	EXPECT_EQ(get(*handler, "/proxy/status/503").result(), http::status::service_unavailable);
+
+	// Synchronous responses are rewritten the same way
+	http::request<http::string_body> req{http::verb::get, "/proxy/redirect/1", 11};
+	EXPECT_EQ(handler->get_response(req)[http::field::location], "/proxy/redirect/0");
+}
+
+TEST_F(LocalUpstreamProxyTest, ProxiesChunkedAndLargeBodies) {
+	UpstreamSimulator upstream;
+	auto handler = make_handler(upstream);
+
+	http::response<http::string_body> chunked = get(*handler, "/proxy/chunked/100000");
+	EXPECT_EQ(chunked.result(), http::status::ok);
+	EXPECT_EQ(chunked.body().size(), 100000);
+	EXPECT_EQ(get(*handler, "/proxy/bytes/100000").body(), chunked.body());
+}
+
+TEST_F(LocalUpstreamProxyTest, ReconnectsAfterUpstreamCloses) {
+	UpstreamSimulator::Options options;
+	options.close_after = 1;
+	UpstreamSimulator upstream(options);
+	auto handler = make_handler(upstream);
+
+	for (int i = 0; i < 3; i++) {
+		EXPECT_EQ(get(*handler, "/proxy/").body(), "upstream /");
+	}
+	EXPECT_EQ(get(*handler, "/proxy/close/10").body().size(), 10);
+	EXPECT_EQ(get(*handler, "/proxy/").result(), http::status::ok);
+	EXPECT_EQ(upstream.requests, 5);
+}
@@ -1,5 +1,7 @@
+#include <boost/asio.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/filesystem.hpp>
+#include <chrono>
 #include <unordered_map>
 
 #include "gtest/gtest.h"
@@ -36,9 +38,39 @@ TEST(SleepEchoHandlerTest, UnitTests) {
 		req.target("/echo");
 		req.version(11);
 
-		// Check OK response
+		// Check OK response, sent after the delay
+		auto start = std::chrono::steady_clock::now();
 		s = sesv.to_string(sesv.get_response(req));
+		EXPECT_GE(std::chrono::steady_clock::now() - start, SleepEchoHandler::delay);
 		EXPECT_NE(s.find("200 OK"), std::string::npos);
 		EXPECT_NE(s.find("GET", 5), std::string::npos);
 	}
-}
\ No newline at end of file
+}
+
+TEST(SleepEchoHandlerTest, DoesNotBlockTheThread) {
+	NginxConfig config;
+	SleepEchoHandler handler("/sleep", config);
+
+	http::request<http::string_body> req;
+	req.method(http::verb::get);
+	req.target("/sleep");
+	req.version(11);
+
+	// Both requests wait on the same thread at the same time
+	boost::asio::io_context ioc;
+	int completed = 0;
+	for (int i = 0; i < 2; i++) {
+		handler.get_async_response(req, ioc.get_executor(), [&](http::response<http::string_body> res) {
+			completed++;
+			EXPECT_EQ(res.result(), http::status::ok);
+		});
+	}
+	EXPECT_EQ(completed, 0);
+
+	auto start = std::chrono::steady_clock::now();
+	ioc.run();
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	EXPECT_EQ(completed, 2);
+	EXPECT_GE(elapsed, SleepEchoHandler::delay);
+	EXPECT_LT(elapsed, 2 * SleepEchoHandler::delay);
+}
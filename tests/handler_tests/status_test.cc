@@ -1,11 +1,14 @@
 #include <boost/beast/http.hpp>
 #include <boost/filesystem.hpp>
+#include <chrono>
+#include <thread>
 #include <unordered_map>
 
 #include "gtest/gtest.h"
 #include "handler.h"
 #include "logger.h"
 #include "parser.h"
+#include "requestHistory.h"
 #include "server.h"
 #include "statusHandler.h"
 
@@ -18,10 +21,11 @@ TEST(StatusHandlerTest, UnitTests) {
 	p.Parse(&configStream, &config);
 	StatusHandler test_handler("/", config);
 
-	boost::posix_time::ptime now = boost::posix_time::second_clock::local_time();
-	StatusHandler::url_info.emplace_back("/foo", 200, now);
-	StatusHandler::url_info.emplace_back("/brick", 404, now);
-	StatusHandler::url_info.emplace_back("/file/trash.txt", 200, now);
+	RequestHistory& history = RequestHistory::instance();
+	history.clear();
+	history.record("/foo", "Test", 200);
+	history.record("/brick", "Test", 404);
+	history.record("/file/trash.txt", "Test", 200);
 
 	server::urlToHandlerName.emplace_back("/foo", "FooHandler");
 	server::urlToHandlerName.emplace_back("/", "NotFoundHandler");
@@ -47,12 +51,111 @@ TEST(StatusHandlerTest, UnitTests) {
 	EXPECT_NE(res.find("/file</td><td>FileHandler"), std::string::npos);
 	EXPECT_NE(res.find("/status</td><td>StatusHandler"), std::string::npos);
 
-	URLInfo top = StatusHandler::url_info[StatusHandler::url_info.size() - 1];
+	URLInfo top = history.snapshot(1).at(0);
 
 	//check get_response adds url and response code pair
 	ASSERT_TRUE(top.url == "/status");
 	ASSERT_TRUE(top.res_code == 200);
 
-	StatusHandler::url_info.clear();
+	history.clear();
 	server::urlToHandlerName.clear();
-}
\ No newline at end of file
+}
+class StatusHandlerPageTest : public ::testing::Test {
+   protected:
+	void SetUp() override {
+		history.clear();
+		for (int i = 0; i < 5; i++) {
+			history.record("/echo?i=" + std::to_string(i), "Echo", 200);
+			// Every request at a time of its own
+			std::this_thread::sleep_for(std::chrono::microseconds(10));
+		}
+		history.record("/missing", "NotFound", 404);
+	}
+
+	void TearDown() override {
+		history.clear();
+	}
+
+	http::response<http::string_body> send(const std::string& target) {
+		http::request<http::string_body> req;
+		req.method(http::verb::get);
+		req.version(11);
+		req.target(target);
+		return handler.get_response(req);
+	}
+
+	RequestHistory& history = RequestHistory::instance();
+	NginxConfig config;
+	StatusHandler handler{"/status", config};
+};
+
+TEST_F(StatusHandlerPageTest, ListsRequestsAsJson) {
+	http::response<http::string_body> res = send("/status?format=json&limit=2");
+	EXPECT_EQ(res.result(), http::status::ok);
+	EXPECT_EQ(res[http::field::content_type], "application/json");
+
+	const std::string& body = res.body();
+	EXPECT_EQ(body.find("{\"total_requests\":7,"), 0);
+	EXPECT_NE(body.find("\"requests\":[{\"url\":\"/missing\",\"handler\":\"NotFound\",\"code\":404,"), std::string::npos);
+	EXPECT_NE(body.find("{\"url\":\"/echo?i=4\""), std::string::npos);
+	EXPECT_EQ(body.find("/echo?i=3"), std::string::npos);
+
+	// Summaries cover every request in the history
+	EXPECT_NE(body.find("\"urls\":[{\"url\":\"/echo\",\"requests\":5,\"codes\":{\"2xx\":5}}"), std::string::npos);
+	EXPECT_NE(body.find("{\"handler\":\"NotFound\",\"requests\":1,\"codes\":{\"4xx\":1}}"), std::string::npos);
+	EXPECT_NE(body.find("\"hot\":{\"window_seconds\":"), std::string::npos);
+	EXPECT_NE(body.find("\"content_cache\":{\"hits\":"), std::string::npos);
+	EXPECT_EQ(body.substr(body.size() - 2), "}\n");
+}
+
+TEST_F(StatusHandlerPageTest, PagesFromSince) {
+	std::vector<URLInfo> requests = history.snapshot();
+	std::string since = requests[4].cursor.to_string();
+
+	std::string body = send("/status?format=json&limit=2&since=" + since).body();
+	EXPECT_NE(body.find("/echo?i=3"), std::string::npos);
+	EXPECT_NE(body.find("/echo?i=2"), std::string::npos);
+	EXPECT_EQ(body.find("/echo?i=4"), std::string::npos);
+	EXPECT_NE(body.find("\"next_since\":\"" + requests[2].cursor.to_string() + "\""), std::string::npos);
+}
+
+TEST_F(StatusHandlerPageTest, RejectsInvalidQueries) {
+	EXPECT_EQ(send("/status?format=xml").result(), http::status::bad_request);
+	EXPECT_EQ(send("/status?limit=-1").result(), http::status::bad_request);
+	EXPECT_EQ(send("/status?limit=ten").result(), http::status::bad_request);
+	EXPECT_EQ(send("/status?since=1x").result(), http::status::bad_request);
+	EXPECT_EQ(send("/status?since=1.2").result(), http::status::bad_request);
+}
+
+TEST_F(StatusHandlerPageTest, StreamsThePageInChunks) {
+	for (int i = 0; i < 400; i++) {
+		history.record("/many", "Echo", 200);
+	}
+
+	http::request<http::string_body> req;
+	req.method(http::verb::get);
+	req.version(11);
+	req.target("/status?limit=1000");
+	http::response<static_body> res;
+	ASSERT_TRUE(handler.get_static_response(req, res));
+	EXPECT_TRUE(res.chunked());
+
+	static_body::writer writer(res.base(), res.body());
+	beast::error_code err;
+	writer.init(err);
+	ASSERT_FALSE(err);
+
+	std::string page;
+	int chunks = 0;
+	while (auto chunk = writer.get(err)) {
+		ASSERT_FALSE(err);
+		page.append(static_cast<const char*>(chunk->first.data()), chunk->first.size());
+		chunks++;
+		if (!chunk->second) {
+			break;
+		}
+	}
+	EXPECT_GT(chunks, 400 / 64);
+	EXPECT_NE(page.find("<td>/many</td><td>400</td>"), std::string::npos);
+	EXPECT_EQ(page.substr(page.size() - 7), "</html>");
+}
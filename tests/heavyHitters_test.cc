@@ -0,0 +1,105 @@
+#include "heavyHitters.h"
+
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+class HeavyHittersTest : public ::testing::Test {
+   protected:
+	HeavyHitters::Options options() {
+		HeavyHitters::Options options;
+		options.k = 3;
+		options.candidates = 16;
+		options.width = 256;
+		options.window = std::chrono::seconds(60);
+		options.sub_windows = 6;
+		return options;
+	}
+
+	HeavyHitters::clock::time_point start = HeavyHitters::clock::time_point(std::chrono::hours(1));
+};
+
+TEST_F(HeavyHittersTest, FindsTheHeavyKeysAmongMany) {
+	HeavyHitters hitters(options());
+	std::mt19937 random(7);
+	for (int i = 0; i < 20000; i++) {
+		hitters.add("/cold/" + std::to_string(random() % 5000), start);
+		if (i % 4 == 0) {
+			hitters.add("/hot", start);
+		}
+		if (i % 8 == 0) {
+			hitters.add("/warm", start);
+		}
+		if (i % 16 == 0) {
+			hitters.add("/mild", start);
+		}
+	}
+
+	std::vector<HeavyHitters::Entry> top = hitters.top(start);
+	ASSERT_EQ(top.size(), 3);
+	EXPECT_EQ(top[0].key, "/hot");
+	EXPECT_EQ(top[1].key, "/warm");
+	EXPECT_EQ(top[2].key, "/mild");
+	// Sketches never undercount
+	EXPECT_GE(top[0].count, 5000);
+	EXPECT_LT(top[0].count, 5000 + 20000 / 10);
+}
+
+TEST_F(HeavyHittersTest, ForgetsKeysOutsideTheWindow) {
+	HeavyHitters hitters(options());
+	for (int i = 0; i < 100; i++) {
+		hitters.add("/old", start);
+	}
+	hitters.add("/new", start + std::chrono::seconds(30));
+
+	std::vector<HeavyHitters::Entry> top = hitters.top(start + std::chrono::seconds(30));
+	ASSERT_EQ(top.size(), 2);
+	EXPECT_EQ(top[0].key, "/old");
+	EXPECT_EQ(top[0].count, 100);
+
+	// Sixty seconds later the first sub-window left the window
+	top = hitters.top(start + std::chrono::seconds(61));
+	ASSERT_EQ(top.size(), 1);
+	EXPECT_EQ(top[0].key, "/new");
+
+	// Reusing the sub-window of /old clears it
+	hitters.add("/newer", start + std::chrono::seconds(61));
+	top = hitters.top(start + std::chrono::seconds(61));
+	ASSERT_EQ(top.size(), 2);
+	EXPECT_EQ(top[0].count, 1);
+}
+
+TEST_F(HeavyHittersTest, CountsFromManyThreads) {
+	HeavyHitters hitters(options());
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.emplace_back([&]() {
+			for (int i = 0; i < 10000; i++) {
+				hitters.add("/shared", start);
+			}
+		});
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	std::vector<HeavyHitters::Entry> top = hitters.top(start);
+	ASSERT_EQ(top.size(), 1);
+	EXPECT_EQ(top[0].count, 40000);
+}
+
+TEST_F(HeavyHittersTest, UsesFixedMemory) {
+	HeavyHitters hitters(options());
+	std::size_t memory = hitters.memory();
+	for (int i = 0; i < 100000; i++) {
+		hitters.add(std::to_string(i) + std::string(200, 'x'), start);
+	}
+	EXPECT_EQ(hitters.memory(), memory);
+
+	std::vector<HeavyHitters::Entry> top = hitters.top(start);
+	ASSERT_EQ(top.size(), 3);
+	EXPECT_EQ(top[0].key.size(), HeavyHitters::max_key_length);
+}
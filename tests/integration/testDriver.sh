@@ -6,6 +6,8 @@ PORT_HTTPS="$3"
 PROXY_PORT="$4"
 PROXY_PORT_HTTPS="$5"
 CERTIFICATE="$6"
+UPSTREAM="$7"
+UPSTREAM_PORT="$8"
 DIR=$(dirname ${TESTDRIVER})
 
 # Utility functions
@@ -53,6 +55,12 @@ if [ ! -f "$CERTIFICATE" ]; then
 	exit 1
 fi
 
+if [ ! -x "${UPSTREAM}" ] || [[ ! "$UPSTREAM_PORT" =~ $NUM_REGEX ]]; then
+	echo "Usage: ${0} <path-to-webserver> <port-num> <https-port-num> <proxy-port-num> <proxy-port-https-num> <certificate> <path-to-koko_upstream> <upstream-port-num>"
+	warn "koko_upstream executable and port not passed in for integration tests, got '${UPSTREAM}' and '${UPSTREAM_PORT}' instead"
+	exit 1
+fi
+
 # Server setup and teardown
 # stop() should clear the files left by start()
 start() {
@@ -86,9 +94,9 @@ start() {
 			port $PROXY_PORT;
 		}
 
-		location \"/bitlyproxy\" ProxyRequestHandler {
-			dest \"www.bit.ly\";
-			port 80;
+		location \"/upstreamproxy\" ProxyRequestHandler {
+			dest \"127.0.0.1\";
+			port $UPSTREAM_PORT;
 		}
 
 		location /sleep SleepEchoHandler {
@@ -97,6 +105,10 @@ start() {
 		location /keepalive EchoHandler {
 			keep-alive 1;
 		}
+
+		location /closing EchoHandler {
+			keep-alive 0;
+		}
 	"
 
 	local PROXY_CONFIG="
@@ -119,9 +131,9 @@ start() {
 
 		}
 
-		location \"/bitlynested\" ProxyRequestHandler {
-			dest \"www.bit.ly\";
-			port 80;
+		location \"/upstreamnested\" ProxyRequestHandler {
+			dest \"127.0.0.1\";
+			port $UPSTREAM_PORT;
 		}
 	"
 
@@ -145,6 +157,9 @@ start() {
 		exit 1
 	fi
 
+	"${UPSTREAM}" --port "$UPSTREAM_PORT" &
+	UPSTREAM_PID="$!"
+
 	CONFIG_PATH="${DIR}/default.conf"
 	echo "$CONFIG" >"$CONFIG_PATH"
 
@@ -169,6 +184,8 @@ stop() {
 	kill ${PROXY_PID}
 	PROXY_KILL_RET=$?
 
+	kill ${UPSTREAM_PID}
+
 	rm "$CONFIG_PATH"
 	rm "$PROXY_CONFIG_PATH"
 
@@ -326,7 +343,7 @@ test_bad_req() {
 
 test_keep_alive() {
 	local URL1="$1" #URL with keep alive
-	local URL2="$2" #URL without keep alive
+	local URL2="$2" #URL closing the connection
 
 	curl -v localhost:"$PORT""$URL1" localhost:"$PORT""$URL2" >file.txt 2>&1
 
@@ -346,7 +363,9 @@ test_keep_alive() {
 		exit 1
 	fi
 
-	grep "Re-using existing connection! (#0) with host localhost" file.txt
+	# Versions of curl word this differently
+	grep -E "Re-using existing connection!? \(?#0\)? with host localhost" file.txt
+	GREP_RET=$?
 
 	if [ $GREP_RET -ne 0 ]; then
 		warn "server response was not expected"
@@ -361,12 +380,13 @@ test_keep_alive() {
 	fi
 
 	grep "Closing connection 0" file.txt
+	GREP_RET=$?
 
 	if [ $GREP_RET -ne 0 ]; then
 		warn "server response was not expected"
 		echo "Response obtained from server:"
 		echo "$OUTPUT_CONTENT"
-		echo "Expected to see: V"
+		echo "Expected to see: Closing connection 0"
 		echo "For Path:"
 		echo "$URL2"
 
@@ -402,15 +422,24 @@ test_header "/static/testing-zip.zip" "application/zip"
 test_header "/status" "text/html"
 test_header "/health" "text/plain"
 
+test_header "/echo" "Date: "
+test_header "/static/test.html" "Date: "
+test_header "/not/in/config" "Date: "
+test_header "/health" "Date: "
+test_header "/health" "Content-Length: 2"
+
 test_header "/proxy/proxystatic/samueli.jpg" "200 OK"
 test_header "/proxy/proxystatic/samueli.jpg" "Content-Type: image/jpeg"
 test_header "/proxy/" "404 Not Found"
 test_header "/proxy/not/in/proxyconfig" "404 Not Found"
 test_header "/proxy/proxyecho" "200 OK"
 test_header "/proxy/proxystatus" "text/html"
-test_header "/bitlyproxy/3hlhXsh" "301 Moved Permanently" # Arbitrary bitly link that never expires
-test_header "/proxy/bitlynested/3hlhXsh" "301 Moved Permanently"
-test_header "/bitlyproxy/3hlhXsh" "Location: http://bit.ly/3hlhXsh"
+test_header "/upstreamproxy/absolute/1" "301 Moved Permanently"
+test_header "/upstreamproxy/absolute/1" "Location: http://127.0.0.1/redirect/0"
+test_header "/upstreamproxy/redirect/1" "Location: /upstreamproxy/redirect/0"
+test_header "/proxy/upstreamnested/redirect/1" "302 Found"
+test_header "/proxy/upstreamnested/redirect/1" "Location: /proxy/upstreamnested/redirect/0"
+test_header "/upstreamproxy/status/503" "503 Service Unavailable"
 
 test_body "/echo" "GET"
 test_body "/static/test.html" "<html"
@@ -421,11 +450,15 @@ test_body "/health" "OK"
 test_body "/proxy/proxyecho" "GET"
 test_body "/proxy/proxystatic/test.html" "<html"
 test_body "/proxy/proxystatus" "<html"
+test_body "/upstreamproxy/html/3" 'href="/upstreamproxy/page2"'
+test_body "/upstreamproxy/html/3" 'src="//cdn.example.com/img2.png"'
+test_body "/upstreamproxy/chunked/5000" "lazy upstream server"
+test_body "/upstreamproxy/close/100" "quick brown fox"
 
 test_body_content "/static/samueli.jpg" "../data/static_data/samueli.jpg"
 test_body_content "/proxy/proxystatic/samueli.jpg" "../data/static_data/samueli.jpg"
 
 test_bad_req "GET /in HTTP/1.1\r\n\n\n" "400 Bad Request"
-test_keep_alive "/keepalive" "/print"
+test_keep_alive "/print" "/closing"
 
 stop
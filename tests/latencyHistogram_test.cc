@@ -0,0 +1,85 @@
+#include "latencyHistogram.h"
+
+#include "gtest/gtest.h"
+
+TEST(LatencyHistogramTest, EmptyHistogram) {
+	LatencyHistogram histogram;
+	EXPECT_EQ(histogram.count(), 0);
+	EXPECT_EQ(histogram.percentile(50), 0);
+	EXPECT_EQ(histogram.mean(), 0);
+}
+
+TEST(LatencyHistogramTest, PercentilesWithinOnePercent) {
+	LatencyHistogram histogram;
+	for (std::uint64_t value = 1; value <= 100000; value++) {
+		histogram.record(value);
+	}
+	EXPECT_EQ(histogram.count(), 100000);
+	EXPECT_EQ(histogram.min(), 1);
+	EXPECT_EQ(histogram.max(), 100000);
+	EXPECT_NEAR(histogram.mean(), 50000.5, 0.001);
+
+	for (double percent : {1.0, 50.0, 90.0, 99.0, 99.9}) {
+		double expected = percent * 1000;
+		EXPECT_NEAR(histogram.percentile(percent), expected, expected / 100) << "p" << percent;
+	}
+	EXPECT_EQ(histogram.percentile(100), 100000);
+	EXPECT_EQ(histogram.percentile(0), 1);
+}
+
+TEST(LatencyHistogramTest, SmallValuesAreExact) {
+	LatencyHistogram histogram;
+	histogram.record(3);
+	histogram.record(7);
+	histogram.record(200);
+	EXPECT_EQ(histogram.percentile(33), 3);
+	EXPECT_EQ(histogram.percentile(50), 7);
+	EXPECT_EQ(histogram.percentile(100), 200);
+}
+
+TEST(LatencyHistogramTest, ClampsLargeValues) {
+	LatencyHistogram histogram;
+	histogram.record(LatencyHistogram::max_value * 2);
+	EXPECT_EQ(histogram.max(), LatencyHistogram::max_value);
+	EXPECT_EQ(histogram.percentile(50), LatencyHistogram::max_value);
+}
+
+TEST(LatencyHistogramTest, CorrectsCoordinatedOmission) {
+	LatencyHistogram histogram;
+	for (int i = 0; i < 98; i++) {
+		histogram.record(100, 1000);
+	}
+	// A stall of 100ms hides the 99 requests that would have been sent meanwhile
+	histogram.record(100000, 1000);
+	EXPECT_EQ(histogram.count(), 98 + 100);
+	EXPECT_EQ(histogram.max(), 100000);
+	EXPECT_NEAR(histogram.percentile(75), 51000, 510);
+	EXPECT_EQ(histogram.percentile(40), 100);
+
+	// Without the correction the stall barely shows
+	LatencyHistogram uncorrected;
+	for (int i = 0; i < 98; i++) {
+		uncorrected.record(100);
+	}
+	uncorrected.record(100000);
+	EXPECT_EQ(uncorrected.percentile(75), 100);
+}
+
+TEST(LatencyHistogramTest, MergesHistograms) {
+	LatencyHistogram first, second, empty;
+	for (std::uint64_t value = 1; value <= 500; value++) {
+		first.record(value);
+		second.record(value + 500);
+	}
+	first.merge(second);
+	first.merge(empty);
+	EXPECT_EQ(first.count(), 1000);
+	EXPECT_EQ(first.min(), 1);
+	EXPECT_EQ(first.max(), 1000);
+	EXPECT_NEAR(first.percentile(50), 500, 5);
+	EXPECT_NEAR(first.percentile(99), 990, 10);
+
+	empty.merge(second);
+	EXPECT_EQ(empty.min(), 501);
+	EXPECT_EQ(empty.count(), 500);
+}
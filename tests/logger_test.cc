@@ -36,4 +36,34 @@ TEST(LogTests, LogsProperly) {
 	int log_works = log_file_content.compare(log_file_msg_starting_pos, log_msg_size, log_msg);
 	system("/bin/bash ./logger_test_scripts/delete_logs.sh");
 	EXPECT_EQ(log_works, 0);
-}
\ No newline at end of file
+}
+
+// Counts how often a log message is formatted
+static int formatted = 0;
+static std::string count_formatting() {
+	formatted++;
+	return "formatted";
+}
+
+TEST(LogTests, SkipsRecordsBelowTheLevel) {
+	formatted = 0;
+	set_log_level(info);
+	TRACE << count_formatting();
+	EXPECT_EQ(formatted, 0);
+	INFO << count_formatting();
+	EXPECT_EQ(formatted, 1);
+
+	set_log_level(trace);
+	TRACE << count_formatting();
+	EXPECT_EQ(formatted, 2);
+}
+
+TEST(LogTests, ParsesLevels) {
+	severity_level level;
+	EXPECT_TRUE(parse_log_level("warning", level));
+	EXPECT_EQ(level, warning);
+	EXPECT_TRUE(parse_log_level("trace", level));
+	EXPECT_EQ(level, trace);
+	EXPECT_FALSE(parse_log_level("verbose", level));
+	EXPECT_FALSE(parse_log_level("", level));
+}
@@ -0,0 +1,80 @@
+#include "metrics.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+TEST(MetricsTest, CountsAcrossThreads) {
+	Counter counter;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 8; t++) {
+		threads.emplace_back([&counter]() {
+			for (int i = 0; i < 10000; i++) {
+				counter.inc();
+			}
+		});
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+	EXPECT_EQ(counter.value(), 80000);
+}
+
+TEST(MetricsTest, GaugesGoUpAndDown) {
+	Gauge gauge;
+	gauge.add(5);
+	std::thread([&gauge]() { gauge.sub(2); }).join();
+	EXPECT_EQ(gauge.value(), 3);
+}
+
+TEST(MetricsTest, HistogramsCountCumulatively) {
+	Histogram histogram({0.1, 1});
+	histogram.observe(0.05);
+	histogram.observe(0.1);
+	histogram.observe(0.5);
+	histogram.observe(2);
+
+	Histogram::Snapshot snapshot = histogram.snapshot();
+	EXPECT_EQ(snapshot.cumulative, (std::vector<std::uint64_t>{2, 3, 4}));
+	EXPECT_DOUBLE_EQ(snapshot.sum, 2.65);
+}
+
+TEST(MetricsTest, RendersThePrometheusFormat) {
+	MetricsRegistry& registry = MetricsRegistry::instance();
+	registry.counter("koko_test_requests_total", "Requests", {{"code", "2xx"}}).inc(2);
+	registry.gauge("koko_test_open", "Open").add(4);
+	registry.gauge_function("koko_test_ratio", "Ratio", {}, []() { return 0.5; });
+	registry.counter_function("koko_test_hits_total", "Hits", {}, []() { return 7.0; });
+	registry.histogram("koko_test_seconds", "Latency", {{"handler", "Echo"}}, {0.5}).observe(0.25);
+
+	std::string text = registry.render();
+	EXPECT_NE(text.find("# HELP koko_test_requests_total Requests\n# TYPE koko_test_requests_total counter\n"
+	                    "koko_test_requests_total{code=\"2xx\"} 2\n"),
+	          std::string::npos);
+	EXPECT_NE(text.find("koko_test_open 4\n"), std::string::npos);
+	EXPECT_NE(text.find("koko_test_ratio 0.5\n"), std::string::npos);
+	EXPECT_NE(text.find("# TYPE koko_test_hits_total counter\nkoko_test_hits_total 7\n"), std::string::npos);
+	EXPECT_NE(text.find("# TYPE koko_test_seconds histogram\n"
+	                    "koko_test_seconds_bucket{handler=\"Echo\",le=\"0.5\"} 1\n"
+	                    "koko_test_seconds_bucket{handler=\"Echo\",le=\"+Inf\"} 1\n"
+	                    "koko_test_seconds_sum{handler=\"Echo\"} 0.25\n"
+	                    "koko_test_seconds_count{handler=\"Echo\"} 1\n"),
+	          std::string::npos);
+}
+
+TEST(MetricsTest, RegistersEachMetricOnce) {
+	MetricsRegistry& registry = MetricsRegistry::instance();
+	Counter& counter = registry.counter("koko_test_once_total", "Once", {{"handler", "A"}});
+	EXPECT_EQ(&counter, &registry.counter("koko_test_once_total", "Once", {{"handler", "A"}}));
+	EXPECT_NE(&counter, &registry.counter("koko_test_once_total", "Once", {{"handler", "B"}}));
+	EXPECT_THROW(registry.gauge("koko_test_once_total", "Once"), std::invalid_argument);
+}
+
+TEST(MetricsTest, EscapesLabelValues) {
+	EXPECT_EQ(render_labels({}), "");
+	EXPECT_EQ(render_labels({{"path", "a\"b\\c\nd"}, {"code", "2xx"}}), "{path=\"a\\\"b\\\\c\\nd\",code=\"2xx\"}");
+	EXPECT_STREQ(status_class(204), "2xx");
+	EXPECT_STREQ(status_class(99), "other");
+}
@@ -0,0 +1,177 @@
+#include "requestHistory.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "coarseClock.h"
+#include "gtest/gtest.h"
+
+TEST(RequestHistoryTest, KeepsTheNewestRequests) {
+	RequestHistory history(4);
+	for (int i = 0; i < 10; i++) {
+		history.record("/" + std::to_string(i), "Test", 200);
+	}
+
+	std::vector<URLInfo> requests = history.snapshot();
+	ASSERT_EQ(requests.size(), 4);
+	EXPECT_EQ(requests[0].url, "/9");
+	EXPECT_EQ(requests[3].url, "/6");
+	EXPECT_EQ(history.total(), 10);
+
+	requests = history.snapshot(2);
+	ASSERT_EQ(requests.size(), 2);
+	EXPECT_EQ(requests[1].url, "/8");
+}
+
+TEST(RequestHistoryTest, PagesFromSince) {
+	RequestHistory history(100);
+	for (int i = 0; i < 10; i++) {
+		history.record("/" + std::to_string(i), "Test", 200);
+		std::this_thread::sleep_for(std::chrono::microseconds(10));
+	}
+	std::vector<URLInfo> all = history.snapshot();
+	ASSERT_EQ(all.size(), 10);
+	EXPECT_EQ(all[0].handler, "Test");
+
+	// The three requests after /4, newest first
+	std::vector<URLInfo> page = history.snapshot(3, all[5].cursor);
+	ASSERT_EQ(page.size(), 3);
+	EXPECT_EQ(page[0].url, "/7");
+	EXPECT_EQ(page[2].url, "/5");
+
+	page = history.snapshot(3, page[0].cursor);
+	ASSERT_EQ(page.size(), 2);
+	EXPECT_EQ(page[0].url, "/9");
+	EXPECT_TRUE(history.snapshot(3, all[0].cursor).empty());
+
+	// A time alone stands for after every request of that microsecond
+	page = history.snapshot(3, HistoryCursor::after(all[5].time_us));
+	ASSERT_EQ(page.size(), 3);
+	EXPECT_EQ(page[2].url, "/5");
+}
+
+TEST(RequestHistoryTest, PagesThroughRequestsOfTheSameMicrosecond) {
+	// The clock does not move while the requests are recorded
+	CoarseClock& clock = CoarseClock::instance();
+	bool was_running = clock.running();
+	clock.stop();
+	clock.start(std::chrono::hours(1));
+
+	RequestHistory history(100);
+	for (int i = 0; i < 3; i++) {
+		history.record("/main" + std::to_string(i), "Test", 200);
+	}
+	std::thread([&history]() {
+		for (int i = 0; i < 4; i++) {
+			history.record("/other" + std::to_string(i), "Test", 200);
+		}
+	}).join();
+	clock.stop();
+	if (was_running) {
+		clock.start();
+	}
+
+	std::vector<URLInfo> all = history.snapshot();
+	ASSERT_EQ(all.size(), 7);
+	EXPECT_EQ(all.front().time_us, all.back().time_us);
+
+	// Pages of two split the requests of that microsecond, and together list each of them once
+	std::vector<std::string> paged;
+	HistoryCursor since = HistoryCursor::after(all.front().time_us - 1);
+	for (int pages = 0; pages < 10; pages++) {
+		std::vector<URLInfo> page = history.snapshot(2, since);
+		if (page.empty()) {
+			break;
+		}
+		EXPECT_LE(page.size(), 2);
+		for (auto it = page.rbegin(); it != page.rend(); ++it) {
+			paged.push_back(it->url);
+		}
+		since = page.front().cursor;
+	}
+	std::vector<std::string> expected;
+	for (auto it = all.rbegin(); it != all.rend(); ++it) {
+		expected.push_back(it->url);
+	}
+	EXPECT_EQ(paged, expected);
+
+	// Cursors survive being passed around as text
+	HistoryCursor parsed;
+	ASSERT_TRUE(HistoryCursor::parse(all[3].cursor.to_string(), parsed));
+	EXPECT_EQ(history.snapshot(1, parsed).at(0).url, all[2].url);
+	EXPECT_FALSE(HistoryCursor::parse("1.2", parsed));
+	EXPECT_FALSE(HistoryCursor::parse("1..2", parsed));
+	EXPECT_FALSE(HistoryCursor::parse("-1", parsed));
+}
+
+TEST(RequestHistoryTest, MergesTheRequestsOfEveryThread) {
+	RequestHistory history(1000);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.emplace_back([&history, t]() {
+			for (int i = 0; i < 100; i++) {
+				history.record("/" + std::to_string(t), "Test", 200 + t);
+			}
+		});
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	std::vector<URLInfo> requests = history.snapshot();
+	ASSERT_EQ(requests.size(), 400);
+	EXPECT_EQ(history.total(), 400);
+	for (std::size_t i = 0; i < requests.size(); i++) {
+		EXPECT_EQ(requests[i].res_code, 200 + std::stoi(requests[i].url.substr(1)));
+		if (i > 0) {
+			EXPECT_GE(requests[i - 1].req_time, requests[i].req_time);
+		}
+	}
+}
+
+TEST(RequestHistoryTest, ReusesTheRingsOfExitedThreads) {
+	RequestHistory history(8);
+	for (int t = 0; t < 20; t++) {
+		std::thread([&history]() { history.record("/", "Test", 200); }).join();
+	}
+	EXPECT_EQ(history.rings(), 1);
+	EXPECT_EQ(history.total(), 20);
+	EXPECT_EQ(history.snapshot().size(), 8);
+}
+
+TEST(RequestHistoryTest, ReadsWhileThreadsRecord) {
+	RequestHistory history(16);
+	std::atomic<bool> done{false};
+	std::thread writer([&]() {
+		for (int i = 0; i < 100000; i++) {
+			history.record("/" + std::string(i % 50, 'a'), "Test", 200);
+		}
+		done = true;
+	});
+
+	while (!done) {
+		for (const URLInfo& request : history.snapshot()) {
+			// Every request read whole, never half overwritten
+			EXPECT_EQ(request.url.find_first_not_of('a', 1), std::string::npos);
+		}
+	}
+	writer.join();
+	EXPECT_EQ(history.total(), 100000);
+}
+
+TEST(RequestHistoryTest, ClearsAndTruncates) {
+	RequestHistory history(4);
+	history.record("/old", "Test", 200);
+	history.clear();
+	EXPECT_EQ(history.total(), 0);
+	EXPECT_TRUE(history.snapshot().empty());
+
+	history.record("/" + std::string(500, 'x'), std::string(50, 'h'), 404);
+	std::vector<URLInfo> requests = history.snapshot();
+	ASSERT_EQ(requests.size(), 1);
+	EXPECT_EQ(requests[0].url.size(), RequestHistory::max_url_length);
+	EXPECT_EQ(requests[0].handler.size(), RequestHistory::max_handler_length);
+	EXPECT_EQ(requests[0].res_code, 404);
+}
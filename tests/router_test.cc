@@ -0,0 +1,100 @@
+#include "router.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "echoHandler.h"
+#include "gtest/gtest.h"
+
+class RouterTest : public ::testing::Test {
+   protected:
+	NginxConfig config;
+	EchoHandler root{"/", config};
+	EchoHandler foo{"/foo", config};
+	EchoHandler foo_bar{"/foo/bar", config};
+	EchoHandler fo{"/fo", config};
+	EchoHandler static_files{"/static", config};
+
+	// Returns the url prefix matched for a target, or "none"
+	std::string matched_prefix(const Router& router, std::string_view target) {
+		std::string_view prefix;
+		if (router.match(target, &prefix) == nullptr) {
+			return "none";
+		}
+		return std::string(prefix);
+	}
+};
+
+TEST_F(RouterTest, LongestPrefix) {
+	Router router({{"/foo", &foo}, {"/foo/bar", &foo_bar}, {"/fo", &fo}});
+	EXPECT_EQ(router.size(), 3);
+
+	EXPECT_EQ(router.match("/foo"), &foo);
+	EXPECT_EQ(router.match("/foo/"), &foo);
+	EXPECT_EQ(router.match("/foo/baz"), &foo);
+	EXPECT_EQ(router.match("/foo/bar"), &foo_bar);
+	EXPECT_EQ(router.match("/foo/bar/baz.txt"), &foo_bar);
+	EXPECT_EQ(router.match("/fo"), &fo);
+	EXPECT_EQ(router.match("/fo/foo"), &fo);
+	EXPECT_EQ(matched_prefix(router, "/foo/bar/x"), "/foo/bar");
+}
+
+TEST_F(RouterTest, DirectoryBoundary) {
+	Router router({{"/foo", &foo}, {"/foo/bar", &foo_bar}});
+
+	// Prefixes only match whole directory names
+	EXPECT_EQ(router.match("/foo_continued"), nullptr);
+	EXPECT_EQ(router.match("/f"), nullptr);
+	EXPECT_EQ(router.match("/foo/barn"), &foo);
+	EXPECT_EQ(router.match(""), nullptr);
+	EXPECT_EQ(router.match("/"), nullptr);
+}
+
+TEST_F(RouterTest, RootMatchesEverything) {
+	Router router({{"/", &root}, {"/foo", &foo}});
+
+	EXPECT_EQ(router.match("/"), &root);
+	EXPECT_EQ(router.match(""), &root);
+	EXPECT_EQ(router.match("/foo_continued"), &root);
+	EXPECT_EQ(router.match("/not/registered"), &root);
+	EXPECT_EQ(router.match("/foo/bar"), &foo);
+}
+
+TEST_F(RouterTest, QueryStrings) {
+	Router router({{"/foo", &foo}, {"/foo/bar", &foo_bar}});
+
+	EXPECT_EQ(router.match("/foo?fbclid=IwAR0-seXzN7KsoM2y0"), &foo);
+	EXPECT_EQ(router.match("/foo/bar?x=/y"), &foo);
+	EXPECT_EQ(router.match("/foo/bar?x=1"), &foo_bar);
+	EXPECT_EQ(router.match("/foo?/bar"), nullptr);
+
+	EXPECT_EQ(Router::strip_query("/a/b?c"), "/a/b");
+	EXPECT_EQ(Router::strip_query("/a?b/c"), "/a?b/c");
+	EXPECT_EQ(Router::strip_query("/a/b"), "/a/b");
+	EXPECT_EQ(Router::strip_query("noslash?x"), "noslash?x");
+}
+
+TEST_F(RouterTest, EdgeSplitting) {
+	// Inserting in an order which splits existing edges
+	Router router({{"/static", &static_files}, {"/foo/bar", &foo_bar}, {"/fo", &fo}, {"/foo", &foo}});
+	EXPECT_EQ(router.size(), 4);
+
+	EXPECT_EQ(router.match("/static/a.txt"), &static_files);
+	EXPECT_EQ(router.match("/stat"), nullptr);
+	EXPECT_EQ(router.match("/foo/bar"), &foo_bar);
+	EXPECT_EQ(router.match("/foo"), &foo);
+	EXPECT_EQ(router.match("/fo"), &fo);
+	EXPECT_EQ(router.match("/foob"), nullptr);
+}
+
+TEST_F(RouterTest, DuplicatePrefixes) {
+	// The first registered handler wins
+	Router router({{"/foo", &foo}, {"/foo", &fo}});
+	EXPECT_EQ(router.size(), 1);
+	EXPECT_EQ(router.match("/foo"), &foo);
+
+	Router empty;
+	EXPECT_EQ(empty.size(), 0);
+	EXPECT_EQ(empty.match("/foo"), nullptr);
+}
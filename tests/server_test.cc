@@ -2,15 +2,19 @@
 
 #include <boost/beast/ssl.hpp>
 #include <chrono>
+#include <fstream>
+#include <functional>
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "config.h"
 #include "gtest/gtest.h"
 #include "logger.h"
 #include "parser.h"
+#include "upstreamSimulator.h"
 
 namespace beast = boost::beast;
 namespace http = boost::beast::http;
@@ -178,9 +182,10 @@ TEST(ServerTest, HandlerCreation) {
 		}
 
 		{
+			UpstreamSimulator upstream;
 			NginxConfig sub_config;
 			std::istringstream configStream;
-			configStream.str("dest www.washington.edu; port 80;");
+			configStream.str("dest 127.0.0.1; port " + upstream.port() + ";");
 			p.Parse(&configStream, &sub_config);
 			handler = server::create_handler("/", "ProxyRequestHandler", sub_config);
 			ASSERT_NO_THROW(handler->get_response(stubReq));
@@ -238,6 +243,7 @@ TEST(ServerTest, MultiThreadTest) {
 	configStream.str(
 	    "port 8100;\n"
 	    "httpsPort 8101;\n"
+	    "threads 4;\n"
 	    "certificate ../tests/certs/fullchain.pem;\n"
 	    "privateKey ../tests/certs/privkey.pem;"
 	    "location /echo EchoHandler {}\n"
@@ -332,3 +338,247 @@ TEST(ServerTest, MultiThreadTest) {
 		server_thread.join();
 	}
 }
+
+TEST(ServerTest, ThreadCount) {
+	NginxConfigParser p;
+	{
+		NginxConfig config;
+		std::istringstream configStream("threads 6;");
+		p.Parse(&configStream, &config);
+		EXPECT_EQ(server::get_thread_count(config), 6);
+	}
+	{
+		// Defaults to the number of cores
+		NginxConfig config;
+		std::istringstream configStream("port 8080;");
+		p.Parse(&configStream, &config);
+		int cores = std::thread::hardware_concurrency();
+		EXPECT_EQ(server::get_thread_count(config), std::max(cores, 1));
+	}
+}
+
+TEST(ServerTest, ReusePortTest) {
+	// Spawn the server with an io_context per thread
+	boost::asio::io_context io_context;
+	bool done = false;
+	NginxConfig config;
+	NginxConfigParser p;
+	std::istringstream configStream;
+
+	configStream.str(
+	    "port 8200;\n"
+	    "httpsPort 8201;\n"
+	    "threads 3;\n"
+	    "reusePort 1;\n"
+	    "pinThreads 1;\n"
+	    "location /echo EchoHandler {}\n");
+	p.Parse(&configStream, &config);
+	std::thread server_thread(server_runner, &io_context, config, &done);
+
+	// Wait for server to start-up
+	std::chrono::seconds wait_time(1);
+	std::this_thread::sleep_for(wait_time);
+	EXPECT_FALSE(done);
+
+	// Every connection should be served, whichever acceptor gets it
+	for (int i = 0; i < 6; i++) {
+		http::request<http::string_body> req;
+		req.method(http::verb::get);
+		req.target("/echo");
+		req.version(11);
+
+		net::io_context ioc;
+		tcp::resolver resolver(ioc);
+		beast::tcp_stream stream(ioc);
+		stream.connect(resolver.resolve("localhost", "8200"));
+		http::write(stream, req);
+
+		beast::flat_buffer buffer;
+		http::response<http::string_body> res;
+		http::read(stream, buffer, res);
+		EXPECT_EQ(res.result(), http::status::ok);
+	}
+
+	// Stopping the passed io_context stops every worker
+	io_context.stop();
+	std::this_thread::sleep_for(wait_time);
+
+	EXPECT_TRUE(done);
+	if (server_thread.joinable() && done) {
+		server_thread.join();
+	}
+}
+
+TEST(ServerTest, StaticFileStreaming) {
+	// Spawn the server
+	boost::asio::io_context io_context;
+	bool done = false;
+	NginxConfig config;
+	NginxConfigParser p;
+	std::istringstream configStream;
+
+	configStream.str(
+	    "port 8300;\n"
+	    "httpsPort 8301;\n"
+	    "threads 2;\n"
+	    "certificate ../tests/certs/fullchain.pem;\n"
+	    "privateKey ../tests/certs/privkey.pem;\n"
+	    "location /static StaticHandler {\n"
+	    "root ../data/static_data;\n"
+	    "}\n");
+	p.Parse(&configStream, &config);
+	std::thread server_thread(server_runner, &io_context, config, &done);
+
+	// Wait for server to start-up
+	std::chrono::seconds wait_time(1);
+	std::this_thread::sleep_for(wait_time);
+	EXPECT_FALSE(done);
+
+	std::ifstream file("../data/static_data/samueli.jpg");
+	std::string expected((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	http::request<http::string_body> req;
+	req.method(http::verb::get);
+	req.target("/static/samueli.jpg");
+	req.version(11);
+
+	{
+		// Sent with sendfile over HTTP
+		net::io_context ioc;
+		tcp::resolver resolver(ioc);
+		beast::tcp_stream stream(ioc);
+		stream.connect(resolver.resolve("localhost", "8300"));
+		http::write(stream, req);
+
+		beast::flat_buffer buffer;
+		http::response_parser<http::string_body> parser;
+		parser.body_limit(expected.size() + 1);
+		http::read(stream, buffer, parser);
+		EXPECT_EQ(parser.get().result(), http::status::ok);
+		EXPECT_TRUE(parser.get().body() == expected);
+	}
+
+	{
+		// Read in chunks over HTTPS
+		net::io_context ioc;
+		ssl::context ctx{ssl::context::tlsv12_client};
+		tcp::resolver resolver(ioc);
+		beast::ssl_stream<beast::tcp_stream> stream(ioc, ctx);
+		beast::get_lowest_layer(stream).connect(resolver.resolve("localhost", "8301"));
+		stream.handshake(ssl::stream_base::client);
+		http::write(stream, req);
+
+		beast::flat_buffer buffer;
+		http::response_parser<http::string_body> parser;
+		parser.body_limit(expected.size() + 1);
+		http::read(stream, buffer, parser);
+		EXPECT_EQ(parser.get().result(), http::status::ok);
+		EXPECT_TRUE(parser.get().body() == expected);
+	}
+
+	io_context.stop();
+	std::this_thread::sleep_for(wait_time);
+
+	EXPECT_TRUE(done);
+	if (server_thread.joinable() && done) {
+		server_thread.join();
+	}
+}
+
+TEST(ServerTest, ProxyDoesNotBlock) {
+	// An upstream server that accepts connections but never replies
+	net::io_context upstream_ioc;
+	tcp::acceptor upstream(upstream_ioc, tcp::endpoint(net::ip::make_address("127.0.0.1"), 8402));
+	std::vector<tcp::socket> hanging;
+	std::function<void()> accept = [&]() {
+		upstream.async_accept([&](beast::error_code err, tcp::socket socket) {
+			if (!err) {
+				hanging.push_back(std::move(socket));
+				accept();
+			}
+		});
+	};
+	accept();
+	std::thread upstream_thread([&]() { upstream_ioc.run(); });
+
+	// Spawn the server with a single thread
+	boost::asio::io_context io_context;
+	bool done = false;
+	NginxConfig config;
+	NginxConfigParser p;
+	std::istringstream configStream;
+
+	configStream.str(
+	    "port 8400;\n"
+	    "httpsPort 8401;\n"
+	    "threads 1;\n"
+	    "location /health HealthHandler {}\n"
+	    "location /proxy ProxyRequestHandler {\n"
+	    "dest 127.0.0.1;\n"
+	    "port 8402;\n"
+	    "}\n");
+	p.Parse(&configStream, &config);
+	std::thread server_thread(server_runner, &io_context, config, &done);
+
+	// Wait for server to start-up
+	std::chrono::seconds wait_time(1);
+	std::this_thread::sleep_for(wait_time);
+	EXPECT_FALSE(done);
+
+	net::io_context ioc;
+	tcp::resolver resolver(ioc);
+	auto results = resolver.resolve("localhost", "8400");
+
+	// Returns the time a /health request takes
+	auto health_latency = [&]() {
+		http::request<http::string_body> req;
+		req.method(http::verb::get);
+		req.target("/health");
+		req.version(11);
+
+		auto start = std::chrono::steady_clock::now();
+		beast::tcp_stream stream(ioc);
+		stream.expires_after(std::chrono::seconds(10));
+		stream.connect(results);
+		http::write(stream, req);
+		beast::flat_buffer buffer;
+		http::response<http::string_body> res;
+		beast::error_code err;
+		http::read(stream, buffer, res, err);
+		EXPECT_FALSE(err);
+		EXPECT_EQ(res.result(), http::status::ok);
+		return std::chrono::steady_clock::now() - start;
+	};
+	auto baseline = health_latency();
+
+	// Several proxy requests hang waiting for the upstream server
+	std::vector<std::unique_ptr<beast::tcp_stream>> proxied;
+	for (int i = 0; i < 8; i++) {
+		http::request<http::string_body> req;
+		req.method(http::verb::get);
+		req.target("/proxy");
+		req.version(11);
+
+		proxied.push_back(std::make_unique<beast::tcp_stream>(ioc));
+		proxied.back()->connect(results);
+		http::write(*proxied.back(), req);
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+	// The only thread is still free to answer health checks quickly
+	for (int i = 0; i < 5; i++) {
+		auto latency = health_latency();
+		EXPECT_LT(latency, baseline + std::chrono::milliseconds(500));
+	}
+
+	// Shut down everything, and wait for the server to stop
+	io_context.stop();
+	upstream_ioc.stop();
+	upstream_thread.join();
+	std::this_thread::sleep_for(wait_time);
+
+	EXPECT_TRUE(done);
+	if (server_thread.joinable() && done) {
+		server_thread.join();
+	}
+}
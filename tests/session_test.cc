@@ -1,8 +1,19 @@
 #include <boost/beast/ssl.hpp>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
+#include "allocation_counter.h"
 #include "echoHandler.h"
+#include "fileHandler.h"
 #include "gtest/gtest.h"
+#include "healthHandler.h"
+#include "idleConnections.h"
+#include "logger.h"
+#include "metrics.h"
+#include "parser.h"
 #include "sessionSSL.h"
+#include "sessionTCP.h"
 
 namespace http = boost::beast::http;
 
@@ -35,7 +46,7 @@ TEST(Session, ConstructResponse) {
 	// create new session
 	url_to_handlers.push_back({"/foo", new MockRequestHandler(http_ok)});
 	url_to_handlers.push_back({"/foo/bar", new MockRequestHandler(http_redirect)});
-	auto s = std::make_shared<sessionSSL>(ssl_ctx, config.get(), url_to_handlers, std::move(socket));
+	auto s = std::make_shared<sessionSSL>(ssl_ctx, config.get(), std::make_shared<const Router>(url_to_handlers), std::move(socket));
 
 	// test no exceptions are thrown in while starting session
 	ASSERT_NO_THROW(s->start());
@@ -80,4 +91,452 @@ TEST(Session, ConstructResponse) {
 		s->construct_response(req, res);
 		EXPECT_EQ(res.result(), http::status::ok);
 	}
-}
\ No newline at end of file
+}
+
+TEST(Session, SetupCostIndependentOfLocations) {
+	boost::asio::io_context io_context;
+	NginxConfig config;
+	EchoHandler handler("/", config);
+
+	auto make_router = [&handler](int locations) {
+		std::vector<std::pair<std::string, RequestHandler *>> url_to_handlers;
+		for (int i = 0; i < locations; i++) {
+			url_to_handlers.push_back({"/location" + std::to_string(i), &handler});
+		}
+		return std::make_shared<const Router>(url_to_handlers);
+	};
+	auto few = make_router(5);
+	auto many = make_router(5000);
+
+	// Returns the allocations made while setting up a connection
+	auto setup_allocations = [&](std::shared_ptr<const Router> router) {
+		tcp::socket socket(io_context);
+		AllocationCounter counter;
+		auto s = std::make_shared<sessionTCP>(&config, router, std::move(socket));
+		return std::make_pair(counter.count(), counter.bytes());
+	};
+
+	// Warm up one time initializations, like the logger's
+	setup_allocations(few);
+
+	auto few_allocations = setup_allocations(few);
+	auto many_allocations = setup_allocations(many);
+	EXPECT_GT(few_allocations.first, 0);
+	EXPECT_EQ(few_allocations.first, many_allocations.first);
+	EXPECT_EQ(few_allocations.second, many_allocations.second);
+
+	// Sessions only point at the shared routing table
+	EXPECT_EQ(few.use_count(), 1);
+	EXPECT_EQ(many.use_count(), 1);
+}
+
+TEST(Session, RequestPathAllocations) {
+	boost::asio::io_context io_context;
+	NginxConfig config;
+	EchoHandler echo("/echo", config);
+	HealthHandler health("/health", config);
+	echo.keep_alive = true;
+	health.keep_alive = true;
+	std::vector<std::pair<std::string, RequestHandler *>> url_to_handlers = {{"/echo", &echo}, {"/health", &health}};
+
+	tcp::acceptor acceptor(io_context, tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+	std::vector<std::string> targets(8, "/echo");
+	targets.resize(16, "/health");
+
+	// The client runs on its own thread, so that only the allocations of the session are counted.
+	// It sends every request once the session thread counts allocations for it.
+	std::atomic<std::size_t> requests{0};
+	std::atomic<std::size_t> responses{0};
+	std::thread client([&]() {
+		boost::asio::io_context client_context;
+		tcp::socket socket(client_context);
+		socket.connect(acceptor.local_endpoint());
+		beast::flat_buffer buffer;
+		for (const std::string &target : targets) {
+			while (requests <= responses) {
+				std::this_thread::yield();
+			}
+			http::request<http::string_body> req{http::verb::get, target, 11};
+			req.set(http::field::host, "localhost");
+			req.set(http::field::user_agent, "allocation test");
+			http::write(socket, req);
+			http::response<http::string_body> res;
+			http::read(socket, buffer, res);
+			EXPECT_EQ(res.result(), http::status::ok);
+			EXPECT_EQ(res[http::field::connection], "keep-alive");
+			responses++;
+		}
+	});
+
+	auto s = std::make_shared<sessionTCP>(&config, std::make_shared<const Router>(url_to_handlers), acceptor.accept());
+	s->start();
+
+	// Records are logged when enabled, as configured for production
+	severity_level log_level = get_log_level();
+	set_log_level(warning);
+
+	// Allocations made while answering every request, on a connection kept alive
+	std::vector<std::size_t> allocations;
+	for (std::size_t i = 0; i < targets.size(); i++) {
+		AllocationCounter counter;
+		requests++;
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+		while (responses <= i && std::chrono::steady_clock::now() < deadline) {
+			io_context.run_one_for(std::chrono::milliseconds(10));
+		}
+		allocations.push_back(counter.count());
+	}
+	set_log_level(log_level);
+	client.join();
+	ASSERT_EQ(responses, targets.size());
+
+	// The first two requests of each handler warm up one time initializations and Asio's cache of
+	// operation state. The others only allocate in Beast and Asio, for the fields of the request and
+	// response and the state of asynchronous operations. Asio's cache sometimes shifts a few of those
+	// from one request to the next, which only the bound on the most allocating request allows for.
+	auto median = [](std::vector<std::size_t> counts) {
+		std::sort(counts.begin(), counts.end());
+		return counts[counts.size() / 2];
+	};
+	std::vector<std::size_t> echo_counts(allocations.begin() + 2, allocations.begin() + 8);
+	std::vector<std::size_t> health_counts(allocations.begin() + 10, allocations.end());
+	EXPECT_LE(median(echo_counts), 18);
+	EXPECT_LE(*std::max_element(echo_counts.begin(), echo_counts.end()), 21);
+	EXPECT_LE(median(health_counts), 12);
+	EXPECT_LE(*std::max_element(health_counts.begin(), health_counts.end()), 15);
+}
+
+// Sends the requests in one write, as a pipelining client does, and reads their responses
+static std::vector<http::response<http::string_body>> pipeline(const std::string &config_text, const std::vector<std::pair<std::string, RequestHandler *>> &url_to_handlers,
+                                                              const std::vector<std::string> &targets) {
+	boost::asio::io_context io_context;
+	NginxConfig config;
+	NginxConfigParser parser;
+	std::istringstream config_stream(config_text);
+	parser.Parse(&config_stream, &config);
+	tcp::acceptor acceptor(io_context, tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+
+	std::vector<http::response<http::string_body>> responses;
+	std::atomic<bool> done{false};
+	std::thread client([&]() {
+		boost::asio::io_context client_context;
+		tcp::socket socket(client_context);
+		socket.connect(acceptor.local_endpoint());
+		std::string requests;
+		for (const std::string &target : targets) {
+			requests += "GET " + target + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+		}
+		boost::asio::write(socket, boost::asio::buffer(requests));
+
+		beast::flat_buffer buffer;
+		beast::error_code err;
+		for (std::size_t i = 0; i < targets.size() && !err; i++) {
+			http::response<http::string_body> res;
+			http::read(socket, buffer, res, err);
+			if (!err) {
+				responses.push_back(std::move(res));
+			}
+		}
+		done = true;
+	});
+
+	auto s = std::make_shared<sessionTCP>(&config, std::make_shared<const Router>(url_to_handlers), acceptor.accept());
+	s->start();
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while (!done && std::chrono::steady_clock::now() < deadline) {
+		io_context.run_one_for(std::chrono::milliseconds(10));
+	}
+	client.join();
+	return responses;
+}
+
+static std::uint64_t pipelined_requests() {
+	return MetricsRegistry::instance().counter("koko_pipelined_requests_total", "").value();
+}
+
+TEST(Session, AnswersPipelinedRequestsInOrder) {
+	NginxConfig config;
+	EchoHandler echo("/echo", config);
+	HealthHandler health("/health", config);
+	NginxConfig file_config;
+	NginxConfigParser parser;
+	std::istringstream file_config_stream("root ../data/static_data;");
+	parser.Parse(&file_config_stream, &file_config);
+	FileHandler file("/static", file_config);
+	echo.keep_alive = true;
+	health.keep_alive = true;
+	file.keep_alive = true;
+	std::vector<std::pair<std::string, RequestHandler *>> url_to_handlers = {{"/echo", &echo}, {"/health", &health}, {"/static", &file}};
+
+	// The static file is written on its own, after the responses before it
+	std::uint64_t before = pipelined_requests();
+	std::vector<std::string> targets = {"/echo/1", "/echo/2", "/health", "/health", "/static/test.html", "/echo/3", "/echo/4", "/missing", "/echo/5"};
+	auto responses = pipeline("", url_to_handlers, targets);
+	ASSERT_EQ(responses.size(), 8);
+	EXPECT_NE(responses[0].body().find("GET /echo/1 "), std::string::npos);
+	EXPECT_NE(responses[1].body().find("GET /echo/2 "), std::string::npos);
+	EXPECT_EQ(responses[2].body(), "OK");
+	EXPECT_EQ(responses[3].body(), "OK");
+	EXPECT_NE(responses[4].body().find("<html"), std::string::npos);
+	EXPECT_NE(responses[5].body().find("GET /echo/3 "), std::string::npos);
+	EXPECT_NE(responses[6].body().find("GET /echo/4 "), std::string::npos);
+	for (std::size_t i = 0; i < 7; i++) {
+		EXPECT_EQ(responses[i].result(), http::status::ok) << targets[i];
+		EXPECT_EQ(responses[i][http::field::connection], "keep-alive") << targets[i];
+	}
+
+	// Requests without a handler close the connection, leaving the last one unanswered
+	EXPECT_EQ(responses[7].result(), http::status::not_found);
+	EXPECT_EQ(responses[7][http::field::connection], "close");
+	EXPECT_EQ(pipelined_requests() - before, 7);
+}
+
+TEST(Session, LimitsPipelineDepth) {
+	NginxConfig config;
+	EchoHandler echo("/echo", config);
+	echo.keep_alive = true;
+	std::vector<std::pair<std::string, RequestHandler *>> url_to_handlers = {{"/echo", &echo}};
+	std::vector<std::string> targets = {"/echo/1", "/echo/2", "/echo/3", "/echo/4", "/echo/5"};
+
+	// Two responses per write, and the last one alone
+	std::uint64_t before = pipelined_requests();
+	auto responses = pipeline("pipelineDepth 2;", url_to_handlers, targets);
+	ASSERT_EQ(responses.size(), targets.size());
+	for (std::size_t i = 0; i < targets.size(); i++) {
+		EXPECT_NE(responses[i].body().find("GET " + targets[i] + " "), std::string::npos);
+	}
+	EXPECT_EQ(pipelined_requests() - before, 4);
+
+	// Every response written on its own
+	before = pipelined_requests();
+	responses = pipeline("pipelineDepth 1;", url_to_handlers, targets);
+	ASSERT_EQ(responses.size(), targets.size());
+	EXPECT_EQ(pipelined_requests() - before, 0);
+
+	// Handlers closing the connection answer only the first request
+	echo.keep_alive = false;
+	responses = pipeline("", url_to_handlers, targets);
+	ASSERT_EQ(responses.size(), 1);
+	EXPECT_EQ(responses[0][http::field::connection], "close");
+}
+
+TEST(Session, FollowsKeepAliveOfRequests) {
+	boost::asio::io_context io_context;
+	NginxConfig config;
+	EchoHandler echo("/echo", config);
+	EchoHandler closing("/closing", config);
+	closing.keep_alive = false;
+	std::vector<std::pair<std::string, RequestHandler *>> url_to_handlers = {{"/echo", &echo}, {"/closing", &closing}};
+	auto s = std::make_shared<sessionTCP>(&config, std::make_shared<const Router>(url_to_handlers), tcp::socket(io_context));
+
+	// Returns the Connection header of the response to the request
+	auto connection = [&](const std::string &target, unsigned version, const char *request_connection) {
+		http::request<http::string_body> req{http::verb::get, target, version};
+		if (request_connection != nullptr) {
+			req.set(http::field::connection, request_connection);
+		}
+		http::response<http::string_body> res;
+		s->construct_response(req, res);
+		return res[http::field::connection].to_string();
+	};
+	EXPECT_EQ(connection("/echo", 11, nullptr), "keep-alive");
+	EXPECT_EQ(connection("/echo", 11, "close"), "close");
+	EXPECT_EQ(connection("/echo", 10, nullptr), "close");
+	EXPECT_EQ(connection("/echo", 10, "keep-alive"), "keep-alive");
+	EXPECT_EQ(connection("/closing", 11, nullptr), "close");
+}
+
+TEST(Session, LimitsRequestsPerConnection) {
+	NginxConfig config;
+	EchoHandler echo("/echo", config);
+	std::vector<std::pair<std::string, RequestHandler *>> url_to_handlers = {{"/echo", &echo}};
+	std::vector<std::string> targets = {"/echo/1", "/echo/2", "/echo/3", "/echo/4", "/echo/5"};
+
+	auto responses = pipeline("keepalive_requests 2;", url_to_handlers, targets);
+	ASSERT_EQ(responses.size(), 2);
+	EXPECT_EQ(responses[0][http::field::connection], "keep-alive");
+	EXPECT_EQ(responses[1][http::field::connection], "close");
+
+	// The location takes precedence over the server
+	echo.keepalive_requests = 3;
+	responses = pipeline("keepalive_requests 2;", url_to_handlers, targets);
+	ASSERT_EQ(responses.size(), 3);
+	EXPECT_EQ(responses[2][http::field::connection], "close");
+}
+
+// Serves the connections of clients with sessions running on a thread of their own
+class SessionServer {
+   public:
+	SessionServer(const std::string &config_text, const std::vector<std::pair<std::string, RequestHandler *>> &url_to_handlers)
+	    : router_(std::make_shared<const Router>(url_to_handlers)) {
+		NginxConfigParser parser;
+		std::istringstream config_stream(config_text);
+		parser.Parse(&config_stream, &config_);
+		thread_ = std::thread([this]() { io_context_.run(); });
+	}
+
+	~SessionServer() {
+		io_context_.stop();
+		thread_.join();
+	}
+
+	// Connects a client, and starts a session for the connection
+	tcp::socket connect() {
+		tcp::socket client(client_context_);
+		client.connect(acceptor_.local_endpoint());
+		std::make_shared<sessionTCP>(&config_, router_, acceptor_.accept())->start();
+		return client;
+	}
+
+   private:
+	NginxConfig config_;
+	std::shared_ptr<const Router> router_;
+	boost::asio::io_context client_context_;
+	boost::asio::io_context io_context_;
+	boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_{io_context_.get_executor()};
+	tcp::acceptor acceptor_{io_context_, tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0)};
+	std::thread thread_;
+};
+
+static http::response<http::string_body> get(tcp::socket &socket, beast::flat_buffer &buffer, const std::string &target) {
+	http::request<http::string_body> req{http::verb::get, target, 11};
+	req.set(http::field::host, "localhost");
+	http::write(socket, req);
+	http::response<http::string_body> res;
+	http::read(socket, buffer, res);
+	return res;
+}
+
+// Reads the response to a HEAD request, which has the headers of a GET response without its body
+static http::response<http::empty_body> head(tcp::socket &socket, beast::flat_buffer &buffer, const std::string &target) {
+	http::request<http::string_body> req{http::verb::head, target, 11};
+	req.set(http::field::host, "localhost");
+	http::write(socket, req);
+	http::response_parser<http::empty_body> parser;
+	parser.skip(true);
+	http::read(socket, buffer, parser);
+	return parser.release();
+}
+
+// Whether the server closed the connection
+static bool closed(tcp::socket &socket) {
+	char byte;
+	beast::error_code err;
+	socket.read_some(boost::asio::buffer(&byte, 1), err);
+	return err == boost::asio::error::eof || err == boost::asio::error::connection_reset;
+}
+
+static void wait_for_idle_connections(std::size_t count) {
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while (IdleConnections::instance().size() != count && std::chrono::steady_clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+static std::uint64_t idle_connections_closed(const char *reason) {
+	return MetricsRegistry::instance().counter("koko_idle_connections_closed_total", "", {{"reason", reason}}).value();
+}
+
+// Idle connections closed for the reason, once there are more than before, since sessions may count
+// them after clients see them closed
+static std::uint64_t idle_connections_closed_after(const char *reason, std::uint64_t before) {
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while (idle_connections_closed(reason) <= before && std::chrono::steady_clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return idle_connections_closed(reason);
+}
+
+TEST(Session, ClosesIdleConnectionsAfterTimeout) {
+	NginxConfig config;
+	EchoHandler echo("/echo", config);
+	EchoHandler quick("/quick", config);
+	quick.keepalive_timeout = 0;
+	std::vector<std::pair<std::string, RequestHandler *>> url_to_handlers = {{"/echo", &echo}, {"/quick", &quick}};
+	SessionServer server("keepalive_timeout 1;", url_to_handlers);
+
+	// Connections are kept open for a second after the last response
+	std::uint64_t before = idle_connections_closed("timeout");
+	tcp::socket client = server.connect();
+	beast::flat_buffer buffer;
+	EXPECT_EQ(get(client, buffer, "/echo").result(), http::status::ok);
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	EXPECT_EQ(get(client, buffer, "/echo")[http::field::connection], "keep-alive");
+	auto start = std::chrono::steady_clock::now();
+	EXPECT_TRUE(closed(client));
+	EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(900));
+	EXPECT_EQ(idle_connections_closed_after("timeout", before) - before, 1);
+
+	// A timeout of 0 in the location closes connections after its responses
+	client = server.connect();
+	EXPECT_EQ(get(client, buffer, "/quick")[http::field::connection], "close");
+	EXPECT_TRUE(closed(client));
+}
+
+TEST(Session, ClosesOldestIdleConnectionsFirst) {
+	NginxConfig config;
+	EchoHandler echo("/echo", config);
+	std::vector<std::pair<std::string, RequestHandler *>> url_to_handlers = {{"/echo", &echo}};
+	SessionServer server("", url_to_handlers);
+
+	std::uint64_t before = idle_connections_closed("pressure");
+	tcp::socket oldest = server.connect();
+	tcp::socket newest = server.connect();
+	beast::flat_buffer oldest_buffer;
+	beast::flat_buffer newest_buffer;
+	get(oldest, oldest_buffer, "/echo");
+	wait_for_idle_connections(1);
+	get(newest, newest_buffer, "/echo");
+	wait_for_idle_connections(2);
+	ASSERT_EQ(IdleConnections::instance().size(), 2);
+
+	EXPECT_EQ(IdleConnections::instance().close_oldest(1), 1);
+	EXPECT_TRUE(closed(oldest));
+	EXPECT_EQ(idle_connections_closed_after("pressure", before) - before, 1);
+
+	// The newest one is still served, and idle again afterwards
+	EXPECT_EQ(get(newest, newest_buffer, "/echo").result(), http::status::ok);
+	wait_for_idle_connections(1);
+	EXPECT_EQ(IdleConnections::instance().size(), 1);
+}
+
+TEST(Session, AnswersHeadRequestsWithoutBody) {
+	NginxConfig config;
+	EchoHandler echo("/echo", config);
+	HealthHandler health("/health", config);
+	std::vector<std::pair<std::string, RequestHandler *>> url_to_handlers = {{"/echo", &echo}, {"/health", &health}};
+	SessionServer server("", url_to_handlers);
+
+	// A body left behind would be read as the start of the next response
+	tcp::socket client = server.connect();
+	beast::flat_buffer buffer;
+	auto canned = head(client, buffer, "/health");
+	EXPECT_EQ(canned.result(), http::status::ok);
+	EXPECT_EQ(canned[http::field::content_length], "2");
+	EXPECT_EQ(canned[http::field::connection], "keep-alive");
+	auto echoed = head(client, buffer, "/echo");
+	EXPECT_EQ(echoed.result(), http::status::ok);
+	EXPECT_NE(echoed[http::field::content_length], "0");
+	EXPECT_EQ(echoed[http::field::connection], "keep-alive");
+
+	auto res = get(client, buffer, "/echo");
+	EXPECT_EQ(res.result(), http::status::ok);
+	EXPECT_EQ(res.body().rfind("GET /echo HTTP/1.1\r\n", 0), 0);
+	EXPECT_EQ(buffer.size(), 0);
+
+	// Pipelined responses are written together, still without the bodies
+	std::string requests = "HEAD /health HTTP/1.1\r\nHost: localhost\r\n\r\n"
+	                       "HEAD /echo HTTP/1.1\r\nHost: localhost\r\n\r\n"
+	                       "GET /health HTTP/1.1\r\nHost: localhost\r\n\r\n";
+	boost::asio::write(client, boost::asio::buffer(requests));
+	for (int i = 0; i < 2; i++) {
+		http::response_parser<http::empty_body> parser;
+		parser.skip(true);
+		http::read(client, buffer, parser);
+		EXPECT_EQ(parser.get().result(), http::status::ok);
+	}
+	http::response<http::string_body> last;
+	http::read(client, buffer, last);
+	EXPECT_EQ(last.body(), "OK");
+	EXPECT_EQ(buffer.size(), 0);
+}
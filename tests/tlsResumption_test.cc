@@ -0,0 +1,141 @@
+#include "tlsResumption.h"
+
+#include <openssl/ssl.h>
+
+#include <boost/asio/ssl.hpp>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "metrics.h"
+
+namespace ssl = boost::asio::ssl;
+
+class TlsResumptionTest : public ::testing::Test {
+   protected:
+	void SetUp() override {
+		server_.use_certificate_chain_file("certs/fullchain.pem");
+		server_.use_private_key_file("certs/privkey.pem", ssl::context::file_format::pem);
+	}
+
+	void TearDown() override {
+		if (session_ != nullptr) {
+			SSL_SESSION_free(session_);
+		}
+	}
+
+	// Does a handshake with the server over memory BIOs, offering the session of the last one.
+	// Returns whether the server resumed the session.
+	bool handshake() {
+		SSL *server = SSL_new(server_.native_handle());
+		SSL *client = SSL_new(client_.native_handle());
+		BIO *server_bio = nullptr;
+		BIO *client_bio = nullptr;
+		BIO_new_bio_pair(&server_bio, 0, &client_bio, 0);
+		SSL_set_bio(server, server_bio, server_bio);
+		SSL_set_bio(client, client_bio, client_bio);
+		SSL_set_accept_state(server);
+		SSL_set_connect_state(client);
+		if (session_ != nullptr) {
+			SSL_set_session(client, session_);
+		}
+
+		bool done = false;
+		for (int i = 0; i < 20 && !done; i++) {
+			int client_done = SSL_do_handshake(client);
+			int server_done = SSL_do_handshake(server);
+			done = client_done == 1 && server_done == 1;
+		}
+		EXPECT_TRUE(done);
+		TlsResumption::count_handshake(server, !done);
+		bool resumed = SSL_session_reused(server);
+
+		if (session_ != nullptr) {
+			SSL_SESSION_free(session_);
+		}
+		session_ = SSL_get1_session(client);
+
+		// Connections closed without a shutdown lose their session, as if they failed
+		SSL_set_shutdown(client, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+		SSL_set_shutdown(server, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+		SSL_free(client);
+		SSL_free(server);
+		return resumed;
+	}
+
+	static std::uint64_t handshakes(const char *type) {
+		return MetricsRegistry::instance().counter("koko_tls_handshakes_total", "", {{"type", type}}).value();
+	}
+
+	static std::uint64_t tickets(const char *result) {
+		return MetricsRegistry::instance().counter("koko_tls_tickets_total", "", {{"result", result}}).value();
+	}
+
+	ssl::context server_{ssl::context::tlsv12};
+	ssl::context client_{ssl::context::tlsv12_client};
+	SSL_SESSION *session_ = nullptr;
+};
+
+TEST_F(TlsResumptionTest, ResumesSessionsFromTheCache) {
+	TlsResumption::Options options;
+	options.tickets = false;
+	TlsResumption::enable(server_, options);
+
+	std::uint64_t full = handshakes("full");
+	std::uint64_t resumed = handshakes("resumed");
+	EXPECT_FALSE(handshake());
+	EXPECT_TRUE(handshake());
+	EXPECT_TRUE(handshake());
+	EXPECT_EQ(handshakes("full") - full, 1);
+	EXPECT_EQ(handshakes("resumed") - resumed, 2);
+
+	EXPECT_EQ(SSL_CTX_sess_number(server_.native_handle()), 1);
+	std::string metrics = MetricsRegistry::instance().render();
+	EXPECT_NE(metrics.find("# TYPE koko_tls_session_cache_hits_total counter"), std::string::npos);
+	EXPECT_NE(metrics.find("koko_tls_session_cache_hits_total 2"), std::string::npos);
+	EXPECT_NE(metrics.find("koko_tls_resumption_ratio"), std::string::npos);
+}
+
+TEST_F(TlsResumptionTest, ResumesSessionsWithTickets) {
+	TlsResumption::Options options;
+	options.cache_size = 0;
+	TlsResumption::enable(server_, options);
+
+	std::uint64_t issued = tickets("issued");
+	std::uint64_t accepted = tickets("accepted");
+	EXPECT_FALSE(handshake());
+	EXPECT_TRUE(handshake());
+	EXPECT_EQ(tickets("issued") - issued, 1);
+	EXPECT_EQ(tickets("accepted") - accepted, 1);
+
+	// Nothing is cached on the server
+	EXPECT_EQ(SSL_CTX_sess_number(server_.native_handle()), 0);
+}
+
+TEST_F(TlsResumptionTest, AcceptsTicketsOfThePreviousKey) {
+	TlsResumption::Options options;
+	options.cache_size = 0;
+	TlsResumption::enable(server_, options);
+	EXPECT_FALSE(handshake());
+
+	// The ticket of the previous key is replaced by one of the current key
+	std::uint64_t renewed = tickets("renewed");
+	TlsResumption::rotate_ticket_keys();
+	EXPECT_TRUE(handshake());
+	EXPECT_EQ(tickets("renewed") - renewed, 1);
+
+	// Tickets of older keys need a full handshake
+	std::uint64_t unknown = tickets("unknown");
+	TlsResumption::rotate_ticket_keys();
+	TlsResumption::rotate_ticket_keys();
+	EXPECT_FALSE(handshake());
+	EXPECT_EQ(tickets("unknown") - unknown, 1);
+}
+
+TEST_F(TlsResumptionTest, DoesFullHandshakesWhenDisabled) {
+	TlsResumption::Options options;
+	options.cache_size = 0;
+	options.tickets = false;
+	TlsResumption::enable(server_, options);
+	EXPECT_FALSE(handshake());
+	EXPECT_FALSE(handshake());
+}
@@ -0,0 +1,306 @@
+#include "upstreamPool.h"
+
+#include <atomic>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+
+// An upstream server on a free local port, serving every connection from a thread of its own
+class TestUpstream {
+   public:
+	TestUpstream()
+	    : acceptor_(ioc_, tcp::endpoint(net::ip::make_address("127.0.0.1"), 0)) {
+		thread_ = std::thread([this]() { accept_loop(); });
+	}
+
+	~TestUpstream() {
+		stop_ = true;
+
+		// Wake up the blocking accept
+		net::io_context ioc;
+		tcp::socket wake(ioc);
+		beast::error_code err;
+		wake.connect(acceptor_.local_endpoint(), err);
+		thread_.join();
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (auto& socket : sockets_) {
+			socket->shutdown(tcp::socket::shutdown_both, err);
+		}
+		for (auto& t : threads_) {
+			t.join();
+		}
+	}
+
+	std::string port() {
+		return std::to_string(acceptor_.local_endpoint().port());
+	}
+
+	std::atomic<int> connections{0};
+	std::atomic<int> requests{0};
+
+	// Closes connections right after responding, while still announcing keep-alive
+	std::atomic<bool> close_after_response{false};
+
+	// Closes connections without responding to the nth request on them
+	std::atomic<int> drop_request{0};
+
+	// Time to wait before responding
+	std::atomic<int> delay_ms{0};
+
+   private:
+	void accept_loop() {
+		while (true) {
+			auto socket = std::make_shared<tcp::socket>(ioc_);
+			beast::error_code err;
+			acceptor_.accept(*socket, err);
+			if (stop_) {
+				return;
+			}
+			if (err) {
+				continue;
+			}
+			connections++;
+
+			std::lock_guard<std::mutex> lock(mutex_);
+			sockets_.push_back(socket);
+			threads_.emplace_back([this, socket]() { serve(*socket); });
+		}
+	}
+
+	void serve(tcp::socket& socket) {
+		beast::flat_buffer buffer;
+		beast::error_code err;
+		for (int n = 1;; n++) {
+			http::request<http::string_body> req;
+			http::read(socket, buffer, req, err);
+			if (err) {
+				return;
+			}
+			requests++;
+
+			if (n == drop_request) {
+				socket.shutdown(tcp::socket::shutdown_both, err);
+				return;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+
+			http::response<http::string_body> res{http::status::ok, 11};
+			res.keep_alive(true);
+			res.body() = "upstream " + req.target().to_string();
+			res.prepare_payload();
+			http::write(socket, res, err);
+			if (err || close_after_response) {
+				socket.shutdown(tcp::socket::shutdown_both, err);
+				return;
+			}
+		}
+	}
+
+	net::io_context ioc_;
+	tcp::acceptor acceptor_;
+	std::atomic<bool> stop_{false};
+	std::thread thread_;
+	std::mutex mutex_;
+	std::vector<std::shared_ptr<tcp::socket>> sockets_;
+	std::vector<std::thread> threads_;
+};
+
+class UpstreamPoolTest : public ::testing::Test {
+   protected:
+	// Sends a request through the pool and runs the io_context until it completes
+	beast::error_code send(UpstreamPool& pool, http::verb method = http::verb::get) {
+		http::request<http::string_body> req{method, "/test", 11};
+		req.set(http::field::host, "127.0.0.1");
+
+		bool done = false;
+		beast::error_code result;
+		pool.async_send(req, ioc.get_executor(), [&](beast::error_code err, http::response<http::string_body> res) {
+			done = true;
+			result = err;
+			if (!err) {
+				EXPECT_EQ(res.result(), http::status::ok);
+				EXPECT_EQ(res.body(), "upstream /test");
+			}
+		});
+		while (!done) {
+			ioc.run_one();
+		}
+		ioc.restart();
+		return result;
+	}
+
+	// Runs the io_context until the condition holds or a few seconds passed
+	template <class Condition>
+	void run_until(Condition condition) {
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+		while (!condition() && std::chrono::steady_clock::now() < deadline) {
+			ioc.run_for(std::chrono::milliseconds(10));
+			// run_for stops the io_context when it runs out of work
+			ioc.restart();
+		}
+	}
+
+	TestUpstream upstream;
+	net::io_context ioc;
+};
+
+TEST_F(UpstreamPoolTest, ReusesConnections) {
+	UpstreamPool pool("127.0.0.1", upstream.port(), {});
+	for (int i = 0; i < 10; i++) {
+		EXPECT_FALSE(send(pool));
+	}
+
+	EXPECT_EQ(upstream.connections, 1);
+	EXPECT_EQ(upstream.requests, 10);
+	UpstreamPool::Stats stats = pool.stats();
+	EXPECT_EQ(stats.hits, 9);
+	EXPECT_EQ(stats.misses, 1);
+	EXPECT_DOUBLE_EQ(stats.hit_rate(), 0.9);
+	EXPECT_EQ(stats.active, 0);
+	EXPECT_EQ(stats.idle, 1);
+}
+
+TEST_F(UpstreamPoolTest, DropsStaleConnections) {
+	upstream.close_after_response = true;
+	UpstreamPool pool("127.0.0.1", upstream.port(), {});
+	for (int i = 0; i < 3; i++) {
+		EXPECT_FALSE(send(pool));
+		// Let the close reach the idle connection
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+
+	EXPECT_EQ(upstream.connections, 3);
+	EXPECT_EQ(pool.stats().stale, 2);
+	EXPECT_EQ(pool.stats().retries, 0);
+}
+
+TEST_F(UpstreamPoolTest, RetriesIdempotentRequestsOnce) {
+	// The upstream server closes the reused connection instead of responding
+	upstream.drop_request = 2;
+	UpstreamPool pool("127.0.0.1", upstream.port(), {});
+	EXPECT_FALSE(send(pool));
+	EXPECT_FALSE(send(pool));
+
+	EXPECT_EQ(upstream.connections, 2);
+	EXPECT_EQ(pool.stats().retries, 1);
+
+	// Requests that are not idempotent are not retried
+	EXPECT_TRUE(send(pool, http::verb::post));
+	EXPECT_EQ(pool.stats().retries, 1);
+}
+
+TEST_F(UpstreamPoolTest, LimitsConnectionsPerHost) {
+	upstream.delay_ms = 100;
+	UpstreamPool::Options options;
+	options.max_per_host = 2;
+	UpstreamPool pool("127.0.0.1", upstream.port(), options);
+
+	// Concurrent requests wait for one of the two connections
+	int done = 0;
+	for (int i = 0; i < 6; i++) {
+		http::request<http::string_body> req{http::verb::get, "/test", 11};
+		pool.async_send(req, ioc.get_executor(), [&](beast::error_code err, http::response<http::string_body>) {
+			EXPECT_FALSE(err);
+			done++;
+		});
+	}
+	run_until([&]() { return done == 6; });
+
+	EXPECT_EQ(done, 6);
+	EXPECT_EQ(upstream.connections, 2);
+	EXPECT_EQ(pool.stats().hits, 4);
+}
+
+TEST_F(UpstreamPoolTest, ClosesIdleConnections) {
+	UpstreamPool::Options options;
+	options.idle_timeout = std::chrono::seconds(1);
+	UpstreamPool pool("127.0.0.1", upstream.port(), options);
+	EXPECT_FALSE(send(pool));
+	EXPECT_EQ(pool.stats().idle, 1);
+
+	run_until([&]() { return pool.stats().idle == 0; });
+	EXPECT_EQ(pool.stats().idle, 0);
+
+	// A new connection is opened for the next request
+	EXPECT_FALSE(send(pool));
+	EXPECT_EQ(upstream.connections, 2);
+}
+
+TEST_F(UpstreamPoolTest, KeepsMaxIdle) {
+	upstream.delay_ms = 100;
+	UpstreamPool::Options options;
+	options.max_idle = 1;
+	UpstreamPool pool("127.0.0.1", upstream.port(), options);
+
+	int done = 0;
+	for (int i = 0; i < 3; i++) {
+		http::request<http::string_body> req{http::verb::get, "/test", 11};
+		pool.async_send(req, ioc.get_executor(), [&](beast::error_code, http::response<http::string_body>) { done++; });
+	}
+	run_until([&]() { return done == 3; });
+	EXPECT_EQ(pool.stats().idle, 1);
+}
+
+TEST_F(UpstreamPoolTest, PrewarmsConnections) {
+	UpstreamPool::Options options;
+	options.prewarm = 3;
+	UpstreamPool pool("127.0.0.1", upstream.port(), options);
+	EXPECT_FALSE(send(pool));
+
+	run_until([&]() { return pool.stats().idle >= 3; });
+	EXPECT_GE(pool.stats().idle, 3);
+
+	// Requests find a connection ready
+	EXPECT_FALSE(send(pool));
+	EXPECT_EQ(pool.stats().hits, 1);
+}
+
+TEST_F(UpstreamPoolTest, ServesSessionsOnDifferentStrands) {
+	UpstreamPool pool("127.0.0.1", upstream.port(), {});
+	auto work = net::make_work_guard(ioc);
+	std::thread thread_a([this]() { ioc.run(); });
+	std::thread thread_b([this]() { ioc.run(); });
+	auto strand_a = net::make_strand(ioc);
+	auto strand_b = net::make_strand(ioc);
+
+	// Sends a request for a session running on the strand, and calls done from it
+	auto proxy = [&pool](const net::strand<net::io_context::executor_type>& strand, std::function<void()> done) {
+		net::post(strand, [&pool, strand, done]() {
+			http::request<http::string_body> req{http::verb::get, "/test", 11};
+			pool.async_send(req, strand, [strand, done](beast::error_code err, http::response<http::string_body>) {
+				EXPECT_FALSE(err);
+				EXPECT_TRUE(strand.running_in_this_thread());
+				done();
+			});
+		});
+	};
+
+	// The first session leaves a pooled connection behind, then is kept busy until the second one
+	// was served over it, which it could not be if the connection was bound to the first strand
+	std::promise<void> a_done, b_done;
+	proxy(strand_a, [&a_done]() { a_done.set_value(); });
+	a_done.get_future().wait();
+	std::future<void> b_served = b_done.get_future();
+	std::promise<bool> a_saw_b;
+	net::post(strand_a, [&]() { a_saw_b.set_value(b_served.wait_for(std::chrono::seconds(5)) == std::future_status::ready); });
+	proxy(strand_b, [&b_done]() { b_done.set_value(); });
+	EXPECT_TRUE(a_saw_b.get_future().get());
+	EXPECT_EQ(pool.stats().hits, 1);
+
+	// The idle connection keeps the io_context busy until its timeout
+	ioc.stop();
+	thread_a.join();
+	thread_b.join();
+}
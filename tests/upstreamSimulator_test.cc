@@ -0,0 +1,133 @@
+#include "upstreamSimulator.h"
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <chrono>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace net = boost::asio;
+namespace beast = boost::beast;
+namespace http = beast::http;
+using tcp = net::ip::tcp;
+
+class UpstreamSimulatorTest : public ::testing::Test {
+   protected:
+	// Sends a request for target over the open connection, opening it first if needed
+	http::response<http::string_body> get(UpstreamSimulator& upstream, const std::string& target) {
+		if (!stream_.socket().is_open()) {
+			stream_.connect(tcp::endpoint(net::ip::make_address("127.0.0.1"), std::stoi(upstream.port())));
+		}
+		http::request<http::string_body> req{http::verb::get, target, 11};
+		req.set(http::field::host, "upstream.test");
+		stream_.expires_after(std::chrono::seconds(10));
+		http::write(stream_, req);
+		http::response<http::string_body> res;
+		beast::error_code err;
+		http::read(stream_, buffer_, res, err);
+		EXPECT_FALSE(err) << err.message();
+		return res;
+	}
+
+	// Whether the upstream server closed the connection
+	bool closed() {
+		char byte;
+		beast::error_code err;
+		stream_.expires_after(std::chrono::seconds(10));
+		stream_.read_some(net::buffer(&byte, 1), err);
+		return err == net::error::eof;
+	}
+
+	net::io_context ioc_;
+	beast::tcp_stream stream_{ioc_};
+	beast::flat_buffer buffer_;
+};
+
+TEST_F(UpstreamSimulatorTest, ServesBodiesOfTheRequestedSize) {
+	UpstreamSimulator upstream;
+	EXPECT_EQ(get(upstream, "/bytes/0").body().size(), 0);
+	EXPECT_EQ(get(upstream, "/bytes/100000").body().size(), 100000);
+	EXPECT_EQ(get(upstream, "/other").body(), "upstream /other");
+	EXPECT_EQ(upstream.connections, 1);
+	EXPECT_EQ(upstream.requests, 3);
+
+	UpstreamSimulator::Options options;
+	options.body_size = 1000;
+	UpstreamSimulator padded(options);
+	stream_.close();
+	http::response<http::string_body> res = get(padded, "/other");
+	EXPECT_EQ(res.body().size(), 1000);
+	EXPECT_EQ(res.body().find("upstream /other"), 0);
+}
+
+TEST_F(UpstreamSimulatorTest, ServesHtmlWithRelativeLinks) {
+	UpstreamSimulator upstream;
+	http::response<http::string_body> res = get(upstream, "/html/3");
+	EXPECT_EQ(res[http::field::content_type], "text/html");
+	EXPECT_NE(res.body().find("href=\"/page2\""), std::string::npos);
+	EXPECT_NE(res.body().find("src=\"//cdn.example.com/img2.png\""), std::string::npos);
+	EXPECT_EQ(res.body().find("/page3"), std::string::npos);
+}
+
+TEST_F(UpstreamSimulatorTest, Redirects) {
+	UpstreamSimulator upstream;
+	http::response<http::string_body> res = get(upstream, "/redirect/2");
+	EXPECT_EQ(res.result(), http::status::found);
+	EXPECT_EQ(res[http::field::location], "/redirect/1");
+	EXPECT_EQ(get(upstream, "/redirect/0").result(), http::status::ok);
+
+	res = get(upstream, "/absolute/2");
+	EXPECT_EQ(res.result(), http::status::moved_permanently);
+	EXPECT_EQ(res[http::field::location], "http://upstream.test/redirect/1");
+
+	EXPECT_EQ(get(upstream, "/status/503").result(), http::status::service_unavailable);
+}
+
+TEST_F(UpstreamSimulatorTest, ChunksBodies) {
+	UpstreamSimulator upstream;
+	http::response<http::string_body> res = get(upstream, "/chunked/5000");
+	EXPECT_TRUE(res.chunked());
+	EXPECT_EQ(res.body().size(), 5000);
+	EXPECT_EQ(res.body(), get(upstream, "/bytes/5000").body());
+}
+
+TEST_F(UpstreamSimulatorTest, ClosesConnections) {
+	UpstreamSimulator upstream;
+	http::response<http::string_body> res = get(upstream, "/close/10");
+	EXPECT_FALSE(res.keep_alive());
+	EXPECT_TRUE(closed());
+
+	// Closes after two responses, while announcing keep-alive
+	UpstreamSimulator::Options options;
+	options.close_after = 2;
+	UpstreamSimulator closing(options);
+	stream_.close();
+	EXPECT_TRUE(get(closing, "/").keep_alive());
+	EXPECT_TRUE(get(closing, "/").keep_alive());
+	EXPECT_TRUE(closed());
+}
+
+TEST_F(UpstreamSimulatorTest, DelaysResponses) {
+	UpstreamSimulator::Options options;
+	options.latency_mean = std::chrono::milliseconds(50);
+	UpstreamSimulator upstream(options);
+
+	auto start = std::chrono::steady_clock::now();
+	get(upstream, "/");
+	EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(50));
+
+	start = std::chrono::steady_clock::now();
+	get(upstream, "/delay/100");
+	EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(150));
+}
+
+TEST_F(UpstreamSimulatorTest, ParsesDistributions) {
+	UpstreamSimulator::Distribution distribution = UpstreamSimulator::Distribution::constant;
+	EXPECT_TRUE(UpstreamSimulator::parse_distribution("exponential", distribution));
+	EXPECT_EQ(distribution, UpstreamSimulator::Distribution::exponential);
+	EXPECT_TRUE(UpstreamSimulator::parse_distribution("uniform", distribution));
+	EXPECT_EQ(distribution, UpstreamSimulator::Distribution::uniform);
+	EXPECT_FALSE(UpstreamSimulator::parse_distribution("normal", distribution));
+	EXPECT_EQ(distribution, UpstreamSimulator::Distribution::uniform);
+}